@@ -0,0 +1,143 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef BENCHS_BENCH_COMMON_H_
+#define BENCHS_BENCH_COMMON_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "bitmap.h"
+#include "gamma_api.h"
+#include "random.h"
+#include "range_query_result.h"
+#include "raw_vector_factory.h"
+
+namespace bench {
+
+// fixed seed, so the data are the same across commits
+const uint32_t kSeed = 20190601;
+
+inline std::vector<float> RandomVectors(int n, int d, uint32_t seed = kSeed) {
+  utils::Random rand(seed);
+  std::vector<float> vecs((long)n * d);
+  for (float &v : vecs) {
+    v = rand.Uniform(1 << 20) / (float)(1 << 20);
+  }
+  return vecs;
+}
+
+inline std::vector<uint8_t> RandomCodes(long n, int code_size,
+                                        uint32_t seed = kSeed) {
+  utils::Random rand(seed);
+  std::vector<uint8_t> codes(n * code_size);
+  for (uint8_t &c : codes) {
+    c = rand.Uniform(256);
+  }
+  return codes;
+}
+
+/** temporary directory removed on destruction, raw vectors and indexes need
+ * a root path even in memory mode
+ */
+class TempDir {
+ public:
+  TempDir() {
+    char tmpl[] = "/tmp/gamma_bench_XXXXXX";
+    char *dir = mkdtemp(tmpl);
+    path_ = dir != nullptr ? dir : "/tmp";
+  }
+
+  ~TempDir() {
+    if (path_ == "/tmp") return;
+    std::string cmd = "rm -rf " + path_;
+    if (system(cmd.c_str())) {
+    }
+  }
+
+  std::string &Path() { return path_; }
+
+ private:
+  std::string path_;
+};
+
+/** memory only mmap raw vector filled with n vectors, doc id i has vector
+ * id i
+ *
+ * @return nullptr if failed
+ */
+inline tig_gamma::RawVector<float> *MakeRawVector(const std::string &root_path,
+                                                  const float *vecs, int n,
+                                                  int d, int max_size) {
+  tig_gamma::RawVector<float> *raw_vec = tig_gamma::RawVectorFactory::Create(
+      tig_gamma::Mmap, "bench", d, max_size, root_path, "");
+  if (raw_vec == nullptr || raw_vec->Init(false, false)) {
+    delete raw_vec;
+    return nullptr;
+  }
+  std::string name("bench");
+  for (int i = 0; i < n; i++) {
+    Field field;
+    field.name = MakeByteArray(name.c_str(), name.size());
+    const float *vec = vecs + (long)i * d;
+    field.value = MakeByteArray(reinterpret_cast<const char *>(vec),
+                                d * sizeof(float));
+    field.source = nullptr;
+    field.data_type = VECTOR;
+    Field *pfield = &field;
+    int ret = raw_vec->Add(i, pfield);
+    DestroyByteArray(field.name);
+    DestroyByteArray(field.value);
+    if (ret != 0) {
+      delete raw_vec;
+      return nullptr;
+    }
+  }
+  return raw_vec;
+}
+
+/** filter result of docs in [0, n), each doc passes with the probability of
+ * density
+ */
+inline tig_gamma::RangeQueryResult *RandomFilter(int n, double density,
+                                                 uint32_t seed = kSeed) {
+  utils::Random rand(seed);
+  tig_gamma::RangeQueryResult *result = new tig_gamma::RangeQueryResult();
+  result->SetRange(0, n - 1);
+  result->Resize();
+  int docs = 0;
+  for (int i = 0; i < n; i++) {
+    if (rand.Uniform(1 << 20) < density * (1 << 20)) {
+      result->Set(i);
+      docs++;
+    }
+  }
+  result->SetDocNum(docs);
+  return result;
+}
+
+// bitmap of deleted docs, each doc is deleted with the probability of ratio
+inline char *RandomDeleted(int n, double ratio, uint32_t seed = kSeed + 1) {
+  char *docids_bitmap = nullptr;
+  int bytes = 0;
+  if (bitmap::create(docids_bitmap, bytes, n)) return nullptr;
+  utils::Random rand(seed);
+  for (int i = 0; i < n; i++) {
+    if (rand.Uniform(1 << 20) < ratio * (1 << 20)) {
+      bitmap::set(docids_bitmap, i);
+    }
+  }
+  return docids_bitmap;
+}
+
+}  // namespace bench
+
+#endif  // BENCHS_BENCH_COMMON_H_
@@ -0,0 +1,142 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+
+#include "bench_common.h"
+#include "benchmark/benchmark.h"
+#include "gamma_index_flat.h"
+#include "gamma_index_hnsw.h"
+
+using tig_gamma::GammaFLATIndex;
+using tig_gamma::GammaHNSWFlatIndex;
+using tig_gamma::GammaSearchCondition;
+using tig_gamma::MultiRangeQueryResults;
+using tig_gamma::RawVector;
+using tig_gamma::idx_t;
+
+namespace {
+
+const int kDimension = 128;
+const int kDocNum = 100000;
+const int kQueryNum = 16;
+const int kTopK = 100;
+
+/** raw vectors of kDocNum random docs, flat and hnsw search them directly
+ */
+struct VectorData {
+  VectorData() {
+    std::vector<float> vecs = bench::RandomVectors(kDocNum, kDimension);
+    queries = bench::RandomVectors(kQueryNum, kDimension, bench::kSeed + 1);
+    docids_bitmap = bench::RandomDeleted(kDocNum, 0);
+    raw_vec.reset(bench::MakeRawVector(dir.Path(), vecs.data(), kDocNum,
+                                       kDimension, kDocNum));
+  }
+
+  ~VectorData() { free(docids_bitmap); }
+
+  std::vector<float> queries;
+  char *docids_bitmap;
+  bench::TempDir dir;
+  std::unique_ptr<RawVector<float>> raw_vec;
+};
+
+VectorData &Data() {
+  static VectorData data;
+  return data;
+}
+
+// hnsw graph is built once, efSearch is changed by each benchmark
+GammaHNSWFlatIndex *HNSWIndex() {
+  static std::unique_ptr<GammaHNSWFlatIndex> index;
+  VectorData &data = Data();
+  if (index == nullptr && data.raw_vec != nullptr) {
+    index.reset(new GammaHNSWFlatIndex(kDimension, L2, 32, 64, 40,
+                                       data.docids_bitmap,
+                                       data.raw_vec.get()));
+    if (index->Indexing() || index->AddRTVecsToIndex()) index.reset();
+  }
+  return index.get();
+}
+
+/** the arguments are the number of queries and the filter density in per
+ * mille, 1000 means there isn't a filter
+ */
+void BM_FlatSearch(benchmark::State &state) {
+  const int nq = state.range(0);
+  const int density = state.range(1);
+  VectorData &data = Data();
+  if (data.raw_vec == nullptr) {
+    state.SkipWithError("create raw vector error");
+    return;
+  }
+  GammaFLATIndex index(kDimension, data.docids_bitmap, data.raw_vec.get());
+
+  MultiRangeQueryResults range_result;
+  GammaSearchCondition condition;
+  condition.topn = kTopK;
+  condition.metric_type = L2;
+  if (density < 1000) {
+    range_result.Add(bench::RandomFilter(kDocNum, density / 1000.0));
+    condition.range_query_result = &range_result;
+  }
+  std::vector<float> dists(nq * kTopK);
+  std::vector<idx_t> labels(nq * kTopK);
+  std::vector<int> total(nq);
+  for (auto _ : state) {
+    index.SearchDirectly(nq, data.queries.data(), &condition, dists.data(),
+                         labels.data(), total.data());
+  }
+  state.SetItemsProcessed(state.iterations() * nq);
+}
+BENCHMARK(BM_FlatSearch)
+    ->Args({1, 1000})
+    ->Args({16, 1000})
+    ->Args({1, 10})
+    ->Args({1, 500})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// the arguments are efSearch and the filter density in per mille
+void BM_HNSWSearch(benchmark::State &state) {
+  const int ef_search = state.range(0);
+  const int density = state.range(1);
+  GammaHNSWFlatIndex *index = HNSWIndex();
+  if (index == nullptr) {
+    state.SkipWithError("build hnsw index error");
+    return;
+  }
+  index->gamma_hnsw_.efSearch = ef_search;
+
+  MultiRangeQueryResults range_result;
+  GammaSearchCondition condition;
+  condition.topn = kTopK;
+  condition.metric_type = L2;
+  if (density < 1000) {
+    range_result.Add(bench::RandomFilter(kDocNum, density / 1000.0));
+    condition.range_query_result = &range_result;
+  }
+  VectorData &data = Data();
+  std::vector<float> dists(kQueryNum * kTopK);
+  std::vector<idx_t> labels(kQueryNum * kTopK);
+  std::vector<int> total(kQueryNum);
+  for (auto _ : state) {
+    index->SearchHNSW(kQueryNum, data.queries.data(), &condition, dists.data(),
+                      labels.data(), total.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kQueryNum);
+}
+BENCHMARK(BM_HNSWSearch)
+    ->Args({64, 1000})
+    ->Args({256, 1000})
+    ->Args({64, 100})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,131 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <map>
+#include <memory>
+
+#include "bench_common.h"
+#include "benchmark/benchmark.h"
+#include "faiss/IndexFlat.h"
+#include "gamma_index_ivfpq.h"
+
+using tig_gamma::GammaIVFPQScanner;
+using tig_gamma::GammaSearchCondition;
+using tig_gamma::MultiRangeQueryResults;
+using tig_gamma::RawVector;
+using tig_gamma::idx_t;
+
+namespace {
+
+const int kDimension = 128;
+const int kNlist = 16;
+const int kTrainNum = 10000;
+const int kListSize = 100000;
+const int kTopK = 100;
+
+typedef GammaIVFPQScanner<faiss::METRIC_L2, faiss::CMax<float, idx_t>, 2>
+    L2Scanner;
+
+/** trained ivfpq of nsubvector m with a list of kListSize random codes, the
+ * scanner checks them against the deleted bitmap and an optional filter
+ */
+struct ScannerData {
+  explicit ScannerData(int m)
+      : quantizer(kDimension), ivfpq(&quantizer, kDimension, kNlist, m, 8) {
+    ivfpq.verbose = false;
+    std::vector<float> xt = bench::RandomVectors(kTrainNum, kDimension);
+    ivfpq.train(kTrainNum, xt.data());
+    query = bench::RandomVectors(1, kDimension, bench::kSeed + 1);
+    codes = bench::RandomCodes(kListSize, ivfpq.code_size);
+    ids.resize(kListSize);
+    for (int i = 0; i < kListSize; i++) ids[i] = i;
+    docids_bitmap = bench::RandomDeleted(kListSize, 0);
+    raw_vec.reset(bench::MakeRawVector(dir.Path(), nullptr, 0, kDimension,
+                                       kListSize));
+  }
+
+  ~ScannerData() { free(docids_bitmap); }
+
+  faiss::IndexFlatL2 quantizer;
+  faiss::IndexIVFPQ ivfpq;
+  std::vector<float> query;
+  std::vector<uint8_t> codes;
+  std::vector<idx_t> ids;
+  char *docids_bitmap;
+  bench::TempDir dir;
+  std::unique_ptr<RawVector<float>> raw_vec;
+};
+
+// training is slow, so it's shared by the benchmarks of the same m
+ScannerData &Data(int m) {
+  static std::map<int, std::unique_ptr<ScannerData>> datas;
+  std::unique_ptr<ScannerData> &data = datas[m];
+  if (data == nullptr) data.reset(new ScannerData(m));
+  return *data;
+}
+
+/** the arguments are nsubvector and the filter density in per mille, 1000
+ * means there isn't a filter
+ */
+template <bool kByPointer>
+void ScanCodes(benchmark::State &state) {
+  const int m = state.range(0);
+  const int density = state.range(1);
+  ScannerData &data = Data(m);
+  if (data.raw_vec == nullptr) {
+    state.SkipWithError("create raw vector error");
+    return;
+  }
+
+  MultiRangeQueryResults range_result;
+  GammaSearchCondition condition;
+  if (density < 1000) {
+    range_result.Add(bench::RandomFilter(kListSize, density / 1000.0));
+    condition.range_query_result = &range_result;
+  }
+  L2Scanner scanner(data.ivfpq, false);
+  scanner.SetVecFilter(data.docids_bitmap, data.raw_vec.get());
+  scanner.set_search_condition(&condition);
+  scanner.set_query(data.query.data());
+  scanner.set_list(0, 0);
+
+  std::vector<const uint8_t *> code_ptrs(kListSize);
+  for (int i = 0; i < kListSize; i++) {
+    code_ptrs[i] = data.codes.data() + (long)i * data.ivfpq.code_size;
+  }
+  std::vector<float> heap_sim(kTopK);
+  std::vector<idx_t> heap_ids(kTopK);
+  for (auto _ : state) {
+    faiss::maxheap_heapify(kTopK, heap_sim.data(), heap_ids.data());
+    if (kByPointer) {
+      scanner.scan_codes_pointer(kListSize, code_ptrs.data(), data.ids.data(),
+                                 heap_sim.data(), heap_ids.data(), kTopK);
+    } else {
+      scanner.scan_codes(kListSize, data.codes.data(), data.ids.data(),
+                         heap_sim.data(), heap_ids.data(), kTopK);
+    }
+    benchmark::DoNotOptimize(heap_sim.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kListSize);
+  state.SetBytesProcessed(state.iterations() * kListSize *
+                          data.ivfpq.code_size);
+}
+
+// codes of indexed lists, which are checked against filters
+void BM_IVFPQScanCodes(benchmark::State &state) { ScanCodes<false>(state); }
+BENCHMARK(BM_IVFPQScanCodes)
+    ->ArgsProduct({{8, 16, 32, 64}, {10, 100, 500, 1000}});
+
+// codes retrieved by pointers, which is how docs are reranked
+void BM_IVFPQScanCodesPointer(benchmark::State &state) {
+  ScanCodes<true>(state);
+}
+BENCHMARK(BM_IVFPQScanCodesPointer)->ArgsProduct({{8, 16, 32, 64}, {1000}});
+
+}  // namespace
+
+BENCHMARK_MAIN();
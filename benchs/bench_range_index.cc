@@ -0,0 +1,187 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "bench_common.h"
+#include "benchmark/benchmark.h"
+#include "field_range_index.h"
+#include "profile.h"
+
+using tig_gamma::FilterInfo;
+using tig_gamma::MultiFieldsRangeIndex;
+using tig_gamma::MultiRangeQueryResults;
+using tig_gamma::Profile;
+
+namespace {
+
+const int kDocNum = 500000;
+// values of the int fields are uniform in [0, kMaxValue)
+const int kMaxValue = 10000;
+const int kTagNum = 16;
+
+enum { kFieldId = 0, kFieldA, kFieldB, kFieldTag, kFieldNum };
+
+/** profile and range index of kDocNum docs, int fields a and b are
+ * independent, tag is a string field of kTagNum values
+ */
+struct RangeIndexData {
+  RangeIndexData() {
+    const char *names[kFieldNum] = {"_id", "a", "b", "tag"};
+    enum DataType types[kFieldNum] = {LONG, INT, INT, STRING};
+    FieldInfo infos[kFieldNum];
+    FieldInfo *pinfos[kFieldNum];
+    for (int i = 0; i < kFieldNum; i++) {
+      infos[i].name = MakeByteArray(names[i], strlen(names[i]));
+      infos[i].data_type = types[i];
+      infos[i].is_index = i == kFieldId ? 0 : FIELD_INDEX_RANGE;
+      pinfos[i] = &infos[i];
+    }
+    std::string table_name("bench");
+    Table table;
+    memset(&table, 0, sizeof(table));
+    table.name = MakeByteArray(table_name.c_str(), table_name.size());
+    table.fields = pinfos;
+    table.fields_num = kFieldNum;
+    table.id_type = 1;
+
+    profile.reset(new Profile(kDocNum, dir.Path()));
+    int ret = profile->CreateTable(&table);
+    DestroyByteArray(table.name);
+    if (ret != 0) return;
+
+    index.reset(new MultiFieldsRangeIndex(dir.Path(), profile.get()));
+    for (int i = kFieldA; i < kFieldNum; i++) {
+      index->AddField(i, types[i]);
+    }
+
+    utils::Random rand(bench::kSeed);
+    for (long docid = 0; docid < kDocNum; docid++) {
+      int a = rand.Uniform(kMaxValue), b = rand.Uniform(kMaxValue);
+      std::string tag = "tag" + std::to_string(rand.Uniform(kTagNum));
+      const char *values[kFieldNum] = {(const char *)&docid, (const char *)&a,
+                                       (const char *)&b, tag.c_str()};
+      int lens[kFieldNum] = {sizeof(docid), sizeof(a), sizeof(b),
+                             (int)tag.size()};
+      Field fields[kFieldNum];
+      std::vector<Field *> pfields(kFieldNum);
+      for (int i = 0; i < kFieldNum; i++) {
+        fields[i].name = infos[i].name;
+        fields[i].value = MakeByteArray(values[i], lens[i]);
+        fields[i].source = nullptr;
+        fields[i].data_type = types[i];
+        pfields[i] = &fields[i];
+      }
+      ret = profile->Add(pfields, docid);
+      for (int i = 0; i < kFieldNum; i++) DestroyByteArray(fields[i].value);
+      if (ret != 0) return;
+      for (int i = kFieldA; i < kFieldNum; i++) index->Add(docid, i);
+    }
+    for (int i = 0; i < kFieldNum; i++) DestroyByteArray(infos[i].name);
+
+    // docs are indexed by a background worker
+    std::vector<FilterInfo> all(1);
+    all[0] = Range(kFieldB, 0, kMaxValue);
+    MultiRangeQueryResults result;
+    while (index->Search(all, &result) < kDocNum) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    ready = true;
+  }
+
+  // filter of values in [lower, upper)
+  static FilterInfo Range(int field, int lower, int upper) {
+    upper--;
+    FilterInfo filter;
+    filter.field = field;
+    filter.lower_value = std::string((const char *)&lower, sizeof(lower));
+    filter.upper_value = std::string((const char *)&upper, sizeof(upper));
+    filter.is_union = 0;
+    return filter;
+  }
+
+  // filter of the first n tags
+  static FilterInfo Tags(int n) {
+    FilterInfo filter;
+    filter.field = kFieldTag;
+    for (int i = 0; i < n; i++) {
+      if (i > 0) filter.lower_value.append("\001");
+      filter.lower_value.append("tag" + std::to_string(i));
+    }
+    filter.is_union = 1;
+    return filter;
+  }
+
+  bench::TempDir dir;
+  std::unique_ptr<Profile> profile;
+  std::unique_ptr<MultiFieldsRangeIndex> index;
+  bool ready = false;
+};
+
+RangeIndexData &Data() {
+  static RangeIndexData data;
+  return data;
+}
+
+void RunFilters(benchmark::State &state,
+                const std::vector<FilterInfo> &filters) {
+  RangeIndexData &data = Data();
+  if (not data.ready) {
+    state.SkipWithError("build range index error");
+    return;
+  }
+  MultiRangeQueryResults result;
+  long docs = 0;
+  for (auto _ : state) {
+    docs += data.index->Search(filters, &result);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["docs"] =
+      benchmark::Counter(docs, benchmark::Counter::kAvgIterations);
+}
+
+// one range filter, the argument is its selectivity in per mille
+void BM_FieldRangeSearch(benchmark::State &state) {
+  int width = kMaxValue * state.range(0) / 1000;
+  RunFilters(state, {RangeIndexData::Range(kFieldA, 0, width)});
+}
+BENCHMARK(BM_FieldRangeSearch)->Arg(1)->Arg(10)->Arg(100)->Arg(500);
+
+// term filter of n tags
+void BM_FieldTermSearch(benchmark::State &state) {
+  RunFilters(state, {RangeIndexData::Tags(state.range(0))});
+}
+BENCHMARK(BM_FieldTermSearch)->Arg(1)->Arg(4);
+
+// two range filters are intersected, the arguments are their selectivities
+// in per mille
+void BM_MultiFieldsIntersect(benchmark::State &state) {
+  int width_a = kMaxValue * state.range(0) / 1000;
+  int width_b = kMaxValue * state.range(1) / 1000;
+  RunFilters(state, {RangeIndexData::Range(kFieldA, 0, width_a),
+                     RangeIndexData::Range(kFieldB, 0, width_b)});
+}
+BENCHMARK(BM_MultiFieldsIntersect)
+    ->Args({10, 10})
+    ->Args({10, 500})
+    ->Args({100, 100})
+    ->Args({500, 500});
+
+// two range filters and a term filter
+void BM_MultiFieldsIntersectTerm(benchmark::State &state) {
+  int width = kMaxValue * state.range(0) / 1000;
+  RunFilters(state, {RangeIndexData::Range(kFieldA, 0, width),
+                     RangeIndexData::Range(kFieldB, 0, width),
+                     RangeIndexData::Tags(kTagNum / 2)});
+}
+BENCHMARK(BM_MultiFieldsIntersectTerm)->Arg(100)->Arg(500);
+
+}  // namespace
+
+BENCHMARK_MAIN();
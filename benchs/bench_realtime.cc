@@ -0,0 +1,154 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <chrono>
+#include <thread>
+
+#include "bench_common.h"
+#include "benchmark/benchmark.h"
+#include "realtime_mem_data.h"
+
+using tig_gamma::realtime::RealTimeMemData;
+
+namespace {
+
+const int kBuckets = 256;
+
+// old bucket memory is freed a second after it's replaced, the buckets must
+// live longer than that
+void WaitAndDelete(RealTimeMemData *data) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  delete data;
+}
+
+// vids are added to the buckets round-robin in batches
+void BM_RealTimeAddKeys(benchmark::State &state) {
+  const int code_bytes = state.range(0);
+  const int batch = state.range(1);
+  const long max_vecs = state.max_iterations * batch;
+
+  VIDMgr vid_mgr(false);
+  char *docids_bitmap = bench::RandomDeleted(max_vecs, 0);
+  RealTimeMemData *data =
+      new RealTimeMemData(kBuckets, max_vecs, &vid_mgr, docids_bitmap, 500,
+                          max_vecs, code_bytes);
+  if (not data->Init()) {
+    state.SkipWithError("init realtime data error");
+    return;
+  }
+
+  std::vector<long> keys(batch);
+  std::vector<uint8_t> codes = bench::RandomCodes(batch, code_bytes);
+  long vid = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < batch; i++) keys[i] = vid++;
+    size_t list_no = (vid / batch) % kBuckets;
+    if (not data->AddKeys(list_no, batch, keys, codes)) {
+      state.SkipWithError("add keys error");
+      break;
+    }
+  }
+  state.SetItemsProcessed(vid);
+  state.SetBytesProcessed(vid * code_bytes);
+
+  WaitAndDelete(data);
+  free(docids_bitmap);
+}
+BENCHMARK(BM_RealTimeAddKeys)
+    ->Args({16, 1})
+    ->Args({16, 100})
+    ->Args({64, 1})
+    ->Args({64, 100})
+    ->Iterations(2000);
+
+// codes of random vids, which is how the rerank and the update path fetch
+// them
+void BM_RealTimeRetrieveCodes(benchmark::State &state) {
+  const int code_bytes = 64;
+  const int num_vecs = state.range(0);
+  const int num_retrieve = state.range(1);
+
+  VIDMgr vid_mgr(false);
+  char *docids_bitmap = bench::RandomDeleted(num_vecs, 0);
+  RealTimeMemData *data =
+      new RealTimeMemData(kBuckets, num_vecs, &vid_mgr, docids_bitmap, 500,
+                          num_vecs, code_bytes);
+  if (not data->Init()) {
+    state.SkipWithError("init realtime data error");
+    return;
+  }
+  utils::Random rand(bench::kSeed);
+  std::vector<uint8_t> code = bench::RandomCodes(1, code_bytes);
+  for (int vid = 0; vid < num_vecs; vid++) {
+    std::vector<long> keys(1, vid);
+    data->AddKeys(rand.Uniform(kBuckets), 1, keys, code);
+  }
+
+  std::vector<int> vids(num_retrieve);
+  for (int &vid : vids) vid = rand.Uniform(num_vecs);
+  std::vector<std::vector<const uint8_t *>> bucket_codes;
+  std::vector<std::vector<long>> bucket_vids;
+  for (auto _ : state) {
+    bucket_codes.clear();
+    bucket_vids.clear();
+    data->RetrieveCodes(vids.data(), vids.size(), bucket_codes, bucket_vids);
+    benchmark::DoNotOptimize(bucket_codes.data());
+  }
+  state.SetItemsProcessed(state.iterations() * num_retrieve);
+
+  WaitAndDelete(data);
+  free(docids_bitmap);
+}
+BENCHMARK(BM_RealTimeRetrieveCodes)
+    ->Args({100000, 100})
+    ->Args({100000, 10000})
+    ->Args({1000000, 10000});
+
+// each iteration compacts another bucket of which 40% docs are deleted
+void BM_RealTimeCompactBucket(benchmark::State &state) {
+  const int code_bytes = 64;
+  const int bucket_size = state.range(0);
+  const int buckets = state.max_iterations;
+  const long num_vecs = (long)buckets * bucket_size;
+
+  VIDMgr vid_mgr(false);
+  char *docids_bitmap = bench::RandomDeleted(num_vecs, 0.4);
+  RealTimeMemData *data =
+      new RealTimeMemData(buckets, num_vecs, &vid_mgr, docids_bitmap,
+                          bucket_size, bucket_size * 2, code_bytes);
+  if (not data->Init()) {
+    state.SkipWithError("init realtime data error");
+    return;
+  }
+  std::vector<long> keys(bucket_size);
+  std::vector<uint8_t> codes = bench::RandomCodes(bucket_size, code_bytes);
+  for (int i = 0; i < buckets; i++) {
+    for (int j = 0; j < bucket_size; j++) keys[j] = (long)i * bucket_size + j;
+    data->AddKeys(i, bucket_size, keys, codes);
+  }
+
+  int bucket_no = 0;
+  for (auto _ : state) {
+    if (not data->CompactBucket(bucket_no++)) {
+      state.SkipWithError("compact bucket error");
+      break;
+    }
+  }
+  state.SetItemsProcessed((long)bucket_no * bucket_size);
+  state.SetBytesProcessed((long)bucket_no * bucket_size * code_bytes);
+
+  WaitAndDelete(data);
+  free(docids_bitmap);
+}
+BENCHMARK(BM_RealTimeCompactBucket)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Iterations(64);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,90 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "bench_common.h"
+#include "benchmark/benchmark.h"
+#include "vector_buffer_queue.h"
+
+namespace {
+
+const int kMaxVectors = 1 << 18;
+const int kChunkNum = 1024;
+
+// batch is 1 for the single vector Push()
+void BM_VectorBufferQueuePush(benchmark::State &state) {
+  const int d = state.range(0);
+  const int batch = state.range(1);
+  VectorBufferQueue<float> queue(kMaxVectors, d, kChunkNum);
+  if (queue.Init()) {
+    state.SkipWithError("init queue error");
+    return;
+  }
+  std::vector<float> vecs = bench::RandomVectors(batch, d);
+  int pushed = 0;
+  for (auto _ : state) {
+    if (pushed + batch > kMaxVectors) {
+      state.PauseTiming();
+      queue.Erase();
+      pushed = 0;
+      state.ResumeTiming();
+    }
+    int ret = batch == 1 ? queue.Push(vecs.data(), d, -1)
+                         : queue.Push(vecs.data(), d, batch, -1);
+    if (ret != 0) {
+      state.SkipWithError("push error");
+      break;
+    }
+    pushed += batch;
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+  state.SetBytesProcessed(state.iterations() * batch * d * sizeof(float));
+}
+BENCHMARK(BM_VectorBufferQueuePush)
+    ->Args({128, 1})
+    ->Args({128, 100})
+    ->Args({512, 1})
+    ->Args({512, 100});
+
+VectorBufferQueue<float> *shared_queue = nullptr;
+
+// random reads of a full queue, threads share the chunk locks
+void BM_VectorBufferQueueGetVector(benchmark::State &state) {
+  const int d = state.range(0);
+  if (state.thread_index == 0) {
+    shared_queue = new VectorBufferQueue<float>(kMaxVectors, d, kChunkNum);
+    std::vector<float> vecs = bench::RandomVectors(kMaxVectors, d);
+    if (shared_queue->Init() ||
+        shared_queue->Push(vecs.data(), d, kMaxVectors, -1)) {
+      state.SkipWithError("fill queue error");
+    }
+  }
+
+  utils::Random rand(bench::kSeed + state.thread_index);
+  std::vector<float> vec(d);
+  for (auto _ : state) {
+    if (shared_queue->GetVector(rand.Uniform(kMaxVectors), vec.data(), d)) {
+      state.SkipWithError("get vector error");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * d * sizeof(float));
+
+  if (state.thread_index == 0) {
+    delete shared_queue;
+    shared_queue = nullptr;
+  }
+}
+BENCHMARK(BM_VectorBufferQueueGetVector)
+    ->Arg(128)
+    ->Arg(512)
+    ->Threads(1)
+    ->Threads(8);
+
+}  // namespace
+
+BENCHMARK_MAIN();
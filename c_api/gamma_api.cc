@@ -17,6 +17,9 @@
 #include "gamma_api_generated.h"
 #include "gamma_engine.h"
 #include "log.h"
+#include "metrics.h"
+#include "request_recorder.h"
+#include "result_sink.h"
 #include "utils.h"
 
 INITIALIZE_EASYLOGGINGPP
@@ -250,6 +253,27 @@ enum ResponseCode DestroyDoc(Doc *doc) {
   return ResponseCode::SUCCESSED;
 }
 
+Doc **MakeDocs(int num) {
+  Doc **docs = static_cast<Doc **>(malloc(sizeof(Doc *) * num));
+  memset(docs, 0, sizeof(Doc *) * num);
+  return docs;
+}
+
+enum ResponseCode SetDoc(Doc **docs, int idx, Doc *doc) {
+  docs[idx] = doc;
+  return ResponseCode::SUCCESSED;
+}
+
+enum ResponseCode DestroyDocs(Doc **docs, int num) {
+  if (docs != nullptr) {
+    for (int i = 0; i < num; ++i) {
+      DestroyDoc(docs[i]);
+    }
+    free(docs);
+  }
+  return ResponseCode::SUCCESSED;
+}
+
 enum ResponseCode SetLogDictionary(ByteArray *log_dir) {
   string dir = string(log_dir->value, log_dir->len);
   if (!utils::isFolderExist(dir.c_str())) {
@@ -317,11 +341,100 @@ enum ResponseCode AddDoc(void *engine, Doc *doc) {
 }
 
 enum ResponseCode AddOrUpdateDoc(void *engine, Doc *doc) {
+  tig_gamma::RequestRecorder &recorder = tig_gamma::RequestRecorder::Instance();
+  long start = recorder.Recording() ? recorder.Now() : 0;
   enum ResponseCode ret = static_cast<enum ResponseCode>(
       static_cast<tig_gamma::GammaEngine *>(engine)->AddOrUpdate(doc));
+  if (recorder.Recording()) recorder.Record(start, doc);
   return ret;
 }
 
+enum ResponseCode AddDocs(void *engine, Doc **docs, int num, int *results) {
+  int ret = static_cast<tig_gamma::GammaEngine *>(engine)->Add(docs, num,
+                                                               results);
+  return ret == 0 ? ResponseCode::SUCCESSED : ResponseCode::FAILED;
+}
+
+enum ResponseCode AddOrUpdateDocs(void *engine, Doc **docs, int num,
+                                  int *results) {
+  int ret = static_cast<tig_gamma::GammaEngine *>(engine)->AddOrUpdate(
+      docs, num, results);
+  return ret == 0 ? ResponseCode::SUCCESSED : ResponseCode::FAILED;
+}
+
+enum ResponseCode AddDocsV2(void *engine, ByteArray *docs, int *results) {
+  if (docs == nullptr || docs->value == nullptr || docs->len <= 0) {
+    return ResponseCode::FAILED;
+  }
+  const uint8_t *buf = reinterpret_cast<const uint8_t *>(docs->value);
+  flatbuffers::Verifier verifier(buf, docs->len);
+  if (!verifier.VerifyBuffer<gamma_api::DocBatch>(nullptr)) {
+    LOG(ERROR) << "invalid doc batch buffer, len=" << docs->len;
+    return ResponseCode::FAILED;
+  }
+  auto batch = flatbuffers::GetRoot<gamma_api::DocBatch>(buf);
+  auto fb_docs = batch->docs();
+  int num = fb_docs ? fb_docs->size() : 0;
+  if (num == 0) return ResponseCode::SUCCESSED;
+
+  // Doc structs are views of the buffer, they are allocated once per batch
+  // and field values aren't copied
+  int fields_num = 0;
+  for (int i = 0; i < num; ++i) {
+    auto fields = fb_docs->Get(i)->fields();
+    fields_num += fields ? fields->size() : 0;
+  }
+  std::vector<ByteArray> arrays(fields_num * 3);
+  std::vector<Field> fields(fields_num);
+  std::vector<Field *> field_ptrs(fields_num);
+  std::vector<Doc> doc_structs(num);
+  std::vector<Doc *> doc_ptrs(num);
+  std::vector<int> codes(num, 0);
+
+  auto ToByteArray = [](ByteArray &array, const char *data, int len) {
+    array.value = const_cast<char *>(data);
+    array.len = len;
+    return &array;
+  };
+  int f = 0;
+  for (int i = 0; i < num; ++i) {
+    auto fb_fields = fb_docs->Get(i)->fields();
+    int n = fb_fields ? fb_fields->size() : 0;
+    doc_structs[i].fields = field_ptrs.data() + f;
+    doc_structs[i].fields_num = n;
+    doc_ptrs[i] = &doc_structs[i];
+    for (int j = 0; j < n; ++j, ++f) {
+      auto fb_field = fb_fields->Get(j);
+      Field &field = fields[f];
+      auto name = fb_field->name();
+      auto value = fb_field->value();
+      auto source = fb_field->source();
+      field.name = ToByteArray(arrays[f * 3], name ? name->data() : "",
+                               name ? name->size() : 0);
+      field.value = ToByteArray(
+          arrays[f * 3 + 1],
+          value ? reinterpret_cast<const char *>(value->data()) : "",
+          value ? value->size() : 0);
+      field.source = nullptr;
+      if (source != nullptr) {
+        field.source =
+            ToByteArray(arrays[f * 3 + 2], source->data(), source->size());
+      }
+      field.data_type = static_cast<enum DataType>(fb_field->data_type());
+      field_ptrs[f] = &field;
+    }
+  }
+
+  tig_gamma::GammaEngine *gamma = static_cast<tig_gamma::GammaEngine *>(engine);
+  int ret = batch->add_or_update()
+                ? gamma->AddOrUpdate(doc_ptrs.data(), num, codes.data())
+                : gamma->Add(doc_ptrs.data(), num, codes.data());
+  if (results != nullptr) {
+    memcpy(results, codes.data(), num * sizeof(int));
+  }
+  return ret == 0 ? ResponseCode::SUCCESSED : ResponseCode::FAILED;
+}
+
 enum ResponseCode UpdateDoc(void *engine, Doc *doc) {
   enum ResponseCode ret = static_cast<enum ResponseCode>(
       static_cast<tig_gamma::GammaEngine *>(engine)->Update(doc));
@@ -329,8 +442,11 @@ enum ResponseCode UpdateDoc(void *engine, Doc *doc) {
 }
 
 enum ResponseCode DelDoc(void *engine, ByteArray *doc_id) {
+  tig_gamma::RequestRecorder &recorder = tig_gamma::RequestRecorder::Instance();
+  long start = recorder.Recording() ? recorder.Now() : 0;
   enum ResponseCode ret = static_cast<enum ResponseCode>(
       static_cast<tig_gamma::GammaEngine *>(engine)->Del(doc_id));
+  if (recorder.Recording()) recorder.Record(start, doc_id);
   return ret;
 }
 
@@ -347,6 +463,56 @@ long GetMemoryBytes(void *engine) {
   return static_cast<tig_gamma::GammaEngine *>(engine)->GetMemoryBytes();
 }
 
+enum ResponseCode SetSearchCache(void *engine, int capacity, int max_stale_ms) {
+  static_cast<tig_gamma::GammaEngine *>(engine)->SetSearchCache(capacity,
+                                                                max_stale_ms);
+  return ResponseCode::SUCCESSED;
+}
+
+enum ResponseCode GetSearchCacheStats(void *engine, long *hits, long *misses,
+                                      int *size) {
+  if (hits == nullptr || misses == nullptr || size == nullptr) {
+    return ResponseCode::FAILED;
+  }
+  static_cast<tig_gamma::GammaEngine *>(engine)->GetSearchCacheStats(
+      *hits, *misses, *size);
+  return ResponseCode::SUCCESSED;
+}
+
+enum ResponseCode SetFilterCache(void *engine, long max_bytes) {
+  static_cast<tig_gamma::GammaEngine *>(engine)->SetFilterCache(max_bytes);
+  return ResponseCode::SUCCESSED;
+}
+
+enum ResponseCode GetFilterCacheStats(void *engine, long *hits, long *misses,
+                                      long *bytes) {
+  if (hits == nullptr || misses == nullptr || bytes == nullptr) {
+    return ResponseCode::FAILED;
+  }
+  int ret = static_cast<tig_gamma::GammaEngine *>(engine)->GetFilterCacheStats(
+      *hits, *misses, *bytes);
+  return ret == 0 ? ResponseCode::SUCCESSED : ResponseCode::FAILED;
+}
+
+enum ResponseCode StartRecording(ByteArray *path) {
+  if (path == nullptr) return ResponseCode::FAILED;
+  int ret = tig_gamma::RequestRecorder::Instance().Start(
+      string(path->value, path->len));
+  return ret == 0 ? ResponseCode::SUCCESSED : ResponseCode::FAILED;
+}
+
+enum ResponseCode StopRecording() {
+  tig_gamma::RequestRecorder::Instance().Stop();
+  return ResponseCode::SUCCESSED;
+}
+
+ByteArray *GetMetrics() {
+  utils::MetricsSnapshot snapshot;
+  utils::Metrics::Instance().Snapshot(snapshot);
+  std::string json = snapshot.ToJson();
+  return MakeByteArray(json.data(), json.size());
+}
+
 Doc *GetDocByID(void *engine, ByteArray *doc_id) {
   Doc *doc = static_cast<tig_gamma::GammaEngine *>(engine)->GetDoc(doc_id);
   return doc;
@@ -558,63 +724,103 @@ enum ResponseCode DestroyRequest(Request *request) {
 }
 
 Response *Search(void *engine, Request *request) {
-  return static_cast<tig_gamma::GammaEngine *>(engine)->Search(request);
-}
-
-ByteArray *SearchV2(void *engine, Request *request) {
+  tig_gamma::RequestRecorder &recorder = tig_gamma::RequestRecorder::Instance();
+  long start = recorder.Recording() ? recorder.Now() : 0;
   Response *response =
       static_cast<tig_gamma::GammaEngine *>(engine)->Search(request);
-  flatbuffers::FlatBufferBuilder builder;
+  if (recorder.Recording()) recorder.Record(start, request);
+  return response;
+}
 
-  std::vector<flatbuffers::Offset<gamma_api::SearchResult>> result_vector;
-  for (int result_idx = 0; result_idx < response->req_num; ++result_idx) {
-    SearchResult *result = response->results[result_idx];
-    std::vector<flatbuffers::Offset<gamma_api::ResultItem>> item_vector;
-    for (int item_idx = 0; item_idx < result->result_num; ++item_idx) {
-      ResultItem *result_item = result->result_items[item_idx];
-      Doc *doc = result_item->doc;
-      auto extra = builder.CreateString(result_item->extra->value,
-                                        result_item->extra->len);
-      std::vector<flatbuffers::Offset<flatbuffers::String>> name_vector;
-      std::vector<flatbuffers::Offset<flatbuffers::String>> value_vector;
-      for (int field_idx = 0; field_idx < doc->fields_num; ++field_idx) {
-        Field *field = doc->fields[field_idx];
-        auto name = builder.CreateString(field->name->value, field->name->len);
-        name_vector.push_back(name);
-        auto value =
-            builder.CreateString(field->value->value, field->value->len);
-        value_vector.push_back(value);
-      }
+namespace {
 
-      auto names = builder.CreateVector(name_vector);
-      auto values = builder.CreateVector(value_vector);
+/** the sink packing results to gamma_api::Response directly, the offset
+ * vectors are reused between items
+ */
+class FlatBufferSink : public tig_gamma::ResultSink {
+ public:
+  explicit FlatBufferSink(flatbuffers::FlatBufferBuilder &builder)
+      : builder_(builder), total_(0), score_(0) {}
+
+  void Begin(int req_num) override {
+    results_.clear();
+    results_.reserve(req_num > 0 ? req_num : 0);
+  }
 
-      auto item = gamma_api::CreateResultItem(builder, result_item->score,
-                                              names, values, extra);
-      item_vector.push_back(item);
-    }
+  void BeginResult(int total) override {
+    total_ = total;
+    items_.clear();
+  }
 
-    auto item_vec = builder.CreateVector(item_vector);
+  void BeginItem(double score) override {
+    score_ = score;
+    names_.clear();
+    values_.clear();
+    vector_results_.clear();
+  }
+
+  void AddField(const std::string &name, const char *value, int len,
+                enum DataType data_type) override {
+    names_.push_back(builder_.CreateString(name));
+    values_.push_back(builder_.CreateString(value, len));
+  }
+
+  void AddVectorResult(const std::string &name, double score,
+                       const char *source, int source_len) override {
+    auto field_name = builder_.CreateString(name);
+    auto field_source = builder_.CreateString(source, source_len);
+    vector_results_.push_back(gamma_api::CreateVectorResult(
+        builder_, field_name, score, field_source));
+  }
 
-    auto msg = builder.CreateString(result->msg->value, result->msg->len);
+  void EndItem() override {
+    auto names = builder_.CreateVector(names_);
+    auto values = builder_.CreateVector(values_);
+    auto vector_results = builder_.CreateVector(vector_results_);
+    items_.push_back(gamma_api::CreateResultItem(builder_, score_, names,
+                                                 values, 0, vector_results));
+  }
+
+  void EndResult(enum SearchResultCode code, const std::string &msg) override {
+    auto item_vec = builder_.CreateVector(items_);
+    auto result_msg = builder_.CreateString(msg);
     gamma_api::SearchResultCode result_code =
-        static_cast<gamma_api::SearchResultCode>(result->result_code);
-    auto results = gamma_api::CreateSearchResult(builder, result->total,
-                                                 result_code, msg, item_vec);
-    result_vector.push_back(results);
+        static_cast<gamma_api::SearchResultCode>(code);
+    results_.push_back(gamma_api::CreateSearchResult(
+        builder_, total_, result_code, result_msg, item_vec));
   }
-  auto result_vec = builder.CreateVector(result_vector);
 
-  flatbuffers::Offset<flatbuffers::String> message;
-  if ((response->online_log_message != nullptr) and
-      (response->online_log_message->len != 0)) {
-    message = builder.CreateString(response->online_log_message->value,
-                                   response->online_log_message->len);
-  } else {
-    message = builder.CreateString("");
+  void End(const char *log_message, int len) override {
+    auto result_vec = builder_.CreateVector(results_);
+    flatbuffers::Offset<flatbuffers::String> message;
+    if (log_message != nullptr && len > 0) {
+      message = builder_.CreateString(log_message, len);
+    } else {
+      message = builder_.CreateString("");
+    }
+    builder_.Finish(gamma_api::CreateResponse(builder_, result_vec, message));
   }
-  auto res = gamma_api::CreateResponse(builder, result_vec, message);
-  builder.Finish(res);
+
+ private:
+  flatbuffers::FlatBufferBuilder &builder_;
+  int total_;
+  double score_;
+  std::vector<flatbuffers::Offset<gamma_api::SearchResult>> results_;
+  std::vector<flatbuffers::Offset<gamma_api::ResultItem>> items_;
+  std::vector<flatbuffers::Offset<flatbuffers::String>> names_;
+  std::vector<flatbuffers::Offset<flatbuffers::String>> values_;
+  std::vector<flatbuffers::Offset<gamma_api::VectorResult>> vector_results_;
+};
+
+}  // namespace
+
+ByteArray *SearchV2(void *engine, Request *request) {
+  tig_gamma::RequestRecorder &recorder = tig_gamma::RequestRecorder::Instance();
+  long start = recorder.Recording() ? recorder.Now() : 0;
+  flatbuffers::FlatBufferBuilder builder;
+  FlatBufferSink sink(builder);
+  static_cast<tig_gamma::GammaEngine *>(engine)->Search(request, &sink);
+  if (recorder.Recording()) recorder.Record(start, request);
 
   ByteArray *response_out = (ByteArray *)malloc(sizeof(ByteArray));
   response_out->len = builder.GetSize();
@@ -623,8 +829,6 @@ ByteArray *SearchV2(void *engine, Request *request) {
          builder.GetSize());
   builder.Release();
 
-  DestroyResponse(response);
-
   return response_out;
 }
 
@@ -648,31 +852,7 @@ Field *GetField(const Doc *doc, int idx) {
 }
 
 enum ResponseCode DestroyResponse(Response *response) {
-  for (int i = 0; i < response->req_num; i++) {
-    for (int j = 0; j < response->results[i]->result_num; j++) {
-      DestroyDoc(response->results[i]->result_items[j]->doc);
-      DestroyByteArray(response->results[i]->result_items[j]->extra);
-      free(response->results[i]->result_items[j]);
-    }
-    DestroyByteArray(response->results[i]->msg);
-    if (response->results[i]->result_items != nullptr) {
-      free(response->results[i]->result_items);
-    }
-    if (response->results[i] != nullptr) {
-      free(response->results[i]);
-    }
-  }
-  DestroyByteArray(response->online_log_message);
-  free(response->results);
-  free(response);
-
-  /*
-   for (int i = 0; i < response->result_num; ++i) {
-     DestroyDoc(response->result_items[i]->doc);
-     free(response->result_items[i]);
-   }
-   free(response->result_items);
-   free(response);
-   */
+  // the response is in its arena
+  delete tig_gamma::ArenaResponse::Of(response)->arena;
   return ResponseCode::SUCCESSED;
 }
@@ -143,11 +143,24 @@ enum ResponseCode SetVectorInfo(VectorInfo **vector_infos, int idx,
  */
 enum ResponseCode DestroyVectorInfos(VectorInfo **vectorInfo, int num);
 
+/** flags of FieldInfo.is_index, they can be combined
+ * FIELD_INDEX_RANGE : index the field in range index
+ * FIELD_INDEX_COLUMN : store a numeric field in a contiguous column, it can be
+ *                      filtered by scanning even if it isn't range indexed
+ * FIELD_INDEX_INTERN : store identical values of a low-cardinality string
+ *                      field only once
+ */
+enum FieldIndexFlag {
+  FIELD_INDEX_RANGE = 1,
+  FIELD_INDEX_COLUMN = 2,
+  FIELD_INDEX_INTERN = 4
+};
+
 // field info
 typedef struct FieldInfo {
   ByteArray *name;
   enum DataType data_type;
-  BOOL is_index;  // whether index numeric field
+  BOOL is_index;  // whether index numeric field, flags of FieldIndexFlag
 } FieldInfo;
 
 /** make FieldInfo array
@@ -289,6 +302,30 @@ Doc *MakeDoc(Field **fields, int fields_num);
  */
 enum ResponseCode DestroyDoc(Doc *doc);
 
+/** make Doc array
+ *
+ * @param num  Doc array length
+ * @return Doc array head pointer
+ */
+Doc **MakeDocs(int num);
+
+/** set Doc arrary content
+ *
+ * @param docs  Doc array head pointer
+ * @param idx   Doc array subscript
+ * @param doc   Doc content to set
+ * @return ResponseCode
+ */
+enum ResponseCode SetDoc(Doc **docs, int idx, Doc *doc);
+
+/** destroy Doc array
+ *
+ * @param docs  Doc array head pointer
+ * @param num   Doc array length
+ * @return ResponseCode
+ */
+enum ResponseCode DestroyDocs(Doc **docs, int num);
+
 enum IndexStatus { UNINDEXED = 0, INDEXING, INDEXED };
 
 /** set the log dictionary, called once when the library is loaded
@@ -336,6 +373,42 @@ enum ResponseCode AddDoc(void *engine, Doc *doc);
  */
 enum ResponseCode AddOrUpdateDoc(void *engine, Doc *doc);
 
+/** add docs to table in batch, it is faster than adding them one by one
+ *
+ * @param engine   search engine pointer
+ * @param docs     Doc array to add
+ * @param num      Doc array length
+ * @param results  output, int array of num, 0 if the doc is added, otherwise
+ *                 the error code of the doc
+ * @return ResponseCode, FAILED if any doc fails
+ */
+enum ResponseCode AddDocs(void *engine, Doc **docs, int num, int *results);
+
+/** add docs to table in batch, a doc is updated if its _id exists, including
+ * the _id added before it in the same batch
+ *
+ * @param engine   search engine pointer
+ * @param docs     Doc array to add
+ * @param num      Doc array length
+ * @param results  output, int array of num, 0 if the doc is added or
+ *                 updated, otherwise the error code of the doc
+ * @return ResponseCode, FAILED if any doc fails
+ */
+enum ResponseCode AddOrUpdateDocs(void *engine, Doc **docs, int num,
+                                  int *results);
+
+/** add docs serialized as DocBatch of idl/fbs/gamma_api.fbs, field values
+ * are read from the buffer directly without copying them to Doc structs
+ *
+ * @param engine   search engine pointer
+ * @param docs     serialized DocBatch
+ * @param results  output, int array of docs num, 0 if the doc is added or
+ *                 updated, otherwise the error code of the doc, it can be
+ *                 NULL if not needed
+ * @return ResponseCode, FAILED if the buffer is invalid or any doc fails
+ */
+enum ResponseCode AddDocsV2(void *engine, ByteArray *docs, int *results);
+
 /** update a doc, if _id not exist, equal to function @AddDoc
  *
  * @param engine  search engine pointer
@@ -366,6 +439,70 @@ int GetDocsNum(void *engine);
  */
 long GetMemoryBytes(void *engine);
 
+/** enable the search result cache, a cached result is invalidated by writes
+ *
+ * @param engine        search engine pointer
+ * @param capacity      max number of cached requests, 0 disables the cache
+ * @param max_stale_ms  a result may be returned within this time after
+ *                      writes, 0 means no staleness is allowed
+ * @return ResponseCode
+ */
+enum ResponseCode SetSearchCache(void *engine, int capacity, int max_stale_ms);
+
+/** get metrics of the search result cache
+ *
+ * @param engine  search engine pointer
+ * @param hits    output, number of cache hits
+ * @param misses  output, number of cache misses
+ * @param size    output, number of cached requests
+ * @return ResponseCode
+ */
+enum ResponseCode GetSearchCacheStats(void *engine, long *hits, long *misses,
+                                      int *size);
+
+/** enable the cache of filter results, results of single filters on indexed
+ * fields are cached and shared by requests, a result is invalidated once its
+ * field is changed
+ *
+ * @param engine     search engine pointer
+ * @param max_bytes  max memory of cached results, 0 disables the cache
+ * @return ResponseCode
+ */
+enum ResponseCode SetFilterCache(void *engine, long max_bytes);
+
+/** get metrics of the filter result cache
+ *
+ * @param engine  search engine pointer
+ * @param hits    output, number of cache hits
+ * @param misses  output, number of cache misses
+ * @param bytes   output, memory of cached results
+ * @return ResponseCode
+ */
+enum ResponseCode GetFilterCacheStats(void *engine, long *hits, long *misses,
+                                      long *bytes);
+
+/** record requests of Search, SearchV2, AddOrUpdateDoc and DelDoc with their
+ * timestamps into a binary log, which can be replayed by tools/replay. A
+ * running recording is stopped first.
+ *
+ * @param path  log file path
+ * @return ResponseCode
+ */
+enum ResponseCode StartRecording(ByteArray *path);
+
+/** stop recording requests and close the log
+ *
+ * @return ResponseCode
+ */
+enum ResponseCode StopRecording();
+
+/** get a snapshot of metrics of the process, which are latency histograms of
+ * search and write stages and counters such as queries and codes scanned
+ *
+ * @return metrics as json, it should be destroyed by DestroyByteArray()
+ */
+ByteArray *GetMetrics();
+
 /** get a doc by id
  *
  * @param engine
@@ -604,7 +741,9 @@ typedef struct Request {
  * @param term_filters_num    termFilters array length
  * @param req_num             request number
  * @param direct_search_type  1 : direct search; 0 : normal search
- * @param online_log_level    DEBUG, INFO, WARN, ERROR
+ * @param online_log_level    DEBUG, INFO, WARN, ERROR, or TRACE which logs as
+ *                            DEBUG and appends a json trace of the execution
+ *                            to online_log_message
  * @param has_rank            default 0, has not rank; 1, has rank
  * @param multi_vector_rank
  * @param parallel_based_on_query
@@ -658,11 +797,17 @@ typedef struct Response {
  *
  * @param engine    search engine pointer
  * @param request   search request pointer
- * @return response, need to call @DestroyResponse to destroy
+ * @return response, need to call @DestroyResponse to destroy. The response
+ * and everything it points to are allocated in one block together with the
+ * temporaries of the search, which are freed by @DestroyResponse as well.
+ * Its parts shouldn't be freed or kept after it
  */
 Response *Search(void *engine, Request *request);
 
 /** query vectors to index with serialized result
+ *
+ * the scores and sources of the vector fields of a hit are in vector_results
+ * of gamma_api::ResultItem, its extra json isn't set any more
  *
  * @param engine    search engine pointer
  * @param request   search request pointer
@@ -704,7 +849,7 @@ Field *GetField(const Doc *doc, int idx);
 
 /** destroy response
  *
- * @param response  response to destroy
+ * @param response  response returned by @Search to destroy
  * @return ResponseCode
  */
 enum ResponseCode DestroyResponse(Response *response);
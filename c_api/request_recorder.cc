@@ -0,0 +1,376 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "request_recorder.h"
+
+#include <string.h>
+
+#include <chrono>
+
+#include "log.h"
+
+namespace tig_gamma {
+
+namespace {
+
+class PayloadWriter {
+ public:
+  explicit PayloadWriter(std::string &buf) : buf_(buf) {}
+
+  template <typename T>
+  void Put(T v) {
+    buf_.append(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+
+  // -1 is written as the length of nullptr
+  void PutBytes(const ByteArray *ba) {
+    int len = ba ? ba->len : -1;
+    Put(len);
+    if (len > 0) buf_.append(ba->value, len);
+  }
+
+ private:
+  std::string &buf_;
+};
+
+/** reads the payload of PayloadWriter, once it runs out of data, numbers are
+ * 0, byte arrays are nullptr and ok() is false
+ */
+class PayloadReader {
+ public:
+  PayloadReader(const char *data, size_t len)
+      : p_(data), end_(data + len), ok_(true) {}
+
+  template <typename T>
+  T Get() {
+    T v;
+    if (Remain() < sizeof(v)) {
+      ok_ = false;
+      memset(&v, 0, sizeof(v));
+      return v;
+    }
+    memcpy(&v, p_, sizeof(v));
+    p_ += sizeof(v);
+    return v;
+  }
+
+  ByteArray *GetBytes() {
+    int len = Get<int>();
+    if (len < 0 || (size_t)len > Remain()) {
+      if (len != -1) ok_ = false;
+      return nullptr;
+    }
+    ByteArray *ba = MakeByteArray(p_, len);
+    p_ += len;
+    return ba;
+  }
+
+  // a number of items, each of which is at least 4 bytes
+  int GetNum() {
+    int num = Get<int>();
+    if (num < 0 || (size_t)num > Remain() / 4) {
+      ok_ = false;
+      return 0;
+    }
+    return num;
+  }
+
+  bool ok() { return ok_; }
+
+ private:
+  size_t Remain() { return end_ - p_; }
+
+  const char *p_;
+  const char *end_;
+  bool ok_;
+};
+
+void WriteRequest(PayloadWriter &w, const Request *request) {
+  w.Put(request->topn);
+  w.Put(request->req_num);
+  w.Put(request->direct_search_type);
+  w.Put((int)request->metric_type);
+  w.Put(request->has_rank);
+  w.Put(request->multi_vector_rank);
+  w.Put((int)request->parallel_based_on_query);
+  w.Put((int)request->l2_sqrt);
+  w.Put(request->nprobe);
+  w.Put((int)request->ivf_flat);
+  w.PutBytes(request->online_log_level);
+
+  w.Put(request->vec_fields_num);
+  for (int i = 0; i < request->vec_fields_num; ++i) {
+    const VectorQuery *query = request->vec_fields[i];
+    w.PutBytes(query->name);
+    w.PutBytes(query->value);
+    w.Put(query->min_score);
+    w.Put(query->max_score);
+    w.Put(query->boost);
+    w.Put(query->has_boost);
+  }
+  w.Put(request->fields_num);
+  for (int i = 0; i < request->fields_num; ++i) {
+    w.PutBytes(request->fields[i]);
+  }
+  w.Put(request->range_filters_num);
+  for (int i = 0; i < request->range_filters_num; ++i) {
+    const RangeFilter *filter = request->range_filters[i];
+    w.PutBytes(filter->field);
+    w.PutBytes(filter->lower_value);
+    w.PutBytes(filter->upper_value);
+    w.Put((int)filter->include_lower);
+    w.Put((int)filter->include_upper);
+  }
+  w.Put(request->term_filters_num);
+  for (int i = 0; i < request->term_filters_num; ++i) {
+    const TermFilter *filter = request->term_filters[i];
+    w.PutBytes(filter->field);
+    w.PutBytes(filter->value);
+    w.Put((int)filter->is_union);
+  }
+}
+
+Request *ReadRequest(PayloadReader &r) {
+  int topn = r.Get<int>();
+  int req_num = r.Get<int>();
+  int direct_search_type = r.Get<int>();
+  int metric_type = r.Get<int>();
+  int has_rank = r.Get<int>();
+  int multi_vector_rank = r.Get<int>();
+  BOOL parallel_based_on_query = r.Get<int>();
+  BOOL l2_sqrt = r.Get<int>();
+  int nprobe = r.Get<int>();
+  BOOL ivf_flat = r.Get<int>();
+  ByteArray *online_log_level = r.GetBytes();
+
+  int vec_fields_num = r.GetNum();
+  VectorQuery **vec_fields = MakeVectorQuerys(vec_fields_num);
+  for (int i = 0; i < vec_fields_num && r.ok(); ++i) {
+    ByteArray *name = r.GetBytes();
+    ByteArray *value = r.GetBytes();
+    double min_score = r.Get<double>();
+    double max_score = r.Get<double>();
+    double boost = r.Get<double>();
+    int has_boost = r.Get<int>();
+    SetVectorQuery(vec_fields, i,
+                   MakeVectorQuery(name, value, min_score, max_score, boost,
+                                   has_boost));
+  }
+  int fields_num = r.GetNum();
+  ByteArray **fields = MakeByteArrays(fields_num);
+  for (int i = 0; i < fields_num && r.ok(); ++i) {
+    SetByteArray(fields, i, r.GetBytes());
+  }
+  int range_filters_num = r.GetNum();
+  RangeFilter **range_filters = MakeRangeFilters(range_filters_num);
+  for (int i = 0; i < range_filters_num && r.ok(); ++i) {
+    ByteArray *field = r.GetBytes();
+    ByteArray *lower_value = r.GetBytes();
+    ByteArray *upper_value = r.GetBytes();
+    BOOL include_lower = r.Get<int>();
+    BOOL include_upper = r.Get<int>();
+    SetRangeFilter(range_filters, i,
+                   MakeRangeFilter(field, lower_value, upper_value,
+                                   include_lower, include_upper));
+  }
+  int term_filters_num = r.GetNum();
+  TermFilter **term_filters = MakeTermFilters(term_filters_num);
+  for (int i = 0; i < term_filters_num && r.ok(); ++i) {
+    ByteArray *field = r.GetBytes();
+    ByteArray *value = r.GetBytes();
+    BOOL is_union = r.Get<int>();
+    SetTermFilter(term_filters, i, MakeTermFilter(field, value, is_union));
+  }
+
+  Request *request = MakeRequest(
+      topn, vec_fields, vec_fields_num, fields, fields_num, range_filters,
+      range_filters_num, term_filters, term_filters_num, req_num,
+      direct_search_type, online_log_level, has_rank, multi_vector_rank,
+      parallel_based_on_query, l2_sqrt, nprobe, ivf_flat);
+  request->metric_type = static_cast<enum DistanceMetricType>(metric_type);
+  return request;
+}
+
+void WriteDoc(PayloadWriter &w, const Doc *doc) {
+  w.Put(doc->fields_num);
+  for (int i = 0; i < doc->fields_num; ++i) {
+    const Field *field = doc->fields[i];
+    w.PutBytes(field->name);
+    w.PutBytes(field->value);
+    w.PutBytes(field->source);
+    w.Put((int)field->data_type);
+  }
+}
+
+Doc *ReadDoc(PayloadReader &r) {
+  int fields_num = r.GetNum();
+  Field **fields = MakeFields(fields_num);
+  for (int i = 0; i < fields_num && r.ok(); ++i) {
+    ByteArray *name = r.GetBytes();
+    ByteArray *value = r.GetBytes();
+    ByteArray *source = r.GetBytes();
+    int data_type = r.Get<int>();
+    SetField(fields, i,
+             MakeField(name, value, source,
+                       static_cast<enum DataType>(data_type)));
+  }
+  return MakeDoc(fields, fields_num);
+}
+
+}  // namespace
+
+RequestRecorder &RequestRecorder::Instance() {
+  static RequestRecorder recorder;
+  return recorder;
+}
+
+int RequestRecorder::Start(const std::string &path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  recording_ = false;
+  if (fp_) fclose(fp_);
+  fp_ = fopen(path.c_str(), "wb");
+  if (fp_ == nullptr) {
+    LOG(ERROR) << "open request log error, path=" << path;
+    return -1;
+  }
+  uint32_t header[2] = {kMagic, kVersion};
+  if (fwrite(header, sizeof(header), 1, fp_) != 1) {
+    LOG(ERROR) << "write request log header error, path=" << path;
+    fclose(fp_);
+    fp_ = nullptr;
+    return -1;
+  }
+  start_ = std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+               .count();
+  recording_ = true;
+  LOG(INFO) << "start recording requests into " << path;
+  return 0;
+}
+
+void RequestRecorder::Stop() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  recording_ = false;
+  if (fp_) {
+    fclose(fp_);
+    fp_ = nullptr;
+    LOG(INFO) << "stop recording requests";
+  }
+}
+
+long RequestRecorder::Now() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+             .count() -
+         start_;
+}
+
+void RequestRecorder::Record(long start, const Request *request) {
+  std::string payload;
+  PayloadWriter w(payload);
+  WriteRequest(w, request);
+  Write(RecordType::SEARCH, start, payload);
+}
+
+void RequestRecorder::Record(long start, const Doc *doc) {
+  std::string payload;
+  PayloadWriter w(payload);
+  WriteDoc(w, doc);
+  Write(RecordType::ADD_OR_UPDATE, start, payload);
+}
+
+void RequestRecorder::Record(long start, const ByteArray *doc_id) {
+  std::string payload;
+  PayloadWriter w(payload);
+  w.PutBytes(doc_id);
+  Write(RecordType::DEL, start, payload);
+}
+
+void RequestRecorder::Write(RecordType type, long start,
+                            const std::string &payload) {
+  std::string record;
+  PayloadWriter w(record);
+  w.Put((uint8_t)type);
+  w.Put((int64_t)start);
+  w.Put((int32_t)(Now() - start));
+  w.Put((uint32_t)payload.size());
+  record.append(payload);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // it may be stopped while serializing
+  if (fp_ == nullptr) return;
+  if (fwrite(record.data(), record.size(), 1, fp_) != 1) {
+    LOG(ERROR) << "write request log error, stop recording";
+    recording_ = false;
+    fclose(fp_);
+    fp_ = nullptr;
+  }
+}
+
+int RequestLogReader::Open(const std::string &path) {
+  fp_ = fopen(path.c_str(), "rb");
+  if (fp_ == nullptr) {
+    LOG(ERROR) << "open request log error, path=" << path;
+    return -1;
+  }
+  uint32_t header[2];
+  if (fread(header, sizeof(header), 1, fp_) != 1 ||
+      header[0] != RequestRecorder::kMagic) {
+    LOG(ERROR) << "invalid request log, path=" << path;
+    return -1;
+  }
+  if (header[1] != RequestRecorder::kVersion) {
+    LOG(ERROR) << "unsupported request log version " << header[1];
+    return -1;
+  }
+  return 0;
+}
+
+int RequestLogReader::Next(RecordedRequest &record) {
+  uint8_t type;
+  int64_t timestamp;
+  int32_t cost;
+  uint32_t len;
+  if (fread(&type, sizeof(type), 1, fp_) != 1) return feof(fp_) ? 0 : -1;
+  if (fread(&timestamp, sizeof(timestamp), 1, fp_) != 1 ||
+      fread(&cost, sizeof(cost), 1, fp_) != 1 ||
+      fread(&len, sizeof(len), 1, fp_) != 1) {
+    LOG(ERROR) << "truncated request log";
+    return -1;
+  }
+  std::string payload(len, '\0');
+  if (len > 0 && fread(&payload[0], len, 1, fp_) != 1) {
+    LOG(ERROR) << "truncated request log";
+    return -1;
+  }
+
+  record.type = static_cast<RecordType>(type);
+  record.timestamp = timestamp;
+  record.cost = cost;
+  PayloadReader r(payload.data(), payload.size());
+  switch (record.type) {
+    case RecordType::SEARCH:
+      record.request = ReadRequest(r);
+      break;
+    case RecordType::ADD_OR_UPDATE:
+      record.doc = ReadDoc(r);
+      break;
+    case RecordType::DEL:
+      record.doc_id = r.GetBytes();
+      break;
+    default:
+      LOG(ERROR) << "unknown record type " << (int)type;
+      return -1;
+  }
+  if (not r.ok()) {
+    LOG(ERROR) << "corrupted record at " << timestamp << "us";
+    return -1;
+  }
+  return 1;
+}
+
+}  // namespace tig_gamma
@@ -0,0 +1,117 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef C_API_REQUEST_RECORDER_H_
+#define C_API_REQUEST_RECORDER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "gamma_api.h"
+
+namespace tig_gamma {
+
+enum class RecordType : uint8_t { SEARCH = 1, ADD_OR_UPDATE = 2, DEL = 3 };
+
+/** a request of the log, which owns the request, doc or doc id of its type
+ */
+struct RecordedRequest {
+  RecordedRequest()
+      : type(RecordType::SEARCH),
+        timestamp(0),
+        cost(0),
+        request(nullptr),
+        doc(nullptr),
+        doc_id(nullptr) {}
+
+  ~RecordedRequest() {
+    if (request) DestroyRequest(request);
+    if (doc) DestroyDoc(doc);
+    if (doc_id) DestroyByteArray(doc_id);
+  }
+
+  RecordType type;
+  long timestamp;  // microseconds since the recording started
+  int cost;        // microseconds the recorded call took
+  Request *request;
+  Doc *doc;
+  ByteArray *doc_id;
+};
+
+/** records requests of the C API into a binary log. The log begins with a
+ * magic and a version, each record is the type, the timestamp, the cost and
+ * the payload length followed by the serialized request, doc or doc id.
+ * Numbers are in host byte order.
+ */
+class RequestRecorder {
+ public:
+  static const uint32_t kMagic = 0x43455247;  // "GREC"
+  static const uint32_t kVersion = 1;
+
+  static RequestRecorder &Instance();
+
+  /** start recording into path, a running recording is stopped first
+   *
+   * @return 0 if successed
+   */
+  int Start(const std::string &path);
+
+  void Stop();
+
+  bool Recording() { return recording_.load(std::memory_order_relaxed); }
+
+  // microseconds since the recording started
+  long Now();
+
+  void Record(long start, const Request *request);
+
+  void Record(long start, const Doc *doc);
+
+  void Record(long start, const ByteArray *doc_id);
+
+ private:
+  RequestRecorder() : fp_(nullptr), recording_(false), start_(0) {}
+
+  void Write(RecordType type, long start, const std::string &payload);
+
+  std::mutex mutex_;
+  FILE *fp_;
+  std::atomic<bool> recording_;
+  long start_;  // steady clock microseconds
+};
+
+/** reads the log of RequestRecorder in order
+ */
+class RequestLogReader {
+ public:
+  RequestLogReader() : fp_(nullptr) {}
+
+  ~RequestLogReader() {
+    if (fp_) fclose(fp_);
+  }
+
+  /** @return 0 if successed
+   */
+  int Open(const std::string &path);
+
+  /** read the next record
+   *
+   * @return 1 if a record is read, 0 at the end of the log, -1 if failed
+   */
+  int Next(RecordedRequest &record);
+
+ private:
+  FILE *fp_;
+};
+
+}  // namespace tig_gamma
+
+#endif  // C_API_REQUEST_RECORDER_H_
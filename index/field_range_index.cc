@@ -901,7 +901,7 @@ long FieldRangeIndex::ScanMemory(long &dense, long &sparse) {
 
 MultiFieldsRangeIndex::MultiFieldsRangeIndex(std::string &path,
                                              Profile *profile)
-    : path_(path) {
+    : path_(path), cache_(profile->FieldsNum()) {
   profile_ = profile;
   fields_.resize(profile->FieldsNum());
   std::fill(fields_.begin(), fields_.end(), nullptr);
@@ -927,6 +927,10 @@ MultiFieldsRangeIndex::MultiFieldsRangeIndex(std::string &path,
 
 MultiFieldsRangeIndex::~MultiFieldsRangeIndex() {
   b_running_ = false;
+  // the queued operations are applied before the fields are freed
+  while (b_operate_running_) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
   for (size_t i = 0; i < fields_.size(); i++) {
     if (fields_[i]) {
       delete fields_[i];
@@ -1029,10 +1033,15 @@ int MultiFieldsRangeIndex::AddDoc(int docid, int field) {
     return 0;
   }
 
-  unsigned char *key;
-  int key_len = 0;
-  profile_->GetFieldRawValue(docid, field, &key, key_len);
-  index->Add(key, key_len, docid, resource_recovery_q_);
+  {
+    // a string key points to the arena, which a compaction may free
+    Profile::StringReadGuard guard(profile_);
+    unsigned char *key;
+    int key_len = 0;
+    profile_->GetFieldRawValue(docid, field, &key, key_len);
+    index->Add(key, key_len, docid, resource_recovery_q_);
+  }
+  cache_.Invalidate(field);
 
   return 0;
 }
@@ -1043,10 +1052,15 @@ int MultiFieldsRangeIndex::DeleteDoc(int docid, int field) {
     return 0;
   }
 
-  unsigned char *key;
-  int key_len = 0;
-  profile_->GetFieldRawValue(docid, field, &key, key_len);
-  index->Delete(key, key_len, docid, resource_recovery_q_);
+  {
+    // a string key points to the arena, which a compaction may free
+    Profile::StringReadGuard guard(profile_);
+    unsigned char *key;
+    int key_len = 0;
+    profile_->GetFieldRawValue(docid, field, &key, key_len);
+    index->Delete(key, key_len, docid, resource_recovery_q_);
+  }
+  cache_.Invalidate(field);
 
   return 0;
 }
@@ -1058,10 +1072,17 @@ int MultiFieldsRangeIndex::Search(const std::vector<FilterInfo> &origin_filters,
   std::vector<FilterInfo> filters;
 
   for (const auto &filter : origin_filters) {
-    FieldRangeIndex *index = fields_[filter.field];
-    if (index == nullptr || filter.field < 0) {
+    if (filter.field < 0) {
       return -1;
     }
+    FieldRangeIndex *index = fields_[filter.field];
+    if (index == nullptr) {
+      if (profile_->GetColumn(filter.field) == nullptr) {
+        return -1;
+      }
+      filters.push_back(filter);  // filtered by scanning column
+      continue;
+    }
     if (not index->IsNumeric() && (filter.is_union == 0)) {
       // type is string and operator is "and", split this filter
       std::vector<string> items =
@@ -1079,11 +1100,8 @@ int MultiFieldsRangeIndex::Search(const std::vector<FilterInfo> &origin_filters,
   int fsize = filters.size();
 
   if (1 == fsize) {
-    auto &filter = filters[0];
-    RangeQueryResult *result = new RangeQueryResult;
-    FieldRangeIndex *index = fields_[filter.field];
-
-    int retval = index->Search(filter.lower_value, filter.upper_value, result);
+    std::shared_ptr<const RangeQueryResult> result;
+    int retval = SearchFieldCached(filters[0], result);
     if (retval > 0) {
       out->Add(result);
     }
@@ -1091,43 +1109,42 @@ int MultiFieldsRangeIndex::Search(const std::vector<FilterInfo> &origin_filters,
     return retval;
   }
 
-  RangeQueryResult *results = new RangeQueryResult[fsize];
-  utils::ScopeDeleter<RangeQueryResult> del(results);
+  std::vector<std::shared_ptr<const RangeQueryResult>> results;
+  results.reserve(fsize);
 
-  int valuable_result = -1;
   // record the shortest docid list
   int shortest_idx = -1, shortest = std::numeric_limits<int>::max();
 
   for (int i = 0; i < fsize; ++i) {
     auto &filter = filters[i];
 
-    FieldRangeIndex *index = fields_[filter.field];
-    if (index == nullptr || filter.field < 0) {
-      continue;
-    }
-
-    int retval = index->Search(filter.lower_value, filter.upper_value,
-                               &(results[valuable_result + 1]));
+    std::shared_ptr<const RangeQueryResult> result;
+    int retval = SearchFieldCached(filter, result);
     if (retval < 0) {
       ;
     } else if (retval == 0) {
       return 0;  // no intersection
     } else {
-      valuable_result += 1;
+      results.push_back(result);
 
       if (shortest > retval) {
         shortest = retval;
-        shortest_idx = valuable_result;
+        shortest_idx = results.size() - 1;
       }
     }
   }
 
-  if (valuable_result < 0) {
+  if (results.empty()) {
     return -1;  // universal set
   }
 
+  if (results.size() == 1) {
+    out->Add(results[0]);
+    return shortest;
+  }
+
   RangeQueryResult *tmp = new RangeQueryResult;
-  int count = Intersect(results, valuable_result, shortest_idx, tmp);
+  int count = Intersect(results, shortest_idx, tmp);
   if (count > 0) {
     out->Add(tmp);
   } else {
@@ -1137,20 +1154,74 @@ int MultiFieldsRangeIndex::Search(const std::vector<FilterInfo> &origin_filters,
   return count;
 }
 
-int MultiFieldsRangeIndex::Intersect(RangeQueryResult *results, int j,
-                                     int shortest_idx, RangeQueryResult *out) {
-  assert(results != nullptr && j >= 0);
+int MultiFieldsRangeIndex::SearchFieldCached(
+    const FilterInfo &filter, std::shared_ptr<const RangeQueryResult> &result) {
+  FieldRangeIndex *index = fields_[filter.field];
+  // scanned columns aren't cached, they are changed without the worker
+  if (index == nullptr || not cache_.Enabled()) {
+    RangeQueryResult *r = new RangeQueryResult;
+    result.reset(r);
+    return SearchField(filter, r);
+  }
 
-  // I want to build a smaller bitmap ...
-  int min_doc = results[0].MinAligned();
-  int max_doc = results[0].MaxAligned();
+  std::string key;
+  RangeQueryCache::MakeKey(filter.field, filter.lower_value,
+                           filter.upper_value, filter.is_union,
+                           index->IsNumeric() ? nullptr : index->Delim(), key);
+  int retval = -1;
+  if (cache_.Get(key, filter.field, retval, result)) {
+    return retval;
+  }
 
-  int total = results[0].Size();
+  uint64_t version = cache_.Version(filter.field);
+  RangeQueryResult *r = new RangeQueryResult;
+  result.reset(r);
+  retval = SearchField(filter, r);
+  if (retval >= 0) {
+    cache_.Put(key, filter.field, version, retval, result);
+  }
+  return retval;
+}
 
-  // results[0].Output();
+int MultiFieldsRangeIndex::SearchField(const FilterInfo &filter,
+                                       RangeQueryResult *result) {
+  FieldRangeIndex *index = fields_[filter.field];
+  if (index != nullptr) {
+    return index->Search(filter.lower_value, filter.upper_value, result);
+  }
 
-  for (int i = 1; i <= j; i++) {
-    RangeQueryResult &r = results[i];
+  const ProfileColumn *column = profile_->GetColumn(filter.field);
+  if (column == nullptr) {
+    return -1;
+  }
+  int doc_num = profile_->DocNum();
+  if (doc_num <= 0) {
+    return 0;
+  }
+  result->SetRange(0, doc_num - 1);
+  result->Resize();
+  int num = column->RangeScan(filter.lower_value, filter.upper_value, doc_num,
+                              result->Ref());
+  if (num < 0) {
+    LOG(ERROR) << "scan column error, field=" << filter.field;
+    result->Clear();
+    return -1;
+  }
+  result->SetDocNum(num);
+  return num;
+}
+
+int MultiFieldsRangeIndex::Intersect(
+    const std::vector<std::shared_ptr<const RangeQueryResult>> &results,
+    int shortest_idx, RangeQueryResult *out) {
+  assert(not results.empty());
+
+  // I want to build a smaller bitmap ...
+  int min_doc = results[0]->MinAligned();
+  int max_doc = results[0]->MaxAligned();
+
+  for (size_t i = 1; i < results.size(); i++) {
+    const RangeQueryResult &r = *results[i];
 
     // the maximum of the minimum(s)
     if (r.MinAligned() > min_doc) {
@@ -1168,58 +1239,34 @@ int MultiFieldsRangeIndex::Intersect(RangeQueryResult *results, int j,
   out->SetRange(min_doc, max_doc);
   out->Resize();
 
-  out->SetDocNum(total);
-
-  char *&bitmap = out->Ref();
-
-  int op_len = sizeof(BM_OPERATE_TYPE) * 8;
-
-  BM_OPERATE_TYPE *op_data_dst = (BM_OPERATE_TYPE *)bitmap;
+  // every result covers [min_doc, max_doc], which is aligned to bytes
+  unsigned char *dst = (unsigned char *)out->Ref();
+  int bytes = (max_doc - min_doc + 1) / 8;
 
   // calculate the intersection with the shortest doc chain.
   {
-    char *data = results[shortest_idx].Ref();
-
-    BM_OPERATE_TYPE *op_data_ori = (BM_OPERATE_TYPE *)data;
-    for (int j = 0; j < (max_doc - min_doc + 1) / op_len; ++j) {
-      op_data_dst[j] = op_data_ori[j];
-    }
+    const RangeQueryResult &r = *results[shortest_idx];
+    memcpy(dst, r.Data() + (min_doc - r.MinAligned()) / 8, bytes);
   }
 
-  for (int i = 0; i < j; ++i) {
-    if (i == shortest_idx) {
+  for (size_t i = 0; i < results.size(); ++i) {
+    if ((int)i == shortest_idx) {
       continue;
     }
-    char *data = results[i].Ref();
-    BM_OPERATE_TYPE *op_data_ori = (BM_OPERATE_TYPE *)data;
-    int min = results[i].MinAligned();
-    int max = results[i].MaxAligned();
-
-    if (min < min_doc) {
-      int offset = (min_doc - min) / op_len;
-      if (max > max_doc) {
-        for (int k = 0; k < (max_doc - min_doc + 1) / op_len; ++k) {
-          op_data_dst[k] &= op_data_ori[k + offset];
-        }
-      } else {
-        for (int k = 0; k < (max - min_doc + 1) / op_len; ++k) {
-          op_data_dst[k] &= op_data_ori[k + offset];
-        }
-      }
-    } else {
-      int offset = (min - min_doc) / op_len;
-      if (max > max_doc) {
-        for (int k = 0; k < (max_doc - min_doc + 1) / op_len; ++k) {
-          op_data_dst[k + offset] &= op_data_ori[k];
-        }
-      } else {
-        for (int k = 0; k < (max - min_doc + 1) / op_len; ++k) {
-          op_data_dst[k + offset] &= op_data_ori[k];
-        }
-      }
+    const RangeQueryResult &r = *results[i];
+    const unsigned char *src =
+        (const unsigned char *)r.Data() + (min_doc - r.MinAligned()) / 8;
+    for (int k = 0; k < bytes; ++k) {
+      dst[k] &= src[k];
     }
   }
 
+  int total = 0;
+  for (int k = 0; k < bytes; ++k) {
+    total += __builtin_popcount(dst[k]);
+  }
+  out->SetDocNum(total);
+
   return total;
 }
 
@@ -8,12 +8,14 @@
 #ifndef FIELD_RANGE_INDEX_H_
 #define FIELD_RANGE_INDEX_H_
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <vector>
 #include "concurrentqueue/blockingconcurrentqueue.h"
 #include "gamma_api.h"
 #include "profile.h"
+#include "range_query_cache.h"
 #include "range_query_result.h"
 
 namespace tig_gamma {
@@ -80,9 +82,41 @@ class MultiFieldsRangeIndex {
   // for debug
   long MemorySize(long &dense, long &sparse);
 
+  /** set max memory of the filter result cache, see
+   * RangeQueryCache::SetCapacity()
+   */
+  void SetCacheCapacity(long max_bytes) { cache_.SetCapacity(max_bytes); }
+
+  void GetCacheStats(long &hits, long &misses, long &bytes) {
+    hits = cache_.Hits();
+    misses = cache_.Misses();
+    bytes = cache_.MemoryBytes();
+  }
+
  private:
-  int Intersect(RangeQueryResult *results, int j, int k,
-                RangeQueryResult *out);
+  /** intersect results into out
+   *
+   * @param shortest_idx index of the result with the fewest docs
+   * @return the size of out
+   */
+  int Intersect(const std::vector<std::shared_ptr<const RangeQueryResult>>
+                    &results,
+                int shortest_idx, RangeQueryResult *out);
+
+  /** search one filter with the result cache, the result of an indexed field
+   * is shared with the cache
+   *
+   * @return the same as SearchField()
+   */
+  int SearchFieldCached(const FilterInfo &filter,
+                        std::shared_ptr<const RangeQueryResult> &result);
+
+  /** search one filter in range index, or by scanning the column of profile
+   * if the field isn't indexed
+   *
+   * @return the size of result, 0 if empty, -1 if the field can't be filtered
+   */
+  int SearchField(const FilterInfo &filter, RangeQueryResult *result);
   void ResourceRecoveryWorker();
   void FieldOperateWorker();
 
@@ -92,11 +126,12 @@ class MultiFieldsRangeIndex {
   std::vector<FieldRangeIndex *> fields_;
   Profile *profile_;
   std::string path_;
-  bool b_running_;
-  bool b_recovery_running_;
-  bool b_operate_running_;
+  std::atomic<bool> b_running_;
+  std::atomic<bool> b_recovery_running_;
+  std::atomic<bool> b_operate_running_;
   ResourceQueue *resource_recovery_q_;
   FieldOperateQueue *field_operate_q_;
+  RangeQueryCache cache_;
 };
 
 }  // namespace tig_gamma
@@ -8,12 +8,17 @@
 #ifndef GAMMA_INDEX_H_
 #define GAMMA_INDEX_H_
 
+#include <set>
 #include <vector>
+#include "arena.h"
 #include "gamma_common_data.h"
 #include "raw_vector.h"
 
 namespace tig_gamma {
 
+// docids of one query, nodes are allocated from the request arena
+typedef std::set<int, std::less<int>, utils::ArenaAllocator<int>> DocidSet;
+
 struct VectorResult {
   VectorResult() {
     n = 0;
@@ -22,6 +27,7 @@ struct VectorResult {
     docids = nullptr;
     sources = nullptr;
     source_lens = nullptr;
+    arena = nullptr;
     total.resize(n);
     idx.resize(n);
     idx.assign(n, 0);
@@ -29,30 +35,44 @@ struct VectorResult {
   }
 
   ~VectorResult() {
+    if (arena) return;  // buffers are freed with the arena
+
     if (dists) {
-      delete dists;
+      delete[] dists;
       dists = nullptr;
     }
 
     if (docids) {
-      delete docids;
+      delete[] docids;
       docids = nullptr;
     }
 
     if (sources) {
-      delete sources;
+      delete[] sources;
       sources = nullptr;
     }
 
     if (source_lens) {
-      delete source_lens;
+      delete[] source_lens;
       source_lens = nullptr;
     }
   }
 
-  bool init(int a, int b) {
+  /** @param arena_ptr buffers are allocated from it if not null */
+  bool init(int a, int b, utils::Arena *arena_ptr = nullptr) {
     n = a;
     topn = b;
+    if (arena_ptr) {
+      arena = arena_ptr;
+      dists = arena->AllocateArray<float>(n * topn);
+      docids = arena->AllocateArray<long>(n * topn);
+      sources = arena->AllocateArray<char *>(n * topn);
+      source_lens = arena->AllocateArray<int>(n * topn);
+      total.resize(n, 0);
+      idx.resize(n, -1);
+      return true;
+    }
+
     dists = new float[n * topn];
     if (!dists) {
       // LOG(ERROR) << "dists in VectorResult malloc error!";
@@ -114,6 +134,7 @@ struct VectorResult {
   int *source_lens;
   std::vector<int> total;
   std::vector<int> idx;
+  utils::Arena *arena;  // not owned
 };
 
 struct GammaIndex {
@@ -193,7 +193,7 @@ int GammaIndexBinaryIVF::Search(const VectorQuery *query,
   for (size_t i = 0; i < n; i++) {
     int pos = 0;
 
-    std::map<int, int> docid2count;
+    DocidSet docid_set(utils::ArenaAllocator<int>(condition->arena));
     for (int j = 0; j < condition->topn; j++) {
       result.dists[i * condition->topn + j] = dists[i * condition->topn + j];
 
@@ -203,7 +203,7 @@ int GammaIndexBinaryIVF::Search(const VectorQuery *query,
       int vector_id = (int)docid[0];
       int real_docid = raw_vec_binary_->vid_mgr_->VID2DocID(vector_id);
 
-      if (docid2count.find(real_docid) == docid2count.end()) {
+      if (docid_set.find(real_docid) == docid_set.end()) {
         int real_pos = i * condition->topn + pos;
         result.docids[real_pos] = real_docid;
         int ret = raw_vec_binary_->GetSource(
@@ -215,7 +215,7 @@ int GammaIndexBinaryIVF::Search(const VectorQuery *query,
         result.dists[real_pos] = result.dists[i * condition->topn + j];
 
         pos++;
-        docid2count[real_docid] = 1;
+        docid_set.insert(real_docid);
       }
     }
 
@@ -282,6 +282,16 @@ void GammaIndexBinaryIVF::search_knn_hamming_heap(
   using HeapForIP = faiss::CMin<int32_t, idx_t>;
   using HeapForL2 = faiss::CMax<int32_t, idx_t>;
 
+  // shared by the scanners of all threads
+  VidFilter vid_filter;
+  if (vid_filter.Init(docids_bitmap_, raw_vec_binary_->vid_mgr_,
+                      condition->range_query_result)) {
+    LOG(ERROR) << "init vid filter error";
+    return;
+  }
+  const VidFilter *old_vid_filter = condition->vid_filter;
+  condition->vid_filter = &vid_filter;
+
 #pragma omp parallel if (n > 1)
   {
     std::unique_ptr<GammaBinaryInvertedListScanner> scanner(
@@ -342,6 +352,7 @@ void GammaIndexBinaryIVF::search_knn_hamming_heap(
 
     }  // parallel for
   }    // parallel
+  condition->vid_filter = old_vid_filter;
 }
 
 template <class HammingComputer, bool store_pairs>
@@ -368,33 +379,19 @@ struct GammaIVFBinaryScannerL2 : GammaBinaryInvertedListScanner {
                     int32_t *simi, idx_t *idxi, size_t k) const override {
     using C = faiss::CMax<int32_t, idx_t>;
 
-    // set filter func
-    std::function<bool(int)> is_filterable;
-
-    if (range_index_ptr_ != nullptr) {
-      is_filterable = [this](int doc_id) -> bool {
-        return (bitmap::test(docids_bitmap_, doc_id) ||
-                (not range_index_ptr_->Has(doc_id)));
-      };
-    } else {
-      is_filterable = [this](int doc_id) -> bool {
-        return (bitmap::test(docids_bitmap_, doc_id));
-      };
-    }
+    size_t npass = 0;
+    const int *pos = FilterList(n, ids, npass);
 
     size_t nup = 0;
-    for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < npass; i++) {
+      size_t j = pos[i];
       idx_t id = store_pairs ? (list_no << 32 | j) : ids[j];
-      if (is_filterable(id)) {
-        continue;
-      }
-      uint32_t dis = hc.hamming(codes);
+      uint32_t dis = hc.hamming(codes + j * code_size);
       if (dis < simi[0]) {
         faiss::heap_pop<C>(k, simi, idxi);
         faiss::heap_push<C>(k, simi, idxi, dis, id);
         nup++;
       }
-      codes += code_size;
     }
     return nup;
   }
@@ -15,6 +15,7 @@
 #include "gamma_index.h"
 #include "raw_vector.h"
 #include "realtime_invert_index.h"
+#include "vid_filter.h"
 
 namespace tig_gamma {
 
@@ -25,6 +26,7 @@ struct GammaBinaryInvertedListScanner {
     docids_bitmap_ = nullptr;
     raw_vec_ = nullptr;
     range_index_ptr_ = nullptr;
+    vid_filter_ = nullptr;
   }
 
   /// from now on we handle this query.
@@ -72,11 +74,28 @@ struct GammaBinaryInvertedListScanner {
 
   void set_search_condition(const GammaSearchCondition *condition) {
     range_index_ptr_ = condition->range_query_result;
+    vid_filter_ = condition->vid_filter;
+    if (vid_filter_ == nullptr) {
+      own_vid_filter_.Init(docids_bitmap_, raw_vec_->vid_mgr_,
+                           range_index_ptr_);
+      vid_filter_ = &own_vid_filter_;
+    }
+  }
+
+  // the positions of a list passing the filter, valid until the next call
+  inline const int *FilterList(size_t n, const idx_t *ids,
+                               size_t &npass) const {
+    size_t n_deleted = 0;
+    npass = vid_filter_->Filter(n, ids, pos_, n_deleted);
+    return pos_.data();
   }
 
   const char *docids_bitmap_;
   const RawVector<uint8_t> *raw_vec_;
   MultiRangeQueryResults *range_index_ptr_;
+  const VidFilter *vid_filter_;
+  VidFilter own_vid_filter_;
+  mutable std::vector<int> pos_;
 };
 
 class GammaIndexBinaryIVF : GammaIndex, faiss::IndexBinaryIVF {
@@ -55,11 +55,28 @@ class GammaIndexFactory {
 
         faiss::IndexFlatL2 *coarse_quantizer =
             new faiss::IndexFlatL2(dimension);
-        GammaIndex *gamma_index = new GammaIVFPQIndex(
+        GammaIVFPQIndex *gamma_index = new GammaIVFPQIndex(
             coarse_quantizer, dimension, ivfpq_param->ncentroids,
             ivfpq_param->nsubvector, ivfpq_param->nbits_per_idx, docids_bitmap,
             raw_vec, counters);
+        IVFFlatStore store = kIVFFlatStoreNone;
+        if (ivfpq_param->ivf_flat_store == "float") {
+          store = kIVFFlatStoreFloat;
+        } else if (ivfpq_param->ivf_flat_store == "fp16") {
+          store = kIVFFlatStoreFP16;
+        }
+        realtime::CompactionOptions compaction;
+        compaction.min_deleted_ratio = ivfpq_param->compact_deleted_ratio;
+        compaction.min_deleted_num = ivfpq_param->compact_min_deleted;
+        compaction.max_bytes_per_round =
+            (long)ivfpq_param->compact_mb_per_round << 20;
+        compaction.max_ms_per_round = ivfpq_param->compact_ms_per_round;
         delete ivfpq_param;
+        if (gamma_index->SetIVFFlatStore(store)) {
+          delete gamma_index;
+          return nullptr;
+        }
+        gamma_index->SetCompactionOptions(compaction);
         return gamma_index;
         break;
       }
@@ -16,6 +16,8 @@
  */
 #include "gamma_index_flat.h"
 
+#include "metrics.h"
+
 namespace tig_gamma {
 
 GammaFLATIndex::GammaFLATIndex(size_t d, const char *docids_bitmap,
@@ -47,13 +49,13 @@ int GammaFLATIndex::Search(const VectorQuery *query,
   for (size_t i = 0; i < n; i++) {
     int pos = 0;
 
-    std::map<int, int> docid2count;
+    DocidSet docid_set(utils::ArenaAllocator<int>(condition->arena));
     for (int j = 0; j < condition->topn; j++) {
       long *docid = result.docids + i * condition->topn + j;
       if (docid[0] == -1) continue;
       int vector_id = (int)docid[0];
       int real_docid = this->raw_vec_->vid_mgr_->VID2DocID(vector_id);
-      if (docid2count.find(real_docid) == docid2count.end()) {
+      if (docid_set.find(real_docid) == docid_set.end()) {
         int real_pos = i * condition->topn + pos;
         result.docids[real_pos] = real_docid;
         int ret = this->raw_vec_->GetSource(vector_id, result.sources[real_pos],
@@ -65,7 +67,7 @@ int GammaFLATIndex::Search(const VectorQuery *query,
         result.dists[real_pos] = result.dists[i * condition->topn + j];
 
         pos++;
-        docid2count[real_docid] = 1;
+        docid_set.insert(real_docid);
       }
     }
 
@@ -106,6 +108,9 @@ void GammaFLATIndex::SearchDirectly(int n, const float *x,
   {
     // we must obtain the num of threads in *THE* parallel area.
     int num_threads = omp_get_max_threads();
+    if (condition->trace != nullptr) {
+      condition->trace->SetThreads(num_threads);
+    }
 
     /*****************************************************
      * Depending on parallel_mode, there are two possible ways
@@ -265,6 +270,10 @@ void GammaFLATIndex::SearchDirectly(int n, const float *x,
         }
 
         total[i] += ndis;
+        utils::Metrics::Instance().Add(utils::kCounterCodesScanned, ndis);
+        if (condition->trace != nullptr) {
+          condition->trace->AddScanned(ndis);
+        }
 
         if (condition->sort_by_docid) {
           sort_by_docid(k, simi, idxi);
@@ -21,6 +21,8 @@
 #include <unistd.h>
 #include <immintrin.h>
 
+#include "metrics.h"
+
 namespace tig_gamma {
 
 using idx_t = faiss::Index::idx_t;
@@ -310,6 +312,9 @@ int GammaHNSWIndex::SearchHNSW(int n, const float *x, GammaSearchCondition *cond
                           omp_get_max_threads();
                           
   int k = condition->topn; // topK
+  if (condition->trace != nullptr) {
+    condition->trace->SetThreads(num_threads);
+  }
 
 #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
   for (int i = 0; i < n; i ++) {
@@ -335,6 +340,10 @@ int GammaHNSWIndex::SearchHNSW(int n, const float *x, GammaSearchCondition *cond
       FlatIPDis *ip_dis = dynamic_cast<FlatIPDis*>(dis);
       total[i] = ip_dis->ndis;
     }
+    utils::Metrics::Instance().Add(utils::kCounterCodesScanned, total[i]);
+    if (condition->trace != nullptr) {
+      condition->trace->AddScanned(total[i]);
+    }
 
     if (reconstruct_from_neighbors &&
       reconstruct_from_neighbors->k_reorder != 0) {
@@ -384,13 +393,13 @@ int GammaHNSWIndex::Search(const VectorQuery *query,
   for (int i = 0; i < n; i++) {
     int pos = 0;
 
-    std::map<int, int> docid2count;
+    DocidSet docid_set(utils::ArenaAllocator<int>(condition->arena));
     for (int j = 0; j < condition->topn; j++) {
       long *docid = result.docids + i * condition->topn + j;
       if (docid[0] == -1) continue;
       int vector_id = (int)docid[0];
       int real_docid = this->raw_vec_->vid_mgr_->VID2DocID(vector_id);
-      if (docid2count.find(real_docid) == docid2count.end()) {
+      if (docid_set.find(real_docid) == docid_set.end()) {
         int real_pos = i * condition->topn + pos;
         result.docids[real_pos] = real_docid;
         int ret = this->raw_vec_->GetSource(vector_id, result.sources[real_pos],
@@ -402,7 +411,7 @@ int GammaHNSWIndex::Search(const VectorQuery *query,
         result.dists[real_pos] = result.dists[i * condition->topn + j];
 
         pos++;
-        docid2count[real_docid] = 1;
+        docid_set.insert(real_docid);
       }
     }
 
@@ -25,6 +25,7 @@
 #include <vector>
 
 #include "bitmap.h"
+#include "metrics.h"
 #include "omp.h"
 #include "utils.h"
 
@@ -76,6 +77,9 @@ GammaIVFPQIndex::GammaIVFPQIndex(faiss::Index *quantizer, size_t d,
   // default value, nprobe will be passed at search time
   this->nprobe = 20;
 
+  ivf_flat_store_ = kIVFFlatStoreNone;
+  rt_flat_index_ptr_ = nullptr;
+  flat_invlists_ = nullptr;
   compaction_ = false;
   compact_bucket_no_ = 0;
   compacted_num_ = 0;
@@ -96,6 +100,14 @@ GammaIVFPQIndex::~GammaIVFPQIndex() {
     delete invlists;
     invlists = nullptr;
   }
+  if (flat_invlists_) {
+    delete flat_invlists_;
+    flat_invlists_ = nullptr;
+  }
+  if (rt_flat_index_ptr_) {
+    delete rt_flat_index_ptr_;
+    rt_flat_index_ptr_ = nullptr;
+  }
   if (quantizer) {
     delete quantizer;  // it will not be delete in parent class
     quantizer = nullptr;
@@ -108,16 +120,16 @@ faiss::InvertedListScanner *GammaIVFPQIndex::get_InvertedListScanner(
 }
 
 GammaInvertedListScanner *GammaIVFPQIndex::GetGammaIVFFlatScanner
-     (size_t d) const
+     (size_t d, IVFFlatStore store) const
 {
   if (metric_type == faiss::METRIC_INNER_PRODUCT) {
     auto scanner = new GammaIVFFlatScanner<
-        faiss::METRIC_INNER_PRODUCT, faiss::CMin<float, int64_t> > (d);
+        faiss::METRIC_INNER_PRODUCT, faiss::CMin<float, int64_t> > (d, store);
     scanner->SetVecFilter(this->docids_bitmap_, this->raw_vec_);
     return scanner;
   } else if (metric_type == faiss::METRIC_L2) {
     auto scanner = new GammaIVFFlatScanner<
-        faiss::METRIC_L2, faiss::CMax<float, int64_t> >(d);
+        faiss::METRIC_L2, faiss::CMax<float, int64_t> >(d, store);
     scanner->SetVecFilter(this->docids_bitmap_, this->raw_vec_);
     return scanner;
   } else {
@@ -126,6 +138,64 @@ GammaInvertedListScanner *GammaIVFPQIndex::GetGammaIVFFlatScanner
   return nullptr;
 }
 
+int GammaIVFPQIndex::SetIVFFlatStore(IVFFlatStore store) {
+  if (store == ivf_flat_store_) return 0;
+  if (indexed_vec_count_ > 0 || rt_flat_index_ptr_ != nullptr) {
+    LOG(ERROR) << "ivf flat store should be set before adding vectors";
+    return -1;
+  }
+  ivf_flat_store_ = store;
+  if (store == kIVFFlatStoreNone) return 0;
+
+  size_t code_size = FlatCodeSize();
+  // the flat codes are many times the pq codes, the buckets start with the
+  // codes bytes of the pq buckets and are extended as they fill
+  size_t bucket_keys =
+      std::max((size_t)500, (size_t)100000 * this->code_size / code_size);
+  rt_flat_index_ptr_ = new realtime::RTInvertIndex(
+      this->nlist, code_size, raw_vec_->GetMaxVectorSize(),
+      raw_vec_->vid_mgr_, docids_bitmap_, bucket_keys, 12800000);
+  if (!rt_flat_index_ptr_->Init()) {
+    LOG(ERROR) << "init ivf flat lists error";
+    delete rt_flat_index_ptr_;
+    rt_flat_index_ptr_ = nullptr;
+    ivf_flat_store_ = kIVFFlatStoreNone;
+    return -1;
+  }
+  flat_invlists_ = new realtime::RTInvertedLists(rt_flat_index_ptr_,
+                                                 this->nlist, code_size);
+  LOG(INFO) << "ivf flat store=" << store << ", code size=" << code_size
+            << ", bucket keys=" << bucket_keys;
+  return 0;
+}
+
+void GammaIVFPQIndex::SetCompactionOptions(
+    const realtime::CompactionOptions &options) {
+  rt_invert_index_ptr_->SetCompactionOptions(options);
+  if (rt_flat_index_ptr_) rt_flat_index_ptr_->SetCompactionOptions(options);
+}
+
+size_t GammaIVFPQIndex::FlatCodeSize() const {
+  size_t raw_d = raw_vec_->GetDimension();
+  return ivf_flat_store_ == kIVFFlatStoreFP16 ? raw_d * sizeof(uint16_t)
+                                              : raw_d * sizeof(float);
+}
+
+void GammaIVFPQIndex::EncodeFlat(int n, const float *vec, size_t stride,
+                                 uint8_t *codes) const {
+  size_t raw_d = raw_vec_->GetDimension();
+  size_t code_size = FlatCodeSize();
+  for (int i = 0; i < n; i++) {
+    const float *x = vec + i * stride;
+    uint8_t *code = codes + i * code_size;
+    if (ivf_flat_store_ == kIVFFlatStoreFP16) {
+      utils::EncodeFP16(x, (uint16_t *)code, raw_d);
+    } else {
+      memcpy(code, x, code_size);
+    }
+  }
+}
+
 GammaInvertedListScanner *GammaIVFPQIndex::GetGammaInvertedListScanner(
     bool store_pairs) const {
   if (metric_type == faiss::METRIC_INNER_PRODUCT) {
@@ -200,6 +270,9 @@ int GammaIVFPQIndex::Delete(int docid) {
   std::vector<int> vids;
   raw_vec_->vid_mgr_->DocID2VID(docid, vids);
   rt_invert_index_ptr_->Delete(vids.data(), vids.size());
+  if (rt_flat_index_ptr_) {
+    rt_flat_index_ptr_->Delete(vids.data(), vids.size());
+  }
   return 0;
 }
 
@@ -215,7 +288,6 @@ int GammaIVFPQIndex::AddRTVecsToIndex() {
 #ifdef DEBUG
     LOG(INFO) << "no extra vectors existed for indexing";
 #endif
-    rt_invert_index_ptr_->CompactIfNeed();
   } else {
     int MAX_NUM_PER_INDEX = 1000;
     int index_count =
@@ -257,6 +329,9 @@ int GammaIVFPQIndex::AddRTVecsToIndex() {
     LOG(ERROR) << "add updated vectors to index error";
     return -1;
   }
+  // a round on each call, its budget keeps ingest going under deletions
+  rt_invert_index_ptr_->CompactIfNeed();
+  if (rt_flat_index_ptr_) rt_flat_index_ptr_->CompactIfNeed();
   return ret;
 }  // namespace tig_gamma
 
@@ -301,6 +376,11 @@ int GammaIVFPQIndex::AddUpdatedVecToIndex() {
     }
     pq.compute_codes(to_encode, xcodes.data(), 1);
     rt_invert_index_ptr_->Update(idx, vids[i], xcodes);
+    if (rt_flat_index_ptr_) {
+      std::vector<uint8_t> flat_code(FlatCodeSize());
+      EncodeFlat(1, vec, d_, flat_code.data());
+      rt_flat_index_ptr_->Update(idx, vids[i], flat_code);
+    }
   }
   updated_num_ += vids.size();
   LOG(INFO) << "update index success! size=" << vids.size()
@@ -314,6 +394,8 @@ bool GammaIVFPQIndex::Add(int n, const float *vec) {
 #endif
   std::map<int, std::vector<long>> new_keys;
   std::map<int, std::vector<uint8_t>> new_codes;
+  std::map<int, std::vector<uint8_t>> new_flat_codes;
+  size_t flat_code_size = rt_flat_index_ptr_ ? FlatCodeSize() : 0;
 
   idx_t *idx;
   faiss::ScopeDeleter<idx_t> del_idx;
@@ -355,12 +437,23 @@ bool GammaIVFPQIndex::Add(int n, const float *vec) {
     size_t ofs = new_codes[key].size();
     new_codes[key].resize(ofs + code_size);
     memcpy((void *)(new_codes[key].data() + ofs), (void *)code, code_size);
+
+    if (flat_code_size > 0) {
+      std::vector<uint8_t> &flat_codes = new_flat_codes[key];
+      ofs = flat_codes.size();
+      flat_codes.resize(ofs + flat_code_size);
+      EncodeFlat(1, vec + i * d, d, flat_codes.data() + ofs);
+    }
   }
 
   /* stage 2 : add invert info to invert index */
   if (!rt_invert_index_ptr_->AddKeys(new_keys, new_codes)) {
     return false;
   }
+  if (rt_flat_index_ptr_ && !rt_flat_index_ptr_->AddKeys(new_keys,
+                                                         new_flat_codes)) {
+    return false;
+  }
   indexed_vec_count_ = vid;
 #ifdef PERFORMANCE_TESTING
   add_count_ += n;
@@ -393,12 +486,24 @@ void GammaIVFPQIndex::SearchIVFPQ(int n, const float *x,
 
   this->invlists->prefetch_lists(idx.get(), n * nprobe);
 
+  // shared by the scanners of all threads
+  VidFilter vid_filter;
+  if (vid_filter.Init(docids_bitmap_, raw_vec_->vid_mgr_,
+                      condition->range_query_result)) {
+    LOG(ERROR) << "init vid filter error";
+    memset(labels, -1, n * sizeof(idx_t) * condition->topn);
+    return;
+  }
+  const VidFilter *old_vid_filter = condition->vid_filter;
+  condition->vid_filter = &vid_filter;
+
   if(condition->ivf_flat)
     search_ivf_flat(n, x, condition, idx.get(), coarse_dis.get(), distances, 
                     labels, total, false);
   else
     search_preassigned(n, x, condition, idx.get(), coarse_dis.get(), distances,
                      labels, total, false);
+  condition->vid_filter = old_vid_filter;
 }
 
 namespace {
@@ -460,12 +565,17 @@ size_t scan_one_list(GammaInvertedListScanner *scanner, idx_t key,
   
   //scan_codes need uint8_t *
   const uint8_t *codes = nullptr;
-  
-  if(ivf_flat) {
+  std::unique_ptr<faiss::InvertedLists::ScopedCodes> scodes;
+
+  if (ivf_flat && raw_vec_head) {
     codes = reinterpret_cast<uint8_t *>(raw_vec_head);
   } else {
-    faiss::InvertedLists::ScopedCodes scodes(invlists, key);
-    codes = scodes.get(); 
+    // the codes of the flat lists are the raw vectors of the list
+    scodes.reset(new faiss::InvertedLists::ScopedCodes(invlists, key));
+    codes = scodes->get();
+  }
+  if (scanner->trace_ != nullptr) {
+    scanner->trace_->AddList(key, list_size);
   }
   scanner->scan_codes(list_size, codes, ids, simi, idxi, k);
 
@@ -484,27 +594,38 @@ void GammaIVFPQIndex::search_ivf_flat(
     return;
   }
 
-  auto raw_vec_type = dynamic_cast<MmapRawVector<float> *>(raw_vec_);
-  if(raw_vec_type == nullptr || raw_vec_type->GetMemoryMode() == 0) {
-    LOG(WARNING) << "IVF FLAT cann't work in RocksDB or in disk mode";
-    memset(labels, -1, n * sizeof(idx_t) * k);
-    return;
-  }
-
+  // with the flat lists the raw vectors are read from the lists, otherwise
+  // from the whole raw vectors in memory by vid
+  faiss::InvertedLists *lists = this->invlists;
   ScopeVector<float> vector_head;
-  int vector_num = raw_vec_->GetVectorNum();
   float *raw_vec_head = nullptr;
-  if(raw_vec_->GetVectorHeader(0, vector_num, vector_head)) {
-    LOG(ERROR) << "Cann't get raw_vec head";
-    memset(labels, -1, n * sizeof(idx_t) * k);
-    return;
+  if (rt_flat_index_ptr_) {
+    lists = flat_invlists_;
   } else {
-    raw_vec_head = const_cast<float *>(vector_head.Get());
+    auto raw_vec_type = dynamic_cast<MmapRawVector<float> *>(raw_vec_);
+    if(raw_vec_type == nullptr || raw_vec_type->GetMemoryMode() == 0) {
+      LOG(WARNING) << "IVF FLAT cann't work in RocksDB or in disk mode "
+                   << "without ivf_flat_store";
+      memset(labels, -1, n * sizeof(idx_t) * k);
+      return;
+    }
+
+    int vector_num = raw_vec_->GetVectorNum();
+    if(raw_vec_->GetVectorHeader(0, vector_num, vector_head)) {
+      LOG(ERROR) << "Cann't get raw_vec head";
+      memset(labels, -1, n * sizeof(idx_t) * k);
+      return;
+    } else {
+      raw_vec_head = const_cast<float *>(vector_head.Get());
+    }
   }
 
   size_t raw_d = raw_vec_->GetDimension();
 
   size_t nprobe = condition->nprobe;
+  if (condition->trace != nullptr) {
+    condition->trace->SetNprobe(nprobe);
+  }
   
   using HeapForIP = faiss::CMin<float, idx_t>;
   using HeapForL2 = faiss::CMax<float, idx_t>;
@@ -522,9 +643,13 @@ void GammaIVFPQIndex::search_ivf_flat(
   size_t ndis = 0;
 #pragma omp parallel if(do_parallel) reduction(+: ndis)
   {
-    GammaInvertedListScanner *scanner = GetGammaIVFFlatScanner(raw_d);
+    GammaInvertedListScanner *scanner =
+        GetGammaIVFFlatScanner(raw_d, ivf_flat_store_);
     faiss::ScopeDeleter1<GammaInvertedListScanner> del(scanner);
     scanner->set_search_condition(condition);
+    if (condition->trace != nullptr) {
+      condition->trace->SetThreads(omp_get_num_threads());
+    }
 
     /****************************************************
     * Actual loops, depending on parallel_mode
@@ -548,7 +673,7 @@ void GammaIVFPQIndex::search_ivf_flat(
         for (size_t ik = 0; ik < nprobe; ik++) {
           nscan += scan_one_list (
               scanner, keys [i * nprobe + ik], coarse_dis[i * nprobe + ik], 
-              simi, idxi, k, this->nlist, this->invlists, store_pairs, 
+              simi, idxi, k, this->nlist, lists, store_pairs, 
               condition->ivf_flat, raw_vec_head);
   
           if (max_codes && nscan >= max_codes) {
@@ -573,7 +698,7 @@ void GammaIVFPQIndex::search_ivf_flat(
           ndis += scan_one_list (
               scanner, keys [i * nprobe + ik], coarse_dis[i * nprobe + ik], 
               local_dis.data(), local_idx.data(), k, this->nlist, 
-              this->invlists, store_pairs, condition->ivf_flat, raw_vec_head);
+              lists, store_pairs, condition->ivf_flat, raw_vec_head);
   
             // can't do the test on max_codes
         }
@@ -604,6 +729,7 @@ void GammaIVFPQIndex::search_ivf_flat(
       }
     }
   } // parallel section
+  utils::Metrics::Instance().Add(utils::kCounterCodesScanned, ndis);
 #ifdef PERFORMANCE_TESTING
   std::string compute_msg = "ivf flat compute ";
   compute_msg += std::to_string(n);
@@ -616,6 +742,9 @@ void GammaIVFPQIndex::search_preassigned(
     const float *coarse_dis, float *distances, idx_t *labels, int *total,
     bool store_pairs, const faiss::IVFSearchParameters *params) {
   int nprobe = condition->nprobe;
+  if (condition->trace != nullptr) {
+    condition->trace->SetNprobe(nprobe);
+  }
 
   long max_codes = params ? params->max_codes : this->max_codes;
 
@@ -630,10 +759,19 @@ void GammaIVFPQIndex::search_preassigned(
   using HeapForL2 = faiss::CMax<float, idx_t>;
 
   const int recall_num = condition->recall_num;
-  float *recall_distances = new float[n * recall_num];
-  idx_t *recall_labels = new idx_t[n * recall_num];
-  faiss::ScopeDeleter<float> del1(recall_distances);
-  faiss::ScopeDeleter<idx_t> del2(recall_labels);
+  float *recall_distances = nullptr;
+  idx_t *recall_labels = nullptr;
+  faiss::ScopeDeleter<float> del1;
+  faiss::ScopeDeleter<idx_t> del2;
+  if (condition->arena) {
+    recall_distances = condition->arena->AllocateArray<float>(n * recall_num);
+    recall_labels = condition->arena->AllocateArray<idx_t>(n * recall_num);
+  } else {
+    recall_distances = new float[n * recall_num];
+    recall_labels = new idx_t[n * recall_num];
+    del1.set(recall_distances);
+    del2.set(recall_labels);
+  }
 
   std::function<void(const float *, float *, idx_t *, float *, idx_t *)>
       compute_dis;
@@ -734,21 +872,19 @@ void GammaIVFPQIndex::search_preassigned(
                              docid_size > 1000 ? 1000 : docid_size, ',');
 #endif
 
-    std::vector<int> vid_list(docid_list.size() * MAX_VECTOR_NUM_PER_DOC);
-    int *vid_list_data = vid_list.data();
-    int *curr_ptr = vid_list_data;
+    std::vector<int> vid_list;
+    vid_list.reserve(docid_list.size());
+    std::vector<int> vids;
     for (size_t i = 0; i < docid_list.size(); i++) {
       if (bitmap::test(this->docids_bitmap_, docid_list[i])) {
         continue;
       }
 
-      int *vids = this->raw_vec_->docid2vid_[docid_list[i]];
-      if (vids) {
-        memcpy((void *)(curr_ptr), (void *)(vids + 1), sizeof(int) * vids[0]);
-        curr_ptr += vids[0];
-      }
+      this->raw_vec_->vid_mgr_->DocID2VID(docid_list[i], vids);
+      vid_list.insert(vid_list.end(), vids.begin(), vids.end());
     }
-    int vid_list_len = curr_ptr - vid_list_data;
+    int *vid_list_data = vid_list.data();
+    int vid_list_len = vid_list.size();
 
 #ifdef PERFORMANCE_TESTING
     double to_vid_end = utils::getmillisecs();
@@ -771,6 +907,9 @@ void GammaIVFPQIndex::search_preassigned(
           GetGammaInvertedListScanner(store_pairs);
       faiss::ScopeDeleter1<GammaInvertedListScanner> del(scanner);
       scanner->set_search_condition(condition);
+      if (condition->trace != nullptr) {
+        condition->trace->SetThreads(omp_get_num_threads());
+      }
 
 #pragma omp for
       for (int i = 0; i < n; i++) {  // loop over queries
@@ -803,8 +942,12 @@ void GammaIVFPQIndex::search_preassigned(
               reinterpret_cast<idx_t *>(bucket_vids[key].data());
 
           scanner->set_list(key, coarse_dis_i);
+          if (condition->trace != nullptr) {
+            condition->trace->AddList(key, ncode);
+          }
           scanner->scan_codes_pointer(ncode, codes, vids, recall_simi,
                                       recall_idxi, recall_num);
+          ndis += ncode;
         }
 
 #ifdef PERFORMANCE_TESTING
@@ -831,6 +974,14 @@ void GammaIVFPQIndex::search_preassigned(
 #endif
       }
     }
+    utils::Metrics::Instance().Add(utils::kCounterCodesScanned, ndis);
+    if (condition->has_rank) {
+      utils::Metrics::Instance().Add(utils::kCounterReranked,
+                                     (uint64_t)n * recall_num);
+      if (condition->trace != nullptr) {
+        condition->trace->AddReranked((long)n * recall_num);
+      }
+    }
     return;
   }
 #endif  // SMALL_DOC_NUM_OPTIMIZATION
@@ -841,6 +992,9 @@ void GammaIVFPQIndex::search_preassigned(
         GetGammaInvertedListScanner(store_pairs);
     faiss::ScopeDeleter1<GammaInvertedListScanner> del(scanner);
     scanner->set_search_condition(condition);
+    if (condition->trace != nullptr) {
+      condition->trace->SetThreads(omp_get_num_threads());
+    }
 
     if (condition->parallel_mode == 0) {  // parallelize over queries
 #pragma omp for
@@ -940,6 +1094,15 @@ void GammaIVFPQIndex::search_preassigned(
     }
   }  // parallel
 
+  utils::Metrics::Instance().Add(utils::kCounterCodesScanned, ndis);
+  if (condition->has_rank) {
+    utils::Metrics::Instance().Add(utils::kCounterReranked,
+                                   (uint64_t)n * recall_num);
+    if (condition->trace != nullptr) {
+      condition->trace->AddReranked((long)n * recall_num);
+    }
+  }
+
 #ifdef PERFORMANCE_TESTING
   std::string compute_msg = "compute ";
   compute_msg += std::to_string(n);
@@ -986,13 +1149,13 @@ int GammaIVFPQIndex::Search(const VectorQuery *query,
   for (size_t i = 0; i < n; i++) {
     int pos = 0;
 
-    std::map<int, int> docid2count;
+    DocidSet docid_set(utils::ArenaAllocator<int>(condition->arena));
     for (int j = 0; j < condition->topn; j++) {
       long *docid = result.docids + i * condition->topn + j;
       if (docid[0] == -1) continue;
       int vector_id = (int)docid[0];
       int real_docid = raw_vec_->vid_mgr_->VID2DocID(vector_id);
-      if (docid2count.find(real_docid) == docid2count.end()) {
+      if (docid_set.find(real_docid) == docid_set.end()) {
         int real_pos = i * condition->topn + pos;
         result.docids[real_pos] = real_docid;
         int ret = raw_vec_->GetSource(vector_id, result.sources[real_pos],
@@ -1004,7 +1167,7 @@ int GammaIVFPQIndex::Search(const VectorQuery *query,
         result.dists[real_pos] = result.dists[i * condition->topn + j];
 
         pos++;
-        docid2count[real_docid] = 1;
+        docid_set.insert(real_docid);
       }
     }
 
@@ -1299,8 +1462,15 @@ int GammaIVFPQIndex::Dump(const std::string &dir, int max_vid) {
     return 0;
   }
 
-  /* return rt_invert_index_ptr_->Dump( */
-  /*     dir, vec_name, std::min(max_vid, indexed_vec_count_ - 1)); */
+  max_vid = std::min(max_vid, indexed_vec_count_ - 1);
+  int ret = rt_invert_index_ptr_->Dump(dir, vec_name, max_vid);
+  if (ret >= 0 && rt_flat_index_ptr_) {
+    ret = rt_flat_index_ptr_->Dump(dir, vec_name + ".flat", max_vid);
+  }
+  if (ret < 0) {
+    LOG(ERROR) << "dump realtime inverted lists error, dir=" << dir;
+    return ret;
+  }
   return 0;
 }
 
@@ -1335,8 +1505,27 @@ int GammaIVFPQIndex::Load(const std::vector<std::string> &index_dirs) {
     return 0;  // it should train again after load
   }
 
-  /* indexed_vec_count_ = rt_invert_index_ptr_->Load(index_dirs, vec_name); */
-  indexed_vec_count_ = 0;
+  int loaded = rt_invert_index_ptr_->Load(index_dirs, vec_name);
+  if (loaded > 0 && rt_flat_index_ptr_ &&
+      rt_flat_index_ptr_->Load(index_dirs, vec_name + ".flat") != loaded) {
+    LOG(ERROR) << "ivf flat lists don't match the inverted lists";
+    loaded = -1;
+  }
+  if (loaded > raw_vec_->GetVectorNum()) {
+    LOG(ERROR) << "loaded " << loaded << " indexed vectors, but there are "
+               << raw_vec_->GetVectorNum() << " vectors";
+    loaded = -1;
+  }
+  if (loaded < 0) {
+    // the lists are rebuilt from the raw vectors
+    if (!rt_invert_index_ptr_->Init() ||
+        (rt_flat_index_ptr_ && !rt_flat_index_ptr_->Init())) {
+      LOG(ERROR) << "init realtime inverted lists error";
+      return -1;
+    }
+    loaded = 0;
+  }
+  indexed_vec_count_ = loaded;
 
   LOG(INFO) << "load: d=" << ivpq->d << ", ntotal=" << ivpq->ntotal
             << ", is_trained=" << ivpq->is_trained
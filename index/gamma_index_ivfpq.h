@@ -35,12 +35,14 @@
 #include "faiss/utils/hamming.h"
 #include "faiss/utils/utils.h"
 #include "field_range_index.h"
+#include "fp16.h"
 #include "gamma_common_data.h"
 #include "gamma_index.h"
 #include "gamma_index_flat.h"
 #include "log.h"
 #include "raw_vector.h"
 #include "realtime_invert_index.h"
+#include "vid_filter.h"
 
 namespace tig_gamma {
 
@@ -64,6 +66,16 @@ struct IndexIVFPQStats {
 // global var that collects them all
 extern IndexIVFPQStats indexIVFPQ_stats;
 
+/** how raw vectors are stored for ivf flat search. With none, the inverted
+ * lists are id lists of the raw vectors in memory, otherwise each list keeps
+ * copies of its vectors contiguously.
+ */
+enum IVFFlatStore {
+  kIVFFlatStoreNone = 0,
+  kIVFFlatStoreFloat,
+  kIVFFlatStoreFP16
+};
+
 // namespace {
 
 using idx_t = faiss::Index::idx_t;
@@ -524,6 +536,8 @@ struct GammaInvertedListScanner : faiss::InvertedListScanner {
     docids_bitmap_ = nullptr;
     raw_vec_ = nullptr;
     range_index_ptr_ = nullptr;
+    trace_ = nullptr;
+    vid_filter_ = nullptr;
   }
 
   virtual size_t scan_codes_pointer(size_t ncode, const uint8_t **codes,
@@ -550,11 +564,36 @@ struct GammaInvertedListScanner : faiss::InvertedListScanner {
 
   inline void set_search_condition(const GammaSearchCondition *condition) {
     this->range_index_ptr_ = condition->range_query_result;
+    this->trace_ = condition->trace;
+    this->vid_filter_ = condition->vid_filter;
+    if (vid_filter_ == nullptr) {
+      own_vid_filter_.Init(docids_bitmap_, raw_vec_->vid_mgr_,
+                           range_index_ptr_);
+      vid_filter_ = &own_vid_filter_;
+    }
+  }
+
+  /** the positions of a list passing the filter of the query, ascending.
+   * They are valid until the next call.
+   */
+  inline const int *FilterList(size_t ncode, const idx_t *ids,
+                               size_t &npass) const {
+    size_t n_deleted = 0;
+    npass = vid_filter_->Filter(ncode, ids, pos_, n_deleted);
+    if (trace_ != nullptr) {
+      // deleted docs of the bitmap are counted as filtered
+      trace_->AddSkipped(ncode - npass - n_deleted, n_deleted);
+    }
+    return pos_.data();
   }
 
   const char *docids_bitmap_;
   const RawVector<float> *raw_vec_;
   MultiRangeQueryResults *range_index_ptr_;
+  utils::QueryTrace *trace_;
+  const VidFilter *vid_filter_;
+  VidFilter own_vid_filter_;
+  mutable std::vector<int> pos_;
 };
 
 template <faiss::MetricType METRIC_TYPE, class C, int precompute_mode>
@@ -572,83 +611,31 @@ struct GammaIVFPQScanner : IVFPQScannerT<idx_t, METRIC_TYPE>,
                             SearchResultType &res) const {
     assert(this->pq.M % 4 == 0);
 
-    // set filter func
-    std::function<bool(int)> is_filterable;
-
-    if (range_index_ptr_ != nullptr) {
-      is_filterable = [this](int doc_id) -> bool {
-        return (bitmap::test(docids_bitmap_, doc_id) ||
-                (not range_index_ptr_->Has(doc_id)));
-      };
-    } else {
-      is_filterable = [this](int doc_id) -> bool {
-        return (bitmap::test(docids_bitmap_, doc_id));
-      };
-    }
-
-    // set compute distance func
-    std::function<float(const uint8_t *)> calc_dis;
-
-    if (this->pq.M % 4 == 0) {
-      calc_dis = [this](const uint8_t *codes) -> float {
-        float dis = this->dis0;
-        const float *tab = this->sim_table;
-
-        for (size_t m = 0; m < this->pq.M; m += 4) {
-          dis += tab[*codes++], tab += this->pq.ksub;
-          dis += tab[*codes++], tab += this->pq.ksub;
-          dis += tab[*codes++], tab += this->pq.ksub;
-          dis += tab[*codes++], tab += this->pq.ksub;
-        }
-
-        return dis;
-      };
-    } else {
-      calc_dis = [this](const uint8_t *codes) -> float {
-        float dis = this->dis0;
-        const float *tab = this->sim_table;
-
-        for (size_t m = 0; m < this->pq.M; m++) {
-          dis += tab[*codes++], tab += this->pq.ksub;
-        }
-
-        return dis;
-      };
-    }
-
-#define HANDLE_ONE                                                             \
-  do {                                                                         \
-    if (res.ids[j] & realtime::kDelIdxMask) {                                  \
-      codes += this->pq.M;                                                     \
-      j++;                                                                     \
-      continue;                                                                \
-    }                                                                          \
-    int doc_id =                                                               \
-        raw_vec_->vid_mgr_->VID2DocID(res.ids[j] & realtime::kRecoverIdxMask); \
-    if ((range_index_ptr_ != nullptr &&                                        \
-         (not range_index_ptr_->Has(doc_id))) ||                               \
-        bitmap::test(docids_bitmap_, doc_id)) {                                \
-      codes += this->pq.M; /* increment pointer */                             \
-      j++;                 /* increment j*/                                    \
-      continue;                                                                \
-    }                                                                          \
-                                                                               \
-    float dis = this->dis0;                                                    \
-    const float *tab = this->sim_table;                                        \
-    for (size_t m = 0; m < this->pq.M; m += 4) {                               \
-      dis += tab[*codes++], tab += this->pq.ksub;                              \
-      dis += tab[*codes++], tab += this->pq.ksub;                              \
-      dis += tab[*codes++], tab += this->pq.ksub;                              \
-      dis += tab[*codes++], tab += this->pq.ksub;                              \
-    }                                                                          \
-                                                                               \
-    res.add(j, dis);                                                           \
-                                                                               \
-    j++; /* increment j */                                                     \
+    // filter the whole list first, then compute the distances of the passed
+    // positions without any branch
+    size_t npass = 0;
+    const int *pos = FilterList(ncode, res.ids, npass);
+
+#define HANDLE_ONE                                         \
+  do {                                                     \
+    size_t j = pos[i];                                     \
+    const uint8_t *code = codes + j * this->pq.M;          \
+    float dis = this->dis0;                                \
+    const float *tab = this->sim_table;                    \
+    for (size_t m = 0; m < this->pq.M; m += 4) {           \
+      dis += tab[*code++], tab += this->pq.ksub;           \
+      dis += tab[*code++], tab += this->pq.ksub;           \
+      dis += tab[*code++], tab += this->pq.ksub;           \
+      dis += tab[*code++], tab += this->pq.ksub;           \
+    }                                                      \
+                                                           \
+    res.add(j, dis);                                       \
+                                                           \
+    i++; /* increment i */                                 \
   } while (0)
-    size_t j = 0;
-    size_t loops = ncode / 8;
-    for (size_t i = 0; i < loops; i++) {
+    size_t i = 0;
+    size_t loops = npass / 8;
+    for (size_t l = 0; l < loops; l++) {
       HANDLE_ONE;  // 1
       HANDLE_ONE;  // 2
       HANDLE_ONE;  // 3
@@ -659,7 +646,7 @@ struct GammaIVFPQScanner : IVFPQScannerT<idx_t, METRIC_TYPE>,
       HANDLE_ONE;  // 8
     }
 
-    switch (ncode % 8) {
+    switch (npass % 8) {
       case 7:
         HANDLE_ONE;
       case 6:
@@ -676,7 +663,7 @@ struct GammaIVFPQScanner : IVFPQScannerT<idx_t, METRIC_TYPE>,
         HANDLE_ONE;
     }
 
-    assert(j == ncode);
+    assert(i == npass);
 
 #undef HANDLE_ONE
   }
@@ -805,8 +792,10 @@ struct GammaIVFPQScanner : IVFPQScannerT<idx_t, METRIC_TYPE>,
 template<faiss::MetricType metric, class C>
 struct GammaIVFFlatScanner: GammaInvertedListScanner {
   size_t d;
+  IVFFlatStore store;
 
-  GammaIVFFlatScanner(size_t d):d(d) {}
+  GammaIVFFlatScanner(size_t d, IVFFlatStore store = kIVFFlatStoreNone)
+      : d(d), store(store) {}
 
   const float *xi;
   void set_query (const float *query) override {
@@ -819,48 +808,65 @@ struct GammaIVFFlatScanner: GammaInvertedListScanner {
   }
 
   float distance_to_code (const uint8_t *code) const override {
+    if (store == kIVFFlatStoreFP16) {
+      const uint16_t *yj = (const uint16_t *)code;
+      return metric == faiss::METRIC_INNER_PRODUCT
+                 ? utils::InnerProductFP16(xi, yj, d)
+                 : utils::L2SqrFP16(xi, yj, d);
+    }
     const float *yj = (float*)code;
     float dis = metric == faiss::METRIC_INNER_PRODUCT ?
       faiss::fvec_inner_product (xi, yj, d) : faiss::fvec_L2sqr (xi, yj, d);
     return dis;
    }
 
+  /** codes are the raw vectors indexed by vid with kIVFFlatStoreNone,
+   * otherwise they are the vectors of the list in the order of ids
+   */
   inline size_t scan_codes (size_t list_size,
                        const uint8_t *codes,
                        const idx_t *ids,
                        float *simi, idx_t *idxi,
                        size_t k) const override
   {
-    // set filter func
-    std::function<bool(int)> is_filterable;
-
-    if (range_index_ptr_ != nullptr) {
-      is_filterable = [this](int doc_id) -> bool {
-        return (bitmap::test(docids_bitmap_, doc_id) ||
-                (not range_index_ptr_->Has(doc_id)));
-      };
-    } else {
-      is_filterable = [this](int doc_id) -> bool {
-        return (bitmap::test(docids_bitmap_, doc_id));
-      };
+    switch (store) {
+      case kIVFFlatStoreFloat:
+        return scan<kIVFFlatStoreFloat>(list_size, codes, ids, simi, idxi, k);
+      case kIVFFlatStoreFP16:
+        return scan<kIVFFlatStoreFP16>(list_size, codes, ids, simi, idxi, k);
+      default:
+        return scan<kIVFFlatStoreNone>(list_size, codes, ids, simi, idxi, k);
     }
+  }
+
+  template <IVFFlatStore kStore>
+  size_t scan (size_t list_size, const uint8_t *codes, const idx_t *ids,
+               float *simi, idx_t *idxi, size_t k) const
+  {
+    size_t npass = 0;
+    const int *pos = FilterList(list_size, ids, npass);
 
     const float *list_vecs = (const float*)codes;
     size_t nup = 0;
-    for (size_t j = 0; j < list_size; j++) {
-      if(ids[j] & realtime::kDelIdxMask) continue;
-      idx_t vid = ids[j] & realtime::kRecoverIdxMask;
-      if(vid < 0) continue;
-      int doc_id = raw_vec_->vid_mgr_->VID2DocID(vid);
-      if(doc_id < 0) continue;
-      if(is_filterable(doc_id)) continue;
-
-      const float *yj = list_vecs + d * vid;
-      float dis = metric == faiss::METRIC_INNER_PRODUCT ?
-        faiss::fvec_inner_product (xi, yj, d) : faiss::fvec_L2sqr (xi, yj, d);
+    for (size_t i = 0; i < npass; i++) {
+      size_t j = pos[i];
+      idx_t vid = ids[j];  // passed ids aren't marked deleted
+
+      float dis;
+      if (kStore == kIVFFlatStoreFP16) {
+        const uint16_t *yj = (const uint16_t *)codes + d * j;
+        dis = metric == faiss::METRIC_INNER_PRODUCT
+                  ? utils::InnerProductFP16(xi, yj, d)
+                  : utils::L2SqrFP16(xi, yj, d);
+      } else {
+        const float *yj =
+            list_vecs + d * (kStore == kIVFFlatStoreNone ? vid : j);
+        dis = metric == faiss::METRIC_INNER_PRODUCT ?
+          faiss::fvec_inner_product (xi, yj, d) : faiss::fvec_L2sqr (xi, yj, d);
+      }
       if (C::cmp (simi[0], dis)) {
         faiss::heap_pop<C> (k, simi, idxi);
-        faiss::heap_push<C> (k, simi, idxi, dis, doc_id);
+        faiss::heap_push<C> (k, simi, idxi, dis, vid);
         nup++;
       }
     }
@@ -883,7 +889,25 @@ struct GammaIVFPQIndex : GammaFLATIndex, faiss::IndexIVFPQ {
   faiss::InvertedListScanner *get_InvertedListScanner(
       bool store_pairs) const override;
 
-  GammaInvertedListScanner *GetGammaIVFFlatScanner(size_t d) const;
+  GammaInvertedListScanner *GetGammaIVFFlatScanner(
+      size_t d, IVFFlatStore store = kIVFFlatStoreNone) const;
+
+  /** keep copies of the raw vectors in separate inverted lists, so ivf flat
+   * search reads each list sequentially and works in any storage mode. It
+   * should be set before vectors are added.
+   *
+   * @return 0 if successed
+   */
+  int SetIVFFlatStore(IVFFlatStore store);
+
+  // applies to the flat lists too, so it's set after SetIVFFlatStore()
+  void SetCompactionOptions(const realtime::CompactionOptions &options);
+
+  size_t FlatCodeSize() const;
+
+  // encode n vectors of stride floats into the codes of the flat lists
+  void EncodeFlat(int n, const float *vec, size_t stride,
+                  uint8_t *codes) const;
 
   GammaInvertedListScanner *GetGammaInvertedListScanner(bool store_pairs) const;
 
@@ -919,7 +943,9 @@ struct GammaIVFPQIndex : GammaFLATIndex, faiss::IndexIVFPQ {
     if (!rt_invert_index_ptr_) {
       return 0;
     }
-    return rt_invert_index_ptr_->GetTotalMemBytes();
+    long bytes = rt_invert_index_ptr_->GetTotalMemBytes();
+    if (rt_flat_index_ptr_) bytes += rt_flat_index_ptr_->GetTotalMemBytes();
+    return bytes;
   }
 
   int Dump(const std::string &dir, int max_vid) override;
@@ -933,6 +959,10 @@ struct GammaIVFPQIndex : GammaFLATIndex, faiss::IndexIVFPQ {
 
   int indexed_vec_count_;
   realtime::RTInvertIndex *rt_invert_index_ptr_;
+  // raw vector copies of kIVFFlatStoreFloat or kIVFFlatStoreFP16
+  IVFFlatStore ivf_flat_store_;
+  realtime::RTInvertIndex *rt_flat_index_ptr_;
+  faiss::InvertedLists *flat_invlists_;
   bool compaction_;
   size_t compact_bucket_no_;
   uint64_t compacted_num_;
@@ -0,0 +1,120 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "range_query_cache.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "utils.h"
+
+namespace tig_gamma {
+
+namespace {
+
+// length prefixed, so adjacent values can't be confused
+void AppendString(std::string &key, const std::string &value) {
+  int len = value.size();
+  key.append(reinterpret_cast<const char *>(&len), sizeof(len));
+  key.append(value);
+}
+
+}  // namespace
+
+RangeQueryCache::RangeQueryCache(int fields_num)
+    : versions_(new std::atomic<uint64_t>[fields_num]()),
+      max_bytes_(0),
+      bytes_(0),
+      hits_(0),
+      misses_(0) {}
+
+void RangeQueryCache::SetCapacity(long max_bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_bytes_ = max_bytes > 0 ? max_bytes : 0;
+  Evict(max_bytes_);
+}
+
+void RangeQueryCache::MakeKey(int field, const std::string &lower,
+                              const std::string &upper, int is_union,
+                              const char *delim, std::string &key) {
+  key.clear();
+  key.append(reinterpret_cast<const char *>(&field), sizeof(field));
+  if (delim == nullptr) {
+    AppendString(key, lower);
+    AppendString(key, upper);
+    return;
+  }
+  std::vector<std::string> items = utils::split(lower, delim);
+  std::sort(items.begin(), items.end());
+  items.erase(std::unique(items.begin(), items.end()), items.end());
+  key.append(1, is_union ? 1 : 0);
+  for (const std::string &item : items) {
+    AppendString(key, item);
+  }
+}
+
+bool RangeQueryCache::Get(const std::string &key, int field, int &retval,
+                          std::shared_ptr<const RangeQueryResult> &result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto &it = items_.find(key);
+  if (it == items_.end()) {
+    ++misses_;
+    return false;
+  }
+  Entry &entry = *it->second;
+  if (entry.version != versions_[field]) {
+    bytes_ -= entry.bytes;
+    lru_.erase(it->second);
+    items_.erase(it);
+    ++misses_;
+    return false;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second);
+  retval = entry.retval;
+  result = entry.result;
+  ++hits_;
+  return true;
+}
+
+void RangeQueryCache::Put(const std::string &key, int field, uint64_t version,
+                          int retval,
+                          std::shared_ptr<const RangeQueryResult> result) {
+  long bytes = sizeof(Entry) + key.size() * 2;
+  if (result != nullptr && retval > 0) {
+    bytes += sizeof(RangeQueryResult) +
+             (result->MaxAligned() - result->MinAligned() + 1) / 8;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // the field may be changed while it's searched
+  if (version != versions_[field] || bytes > max_bytes_) return;
+  const auto &it = items_.find(key);
+  if (it != items_.end()) {
+    bytes_ -= it->second->bytes;
+    lru_.erase(it->second);
+    items_.erase(it);
+  }
+  Evict(max_bytes_ - bytes);
+  lru_.push_front(Entry{key, field, version, retval, bytes, result});
+  items_[key] = lru_.begin();
+  bytes_ += bytes;
+}
+
+void RangeQueryCache::Evict(long max_bytes) {
+  while (bytes_ > max_bytes && not lru_.empty()) {
+    bytes_ -= lru_.back().bytes;
+    items_.erase(lru_.back().key);
+    lru_.pop_back();
+  }
+}
+
+long RangeQueryCache::MemoryBytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+}  // namespace tig_gamma
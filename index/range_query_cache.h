@@ -0,0 +1,100 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef RANGE_QUERY_CACHE_H_
+#define RANGE_QUERY_CACHE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "range_query_result.h"
+
+namespace tig_gamma {
+
+/** LRU cache of materialized results of single filters, bounded by the bytes
+ * of their bitmaps. Results are shared by concurrent queries and must not be
+ * modified once cached.
+ *
+ * Each field has a version which is bumped after a doc of the field is added
+ * to or deleted from the range index, an entry built on an older version is
+ * stale and dropped when it's looked up. It's thread safe.
+ */
+class RangeQueryCache {
+ public:
+  explicit RangeQueryCache(int fields_num);
+
+  /** @param max_bytes max memory of cached results, the cache is disabled if
+   * 0
+   */
+  void SetCapacity(long max_bytes);
+
+  bool Enabled() const { return max_bytes_ > 0; }
+
+  /** make the key of a filter, items of a string "or" filter are sorted and
+   * deduplicated so their order doesn't matter
+   *
+   * @param delim delimiter of items, null for a numeric field
+   */
+  static void MakeKey(int field, const std::string &lower,
+                      const std::string &upper, int is_union,
+                      const char *delim, std::string &key);
+
+  uint64_t Version(int field) const { return versions_[field]; }
+
+  // called by the field operate worker after the index of field is changed
+  void Invalidate(int field) { ++versions_[field]; }
+
+  /** @param retval output, return value of searching the filter
+   * @param result output, null if the result is empty
+   * @return true if hit
+   */
+  bool Get(const std::string &key, int field, int &retval,
+           std::shared_ptr<const RangeQueryResult> &result);
+
+  /** @param version version of field before it's searched */
+  void Put(const std::string &key, int field, uint64_t version, int retval,
+           std::shared_ptr<const RangeQueryResult> result);
+
+  long Hits() const { return hits_; }
+
+  long Misses() const { return misses_; }
+
+  long MemoryBytes();
+
+ private:
+  struct Entry {
+    std::string key;
+    int field;
+    uint64_t version;
+    int retval;
+    long bytes;
+    std::shared_ptr<const RangeQueryResult> result;
+  };
+
+  void Evict(long max_bytes);
+
+  std::unique_ptr<std::atomic<uint64_t>[]> versions_;
+
+  std::mutex mutex_;
+  std::atomic<long> max_bytes_;
+  long bytes_;
+  std::list<Entry> lru_;  // the most recently used at front
+  std::unordered_map<std::string, std::list<Entry>::iterator> items_;
+
+  std::atomic<long> hits_;
+  std::atomic<long> misses_;
+};
+
+}  // namespace tig_gamma
+
+#endif  // RANGE_QUERY_CACHE_H_
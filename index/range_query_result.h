@@ -11,6 +11,7 @@
 #include <cassert>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <string>
 #include <vector>
 #include "bitmap.h"
@@ -102,11 +103,13 @@ class RangeQueryResult {
   int Min() const { return min_; }
   int Max() const { return max_; }
 
-  int MinAligned() { return min_aligned_; }
-  int MaxAligned() { return max_aligned_; }
+  int MinAligned() const { return min_aligned_; }
+  int MaxAligned() const { return max_aligned_; }
 
   char *&Ref() { return bitmap_; }
 
+  const char *Data() const { return bitmap_; }
+
   void SetDocNum(int num) { n_doc_ = num; }
 
   /**
@@ -132,10 +135,7 @@ class MultiRangeQueryResults {
  public:
   MultiRangeQueryResults() { Clear(); }
 
-  ~MultiRangeQueryResults() {
-    delete all_results_;
-    all_results_ = nullptr;
-  }
+  ~MultiRangeQueryResults() {}
 
   // Take full advantage of multi-core while recalling
   bool Has(int doc) const {
@@ -148,11 +148,17 @@ class MultiRangeQueryResults {
   void Clear() {
     min_ = 0;
     max_ = std::numeric_limits<int>::max();
-    all_results_ = nullptr;
+    all_results_.reset();
   }
 
  public:
+  // take the ownership of r
   void Add(RangeQueryResult *r) {
+    Add(std::shared_ptr<const RangeQueryResult>(r));
+  }
+
+  // r may be shared with other queries, it's read only
+  void Add(std::shared_ptr<const RangeQueryResult> r) {
     all_results_ = r;
 
     // the maximum of the minimum(s)
@@ -173,13 +179,13 @@ class MultiRangeQueryResults {
    */
   std::vector<int> ToDocs() const;
 
-  const RangeQueryResult *GetAllResult() const { return all_results_; }
+  const RangeQueryResult *GetAllResult() const { return all_results_.get(); }
 
  private:
   int min_;
   int max_;
 
-  RangeQueryResult *all_results_;
+  std::shared_ptr<const RangeQueryResult> all_results_;
 };
 
 }  // namespace tig_gamma
@@ -0,0 +1,93 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "vid_filter.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace tig_gamma {
+
+VidFilter::VidFilter()
+    : docids_bitmap_(nullptr),
+      vid2docid_(nullptr),
+      windowed_(true),
+      min_vid_(0),
+      nbits_(0),
+      bits_(1, 0) {}
+
+int VidFilter::Init(const char *docids_bitmap, const VIDMgr *vid_mgr,
+                    const MultiRangeQueryResults *range) {
+  // an empty window until it's initialized, so nothing passes on error
+  windowed_ = true;
+  min_vid_ = 0;
+  nbits_ = 0;
+  bits_.assign(1, 0);
+  if (docids_bitmap == nullptr || vid_mgr == nullptr) {
+    LOG(ERROR) << "docids_bitmap or vid_mgr is NULL!";
+    return -1;
+  }
+  docids_bitmap_ = docids_bitmap;
+  vid2docid_ = vid_mgr->multi_vids_ ? vid_mgr->vid2docid_.get() : nullptr;
+  windowed_ = range != nullptr;
+  if (not windowed_) return 0;
+
+  // no doc passes if there isn't any result
+  const RangeQueryResult *result = range->GetAllResult();
+  if (result == nullptr || result->Data() == nullptr) return 0;
+
+  if (vid_mgr->multi_vids_) {
+    InitWindowMultiVids(result, vid_mgr);
+  } else {
+    InitWindow(result);
+  }
+  return 0;
+}
+
+// vid is docid, so the window is the bitmap of the result without the
+// deleted docs, both of which are aligned to bytes
+void VidFilter::InitWindow(const RangeQueryResult *result) {
+  int min_aligned = result->MinAligned();
+  size_t nbytes = (result->MaxAligned() - min_aligned + 1) / 8;
+  min_vid_ = min_aligned;
+  nbits_ = nbytes * 8;
+  bits_.assign(nbytes / 8 + 1, 0);
+
+  uint8_t *bits = reinterpret_cast<uint8_t *>(bits_.data());
+  const uint8_t *deleted =
+      reinterpret_cast<const uint8_t *>(docids_bitmap_) + min_aligned / 8;
+  memcpy(bits, result->Data(), nbytes);
+  for (size_t i = 0; i < nbytes; i++) {
+    bits[i] &= ~deleted[i];
+  }
+}
+
+void VidFilter::InitWindowMultiVids(const RangeQueryResult *result,
+                                    const VIDMgr *vid_mgr) {
+  std::vector<int> vids;
+  for (int docid = result->Min(); docid <= result->Max(); docid++) {
+    if (not result->Has(docid) || bitmap::test(docids_bitmap_, docid)) {
+      continue;
+    }
+    int num = 0;
+    const int *vid_list = vid_mgr->DocVIDs(docid, num);
+    vids.insert(vids.end(), vid_list, vid_list + num);
+  }
+  if (vids.empty()) return;
+
+  auto minmax = std::minmax_element(vids.begin(), vids.end());
+  min_vid_ = *minmax.first;
+  nbits_ = *minmax.second - min_vid_ + 1;
+  bits_.assign(nbits_ / 64 + 1, 0);
+  for (int vid : vids) {
+    uint64_t off = vid - min_vid_;
+    bits_[off >> 6] |= (uint64_t)1 << (off & 63);
+  }
+}
+
+}  // namespace tig_gamma
@@ -0,0 +1,117 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef INDEX_VID_FILTER_H_
+#define INDEX_VID_FILTER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "bitmap.h"
+#include "range_query_result.h"
+#include "raw_vector_common.h"
+
+namespace tig_gamma {
+
+/** the vectors a query may return, built once per query from the deleted
+ * docs and the range filter. With a range filter, they are translated into a
+ * bitmap of the vids in the range, so a vid is tested by a single bit instead
+ * of VID2DocID, the deletion bitmap and the range result each.
+ *
+ * Scanners call Filter() on the ids of a list to get the positions passing
+ * it, then compute the distances of these positions only.
+ */
+class VidFilter {
+ public:
+  VidFilter();
+
+  /** @param range  the range filter of the query, nullptr if none
+   * @return 0 if successed
+   */
+  int Init(const char *docids_bitmap, const VIDMgr *vid_mgr,
+           const MultiRangeQueryResults *range);
+
+  bool Pass(int64_t vid) const {
+    if (windowed_) return PassWindow(vid);
+    return PassDocid(vid);
+  }
+
+  /** compact the positions of ids passing the filter into pos without
+   * branches. The sign bit of an id is the deletion mark of the realtime
+   * buckets, such ids don't pass. All positions pass if ids is nullptr.
+   *
+   * @param pos        resized to n if it is smaller
+   * @param n_deleted  add the number of ids marked deleted
+   * @return the number of passed positions
+   */
+  size_t Filter(size_t n, const int64_t *ids, std::vector<int> &pos,
+                size_t &n_deleted) const {
+    if (pos.size() < n) pos.resize(n);
+    if (ids == nullptr) {
+      for (size_t j = 0; j < n; j++) pos[j] = (int)j;
+      return n;
+    }
+    if (windowed_) {
+      return FilterIds(n, ids, pos.data(), n_deleted,
+                       [this](int64_t vid) { return PassWindow(vid); });
+    }
+    return FilterIds(n, ids, pos.data(), n_deleted,
+                     [this](int64_t vid) { return PassDocid(vid); });
+  }
+
+ private:
+  template <class PassFunc>
+  static size_t FilterIds(size_t n, const int64_t *ids, int *pos,
+                          size_t &n_deleted, PassFunc pass) {
+    size_t npass = 0, ndel = 0;
+    for (size_t j = 0; j < n; j++) {
+      int64_t id = ids[j];
+      bool del = id < 0;
+      pos[npass] = (int)j;
+      npass += (not del) & pass(id & INT64_MAX);
+      ndel += del;
+    }
+    n_deleted += ndel;
+    return npass;
+  }
+
+  // out of the window is read as bit 0 and masked
+  bool PassWindow(int64_t vid) const {
+    uint64_t off = (uint64_t)(vid - min_vid_);
+    bool in = off < nbits_;
+    off = in ? off : 0;
+    return in & ((bits_[off >> 6] >> (off & 63)) & 1);
+  }
+
+  // a vid of no doc is -1 in vid2docid_
+  bool PassDocid(int64_t vid) const {
+    int docid = vid2docid_ ? (*vid2docid_)[vid] : (int)vid;
+    bool valid = docid >= 0;
+    docid = valid ? docid : 0;
+    return valid & (not bitmap::test(docids_bitmap_, docid));
+  }
+
+  void InitWindow(const RangeQueryResult *result);
+
+  void InitWindowMultiVids(const RangeQueryResult *result,
+                           const VIDMgr *vid_mgr);
+
+  const char *docids_bitmap_;
+  // nullptr if a doc has only one vector
+  const utils::PagedArray<int> *vid2docid_;
+
+  // with a range filter, bit i of bits_ is whether vid min_vid_ + i passes
+  bool windowed_;
+  int64_t min_vid_;
+  uint64_t nbits_;
+  std::vector<uint64_t> bits_;
+};
+
+}  // namespace tig_gamma
+
+#endif  // INDEX_VID_FILTER_H_
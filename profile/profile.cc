@@ -9,7 +9,10 @@
 
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <string>
 
@@ -25,38 +28,91 @@ using namespace rocksdb;
 namespace tig_gamma {
 
 const static string kProfileDumpedNum = "profile_dumped_num";
+const static string kProfileRowsFile = "profile.rows";
+const static string kProfileStrFile = "profile.str";
+const static string kProfileKeysFile = "profile.keys";
+const static uint32_t kSnapshotMagic = 0x46525047;  // "GPRF"
+const static uint32_t kSnapshotVersion = 1;
+// the key index grows from it as docs are added
+const static uint64_t kInitKeyIndexDocs = 1 << 16;
+
+namespace {
+
+/** header of profile snapshot files, it is followed by data_bytes of rows or
+ * strings, rows are item_length bytes each and their string offsets are the
+ * offsets in the string file
+ */
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  int64_t doc_num;
+  int64_t item_length;
+  int64_t data_bytes;
+};
+
+void RemoveSnapshot(const string &folder) {
+  remove((folder + "/" + kProfileStrFile).c_str());
+  remove((folder + "/" + kProfileRowsFile).c_str());
+  remove((folder + "/" + kProfileKeysFile).c_str());
+}
+
+}  // namespace
 
 Profile::Profile(const int max_doc_size, const string &root_path) {
   item_length_ = 0;
   field_num_ = 0;
   key_idx_ = -1;
   mem_ = nullptr;
-  str_mem_ = nullptr;
+  str_mems_[0] = nullptr;
+  str_mems_[1] = nullptr;
+  str_cur_ = 0;
   max_profile_size_ = max_doc_size;
   max_str_size_ = max_profile_size_ * 128;
   str_offset_ = 0;
+  str_garbage_bytes_ = 0;
+  str_reserved_ = 0;
+  str_seq_ = 0;
+  str_compacting_ = false;
+  str_compactor_ = nullptr;
+  str_epoch_ = 0;
+  str_readers_[0] = 0;
+  str_readers_[1] = 0;
+  doc_num_ = 0;
+  key_index_ = nullptr;
   db_path_ = root_path + "/profile";
 
-  // TODO : there is a failure.
-  // if (!item_to_docid_.reserve(max_doc_size)) {
-  //   LOG(ERROR) << "item_to_docid reserve failed, max_doc_size [" <<
-  //   max_doc_size
-  //              << "]";
-  // }
-
   table_created_ = false;
   LOG(INFO) << "Profile created success!";
 }
 
 Profile::~Profile() {
+  if (str_compactor_ != nullptr) {
+    str_compactor_->join();
+    delete str_compactor_;
+    str_compactor_ = nullptr;
+  }
+
   if (mem_ != nullptr) {
     delete[] mem_;
   }
 
-  if (str_mem_ != nullptr) {
-    delete[] str_mem_;
+  for (int i = 0; i < 2; i++) {
+    if (str_mems_[i] != nullptr) {
+      delete[] str_mems_[i];
+      str_mems_[i] = nullptr;
+    }
+  }
+
+  for (auto *interns : str_interns_) {
+    if (interns != nullptr) delete interns;
   }
 
+  for (ProfileColumn *column : columns_) {
+    if (column != nullptr) delete column;
+  }
+  columns_.clear();
+  CHECK_DELETE(key_index_);
+
 #ifdef WITH_ROCKSDB
   if (db_) {
     delete db_;
@@ -77,24 +133,141 @@ Profile::~Profile() {
   LOG(INFO) << "Profile deleted.";
 }
 
-int Profile::Load(const std::vector<string> &folders, int &doc_num) {
+int Profile::LoadDocNum(const std::vector<string> &folders, int &doc_num) {
   doc_num = 0;
+  string folder = FindSnapshot(folders);
+  if (folder != "") {
+    string rows_file = folder + "/" + kProfileRowsFile;
+    SnapshotHeader header;
+    int fd = open(rows_file.c_str(), O_RDONLY);
+    if (fd == -1) {
+      LOG(ERROR) << "open " << rows_file << " error: " << strerror(errno);
+      return -1;
+    }
+    ssize_t bytes = utils::pread_n(fd, (char *)&header, sizeof(header), 0);
+    close(fd);
+    if (bytes != sizeof(header) || header.magic != kSnapshotMagic ||
+        header.doc_num < 0) {
+      LOG(ERROR) << "invalid snapshot header of " << rows_file;
+      return -1;
+    }
+    doc_num = (int)header.doc_num;
+    return 0;
+  }
 #ifdef WITH_ROCKSDB
   string value;
   rocksdb::Status s =
       db_->Get(rocksdb::ReadOptions(), kProfileDumpedNum, &value);
   if (!s.ok()) {
-    LOG(INFO) << "the key=" << kProfileDumpedNum
-              << " isn't in db, skip loading";
-    doc_num = 0;
+    LOG(INFO) << "the key=" << kProfileDumpedNum << " isn't in db";
     return 0;
   }
   doc_num = std::stoi(value, 0, 10);
   if (doc_num < 0) {
     LOG(ERROR) << "invalid doc num of db, value=" << value;
+    doc_num = 0;
     return -1;
   }
+#endif
+  return 0;
+}
+
+string Profile::FindSnapshot(const std::vector<string> &folders) const {
+  for (auto it = folders.rbegin(); it != folders.rend(); ++it) {
+    string str_file = *it + "/" + kProfileStrFile;
+    if (utils::get_file_size(str_file) > 0) return *it;
+  }
+  return "";
+}
+
+int Profile::Load(const std::vector<string> &folders, int &doc_num) {
+  doc_num = 0;
+  if (LoadDocNum(folders, doc_num)) return -1;
+  if (doc_num == 0) {
+    LOG(INFO) << "no profile is dumped, skip loading";
+    return 0;
+  }
   LOG(INFO) << "begin to load profile, doc num=" << doc_num;
+  double start = utils::getmillisecs();
+
+  string folder = FindSnapshot(folders);
+  int ret = folder != "" ? LoadSnapshot(folder, doc_num) : LoadFromDB(doc_num);
+  if (ret != 0) {
+    LOG(ERROR) << "load profile rows error, ret=" << ret;
+    return ret;
+  }
+  if (folder != "") RetainSnapshots(folders, folder);
+
+  for (int field_id = 0; field_id < (int)columns_.size(); field_id++) {
+    ProfileColumn *column = columns_[field_id];
+    if (column == nullptr) continue;
+    int field_offset = idx_attr_offset_[field_id];
+#pragma omp parallel for
+    for (int docid = 0; docid < doc_num; docid++) {
+      column->Set(docid, mem_ + (long)docid * item_length_ + field_offset);
+    }
+  }
+  doc_num_ = doc_num;
+
+  const string str_id = "_id";
+  const auto &iter = attr_idx_map_.find(str_id);
+  if (iter == attr_idx_map_.end()) {
+    LOG(ERROR) << "cannot find field [" << str_id << "]";
+    return -1;
+  }
+
+  int idx = iter->second;
+
+#ifdef USE_BTREE
+#pragma omp parallel for
+  for (int i = 0; i < doc_num; ++i) {
+    long key = -1;
+    GetField<long>(i, idx, key);
+    BtDb *bt = bt_open(cache_mgr_, main_mgr_);
+    BTERR bterr = bt_insertkey(
+        bt->main, reinterpret_cast<unsigned char *>(&key), sizeof(key), 0,
+        static_cast<void *>(&i), sizeof(int), Unique);
+    if (bterr) {
+      LOG(ERROR) << "Error " << bt->mgr->err;
+    }
+    bt_close(bt);
+  }
+#else
+  double key_start = utils::getmillisecs();
+  if (folder == "" ||
+      key_index_->Load(folder + "/" + kProfileKeysFile, doc_num)) {
+    LOG(INFO) << "build key index of " << doc_num << " docs";
+    auto fingerprint = [&](int docid) -> uint64_t {
+      if (id_type_ == 0) {
+        char *key = nullptr;
+        int len = GetFieldString(docid, idx, &key);
+        return ProfileKeyIndex::Fingerprint(key, len);
+      }
+      long key = -1;
+      GetField<long>(docid, idx, key);
+      return ProfileKeyIndex::Fingerprint(key);
+    };
+    auto same = [&](int docid, int other) {
+      char *key = nullptr;
+      int len = GetFieldString(docid, idx, &key);
+      return KeyEquals(other, string(key, len));
+    };
+    if (key_index_->Build(doc_num, fingerprint, same)) {
+      LOG(ERROR) << "build key index error";
+      return -1;
+    }
+  }
+  LOG(INFO) << "key index is ready, cost " << utils::getmillisecs() - key_start
+            << "ms";
+#endif
+
+  LOG(INFO) << "Profile load successed! doc num=" << doc_num << ", cost "
+            << utils::getmillisecs() - start << "ms";
+  return 0;
+}
+
+int Profile::LoadFromDB(int doc_num) {
+#ifdef WITH_ROCKSDB
   rocksdb::Iterator *it = db_->NewIterator(rocksdb::ReadOptions());
   string start_key;
   ToRowKey(0, start_key);
@@ -109,51 +282,225 @@ int Profile::Load(const std::vector<string> &folders, int &doc_num) {
     const char *data = value.data_;
     memcpy((void *)(mem_ + (long)c * item_length_), data, item_length_);
     data += item_length_;
-    memcpy(str_mem_ + str_offset_, data, value.size_ - item_length_);
     for (int field_id = 0; field_id < (int)idx_attr_offset_.size();
          field_id++) {
       if (attrs_[field_id] != STRING) continue;
       int field_offset = idx_attr_offset_[field_id];
       char *field = mem_ + (long)c * item_length_ + field_offset;
-      memcpy((void *)field, (void *)&str_offset_, sizeof(uint64_t));
       uint16_t field_len = 0;
       memcpy((void *)&field_len, (field + sizeof(uint64_t)), sizeof(field_len));
-      str_offset_ += field_len;
+      uint64_t str_offset = 0;
+      if (AppendString(field_id, data, field_len, str_offset)) {
+        LOG(ERROR) << "Str memory reached max size [" << max_str_size_
+                   << "], count=" << c;
+        delete it;
+        return 3;
+      }
+      memcpy((void *)field, (void *)&str_offset, sizeof(uint64_t));
+      data += field_len;
     }
   }
   delete it;
+  return 0;
+#else
+  LOG(ERROR) << "no profile snapshot is found, and rocksdb is need when "
+                "compiling for loading the old profile dump";
+  return -1;
+#endif
+}
 
-  const string str_id = "_id";
-  const auto &iter = attr_idx_map_.find(str_id);
-  if (iter == attr_idx_map_.end()) {
-    LOG(ERROR) << "cannot find field [" << str_id << "]";
+int Profile::DumpSnapshot(const string &path, int doc_num) {
+  double start = utils::getmillisecs();
+  string rows_file = path + "/" + kProfileRowsFile;
+  string str_file = path + "/" + kProfileStrFile;
+  // the string file is written last and marks a complete snapshot
+  remove(str_file.c_str());
+  FILE *rows_fp = fopen(rows_file.c_str(), "wb");
+  FILE *str_fp = rows_fp ? fopen((str_file + ".tmp").c_str(), "wb") : nullptr;
+  if (rows_fp == nullptr || str_fp == nullptr) {
+    LOG(ERROR) << "open snapshot file in " << path
+               << " error: " << strerror(errno);
+    if (rows_fp) fclose(rows_fp);
     return -1;
   }
 
-  int idx = iter->second;
+  SnapshotHeader header;
+  header.magic = kSnapshotMagic;
+  header.version = kSnapshotVersion;
+  header.doc_num = doc_num;
+  header.item_length = item_length_;
+  header.data_bytes = (int64_t)doc_num * item_length_;
+  bool ok = fwrite(&header, sizeof(header), 1, rows_fp) == 1;
+  // placeholder, data bytes of strings are known at the end
+  ok = ok && fwrite(&header, sizeof(header), 1, str_fp) == 1;
+
+  std::vector<int> str_fields;
+  for (int field_id = 0; field_id < (int)attrs_.size(); field_id++) {
+    if (attrs_[field_id] == STRING) str_fields.push_back(field_id);
+  }
+  // interned strings are shared by docs, they are written once
+  std::vector<std::unordered_map<uint64_t, uint64_t>> interned(attrs_.size());
+
+  // rows are copied and strings are packed in batches, string offsets of
+  // rows are rewritten to the offsets in the string file
+  StringReadGuard guard(this);
+  const int kBatch = 1 << 16;
+  std::vector<char> rows;
+  std::vector<char> strs;
+  uint64_t str_bytes = 0;
+  for (int begin = 0; ok && begin < doc_num; begin += kBatch) {
+    int end = std::min(begin + kBatch, doc_num);
+    rows.resize((size_t)(end - begin) * item_length_);
+    memcpy(rows.data(), mem_ + (uint64_t)begin * item_length_, rows.size());
+    strs.clear();
+    for (int docid = begin; docid < end; docid++) {
+      char *row = rows.data() + (uint64_t)(docid - begin) * item_length_;
+      for (int field_id : str_fields) {
+        uint64_t offset = 0;
+        uint16_t len = 0;
+        GetStringPos(docid, field_id, offset, len);
+        uint64_t new_offset = str_bytes + strs.size();
+        bool copy = true;
+        if (str_interns_[field_id] != nullptr) {
+          auto ret = interned[field_id].emplace(offset, new_offset);
+          if (!ret.second) {
+            new_offset = ret.first->second;
+            copy = false;
+          }
+        }
+        if (copy) {
+          strs.insert(strs.end(), StrAddr(offset), StrAddr(offset) + len);
+        }
+        char *field = row + idx_attr_offset_[field_id];
+        memcpy(field, &new_offset, sizeof(uint64_t));
+        memcpy(field + sizeof(uint64_t), &len, sizeof(uint16_t));
+      }
+    }
+    ok = fwrite(rows.data(), 1, rows.size(), rows_fp) == rows.size() &&
+         fwrite(strs.data(), 1, strs.size(), str_fp) == strs.size();
+    str_bytes += strs.size();
+  }
 
-#pragma omp parallel for
-  for (int i = 0; i < doc_num; ++i) {
-    long key = -1;
-    GetField<long>(i, idx, key);
-#ifdef USE_BTREE
-    BtDb *bt = bt_open(cache_mgr_, main_mgr_);
-    BTERR bterr = bt_insertkey(
-        bt->main, reinterpret_cast<unsigned char *>(&key), sizeof(key), 0,
-        static_cast<void *>(&i), sizeof(int), Unique);
-    if (bterr) {
-      LOG(ERROR) << "Error " << bt->mgr->err;
+  ok = ok && key_index_->Dump(path + "/" + kProfileKeysFile, doc_num) == 0;
+
+  header.data_bytes = str_bytes;
+  ok = ok && fseek(str_fp, 0, SEEK_SET) == 0 &&
+       fwrite(&header, sizeof(header), 1, str_fp) == 1;
+  ok = (fclose(rows_fp) == 0) && ok;
+  ok = (fclose(str_fp) == 0) && ok;
+  if (!ok || rename((str_file + ".tmp").c_str(), str_file.c_str())) {
+    LOG(ERROR) << "write profile snapshot to " << path
+               << " error: " << strerror(errno);
+    return -2;
+  }
+
+  // keep the previous snapshot until this dump is done
+  if (snapshot_paths_[1] != "" && snapshot_paths_[1] != path) {
+    RemoveSnapshot(snapshot_paths_[1]);
+  }
+  if (snapshot_paths_[0] != path) {
+    snapshot_paths_[1] = snapshot_paths_[0];
+    snapshot_paths_[0] = path;
+  }
+
+  LOG(INFO) << "dump profile snapshot to " << path << ", doc num=" << doc_num
+            << ", string bytes=" << str_bytes << ", cost "
+            << utils::getmillisecs() - start << "ms";
+  return 0;
+}
+
+void Profile::RetainSnapshots(const std::vector<string> &folders,
+                              const string &folder) {
+  snapshot_paths_[0] = folder;
+  snapshot_paths_[1] = "";
+  bool older = false;
+  for (auto it = folders.rbegin(); it != folders.rend(); ++it) {
+    if (*it == folder) {
+      older = true;
+      continue;
     }
-    bt_close(bt);
-#else
-    item_to_docid_.insert(key, i);
-#endif
+    // files of an unfinished dump after the loaded one are removed too
+    if (older && snapshot_paths_[1] == "" &&
+        utils::get_file_size(*it + "/" + kProfileStrFile) > 0) {
+      snapshot_paths_[1] = *it;
+      continue;
+    }
+    RemoveSnapshot(*it);
   }
+}
 
-  LOG(INFO) << "Profile load successed! doc num=" << doc_num;
-#else
-  LOG(ERROR) << "rocksdb is need when compiling for profile's loading";
-#endif
+int Profile::LoadSnapshot(const string &folder, int doc_num) {
+  const string files[2] = {folder + "/" + kProfileRowsFile,
+                           folder + "/" + kProfileStrFile};
+  char *dsts[2] = {mem_, str_mems_[str_cur_]};
+  uint64_t limits[2] = {max_profile_size_ * item_length_, max_str_size_};
+  uint64_t loaded[2] = {0, 0};
+  for (int i = 0; i < 2; i++) {
+    long file_size = utils::get_file_size(files[i]);
+    int fd = open(files[i].c_str(), O_RDONLY);
+    if (fd == -1 || file_size < (long)sizeof(SnapshotHeader)) {
+      LOG(ERROR) << "open " << files[i] << " error, file size=" << file_size;
+      if (fd != -1) close(fd);
+      return -1;
+    }
+    char *data =
+        (char *)mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      LOG(ERROR) << "mmap " << files[i] << " error: " << strerror(errno);
+      return -1;
+    }
+    madvise(data, file_size, MADV_SEQUENTIAL);
+
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+    uint64_t bytes = header.data_bytes;
+    if (header.magic != kSnapshotMagic || header.version != kSnapshotVersion ||
+        header.doc_num != doc_num || header.item_length != item_length_ ||
+        bytes + sizeof(header) != (uint64_t)file_size || bytes > limits[i]) {
+      LOG(ERROR) << "invalid snapshot " << files[i] << ", doc num="
+                 << header.doc_num << ", item length=" << header.item_length
+                 << ", data bytes=" << bytes << ", file size=" << file_size;
+      munmap(data, file_size);
+      return -2;
+    }
+
+    const char *src = data + sizeof(header);
+    const uint64_t kChunk = 64 << 20;
+    long chunks = (bytes + kChunk - 1) / kChunk;
+#pragma omp parallel for
+    for (long c = 0; c < chunks; c++) {
+      uint64_t off = c * kChunk;
+      memcpy(dsts[i] + off, src + off, std::min(kChunk, bytes - off));
+    }
+    munmap(data, file_size);
+    loaded[i] = bytes;
+  }
+  str_offset_ = loaded[1];
+  str_garbage_bytes_ = 0;
+
+  // snapshot strings are all in the current arena
+  uint64_t tag = (uint64_t)str_cur_ << kStrArenaShift;
+  for (int field_id = 0; field_id < (int)attrs_.size(); field_id++) {
+    if (attrs_[field_id] != STRING) continue;
+    auto *interns = str_interns_[field_id];
+#pragma omp parallel for if (interns == nullptr)
+    for (int docid = 0; docid < doc_num; docid++) {
+      char *field =
+          mem_ + (uint64_t)docid * item_length_ + idx_attr_offset_[field_id];
+      uint64_t offset = 0;
+      memcpy(&offset, field, sizeof(uint64_t));
+      offset |= tag;
+      memcpy(field, &offset, sizeof(uint64_t));
+      if (interns != nullptr) {
+        uint16_t len = 0;
+        memcpy(&len, field + sizeof(uint64_t), sizeof(uint16_t));
+        interns->emplace(string(StrAddr(offset), len), offset);
+      }
+    }
+  }
+  LOG(INFO) << "load profile snapshot from " << folder
+            << ", rows bytes=" << loaded[0] << ", string bytes=" << loaded[1];
   return 0;
 }
 
@@ -185,12 +532,58 @@ int Profile::CreateTable(const Table *table) {
   if (mem_) {
     delete[] mem_;
   }
-  if (str_mem_) {
-    delete[] str_mem_;
+  if (str_mems_[str_cur_]) {
+    delete[] str_mems_[str_cur_];
   }
 
+  // left uninitialized, so the pages of rows never written aren't committed
   mem_ = new char[max_profile_size_ * item_length_];
-  str_mem_ = new char[max_str_size_];
+  str_mems_[str_cur_] = new char[max_str_size_];
+
+  // long keys are exact in fingerprints, string keys need verifying
+  key_index_ = new ProfileKeyIndex(
+      std::min(max_profile_size_, kInitKeyIndexDocs), id_type_ != 0);
+  if (key_index_->Init()) {
+    LOG(ERROR) << "init key index error";
+    return -1;
+  }
+
+  str_interns_.assign(field_num_, nullptr);
+  for (int i = 0; i < table->fields_num; ++i) {
+    if (!(table->fields[i]->is_index & FIELD_INDEX_INTERN)) continue;
+    const string name =
+        string(table->fields[i]->name->value, table->fields[i]->name->len);
+    int field_id = attr_idx_map_[name];
+    if (attrs_[field_id] != STRING) {
+      LOG(WARNING) << "only string field can be interned, field [" << name
+                   << "] is ignored";
+      continue;
+    }
+    str_interns_[field_id] = new std::unordered_map<std::string, uint64_t>;
+    LOG(INFO) << "values of field [" << name << "] are interned";
+  }
+
+  columns_.assign(field_num_, nullptr);
+  for (int i = 0; i < table->fields_num; ++i) {
+    if (!(table->fields[i]->is_index & FIELD_INDEX_COLUMN)) continue;
+    const string name =
+        string(table->fields[i]->name->value, table->fields[i]->name->len);
+    int field_id = attr_idx_map_[name];
+    if (!ProfileColumn::IsNumeric(attrs_[field_id])) {
+      LOG(WARNING) << "only numeric field can be stored as column, field ["
+                   << name << "] is ignored";
+      continue;
+    }
+    ProfileColumn *column =
+        new ProfileColumn(attrs_[field_id], max_profile_size_);
+    if (column->Init()) {
+      LOG(ERROR) << "init column of field [" << name << "] error";
+      delete column;
+      return -1;
+    }
+    columns_[field_id] = column;
+    LOG(INFO) << "field [" << name << "] is stored as column";
+  }
 
 #ifdef WITH_ROCKSDB
   // open DB
@@ -254,12 +647,12 @@ int Profile::FTypeSize(enum DataType fType) {
   return length;
 }
 
-void Profile::SetFieldValue(int docid, const std::string &field,
-                            const char *value, uint16_t len) {
+int Profile::SetFieldValue(int docid, const std::string &field,
+                           const char *value, uint16_t len) {
   const auto &iter = attr_idx_map_.find(field);
   if (iter == attr_idx_map_.end()) {
     LOG(ERROR) << "Cannot find field [" << field << "]";
-    return;
+    return -1;
   }
   int idx = iter->second;
   size_t offset = (uint64_t)docid * item_length_ + idx_attr_offset_[idx];
@@ -268,17 +661,204 @@ void Profile::SetFieldValue(int docid, const std::string &field,
   if (attr != DataType::STRING) {
     int type_size = FTypeSize(attr);
     memcpy(mem_ + offset, value, type_size);
+    if (columns_[idx] != nullptr) columns_[idx]->Set(docid, value);
   } else {
-    int ofst = sizeof(uint64_t);
-    if ((str_offset_ + len) >= max_str_size_) {
+    std::lock_guard<std::mutex> lock(str_mutex_);
+    uint64_t str_offset = 0;
+    if (AppendString(idx, value, len, str_offset)) {
       LOG(ERROR) << "Str memory reached max size [" << max_str_size_ << "]";
-      return;
+      // rows aren't initialized, the compaction reads the position
+      SetStringPos(mem_ + offset, (uint64_t)str_cur_ << kStrArenaShift, 0);
+      return -1;
+    }
+    SetStringPos(mem_ + offset, str_offset, len);
+  }
+  return 0;
+}
+
+void Profile::SetStringPos(char *field, uint64_t offset, uint16_t len) {
+  str_seq_.fetch_add(1, std::memory_order_release);
+  memcpy(field, &offset, sizeof(uint64_t));
+  memcpy(field + sizeof(uint64_t), &len, sizeof(uint16_t));
+  str_seq_.fetch_add(1, std::memory_order_release);
+}
+
+int Profile::AppendString(int field_id, const char *value, uint16_t len,
+                          uint64_t &offset, bool compacting) {
+  std::unordered_map<std::string, uint64_t> *interns =
+      str_interns_.size() > 0 ? str_interns_[field_id] : nullptr;
+  if (interns != nullptr) {
+    const auto &iter = interns->find(string(value, len));
+    if (iter != interns->end()) {
+      offset = iter->second;
+      return 0;
     }
-    memcpy(mem_ + offset, &str_offset_, sizeof(uint64_t));
-    memcpy(mem_ + offset + ofst, &len, sizeof(uint16_t));
-    memcpy(str_mem_ + str_offset_, value, sizeof(char) * len);
-    str_offset_ += len;
   }
+  uint64_t limit = max_str_size_ - (compacting ? 0 : str_reserved_);
+  if ((str_offset_ + len) >= limit) {
+    if (!compacting) CompactStringsIfNeed();
+    return -1;
+  }
+  memcpy(str_mems_[str_cur_] + str_offset_, value, sizeof(char) * len);
+  offset = str_offset_ | ((uint64_t)str_cur_ << kStrArenaShift);
+  str_offset_ += len;
+  if (compacting) str_reserved_ -= std::min((uint64_t)len, str_reserved_);
+  if (interns != nullptr) {
+    interns->emplace(string(value, len), offset);
+  }
+  return 0;
+}
+
+void Profile::GetStringPos(int docid, int field_id, uint64_t &offset,
+                           uint16_t &len) const {
+  const char *field =
+      mem_ + (uint64_t)docid * item_length_ + idx_attr_offset_[field_id];
+  // seqlock, retry if compaction moved offsets meanwhile
+  uint64_t seq = 0;
+  do {
+    seq = str_seq_.load(std::memory_order_acquire);
+    memcpy(&offset, field, sizeof(uint64_t));
+    memcpy(&len, field + sizeof(uint64_t), sizeof(uint16_t));
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) || seq != str_seq_.load(std::memory_order_relaxed));
+}
+
+int Profile::EnterStringRead() const {
+  while (true) {
+    uint64_t epoch = str_epoch_.load();
+    int slot = epoch & 1;
+    str_readers_[slot].fetch_add(1);
+    // the compaction advancing the epoch may have missed it, retry in the
+    // new one
+    if (str_epoch_.load() == epoch) return slot;
+    str_readers_[slot].fetch_sub(1);
+  }
+}
+
+void Profile::WaitStringReaders() {
+  int slot = str_epoch_.fetch_add(1) & 1;
+  while (str_readers_[slot].load() > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void Profile::CompactStringsIfNeed() {
+  // compact if the garbage is more than 30% of used bytes of a half full arena
+  uint64_t garbage = str_garbage_bytes_;
+  if (str_offset_ < max_str_size_ / 2 || garbage * 10 < str_offset_ * 3) {
+    return;
+  }
+  bool expected = false;
+  if (!str_compacting_.compare_exchange_strong(expected, true)) return;
+  if (str_compactor_ != nullptr) {
+    str_compactor_->join();
+    delete str_compactor_;
+  }
+  LOG(INFO) << "start to compact strings, used bytes=" << str_offset_
+            << ", garbage bytes=" << garbage;
+  str_compactor_ = new std::thread([this]() {
+    CompactStrings();
+    str_compacting_ = false;
+  });
+}
+
+int Profile::CompactStrings() {
+  std::lock_guard<std::mutex> compact_lock(str_compact_mutex_);
+  double start = utils::getmillisecs();
+  int old_arena = 0;
+  int doc_num = 0;
+  uint64_t old_used = 0;
+  {
+    std::lock_guard<std::mutex> lock(str_mutex_);
+    old_arena = 1 - str_cur_;
+    if (str_mems_[old_arena] != nullptr) {
+      // the last compaction didn't finish, docs are in both arenas, the ones
+      // in the other arena are moved to the current one
+      LOG(WARNING) << "go on compacting strings left in the other arena";
+    } else {
+      int new_arena = old_arena;
+      old_arena = str_cur_;
+      str_mems_[new_arena] = new (std::nothrow) char[max_str_size_];
+      if (str_mems_[new_arena] == nullptr) {
+        LOG(ERROR) << "malloc string arena error, size=" << max_str_size_;
+        return -1;
+      }
+      // from now on writers append to the new arena, the live strings of the
+      // old one are kept room for
+      old_used = str_offset_;
+      uint64_t garbage = str_garbage_bytes_;
+      str_reserved_ = old_used > garbage ? old_used - garbage : 0;
+      str_cur_ = new_arena;
+      str_offset_ = 0;
+      str_garbage_bytes_ = 0;
+      for (auto *interns : str_interns_) {
+        if (interns != nullptr) interns->clear();
+      }
+    }
+    doc_num = doc_num_;
+  }
+
+  std::vector<int> str_fields;
+  for (int field_id = 0; field_id < (int)attrs_.size(); field_id++) {
+    if (attrs_[field_id] == STRING) str_fields.push_back(field_id);
+  }
+
+  const int kBatch = 10000;
+  int ret = 0;
+  std::vector<std::pair<char *, uint64_t>> moved;
+  for (int begin = 0; begin < doc_num && ret == 0; begin += kBatch) {
+    int end = std::min(begin + kBatch, doc_num);
+    std::lock_guard<std::mutex> lock(str_mutex_);
+    moved.clear();
+    for (int docid = begin; docid < end && ret == 0; docid++) {
+      for (int field_id : str_fields) {
+        char *field =
+            mem_ + (uint64_t)docid * item_length_ + idx_attr_offset_[field_id];
+        uint64_t offset = 0;
+        uint16_t len = 0;
+        memcpy(&offset, field, sizeof(uint64_t));
+        memcpy(&len, field + sizeof(uint64_t), sizeof(uint16_t));
+        if ((int)(offset >> kStrArenaShift) == str_cur_) continue;
+        uint64_t new_offset = 0;
+        if (AppendString(field_id, StrAddr(offset), len, new_offset, true)) {
+          // the moved docs are published, the others stay in the old arena
+          LOG(ERROR) << "compact strings error, the new arena is full, docid="
+                     << docid;
+          ret = -2;
+          break;
+        }
+        moved.emplace_back(field, new_offset);
+      }
+    }
+    str_seq_.fetch_add(1, std::memory_order_release);
+    for (const auto &m : moved) {
+      memcpy(m.first, &m.second, sizeof(uint64_t));
+    }
+    str_seq_.fetch_add(1, std::memory_order_release);
+  }
+
+  uint64_t new_used = 0;
+  {
+    std::lock_guard<std::mutex> lock(str_mutex_);
+    str_reserved_ = 0;
+    if (ret != 0) return ret;
+    new_used = str_offset_;
+  }
+  // readers entered before may still read old offsets or hold pointers to
+  // old strings
+  WaitStringReaders();
+  char *old_mem = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(str_mutex_);
+    old_mem = str_mems_[old_arena];
+    str_mems_[old_arena] = nullptr;
+  }
+  delete[] old_mem;
+
+  LOG(INFO) << "compact strings success, doc num=" << doc_num
+            << ", bytes " << old_used << " -> " << new_used << ", cost "
+            << utils::getmillisecs() - start << "ms";
+  return 0;
 }
 
 int Profile::AddField(const string &name, enum DataType ftype, int is_index) {
@@ -311,25 +891,53 @@ int Profile::GetDocIDByKey(std::string &key, int &doc_id) {
     return 0;
   }
 #else
-  if (id_type_ == 0) {
-    if (item_to_docid_str_.find(key, doc_id)) {
-      return 0;
-    }
-  } else {
-    long key_long = -1;
-    memcpy(&key_long, key.data(), sizeof(key_long));
-
-    if (item_to_docid_.find(key_long, doc_id)) {
-      return 0;
-    }
+  if (key_index_ == nullptr) return -1;
+  doc_id = key_index_->Find(KeyFingerprint(key), [&](int docid) {
+    return KeyEquals(docid, key);
+  });
+  if (doc_id >= 0) {
+    return 0;
   }
-
 #endif
   return -1;
 }
 
+void Profile::GetDocIDsByKeys(std::vector<std::string> &keys,
+                              std::vector<int> &doc_ids) {
+  int num = keys.size();
+  doc_ids.assign(num, -1);
+#pragma omp parallel for if (num > 1000)
+  for (int i = 0; i < num; i++) {
+    if (GetDocIDByKey(keys[i], doc_ids[i])) doc_ids[i] = -1;
+  }
+}
+
+uint64_t Profile::KeyFingerprint(const std::string &key) const {
+  if (id_type_ == 0) {
+    return ProfileKeyIndex::Fingerprint(key.data(), key.size());
+  }
+  long key_long = -1;
+  memcpy(&key_long, key.data(), std::min(key.size(), sizeof(key_long)));
+  return ProfileKeyIndex::Fingerprint(key_long);
+}
+
+bool Profile::KeyEquals(int docid, const std::string &key) const {
+  StringReadGuard guard(this);
+  char *value = nullptr;
+  int len = GetFieldString(docid, key_idx_, &value);
+  return len == (int)key.size() && memcmp(value, key.data(), len) == 0;
+}
+
 int Profile::Add(const std::vector<Field *> &fields, int doc_id,
                  bool is_existed) {
+  std::string key;
+  int ret = AddFields(fields, doc_id, key);
+  if (ret != 0) return ret;
+  return AddKey(key, doc_id);
+}
+
+int Profile::AddFields(const std::vector<Field *> &fields, int doc_id,
+                       std::string &key) {
   if (doc_id >= static_cast<int>(max_profile_size_)) {
     LOG(ERROR) << "Doc num reached upper limit [" << max_profile_size_ << "]";
     return -1;
@@ -341,7 +949,7 @@ int Profile::Add(const std::vector<Field *> &fields, int doc_id,
     return -1;
   }
   std::vector<Field *> fields_reorder(fields.size());
-  std::string key;
+  key.clear();
   for (size_t i = 0; i < fields.size(); ++i) {
     const auto field_value = fields[i];
     const string &name =
@@ -366,6 +974,26 @@ int Profile::Add(const std::vector<Field *> &fields, int doc_id,
     return -1;
   }
 
+  for (size_t i = 0; i < fields_reorder.size(); ++i) {
+    const auto field_value = fields_reorder[i];
+    const string &name =
+        std::string(field_value->name->value, field_value->name->len);
+
+    auto it = attr_idx_map_.find(name);
+    if (it == attr_idx_map_.end()) {
+      LOG(ERROR) << "Cannot find field name [" << name << "]";
+      continue;
+    }
+    if (SetFieldValue(doc_id, name.c_str(), field_value->value->value,
+                      field_value->value->len)) {
+      LOG(ERROR) << "set field [" << name << "] error, docid=" << doc_id;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int Profile::AddKey(const std::string &key, int doc_id) {
 #ifdef USE_BTREE
   BtDb *bt = bt_open(cache_mgr_, main_mgr_);
 
@@ -377,34 +1005,20 @@ int Profile::Add(const std::vector<Field *> &fields, int doc_id,
   }
   bt_close(bt);
 #else
-if (id_type_ == 0) {
-    item_to_docid_str_.insert(key, doc_id);
-  } else {
-    long key_long = -1;
-    memcpy(&key_long, key.data(), sizeof(key_long));
-
-    item_to_docid_.insert(key_long, doc_id);
+  // added after fields, as string keys are verified by the _id of doc
+  if (key_index_->Add(KeyFingerprint(key), doc_id, [&](int docid) {
+        return KeyEquals(docid, key);
+      }) < 0) {
+    LOG(ERROR) << "add to key index error, key [" << key << "], docid="
+               << doc_id;
+    return -1;
   }
-
 #endif
 
-  for (size_t i = 0; i < fields_reorder.size(); ++i) {
-    const auto field_value = fields_reorder[i];
-    const string &name =
-        std::string(field_value->name->value, field_value->name->len);
-
-    auto it = attr_idx_map_.find(name);
-    if (it == attr_idx_map_.end()) {
-      LOG(ERROR) << "Cannot find field name [" << name << "]";
-      continue;
-    }
-    SetFieldValue(doc_id, name.c_str(), field_value->value->value,
-                  field_value->value->len);
-  }
+  if (doc_id >= doc_num_) doc_num_ = doc_id + 1;
 
   if (doc_id % 10000 == 0) {
-    LOG(INFO) << "Add item _id [" << key << "], num [" << doc_id << "]"
-              << ", is_existed=" << is_existed;
+    LOG(INFO) << "Add item _id [" << key << "], num [" << doc_id << "]";
   }
   return 0;
 }
@@ -425,34 +1039,38 @@ int Profile::Update(const std::vector<Field *> &fields, int doc_id) {
     int field_id = it->second;
 
     if (field_value->data_type == STRING) {
-      size_t offset =
-          (uint64_t)doc_id * item_length_ + idx_attr_offset_[field_id];
-      size_t str_offset = 0;
-      memcpy(&str_offset, mem_ + offset, sizeof(size_t));
-      unsigned short len;
-      memcpy(&len, mem_ + offset + sizeof(size_t), sizeof(unsigned short));
-
-      if (len >= field_value->value->len) {
-        memcpy(mem_ + offset + sizeof(size_t), &(field_value->value->len),
-               sizeof(unsigned short));
-        memcpy(str_mem_ + str_offset, field_value->value->value,
-               field_value->value->len);
+      char *field =
+          mem_ + (uint64_t)doc_id * item_length_ + idx_attr_offset_[field_id];
+      uint16_t new_len = field_value->value->len;
+      std::lock_guard<std::mutex> lock(str_mutex_);
+      uint64_t str_offset = 0;
+      uint16_t len = 0;
+      memcpy(&str_offset, field, sizeof(uint64_t));
+      memcpy(&len, field + sizeof(uint64_t), sizeof(uint16_t));
+
+      // interned strings are shared by docs, so they are never overwritten
+      bool interned = str_interns_[field_id] != nullptr;
+      // garbage is counted for the current arena, the other one is freed by
+      // the compaction in progress
+      bool current = (int)(str_offset >> kStrArenaShift) == str_cur_;
+      if (!interned && len >= new_len) {
+        SetStringPos(field, str_offset, new_len);
+        memcpy(StrAddr(str_offset), field_value->value->value, new_len);
+        if (current) str_garbage_bytes_ += len - new_len;
       } else {
-        len = field_value->value->len;
-        int ofst = sizeof(uint64_t);
-        if ((str_offset_ + len) >= max_str_size_) {
+        uint64_t new_offset = 0;
+        if (AppendString(field_id, field_value->value->value, new_len,
+                         new_offset)) {
           LOG(ERROR) << "Str memory reached max size [" << max_str_size_ << "]";
           return -1;
         }
-        memcpy(mem_ + offset, &str_offset_, sizeof(uint64_t));
-        memcpy(mem_ + offset + ofst, &len, sizeof(uint16_t));
-        memcpy(str_mem_ + str_offset_, field_value->value->value,
-               sizeof(char) * len);
-        str_offset_ += len;
+        SetStringPos(field, new_offset, new_len);
+        if (!interned && current) str_garbage_bytes_ += len;
       }
-    } else {
-      SetFieldValue(doc_id, name.c_str(), field_value->value->value,
-                    field_value->value->len);
+      CompactStringsIfNeed();
+    } else if (SetFieldValue(doc_id, name.c_str(), field_value->value->value,
+                             field_value->value->len)) {
+      return -1;
     }
   }
 
@@ -471,20 +1089,19 @@ void Profile::ToRowKey(int id, string &key) const {
 }
 
 int Profile::GetRawDoc(int docid, vector<char> &raw_doc) {
+  StringReadGuard guard(this);
   int len = item_length_;
   raw_doc.resize(len, 0);
   memcpy((void *)raw_doc.data(), mem_ + (long)docid * item_length_,
          item_length_);
   for (int i = 0; i < (int)idx_attr_offset_.size(); i++) {
     if (attrs_[i] != STRING) continue;
-    char *field = mem_ + (long)docid * item_length_ + idx_attr_offset_[i];
+    uint64_t str_offset = 0;
     uint16_t str_len = 0;
-    memcpy((void *)&str_len, field + sizeof(uint64_t), sizeof(str_len));
+    GetStringPos(docid, i, str_offset, str_len);
     if (str_len == 0) continue;
     raw_doc.resize(len + str_len, 0);
-    uint64_t str_offset = 0;
-    memcpy((void *)&str_offset, field, sizeof(uint64_t));
-    memcpy((void *)(raw_doc.data() + len), str_mem_ + str_offset, str_len);
+    memcpy((void *)(raw_doc.data() + len), StrAddr(str_offset), str_len);
     len += str_len;
   }
   return 0;
@@ -507,29 +1124,26 @@ int Profile::PutToDB(int docid) {
 }
 
 int Profile::Dump(const string &path, int start_docid, int end_docid) {
-#ifdef WITH_ROCKSDB
-  for (int docid = start_docid; docid <= end_docid; docid++) {
-    if (PutToDB(docid)) {
-      LOG(ERROR) << "put to rocksdb error, docid=" << docid;
-      return -2;
-    }
-  }
-  string value;
-  ToRowKey(end_docid + 1, value);
-  Status s = db_->Put(WriteOptions(), Slice(kProfileDumpedNum), Slice(value));
-  if (!s.ok()) {
-    LOG(ERROR) << "rocksdb put error:" << s.ToString()
-               << ", key=" << kProfileDumpedNum << ", value=" << value;
-    return -2;
+  // rows may be updated after dumped, so all docs are in every snapshot
+  int ret = DumpSnapshot(path, end_docid + 1);
+  if (ret != 0) {
+    LOG(ERROR) << "dump profile snapshot error, ret=" << ret
+               << ", start docid=" << start_docid;
+    return ret;
   }
-#else
-  LOG(ERROR) << "rocksdb is need when compiling for profile's dumping";
-#endif
   return 0;
 }
 
 long Profile::GetMemoryBytes() {
-  return max_profile_size_ * item_length_ + max_str_size_;
+  long total = max_profile_size_ * item_length_;
+  if (key_index_ != nullptr) total += key_index_->GetMemoryBytes();
+  for (int i = 0; i < 2; i++) {
+    if (str_mems_[i] != nullptr) total += max_str_size_;
+  }
+  for (const ProfileColumn *column : columns_) {
+    if (column != nullptr) total += column->GetMemoryBytes();
+  }
+  return total;
 }
 
 int Profile::GetDocInfo(const int docid, Doc *&doc) {
@@ -541,6 +1155,7 @@ int Profile::GetDocInfo(const int docid, Doc *&doc) {
     memset(doc->fields, 0, doc->fields_num * sizeof(Field *));
   }
 
+  StringReadGuard guard(this);
   int i = 0;
   for (const auto &it : attr_type_map_) {
     const string &attr = it.first;
@@ -617,13 +1232,10 @@ int Profile::GetFieldString(int docid, const std::string &field,
 }
 
 int Profile::GetFieldString(int docid, int field_id, char **value) const {
-  size_t offset = (uint64_t)docid * item_length_ + idx_attr_offset_[field_id];
-  size_t str_offset = 0;
-  memcpy(&str_offset, mem_ + offset, sizeof(size_t));
-  unsigned short len;
-  memcpy(&len, mem_ + offset + sizeof(size_t), sizeof(unsigned short));
-  offset += sizeof(unsigned short);
-  *value = str_mem_ + str_offset;
+  uint64_t str_offset = 0;
+  uint16_t len = 0;
+  GetStringPos(docid, field_id, str_offset, len);
+  *value = StrAddr(str_offset);
   return len;
 }
 
@@ -643,6 +1255,36 @@ int Profile::GetFieldRawValue(int docid, int field_id, unsigned char **value,
   return 0;
 }
 
+void Profile::GetFieldsRawValues(const std::vector<int> &docids,
+                                 const std::vector<int> &field_ids,
+                                 std::vector<const char *> &values,
+                                 std::vector<int> &lens) {
+  size_t fields_num = field_ids.size();
+  values.assign(docids.size() * fields_num, nullptr);
+  lens.assign(docids.size() * fields_num, 0);
+
+  std::vector<int> order(docids.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::sort(order.begin(), order.end(),
+            [&](int a, int b) { return docids[a] < docids[b]; });
+
+  for (size_t i = 0; i < order.size(); i++) {
+    int docid = docids[order[i]];
+    if (i + 1 < order.size() && docids[order[i + 1]] >= 0) {
+      __builtin_prefetch(mem_ + (uint64_t)docids[order[i + 1]] * item_length_);
+    }
+    if (docid < 0) continue;
+    size_t base = (size_t)order[i] * fields_num;
+    for (size_t j = 0; j < fields_num; j++) {
+      unsigned char *value = nullptr;
+      int len = 0;
+      if (GetFieldRawValue(docid, field_ids[j], &value, len) != 0) continue;
+      values[base + j] = reinterpret_cast<const char *>(value);
+      lens[base + j] = len;
+    }
+  }
+}
+
 int Profile::GetFieldType(const std::string &field_name, enum DataType &type) {
   const auto &it = attr_type_map_.find(field_name);
   if (it == attr_type_map_.end()) {
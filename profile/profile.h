@@ -8,12 +8,17 @@
 #ifndef PROFILE_H_
 #define PROFILE_H_
 
-#include <cuckoohash_map.hh>
+#include <atomic>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include "gamma_api.h"
 #include "log.h"
+#include "profile_column.h"
+#include "profile_key_index.h"
 
 #ifdef USE_BTREE
 #include "threadskv10h.h"
@@ -51,6 +56,22 @@ class Profile {
   int Add(const std::vector<Field *> &fields, int doc_id,
           bool is_existed = false);
 
+  /** write the fields of a new doc without indexing its key, so it isn't
+   * found or counted until AddKey(), and is overwritten by the next add to
+   * doc_id if the doc is given up
+   *
+   * @param key output, the _id of the doc
+   * @return 0 if successed
+   */
+  int AddFields(const std::vector<Field *> &fields, int doc_id,
+                std::string &key);
+
+  /** index the key of a doc written by AddFields() and count it in DocNum()
+   *
+   * @return 0 if successed
+   */
+  int AddKey(const std::string &key, int doc_id);
+
   /** update a doc
    *
    * @param doc     doc to update
@@ -67,7 +88,16 @@ class Profile {
    */
   int GetDocIDByKey(std::string &key, int &doc_id);
 
-  /** dump datas to disk
+  /** get docids of keys in parallel
+   *
+   * @param keys keys to get
+   * @param doc_ids output, docid of each key, -1 if the key isn't found
+   */
+  void GetDocIDsByKeys(std::vector<std::string> &keys,
+                       std::vector<int> &doc_ids);
+
+  /** dump datas to disk, all docs to end_docid are in the snapshot since rows
+   * before start_docid may be updated after the last dump
    *
    * @return ResultCode
    */
@@ -84,6 +114,11 @@ class Profile {
   bool GetField(const int docid, const int field_id, T &value) const {
     if ((docid < 0) or (field_id < 0 || field_id >= field_num_)) return false;
 
+    const ProfileColumn *column = columns_[field_id];
+    if (column != nullptr) {
+      memcpy(&value, column->Get(docid), sizeof(T));
+      return true;
+    }
     size_t offset = (uint64_t)docid * item_length_ + idx_attr_offset_[field_id];
     memcpy(&value, mem_ + offset, sizeof(T));
     return true;
@@ -98,6 +133,23 @@ class Profile {
     GetField<T>(docid, iter->second, value);
   }
 
+  /** strings read from the profile stay valid while a guard is alive, a
+   * compaction frees the old arena once the guards taken before it are
+   * released. The thread calling CompactStrings() shouldn't hold one
+   */
+  class StringReadGuard {
+   public:
+    explicit StringReadGuard(const Profile *profile)
+        : profile_(profile), slot_(profile->EnterStringRead()) {}
+
+    ~StringReadGuard() { profile_->LeaveStringRead(slot_); }
+
+   private:
+    const Profile *profile_;
+    int slot_;
+  };
+
+  // value points to the string arena, see StringReadGuard
   int GetFieldString(int docid, const std::string &field, char **value) const;
 
   int GetFieldString(int docid, int field_id, char **value) const;
@@ -105,6 +157,18 @@ class Profile {
   int GetFieldRawValue(int docid, int field_id, unsigned char **value,
                        int &data_len);
 
+  /** get raw values of fields of many docs in one pass, rows are visited in
+   * docid order and values point to profile memory without copy
+   *
+   * @param values(output) value of docids[i] and field_ids[j] is at
+   *                       i * field_ids.size() + j, null if it's invalid
+   * @param lens(output) lengths of values
+   */
+  void GetFieldsRawValues(const std::vector<int> &docids,
+                          const std::vector<int> &field_ids,
+                          std::vector<const char *> &values,
+                          std::vector<int> &lens);
+
   int GetFieldType(const std::string &field, enum DataType &type);
 
   int GetAttrType(std::map<std::string, enum DataType> &attr_type_map);
@@ -115,22 +179,124 @@ class Profile {
 
   int Load(const std::vector<std::string> &folders, int &doc_num);
 
+  /** get the dumped doc num without loading the profile, so components
+   * depending only on it can be loaded concurrently
+   *
+   * @param folders dump folders, sorted by dumping time
+   * @param doc_num(output) the dumped doc num, 0 if nothing is dumped
+   * @return 0 if successed
+   */
+  int LoadDocNum(const std::vector<std::string> &folders, int &doc_num);
+
   int FieldsNum() { return attrs_.size(); };
 
+  /** get the column of a numeric field created with FIELD_INDEX_COLUMN
+   *
+   * @return nullptr if the field isn't stored as column
+   */
+  const ProfileColumn *GetColumn(int field_id) const {
+    if (field_id < 0 || field_id >= (int)columns_.size()) return nullptr;
+    return columns_[field_id];
+  }
+
+  /** @return the number of docs stored, it is max docid + 1 */
+  int DocNum() const { return doc_num_; }
+
+  /** rewrite the live strings of all docs into a new string arena and free
+   * the old one, readers are never blocked, writers wait for each batch.
+   * The bytes of the live strings are kept in the new arena, so writers find
+   * it full before the compaction does. Compactions are serialized
+   *
+   * @return 0 if successed, -2 if the new arena is full, docs are left in
+   * both arenas then and the next compaction goes on moving them
+   */
+  int CompactStrings();
+
  private:
   int FTypeSize(enum DataType fType);
 
-  void SetFieldValue(int docid, const std::string &field, const char *value,
-                     uint16_t len);
+  /** @return 0 if successed, -1 if the field is unknown or the string
+   * arena is full, a string field is set to empty then
+   */
+  int SetFieldValue(int docid, const std::string &field, const char *value,
+                    uint16_t len);
+
+  /** append a string of field to the current arena, or reuse the interned
+   * one, it must be called with str_mutex_ held
+   *
+   * @param offset output, the arena tagged offset of string
+   * @param compacting if it's moved by compaction, which may use the bytes
+   *                   reserved for it
+   * @return 0 if successed, -1 if the arena is full
+   */
+  int AppendString(int field_id, const char *value, uint16_t len,
+                   uint64_t &offset, bool compacting = false);
+
+  // @return the slot of the reader, passed to LeaveStringRead()
+  int EnterStringRead() const;
+
+  void LeaveStringRead(int slot) const {
+    str_readers_[slot].fetch_sub(1, std::memory_order_release);
+  }
+
+  // wait for the readers entered before, they may read the old arena
+  void WaitStringReaders();
+
+  /** read the arena tagged offset and length of a string field consistently
+   * with compaction
+   */
+  void GetStringPos(int docid, int field_id, uint64_t &offset,
+                    uint16_t &len) const;
+
+  // set the position of a string field, readers see it atomically
+  void SetStringPos(char *field, uint64_t offset, uint16_t len);
+
+  char *StrAddr(uint64_t offset) const {
+    return str_mems_[offset >> kStrArenaShift] + (offset & kStrOffsetMask);
+  }
+
+  // start compaction in background if there is too much garbage
+  void CompactStringsIfNeed();
 
   int AddField(const std::string &name, enum DataType ftype, int is_index);
 
   void ToRowKey(int id, std::string &key) const;
 
+  uint64_t KeyFingerprint(const std::string &key) const;
+
+  // @return true if the _id of docid is key, it is for string keys
+  bool KeyEquals(int docid, const std::string &key) const;
+
   int GetRawDoc(int docid, std::vector<char> &raw_doc);
 
   int PutToDB(int docid);
 
+  /** write rows and packed strings of docs in [0, doc_num) to the snapshot
+   * files in path, the previous snapshot but one is removed then
+   *
+   * @return 0 if successed
+   */
+  int DumpSnapshot(const std::string &path, int doc_num);
+
+  /** mmap the snapshot files in folder and copy them to memory
+   *
+   * @return 0 if successed
+   */
+  int LoadSnapshot(const std::string &folder, int doc_num);
+
+  /** keep the loaded snapshot of folder and the one before it as if they
+   * were dumped by this process, snapshot files of the other folders are
+   * removed, so restarts don't leave old snapshots on disk
+   */
+  void RetainSnapshots(const std::vector<std::string> &folders,
+                       const std::string &folder);
+
+  // @return the last folder having a snapshot, empty if there isn't one
+  std::string FindSnapshot(const std::vector<std::string> &folders) const;
+
+  // load the snapshot of rocksdb, it is used by dumps before native snapshot
+  int LoadFromDB(int doc_num);
+
   std::string name_;   // table name
   int item_length_;    // every doc item length
   uint8_t field_num_;  // field number
@@ -144,16 +310,39 @@ class Profile {
   std::vector<enum DataType> attrs_;
 
   uint8_t id_type_; // 0 string, 1 long, default 1
-  cuckoohash_map<long, int> item_to_docid_;
-  cuckoohash_map<std::string, int> item_to_docid_str_;
+  ProfileKeyIndex *key_index_;
 
   char *mem_;
-  char *str_mem_;
+  std::vector<ProfileColumn *> columns_;  // indexed by field id, may be null
+  std::atomic<int> doc_num_;
+  // the highest bit of a string offset tells which arena it is in, only the
+  // current one is appended, the other one exists during compaction
+  static const int kStrArenaShift = 63;
+  static const uint64_t kStrOffsetMask = ~(1UL << kStrArenaShift);
+  char *str_mems_[2];
+  int str_cur_;
   uint64_t max_profile_size_;
   uint64_t max_str_size_;
-  uint64_t str_offset_;
+  uint64_t str_offset_;  // append position of current arena
+  // garbage bytes of the current arena
+  std::atomic<uint64_t> str_garbage_bytes_;
+  // bytes of the current arena kept for the strings compaction moves
+  uint64_t str_reserved_;
+  std::mutex str_mutex_;                  // writers of string arena
+  std::atomic<uint64_t> str_seq_;         // odd when offsets are moving
+  std::atomic<bool> str_compacting_;
+  std::thread *str_compactor_;
+  std::mutex str_compact_mutex_;          // held by a compaction
+  // readers of the string arenas, counted in the slot of the epoch they
+  // entered, a compaction advances the epoch and waits for the last slot
+  mutable std::atomic<uint64_t> str_epoch_;
+  mutable std::atomic<int> str_readers_[2];
+  // interned values of FIELD_INDEX_INTERN fields, indexed by field id
+  std::vector<std::unordered_map<std::string, uint64_t> *> str_interns_;
 
   bool table_created_;
+  // folders of the latest two snapshots, older ones are removed
+  std::string snapshot_paths_[2];
 #ifdef WITH_ROCKSDB
   rocksdb::DB *db_;
 #endif
@@ -0,0 +1,180 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "profile_column.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "log.h"
+
+namespace tig_gamma {
+
+namespace {
+
+// scanning less docs than this isn't worth starting threads
+const int kParallelScanMin = 1 << 16;
+
+template <typename T>
+inline uint8_t MatchScalar(const T *values, int n, T lower, T upper) {
+  uint8_t mask = 0;
+  for (int i = 0; i < n; i++) {
+    mask |= (uint8_t)((values[i] >= lower) & (values[i] <= upper)) << i;
+  }
+  return mask;
+}
+
+/** match 8 sequential values, bit i of the returned mask is set if values[i]
+ * is in [lower, upper]
+ */
+template <typename T>
+inline uint8_t Match8(const T *values, T lower, T upper) {
+  return MatchScalar<T>(values, 8, lower, upper);
+}
+
+#ifdef __AVX2__
+template <>
+inline uint8_t Match8<float>(const float *values, float lower, float upper) {
+  __m256 v = _mm256_loadu_ps(values);
+  __m256 ge = _mm256_cmp_ps(v, _mm256_set1_ps(lower), _CMP_GE_OQ);
+  __m256 le = _mm256_cmp_ps(v, _mm256_set1_ps(upper), _CMP_LE_OQ);
+  return (uint8_t)_mm256_movemask_ps(_mm256_and_ps(ge, le));
+}
+
+template <>
+inline uint8_t Match8<int>(const int *values, int lower, int upper) {
+  __m256i v = _mm256_loadu_si256((const __m256i *)values);
+  __m256i lt = _mm256_cmpgt_epi32(_mm256_set1_epi32(lower), v);
+  __m256i gt = _mm256_cmpgt_epi32(v, _mm256_set1_epi32(upper));
+  int out = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(lt, gt)));
+  return (uint8_t)~out;
+}
+
+template <>
+inline uint8_t Match8<long>(const long *values, long lower, long upper) {
+  __m256i lo = _mm256_set1_epi64x(lower);
+  __m256i hi = _mm256_set1_epi64x(upper);
+  int out = 0;
+  for (int i = 0; i < 2; i++) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(values + i * 4));
+    __m256i miss =
+        _mm256_or_si256(_mm256_cmpgt_epi64(lo, v), _mm256_cmpgt_epi64(v, hi));
+    out |= _mm256_movemask_pd(_mm256_castsi256_pd(miss)) << (i * 4);
+  }
+  return (uint8_t)~out;
+}
+
+template <>
+inline uint8_t Match8<double>(const double *values, double lower,
+                              double upper) {
+  __m256d lo = _mm256_set1_pd(lower);
+  __m256d hi = _mm256_set1_pd(upper);
+  int out = 0;
+  for (int i = 0; i < 2; i++) {
+    __m256d v = _mm256_loadu_pd(values + i * 4);
+    __m256d in = _mm256_and_pd(_mm256_cmp_pd(v, lo, _CMP_GE_OQ),
+                               _mm256_cmp_pd(v, hi, _CMP_LE_OQ));
+    out |= _mm256_movemask_pd(in) << (i * 4);
+  }
+  return (uint8_t)out;
+}
+#endif  // __AVX2__
+
+template <typename T>
+int ScanRange(const char *data, const std::string &lower,
+              const std::string &upper, int doc_num, char *bitmap) {
+  if (lower.size() != sizeof(T) || upper.size() != sizeof(T)) return -1;
+  T lo, hi;
+  memcpy(&lo, lower.data(), sizeof(T));
+  memcpy(&hi, upper.data(), sizeof(T));
+  const T *values = reinterpret_cast<const T *>(data);
+
+  // every 8 docs fill one byte of bitmap, so threads never share a byte
+  int bytes = doc_num >> 3;
+  int num = 0;
+#pragma omp parallel for reduction(+ : num) if (doc_num > kParallelScanMin)
+  for (int b = 0; b < bytes; b++) {
+    uint8_t mask = Match8<T>(values + ((long)b << 3), lo, hi);
+    bitmap[b] = (char)mask;
+    num += __builtin_popcount(mask);
+  }
+  int remain = doc_num & 7;
+  if (remain > 0) {
+    uint8_t mask =
+        MatchScalar<T>(values + ((long)bytes << 3), remain, lo, hi);
+    bitmap[bytes] = (char)mask;
+    num += __builtin_popcount(mask);
+  }
+  return num;
+}
+
+}  // namespace
+
+ProfileColumn::ProfileColumn(enum DataType type, int max_doc_size)
+    : type_(type), max_doc_size_(max_doc_size), data_(nullptr) {
+  switch (type) {
+    case INT:
+      type_size_ = sizeof(int32_t);
+      break;
+    case LONG:
+      type_size_ = sizeof(int64_t);
+      break;
+    case FLOAT:
+      type_size_ = sizeof(float);
+      break;
+    case DOUBLE:
+      type_size_ = sizeof(double);
+      break;
+    default:
+      type_size_ = 0;
+  }
+}
+
+ProfileColumn::~ProfileColumn() {
+  if (data_ != nullptr) {
+    free(data_);
+    data_ = nullptr;
+  }
+}
+
+int ProfileColumn::Init() {
+  if (type_size_ == 0 || max_doc_size_ <= 0) {
+    LOG(ERROR) << "invalid column, type=" << type_
+               << ", max doc size=" << max_doc_size_;
+    return -1;
+  }
+  data_ = (char *)calloc((size_t)max_doc_size_, type_size_);
+  if (data_ == nullptr) {
+    LOG(ERROR) << "malloc column error, bytes=" << GetMemoryBytes();
+    return -2;
+  }
+  return 0;
+}
+
+int ProfileColumn::RangeScan(const std::string &lower,
+                             const std::string &upper, int doc_num,
+                             char *bitmap) const {
+  if (bitmap == nullptr || doc_num < 0 || doc_num > max_doc_size_) return -1;
+  switch (type_) {
+    case INT:
+      return ScanRange<int>(data_, lower, upper, doc_num, bitmap);
+    case LONG:
+      return ScanRange<long>(data_, lower, upper, doc_num, bitmap);
+    case FLOAT:
+      return ScanRange<float>(data_, lower, upper, doc_num, bitmap);
+    case DOUBLE:
+      return ScanRange<double>(data_, lower, upper, doc_num, bitmap);
+    default:
+      return -1;
+  }
+}
+
+}  // namespace tig_gamma
@@ -0,0 +1,64 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef PROFILE_COLUMN_H_
+#define PROFILE_COLUMN_H_
+
+#include <string.h>
+#include <string>
+#include "gamma_api.h"
+
+namespace tig_gamma {
+
+/** the values of one numeric field stored contiguously by docid, so a field
+ * can be read without strided row access and filtered by scanning
+ */
+class ProfileColumn {
+ public:
+  ProfileColumn(enum DataType type, int max_doc_size);
+
+  ~ProfileColumn();
+
+  /** malloc memory
+   *
+   * @return 0 if successed
+   */
+  int Init();
+
+  void Set(int docid, const char *value) {
+    memcpy(data_ + (long)docid * type_size_, value, type_size_);
+  }
+
+  const char *Get(int docid) const { return data_ + (long)docid * type_size_; }
+
+  const char *Data() const { return data_; }
+
+  /** scan docs in [0, doc_num) and set the bit of docid in bitmap if its value
+   * is in [lower, upper], lower and upper are raw bytes of the field type
+   *
+   * @param bitmap output, it should have (doc_num / 8 + 1) bytes at least
+   * @return the number of matched docs, -1 if parameters are invalid
+   */
+  int RangeScan(const std::string &lower, const std::string &upper,
+                int doc_num, char *bitmap) const;
+
+  long GetMemoryBytes() const { return (long)max_doc_size_ * type_size_; }
+
+  static bool IsNumeric(enum DataType type) {
+    return type == INT || type == LONG || type == FLOAT || type == DOUBLE;
+  }
+
+ private:
+  enum DataType type_;
+  int type_size_;
+  int max_doc_size_;
+  char *data_;
+};
+
+}  // namespace tig_gamma
+
+#endif  // PROFILE_COLUMN_H_
@@ -0,0 +1,337 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "profile_key_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "log.h"
+#include "utils.h"
+
+namespace tig_gamma {
+
+namespace {
+
+const uint32_t kKeyIndexMagic = 0x594b5047;  // "GPKY"
+const uint32_t kKeyIndexVersion = 2;
+// the header is padded to a page, so the mmapped table is page aligned
+const long kKeyIndexHeaderBytes = 4096;
+
+struct KeyIndexHeader {
+  uint32_t magic;
+  uint32_t version;
+  int64_t doc_num;
+  int64_t region_slots;
+  int32_t exact;
+  int64_t key_num;
+};
+
+// the finalizer of splitmix64, it is bijective
+inline uint64_t Mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+  return x ^ (x >> 31);
+}
+
+}  // namespace
+
+ProfileKeyIndex::ProfileKeyIndex(int init_doc_num, bool exact)
+    : exact_(exact),
+      table_(nullptr),
+      key_num_(0),
+      mem_bytes_(0),
+      mapped_(nullptr),
+      mapped_bytes_(0) {
+  // load factor is 0.77 at most, slots of a region are a multiple of 64
+  uint64_t regions = 1UL << kRegionBits;
+  init_region_slots_ =
+      ((uint64_t)init_doc_num * 13 / 10 + regions - 1) / regions;
+  init_region_slots_ = std::max((init_region_slots_ + 63) / 64 * 64, 64UL);
+}
+
+ProfileKeyIndex::~ProfileKeyIndex() { Free(); }
+
+void ProfileKeyIndex::Free() {
+  retired_tables_.push_back(table_.load());
+  for (Table *table : retired_tables_) {
+    if (table == nullptr) continue;
+    if (table->owned) {
+      free(table->fps);
+      free(table->docids);
+    }
+    delete table;
+  }
+  retired_tables_.clear();
+  table_ = nullptr;
+  if (mapped_ != nullptr) {
+    munmap(mapped_, mapped_bytes_);
+    mapped_ = nullptr;
+    mapped_bytes_ = 0;
+  }
+  key_num_ = 0;
+  mem_bytes_ = 0;
+}
+
+ProfileKeyIndex::Table *ProfileKeyIndex::NewTable(uint64_t region_slots) {
+  uint64_t slots = region_slots << kRegionBits;
+  Table *table = new Table;
+  table->region_slots = region_slots;
+  table->slots = slots;
+  table->fps = (uint64_t *)malloc(slots * sizeof(uint64_t));
+  table->docids = (int *)malloc(slots * sizeof(int));
+  table->owned = true;
+  if (table->fps == nullptr || table->docids == nullptr) {
+    LOG(ERROR) << "malloc key index error, slots=" << slots;
+    free(table->fps);
+    free(table->docids);
+    delete table;
+    return nullptr;
+  }
+  memset(table->docids, -1, slots * sizeof(int));
+  mem_bytes_ += slots * (sizeof(uint64_t) + sizeof(int));
+  return table;
+}
+
+int ProfileKeyIndex::Init() {
+  table_ = NewTable(init_region_slots_);
+  return table_ == nullptr ? -1 : 0;
+}
+
+void ProfileKeyIndex::CopyRegion(const Table *from, int r, int doc_num,
+                                 uint64_t region_slots, uint64_t *fps,
+                                 int *docids) {
+  const uint64_t *from_fps = from->fps + r * from->region_slots;
+  const int *from_docids = from->docids + r * from->region_slots;
+  for (uint64_t i = 0; i < from->region_slots; i++) {
+    int docid = __atomic_load_n(&from_docids[i], __ATOMIC_ACQUIRE);
+    if (docid < 0 || docid >= doc_num) continue;
+    // keys are unique in the table, so they are placed without matching
+    uint64_t fp = from_fps[i];
+    uint64_t pos = ((fp & 0xffffffffUL) * region_slots) >> 32;
+    while (docids[pos] >= 0) {
+      if (++pos == region_slots) pos = 0;
+    }
+    fps[pos] = fp;
+    docids[pos] = docid;
+  }
+}
+
+int ProfileKeyIndex::Grow() {
+  Table *table = table_.load(std::memory_order_relaxed);
+  Table *new_table = NewTable(table->region_slots * 2);
+  if (new_table == nullptr) return -1;
+  const int regions = 1 << kRegionBits;
+#pragma omp parallel for
+  for (int r = 0; r < regions; r++) {
+    uint64_t offset = r * new_table->region_slots;
+    CopyRegion(table, r, std::numeric_limits<int>::max(),
+               new_table->region_slots, new_table->fps + offset,
+               new_table->docids + offset);
+  }
+  table_.store(new_table, std::memory_order_release);
+  // readers may still probe it
+  retired_tables_.push_back(table);
+  LOG(INFO) << "key index grows to " << new_table->slots << " slots, key num="
+            << key_num_;
+  return 0;
+}
+
+uint64_t ProfileKeyIndex::Fingerprint(long key) { return Mix((uint64_t)key); }
+
+uint64_t ProfileKeyIndex::Fingerprint(const char *key, int len) {
+  // FNV-1a, it is stable between builds as it's persisted
+  uint64_t h = 0xcbf29ce484222325UL;
+  for (int i = 0; i < len; i++) {
+    h ^= (uint8_t)key[i];
+    h *= 0x100000001b3UL;
+  }
+  return Mix(h);
+}
+
+int ProfileKeyIndex::Build(int doc_num,
+                           const std::function<uint64_t(int)> &fingerprint,
+                           const std::function<bool(int, int)> &same) {
+  if (doc_num <= 0) return 0;
+  const int regions = 1 << kRegionBits;
+  // sized for all the docs up front, the index is empty
+  uint64_t region_slots = ((uint64_t)doc_num * 13 / 10 + regions - 1) / regions;
+  region_slots = (region_slots + 63) / 64 * 64;
+  if (region_slots > table_.load()->region_slots) {
+    Table *table = NewTable(region_slots);
+    if (table == nullptr) return -1;
+    retired_tables_.push_back(table_.load());
+    table_ = table;
+  }
+  Table *table = table_.load();
+
+  std::vector<uint64_t> fps(doc_num);
+#pragma omp parallel for
+  for (int docid = 0; docid < doc_num; docid++) {
+    fps[docid] = fingerprint(docid);
+  }
+
+  // partition docids by region, docids keep ascending in each region so the
+  // first doc of a key wins as in adding one by one
+  std::vector<int> begins(regions + 1, 0);
+  for (int docid = 0; docid < doc_num; docid++) {
+    begins[(fps[docid] >> (64 - kRegionBits)) + 1]++;
+  }
+  for (int r = 0; r < regions; r++) begins[r + 1] += begins[r];
+  std::vector<int> docids(doc_num);
+  std::vector<int> pos(begins.begin(), begins.end() - 1);
+  for (int docid = 0; docid < doc_num; docid++) {
+    docids[pos[fps[docid] >> (64 - kRegionBits)]++] = docid;
+  }
+
+  // the docs of a region after it is full, they are added after growing
+  std::vector<std::vector<int>> left(regions);
+  long key_num = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : key_num)
+  for (int r = 0; r < regions; r++) {
+    for (int i = begins[r]; i < begins[r + 1]; i++) {
+      int docid = docids[i];
+      if (!left[r].empty()) {
+        left[r].push_back(docid);
+        continue;
+      }
+      int ret = Insert(table, fps[docid], docid,
+                       [&](int other) { return same(docid, other); });
+      if (ret == 0) key_num++;
+      if (ret < 0) left[r].push_back(docid);
+    }
+  }
+  key_num_ += key_num;
+
+  for (int r = 0; r < regions; r++) {
+    for (int docid : left[r]) {
+      if (Add(fps[docid], docid,
+              [&](int other) { return same(docid, other); }) < 0) {
+        LOG(ERROR) << "add key of doc " << docid << " to key index error";
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+int ProfileKeyIndex::Dump(const std::string &file, int doc_num) const {
+  FILE *fp = fopen(file.c_str(), "wb");
+  if (fp == nullptr) {
+    LOG(ERROR) << "open " << file << " error: " << strerror(errno);
+    return -1;
+  }
+  const Table *table = table_.load(std::memory_order_acquire);
+  char header_page[kKeyIndexHeaderBytes];
+  memset(header_page, 0, sizeof(header_page));
+  KeyIndexHeader header;
+  header.magic = kKeyIndexMagic;
+  header.version = kKeyIndexVersion;
+  header.doc_num = doc_num;
+  header.region_slots = table->region_slots;
+  header.exact = exact_;
+  header.key_num = 0;
+
+  // the keys of docs < doc_num are rehashed region by region without the
+  // others, which may be in their probing chains. They were all added
+  // before the dump, so both passes see the same keys
+  const int regions = 1 << kRegionBits;
+  std::vector<uint64_t> fps(table->region_slots);
+  std::vector<int> docids(table->region_slots);
+  bool ok = fwrite(header_page, sizeof(header_page), 1, fp) == 1;
+  for (int pass = 0; pass < 2 && ok; pass++) {
+    for (int r = 0; r < regions && ok; r++) {
+      std::fill(docids.begin(), docids.end(), -1);
+      CopyRegion(table, r, doc_num, table->region_slots, fps.data(),
+                 docids.data());
+      if (pass == 0) {
+        ok = fwrite(fps.data(), sizeof(uint64_t), fps.size(), fp) ==
+             fps.size();
+        header.key_num +=
+            std::count_if(docids.begin(), docids.end(),
+                          [](int docid) { return docid >= 0; });
+      } else {
+        ok = fwrite(docids.data(), sizeof(int), docids.size(), fp) ==
+             docids.size();
+      }
+    }
+  }
+  memcpy(header_page, &header, sizeof(header));
+  ok = ok && fseek(fp, 0, SEEK_SET) == 0 &&
+       fwrite(header_page, sizeof(header_page), 1, fp) == 1;
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok) {
+    LOG(ERROR) << "write key index to " << file << " error";
+    return -2;
+  }
+  return 0;
+}
+
+int ProfileKeyIndex::Load(const std::string &file, int doc_num) {
+  long file_size = utils::get_file_size(file);
+  if (file_size < kKeyIndexHeaderBytes) {
+    LOG(INFO) << "key index " << file << " isn't usable, file size="
+              << file_size;
+    return -1;
+  }
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd == -1) {
+    LOG(ERROR) << "open " << file << " error: " << strerror(errno);
+    return -1;
+  }
+  KeyIndexHeader header;
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+    LOG(ERROR) << "read " << file << " error: " << strerror(errno);
+    close(fd);
+    return -1;
+  }
+  uint64_t slots = (uint64_t)header.region_slots << kRegionBits;
+  long expected =
+      kKeyIndexHeaderBytes + slots * (sizeof(uint64_t) + sizeof(int));
+  if (header.magic != kKeyIndexMagic || header.version != kKeyIndexVersion ||
+      header.doc_num != doc_num || header.region_slots <= 0 ||
+      header.exact != exact_ || file_size != expected) {
+    LOG(INFO) << "key index " << file << " isn't usable, doc num="
+              << header.doc_num << ", region slots=" << header.region_slots
+              << ", file size=" << file_size << ", expected=" << expected;
+    close(fd);
+    return -1;
+  }
+  // private mapping, keys added later are copied on write
+  char *data = (char *)mmap(nullptr, file_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "mmap " << file << " error: " << strerror(errno);
+    return -1;
+  }
+  Free();
+  mapped_ = data;
+  mapped_bytes_ = file_size;
+  Table *table = new Table;
+  table->region_slots = header.region_slots;
+  table->slots = slots;
+  table->fps = (uint64_t *)(data + kKeyIndexHeaderBytes);
+  table->docids = (int *)(data + kKeyIndexHeaderBytes +
+                          slots * sizeof(uint64_t));
+  table->owned = false;
+  table_ = table;
+  key_num_ = header.key_num;
+  mem_bytes_ = file_size;
+  return 0;
+}
+
+}  // namespace tig_gamma
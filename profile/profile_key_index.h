@@ -0,0 +1,175 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef PROFILE_KEY_INDEX_H_
+#define PROFILE_KEY_INDEX_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace tig_gamma {
+
+/** key to docid index of profile, keys are stored as 64-bit fingerprints
+ * with docids in an open addressing table, so there is no key copy per doc.
+ * A fingerprint of long key is the key itself mixed bijectively, a string key
+ * is verified by its _id in profile, which is passed to the index as a
+ * matcher of docid. The table is split into regions by the high bits of
+ * fingerprint, then it can be built by regions in parallel.
+ *
+ * It supports one writer and concurrent readers, a key is never removed or
+ * remapped. The table is doubled and rehashed when it's too loaded, readers
+ * probe the table they loaded, so replaced tables are kept until the index
+ * is destroyed, they take less memory than the current one altogether.
+ */
+class ProfileKeyIndex {
+ public:
+  /** @param init_doc_num  the number of keys the first table holds */
+  ProfileKeyIndex(int init_doc_num, bool exact);
+
+  ~ProfileKeyIndex();
+
+  /** malloc memory
+   *
+   * @return 0 if successed
+   */
+  int Init();
+
+  static uint64_t Fingerprint(long key);
+
+  static uint64_t Fingerprint(const char *key, int len);
+
+  /** find the docid of key
+   *
+   * @param match callable as bool(int docid), tells if the key of docid is
+   *              the key to find, it isn't called if the index is exact
+   * @return docid, -1 if not found
+   */
+  template <typename Match>
+  int Find(uint64_t fp, Match match) const {
+    const Table *table = table_.load(std::memory_order_acquire);
+    uint64_t pos = table->Home(fp);
+    uint64_t region_end =
+        pos - pos % table->region_slots + table->region_slots;
+    for (uint64_t i = 0; i < table->region_slots; i++) {
+      int docid = __atomic_load_n(&table->docids[pos], __ATOMIC_ACQUIRE);
+      if (docid < 0) return -1;
+      if (table->fps[pos] == fp && (exact_ || match(docid))) return docid;
+      if (++pos == region_end) pos -= table->region_slots;
+    }
+    return -1;
+  }
+
+  /** add key of docid if it doesn't exist, the table grows if it's full
+   *
+   * @return 0 if successed, 1 if key exists, -1 if growing failed
+   */
+  template <typename Match>
+  int Add(uint64_t fp, int docid, Match match) {
+    Table *table = table_.load(std::memory_order_relaxed);
+    if ((uint64_t)(key_num_ + 1) * 13 > table->slots * 10 && Grow()) {
+      return -1;
+    }
+    while (true) {
+      table = table_.load(std::memory_order_relaxed);
+      int ret = Insert(table, fp, docid, match);
+      if (ret == 0) key_num_++;
+      // the region of fp is full while others are not
+      if (ret >= 0 || Grow()) return ret;
+    }
+  }
+
+  /** add keys of docs in [0, doc_num) by regions in parallel, the index
+   * should be empty
+   *
+   * @param fingerprint callable as uint64_t(int docid)
+   * @param same callable as bool(int docid, int other), tells if two docs
+   *             have the same key
+   * @return 0 if successed
+   */
+  int Build(int doc_num, const std::function<uint64_t(int)> &fingerprint,
+            const std::function<bool(int, int)> &same);
+
+  /** write the index to file, keys of docs >= doc_num are excluded
+   *
+   * @return 0 if successed
+   */
+  int Dump(const std::string &file, int doc_num) const;
+
+  /** mmap the index dumped of doc_num docs, it is copied on write
+   *
+   * @return 0 if successed, the index is unchanged if failed
+   */
+  int Load(const std::string &file, int doc_num);
+
+  long GetMemoryBytes() const { return mem_bytes_; }
+
+ private:
+  static const int kRegionBits = 6;
+
+  struct Table {
+    uint64_t region_slots;
+    uint64_t slots;
+    uint64_t *fps;
+    int *docids;
+    bool owned;  // false if it's in the mmapped file
+
+    uint64_t Home(uint64_t fp) const {
+      uint64_t region = fp >> (64 - kRegionBits);
+      // map the low 32 bits to [0, region_slots) without modulo
+      uint64_t offset = ((fp & 0xffffffffUL) * region_slots) >> 32;
+      return region * region_slots + offset;
+    }
+  };
+
+  // @return 0 if successed, 1 if key exists, -1 if the region is full
+  template <typename Match>
+  int Insert(Table *table, uint64_t fp, int docid, Match match) {
+    uint64_t pos = table->Home(fp);
+    uint64_t region_end =
+        pos - pos % table->region_slots + table->region_slots;
+    for (uint64_t i = 0; i < table->region_slots; i++) {
+      int cur = table->docids[pos];
+      if (cur < 0) {
+        table->fps[pos] = fp;
+        __atomic_store_n(&table->docids[pos], docid, __ATOMIC_RELEASE);
+        return 0;
+      }
+      if (table->fps[pos] == fp && (exact_ || match(cur))) return 1;
+      if (++pos == region_end) pos -= table->region_slots;
+    }
+    return -1;
+  }
+
+  // a table of regions of region_slots, no key is in it
+  Table *NewTable(uint64_t region_slots);
+
+  // the keys of region r with docid < doc_num, rehashed into fps and docids
+  // of region_slots
+  static void CopyRegion(const Table *from, int r, int doc_num,
+                         uint64_t region_slots, uint64_t *fps, int *docids);
+
+  // replace the table by a rehashed one of double size
+  int Grow();
+
+  void Free();
+
+  bool exact_;
+  uint64_t init_region_slots_;
+  std::atomic<Table *> table_;
+  std::vector<Table *> retired_tables_;
+  long key_num_;
+  long mem_bytes_;
+  char *mapped_;  // the mmapped file if loaded, a table may be in it
+  long mapped_bytes_;
+};
+
+}  // namespace tig_gamma
+
+#endif  // PROFILE_KEY_INDEX_H_
@@ -0,0 +1,99 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "compaction_scheduler.h"
+
+#include <chrono>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "log.h"
+#include "metrics.h"
+#include "realtime_mem_data.h"
+
+namespace tig_gamma {
+namespace realtime {
+
+CompactionScheduler::CompactionScheduler(RealTimeMemData *data)
+    : data_(data),
+      scans_(new std::atomic<uint32_t>[data->buckets_num_]),
+      pending_buckets_(0),
+      wasted_bytes_(0) {
+  for (size_t i = 0; i < data_->buckets_num_; i++) scans_[i] = 0;
+}
+
+int CompactionScheduler::RunRound() {
+  utils::StageTimer timer(utils::kStageCompaction);
+  auto start = std::chrono::steady_clock::now();
+  long entry_bytes = data_->code_bytes_per_vec_ + sizeof(long);
+
+  // (score, bucket_no)
+  std::priority_queue<std::pair<double, int>> queue;
+  long wasted_bytes = 0;
+  for (int i = 0; i < (int)data_->buckets_num_; i++) {
+    RTInvertBucketData *invert = data_->cur_invert_ptr_;
+    uint32_t scans = scans_[i].load(std::memory_order_relaxed);
+    scans_[i].store(scans / 2, std::memory_order_relaxed);
+
+    int size = invert->retrieve_idx_pos_[i];
+    int deleted = invert->deleted_nums_[i];
+    if (size <= 0 || deleted < options_.min_deleted_num ||
+        deleted < options_.min_deleted_ratio * size) {
+      continue;
+    }
+    long waste = deleted * entry_bytes;
+    wasted_bytes += waste;
+    queue.emplace((double)waste * (1 + scans), i);
+  }
+
+  int compacted = 0;
+  long copied_bytes = 0, compacted_codes = 0;
+  while (not queue.empty()) {
+    int bucket_no = queue.top().second;
+    int size = data_->cur_invert_ptr_->retrieve_idx_pos_[bucket_no];
+    long cost = size * entry_bytes;
+    long elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    if (compacted > 0 && (copied_bytes + cost > options_.max_bytes_per_round ||
+                          elapsed_ms >= options_.max_ms_per_round)) {
+      break;
+    }
+    queue.pop();
+    if (!data_->CompactBucket(bucket_no)) {
+      LOG(ERROR) << "compact bucket=" << bucket_no << " error!";
+      pending_buckets_ = queue.size() + 1;
+      return -2;
+    }
+    compacted++;
+    copied_bytes += cost;
+    compacted_codes +=
+        size - data_->cur_invert_ptr_->retrieve_idx_pos_[bucket_no];
+  }
+  pending_buckets_ = queue.size();
+  wasted_bytes_ = wasted_bytes;
+
+  if (compacted == 0) {
+    timer.Discard();
+    return 0;
+  }
+  utils::Metrics &metrics = utils::Metrics::Instance();
+  metrics.Add(utils::kCounterCompactions, compacted);
+  metrics.Add(utils::kCounterCompactedCodes, compacted_codes);
+  metrics.Add(utils::kCounterCompactedBytes, copied_bytes);
+  LOG(INFO) << "compaction round: buckets=" << compacted
+            << ", compacted codes=" << compacted_codes
+            << ", copied bytes=" << copied_bytes
+            << ", pending buckets=" << pending_buckets_
+            << ", total compacted num="
+            << data_->cur_invert_ptr_->compacted_num_;
+  return 0;
+}
+
+}  // namespace realtime
+}  // namespace tig_gamma
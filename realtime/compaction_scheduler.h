@@ -0,0 +1,85 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef REALTIME_COMPACTION_SCHEDULER_H_
+#define REALTIME_COMPACTION_SCHEDULER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+namespace tig_gamma {
+namespace realtime {
+
+struct RealTimeMemData;
+
+struct CompactionOptions {
+  // a bucket is compacted if at least this ratio of its codes are deleted
+  double min_deleted_ratio;
+  // and at least this number
+  int min_deleted_num;
+  // budget of a round, the bytes of buckets copied and the time. A round
+  // compacts at least one bucket, so large buckets aren't starved
+  long max_bytes_per_round;
+  int max_ms_per_round;
+
+  CompactionOptions()
+      : min_deleted_ratio(0.3),
+        min_deleted_num(1),
+        max_bytes_per_round(64L << 20),
+        max_ms_per_round(100) {}
+};
+
+/** decides which buckets of the realtime inverted lists are compacted and
+ * when. Buckets are scored by the bytes of their deleted codes times how
+ * often they are scanned, since that's the work a compaction saves, and the
+ * most wasteful ones are compacted first until the budget of a round runs
+ * out.
+ *
+ * Compacting a bucket replaces its arrays, which is only safe on the
+ * thread adding to them, so RunRound() is called from the indexing thread on
+ * every round, with or without new vectors. Scans are recorded from any
+ * thread, and their counts are halved each round to follow recent queries.
+ */
+class CompactionScheduler {
+ public:
+  explicit CompactionScheduler(RealTimeMemData *data);
+
+  void SetOptions(const CompactionOptions &options) { options_ = options; }
+
+  const CompactionOptions &Options() const { return options_; }
+
+  void RecordScan(int bucket_no) {
+    scans_[bucket_no].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /** compact the buckets over the thresholds within the budget
+   *
+   * @return 0 if successed
+   */
+  int RunRound();
+
+  // buckets over the thresholds left by the last round
+  int PendingBuckets() const { return pending_buckets_; }
+
+  // bytes of deleted codes in the buckets over the thresholds, seen by the
+  // last round before compacting
+  long WastedBytes() const { return wasted_bytes_; }
+
+ private:
+  RealTimeMemData *data_;
+  CompactionOptions options_;
+  std::unique_ptr<std::atomic<uint32_t>[]> scans_;
+  int pending_buckets_;
+  long wasted_bytes_;
+};
+
+}  // namespace realtime
+}  // namespace tig_gamma
+
+#endif  // REALTIME_COMPACTION_SCHEDULER_H_
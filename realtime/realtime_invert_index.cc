@@ -40,6 +40,7 @@ bool RTInvertIndex::Init() {
   if (nullptr == cur_ptr_) return false;
 
   if (!cur_ptr_->Init()) return false;
+  cur_ptr_->SetCompactionOptions(compaction_options_);
   return true;
 }
 
@@ -108,8 +109,17 @@ int RTInvertIndex::Load(const std::vector<std::string> &index_dirs,
 
 void RTInvertIndex::PrintBucketSize() { cur_ptr_->PrintBucketSize(); }
 
+void RTInvertIndex::RecordScan(size_t bucket_no) {
+  cur_ptr_->RecordScan(bucket_no);
+}
+
 int RTInvertIndex::CompactIfNeed() { return cur_ptr_->CompactIfNeed(); }
 
+void RTInvertIndex::SetCompactionOptions(const CompactionOptions &options) {
+  compaction_options_ = options;
+  cur_ptr_->SetCompactionOptions(options);
+}
+
 int RTInvertIndex::Delete(int *vids, int n) {
   return cur_ptr_->Delete(vids, n);
 }
@@ -127,6 +137,8 @@ size_t RTInvertedLists::list_size(size_t list_no) const {
   bool ret = rt_invert_index_ptr_->GetIvtList(list_no, ivt_list, list_size,
                                               ivt_codes_list);
   if (!ret) return 0;
+  // a probed list is asked for its size first, count it for compaction
+  rt_invert_index_ptr_->RecordScan(list_no);
   return list_size;
 }
 
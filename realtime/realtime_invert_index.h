@@ -55,13 +55,17 @@ struct RTInvertIndex {
                     std::vector<std::vector<const uint8_t *>> &bucket_codes,
                     std::vector<std::vector<long>> &bucket_vids);
 
+  // @return the number of dumped entries, < 0 if error
   int Dump(const std::string &file_path, const std::string &vec_name,
            int max_vid);
+  // @return the number of vids loaded, < 0 if error
   int Load(const std::vector<std::string> &index_dirs,
            const std::string &vec_name);
 
   void PrintBucketSize();
   int CompactIfNeed();
+  void SetCompactionOptions(const CompactionOptions &options);
+  void RecordScan(size_t bucket_no);
   int Delete(int *vids, int n);
 
  private:
@@ -74,6 +78,7 @@ struct RTInvertIndex {
   const char *docids_bitmap_;
 
   RealTimeMemData *cur_ptr_;
+  CompactionOptions compaction_options_;
 };
 
 using idx_t = faiss::Index::idx_t;
@@ -10,8 +10,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <algorithm>
 #include "bitmap.h"
 #include "log.h"
+#include "metrics.h"
 #include "utils.h"
 
 namespace tig_gamma {
@@ -22,7 +24,6 @@ RTInvertBucketData::RTInvertBucketData(RTInvertBucketData *other) {
   retrieve_idx_pos_ = other->retrieve_idx_pos_;
   cur_bucket_keys_ = other->cur_bucket_keys_;
   codes_array_ = other->codes_array_;
-  dump_latest_pos_ = other->dump_latest_pos_;
   vid_mgr_ = other->vid_mgr_;
   docids_bitmap_ = other->docids_bitmap_;
   vid_bucket_no_pos_ = other->vid_bucket_no_pos_;
@@ -37,7 +38,6 @@ RTInvertBucketData::RTInvertBucketData(VIDMgr *vid_mgr,
   retrieve_idx_pos_ = nullptr;
   cur_bucket_keys_ = nullptr;
   codes_array_ = nullptr;
-  dump_latest_pos_ = nullptr;
   vid_mgr_ = vid_mgr;
   docids_bitmap_ = docids_bitmap;
   vid_bucket_no_pos_ = nullptr;
@@ -68,8 +68,8 @@ bool RTInvertBucketData::Init(const size_t &buckets_num,
     cur_bucket_keys_[i] = bucket_keys;
     deleted_nums_[i] = 0;
   }
-  vid_bucket_no_pos_ = new std::atomic<long>[max_vec_size];
-  for (int i = 0; i < max_vec_size; i++) vid_bucket_no_pos_[i] = -1;
+  vid_bucket_no_pos_ =
+      new utils::PagedArray<std::atomic<long>, long>(max_vec_size, -1);
 
   total_mem_bytes += buckets_num * bucket_keys * sizeof(long);
   total_mem_bytes +=
@@ -79,10 +79,7 @@ bool RTInvertBucketData::Init(const size_t &buckets_num,
   retrieve_idx_pos_ = new (std::nothrow) int[buckets_num];
   if (retrieve_idx_pos_ == nullptr) return false;
   memset(retrieve_idx_pos_, 0, buckets_num * sizeof(int));
-  dump_latest_pos_ = new (std::nothrow) int[buckets_num];
-  if (dump_latest_pos_ == nullptr) return false;
-  memset(dump_latest_pos_, 0, buckets_num * sizeof(int));
-  total_mem_bytes += buckets_num * sizeof(int) * 2;
+  total_mem_bytes += buckets_num * sizeof(int);
   buckets_num_ = buckets_num;
 
   LOG(INFO) << "===init total_mem_bytes is " << total_mem_bytes << "===";
@@ -104,9 +101,14 @@ bool RTInvertBucketData::CompactBucket(const size_t &bucket_no,
   int batch_num = 0;
   int new_pos = 0;
   for (int i = 0; i <= old_pos; i++) {
-    if (i == old_pos || old_idx_array[i] & kDelIdxMask ||
-        bitmap::test(docids_bitmap_,
-                     vid_mgr_->VID2DocID(old_idx_array[i] & kRecoverIdxMask))) {
+    bool dropped = i == old_pos || old_idx_array[i] & kDelIdxMask;
+    if (!dropped && bitmap::test(docids_bitmap_,
+                                 vid_mgr_->VID2DocID(old_idx_array[i]))) {
+      // no longer indexed, so a later delete of it isn't counted again
+      (*vid_bucket_no_pos_)[old_idx_array[i]] = -1;
+      dropped = true;
+    }
+    if (dropped) {
       if (batch_num > 0) {
         memcpy((void *)(idx_array + pos), (void *)idx_batch_header,
                sizeof(long) * batch_num);
@@ -125,7 +127,7 @@ bool RTInvertBucketData::CompactBucket(const size_t &bucket_no,
       idx_batch_header = old_idx_array + i;
       code_batch_header = old_codes_array + i * code_bytes_per_vec;
     }
-    vid_bucket_no_pos_[old_idx_array[i]] = bucket_no << 32 | new_pos;
+    (*vid_bucket_no_pos_)[old_idx_array[i]] = bucket_no << 32 | new_pos;
     new_pos++;
     batch_num++;
   }
@@ -175,31 +177,8 @@ bool RTInvertBucketData::ExtendBucketMem(const size_t &bucket_no,
   return true;
 }
 
-int RTInvertBucketData::GetCurDumpPos(const size_t &bucket_no, int max_vid,
-                                      int &dump_start_pos, int &size) {
-  int start_pos = dump_latest_pos_[bucket_no];
-  int end_pos = retrieve_idx_pos_[bucket_no];
-  if (end_pos == 0) {
-    LOG(ERROR) << "bucket no=" << bucket_no << "has no data to dump";
-    return -1;
-  }
-  if (start_pos > end_pos) {
-    LOG(ERROR) << "the latest dumping pos exceed the max retrieval pos";
-    return -1;
-  }
-  while ((long)max_vid < idx_array_[bucket_no][--end_pos])
-    ;
-  if (start_pos > end_pos) {
-    return -2;
-  }
-  dump_start_pos = start_pos;
-  size = end_pos - start_pos + 1;
-  dump_latest_pos_[bucket_no] += size;
-  return 0;
-}
-
 void RTInvertBucketData::Delete(int vid) {
-  long bucket_no_pos = vid_bucket_no_pos_[vid];
+  long bucket_no_pos = (*vid_bucket_no_pos_)[vid];
   if (bucket_no_pos == -1) return;  // do nothing
   int bucket_no = bucket_no_pos >> 32;
   // only increase bucket's deleted counter
@@ -216,30 +195,36 @@ RealTimeMemData::RealTimeMemData(size_t buckets_num, long max_vec_size,
       code_bytes_per_vec_(code_bytes_per_vec),
       max_vec_size_(max_vec_size),
       vid_mgr_(vid_mgr),
-      docids_bitmap_(docids_bitmap) {
+      docids_bitmap_(docids_bitmap),
+      dumping_(false),
+      dumped_max_vid_(-1),
+      delta_segments_(0) {
   cur_invert_ptr_ = nullptr;
   extend_invert_ptr_ = nullptr;
   total_mem_bytes_ = 0;
+  compaction_scheduler_ = new CompactionScheduler(this);
 }
 
 RealTimeMemData::~RealTimeMemData() {
   if (cur_invert_ptr_) {
     for (size_t i = 0; i < buckets_num_; i++) {
-      if (cur_invert_ptr_->idx_array_)
+      if (cur_invert_ptr_->idx_array_ &&
+          !IsMapped(cur_invert_ptr_->idx_array_[i]))
         CHECK_DELETE_ARRAY(cur_invert_ptr_->idx_array_[i]);
-      if (cur_invert_ptr_->codes_array_)
+      if (cur_invert_ptr_->codes_array_ &&
+          !IsMapped(cur_invert_ptr_->codes_array_[i]))
         CHECK_DELETE_ARRAY(cur_invert_ptr_->codes_array_[i]);
     }
     CHECK_DELETE_ARRAY(cur_invert_ptr_->idx_array_);
     CHECK_DELETE_ARRAY(cur_invert_ptr_->retrieve_idx_pos_);
     CHECK_DELETE_ARRAY(cur_invert_ptr_->cur_bucket_keys_);
     CHECK_DELETE_ARRAY(cur_invert_ptr_->codes_array_);
-    CHECK_DELETE_ARRAY(cur_invert_ptr_->dump_latest_pos_);
-    CHECK_DELETE_ARRAY(cur_invert_ptr_->vid_bucket_no_pos_);
+    CHECK_DELETE(cur_invert_ptr_->vid_bucket_no_pos_);
     CHECK_DELETE_ARRAY(cur_invert_ptr_->deleted_nums_);
   }
   CHECK_DELETE(cur_invert_ptr_);
   CHECK_DELETE(extend_invert_ptr_);
+  CHECK_DELETE(compaction_scheduler_);
 }
 
 bool RealTimeMemData::Init() {
@@ -278,7 +263,8 @@ bool RealTimeMemData::AddKeys(size_t list_no, size_t n, std::vector<long> &keys,
     if (keys[i] >= max_vec_size_) {
       return false;
     }
-    cur_invert_ptr_->vid_bucket_no_pos_[keys[i]] = list_no << 32 | retrive_pos;
+    (*cur_invert_ptr_->vid_bucket_no_pos_)[keys[i]] =
+        list_no << 32 | retrive_pos;
     retrive_pos++;
     if (bitmap::test(cur_invert_ptr_->docids_bitmap_,
                      cur_invert_ptr_->vid_mgr_->VID2DocID(keys[i]))) {
@@ -294,37 +280,48 @@ bool RealTimeMemData::AddKeys(size_t list_no, size_t n, std::vector<long> &keys,
 
 int RealTimeMemData::Update(int bucket_no, int vid,
                             std::vector<uint8_t> &codes) {
-  long bucket_no_pos = cur_invert_ptr_->vid_bucket_no_pos_[vid];
+  long bucket_no_pos = (*cur_invert_ptr_->vid_bucket_no_pos_)[vid];
   if (bucket_no_pos == -1) return 0;  // do nothing
   int old_bucket_no = bucket_no_pos >> 32;
   int old_pos = bucket_no_pos & 0xffffffff;
   assert(code_bytes_per_vec_ == codes.size());
+  int ret = 0;
   if (old_bucket_no == bucket_no) {
     uint8_t *codes_array = cur_invert_ptr_->codes_array_[old_bucket_no];
     memcpy(codes_array + old_pos * code_bytes_per_vec_, codes.data(),
            codes.size() * sizeof(uint8_t));
-    return 0;
-  }
-
-  // mark deleted
-  cur_invert_ptr_->idx_array_[old_bucket_no][old_pos] |= kDelIdxMask;
-  cur_invert_ptr_->deleted_nums_[old_bucket_no]++;
-  std::vector<long> keys;
-  keys.push_back(vid);
-
-  return AddKeys(bucket_no, 1, keys, codes);
+  } else {
+    // mark deleted
+    cur_invert_ptr_->idx_array_[old_bucket_no][old_pos] |= kDelIdxMask;
+    cur_invert_ptr_->deleted_nums_[old_bucket_no]++;
+    std::vector<long> keys;
+    keys.push_back(vid);
+
+    ret = AddKeys(bucket_no, 1, keys, codes);
+  }
+  // checked after the code is written, a dump raising dumped_max_vid_
+  // before reads the new code
+  if (vid <= dumped_max_vid_) {
+    std::lock_guard<std::mutex> lock(updated_mutex_);
+    updated_vids_.push_back(vid);
+  }
+  return ret;
 }
 
 int RealTimeMemData::Delete(int *vids, int n) {
+  // a compaction resets the counters of the buckets it copies, deletes are
+  // counted before or after it
+  std::lock_guard<std::mutex> lock(swap_mutex_);
   for (int i = 0; i < n; i++) {
-    RTInvertBucketData *invert_ptr = cur_invert_ptr_;
-    invert_ptr->Delete(vids[i]);
+    cur_invert_ptr_->Delete(vids[i]);
   }
   return 0;
 }
 
 void RealTimeMemData::FreeOldData(long *idx, uint8_t *codes,
                                   RTInvertBucketData *invert, long size) {
+  if (IsMapped(idx)) idx = nullptr;
+  if (IsMapped(codes)) codes = nullptr;
   if (idx) {
     delete idx;
     idx = nullptr;
@@ -341,28 +338,7 @@ void RealTimeMemData::FreeOldData(long *idx, uint8_t *codes,
 }
 
 int RealTimeMemData::CompactIfNeed() {
-  long last_compacted_num = cur_invert_ptr_->compacted_num_;
-  for (int i = 0; i < (int)buckets_num_; i++) {
-    if (Compactable(i)) {
-      if (!CompactBucket(i)) {
-        LOG(ERROR) << "compact bucket=" << i << " error!";
-        return -2;
-      }
-    }
-  }
-  if (cur_invert_ptr_->compacted_num_ > last_compacted_num) {
-    LOG(INFO) << "Compaction happened, compacted num="
-              << cur_invert_ptr_->compacted_num_ - last_compacted_num
-              << ", last compacted num=" << last_compacted_num
-              << ", current compacted num=" << cur_invert_ptr_->compacted_num_;
-  }
-  return 0;
-}
-
-bool RealTimeMemData::Compactable(int bucket_no) {
-  return (float)cur_invert_ptr_->deleted_nums_[bucket_no] /
-             cur_invert_ptr_->retrieve_idx_pos_[bucket_no] >=
-         0.3f;
+  return compaction_scheduler_->RunRound();
 }
 
 bool RealTimeMemData::CompactBucket(int bucket_no) {
@@ -403,6 +379,8 @@ int RealTimeMemData::ExtendBucketIfNeed(int bucket_no, size_t keys_size) {
       if (!ExtendBucketMem(bucket_no)) {
         return -2;
       }
+      // a bucket mapped from a segment is full, doubling may not be enough
+      return ExtendBucketIfNeed(bucket_no, keys_size);
     }
   }
   return 0;
@@ -413,6 +391,7 @@ bool RealTimeMemData::ExtendBucketMem(const size_t &bucket_no) {
 }
 
 bool RealTimeMemData::AdjustBucketMem(const size_t &bucket_no, int type) {
+  std::lock_guard<std::mutex> lock(swap_mutex_);
   extend_invert_ptr_ = new (std::nothrow) RTInvertBucketData(cur_invert_ptr_);
   if (!extend_invert_ptr_) {
     LOG(ERROR) << "memory extend_invert_ptr_ alloc error!";
@@ -424,6 +403,7 @@ bool RealTimeMemData::AdjustBucketMem(const size_t &bucket_no, int type) {
   int old_keys = cur_invert_ptr_->cur_bucket_keys_[bucket_no];
   long free_size = old_keys * sizeof(long) +
                    old_keys * code_bytes_per_vec_ * sizeof(uint8_t);
+  if (IsMapped(old_idx_array)) free_size = 0;
 
   if (type == 0) {  // extend bucket
     // WARNING:
@@ -442,23 +422,28 @@ bool RealTimeMemData::AdjustBucketMem(const size_t &bucket_no, int type) {
     free_size = 0;
   }
 
-  RTInvertBucketData *old_invert_ptr = cur_invert_ptr_;
+  RetiredData retired = {old_idx_array, old_codes_array, cur_invert_ptr_,
+                         free_size};
   cur_invert_ptr_ = extend_invert_ptr_;
+  extend_invert_ptr_ = nullptr;
+
+  if (dumping_) {
+    // the dump reads them without the lock
+    retired_data_.push_back(retired);
+  } else {
+    FreeOldDataLater(retired);
+  }
+  return true;
+}
 
+void RealTimeMemData::FreeOldDataLater(const RetiredData &data) {
   std::function<void(long *, uint8_t *, RTInvertBucketData *, long)> func_free =
       std::bind(&RealTimeMemData::FreeOldData, this, std::placeholders::_1,
                 std::placeholders::_2, std::placeholders::_3,
                 std::placeholders::_4);
 
-  utils::AsyncWait(1000, func_free, old_idx_array, old_codes_array,
-                   old_invert_ptr, free_size);
-
-  old_idx_array = nullptr;
-  old_codes_array = nullptr;
-  old_invert_ptr = nullptr;
-  extend_invert_ptr_ = nullptr;
-
-  return true;
+  utils::AsyncWait(1000, func_free, data.idx, data.codes, data.invert,
+                   data.size);
 }
 
 bool RealTimeMemData::GetIvtList(const size_t &bucket_no, long *&ivt_list,
@@ -480,10 +465,14 @@ int RealTimeMemData::RetrieveCodes(
     bucket_vids[i].reserve(vid_size / buckets_num_);
   }
 
+  // read only, vids not indexed don't allocate pages
+  const utils::PagedArray<std::atomic<long>, long> &vid_bucket_no_pos =
+      *cur_invert_ptr_->vid_bucket_no_pos_;
   for (size_t i = 0; i < vid_size; i++) {
-    if (cur_invert_ptr_->vid_bucket_no_pos_[vids[i]] != -1) {
-      int bucket_no = cur_invert_ptr_->vid_bucket_no_pos_[vids[i]] >> 32;
-      int pos = cur_invert_ptr_->vid_bucket_no_pos_[vids[i]] & 0xffffffff;
+    long bucket_no_pos = vid_bucket_no_pos[vids[i]];
+    if (bucket_no_pos != -1) {
+      int bucket_no = bucket_no_pos >> 32;
+      int pos = bucket_no_pos & 0xffffffff;
       bucket_codes[bucket_no].push_back(
           cur_invert_ptr_->codes_array_[bucket_no] + pos * code_bytes_per_vec_);
       bucket_vids[bucket_no].push_back(vids[i]);
@@ -504,12 +493,15 @@ int RealTimeMemData::RetrieveCodes(
     bucket_vids[i].reserve(vids_list_size / buckets_num_);
   }
 
+  const utils::PagedArray<std::atomic<long>, long> &vid_bucket_no_pos =
+      *cur_invert_ptr_->vid_bucket_no_pos_;
   for (size_t i = 0; i < vids_list_size; i++) {
     for (int j = 1; j <= vids_list[i][0]; j++) {
       int vid = vids_list[i][j];
-      if (cur_invert_ptr_->vid_bucket_no_pos_[vid] != -1) {
-        int bucket_no = cur_invert_ptr_->vid_bucket_no_pos_[vid] >> 32;
-        int pos = cur_invert_ptr_->vid_bucket_no_pos_[vid] & 0xffffffff;
+      long bucket_no_pos = vid_bucket_no_pos[vid];
+      if (bucket_no_pos != -1) {
+        int bucket_no = bucket_no_pos >> 32;
+        int pos = bucket_no_pos & 0xffffffff;
         bucket_codes[bucket_no].push_back(
             cur_invert_ptr_->codes_array_[bucket_no] +
             pos * code_bytes_per_vec_);
@@ -523,179 +515,246 @@ int RealTimeMemData::RetrieveCodes(
 
 int RealTimeMemData::Dump(const std::string &dir, const std::string &vec_name,
                           int max_vid) {
-  int buckets[buckets_num_];
-  long *ids[buckets_num_];
-  uint8_t *codes[buckets_num_];
-  LOG(INFO) << "dump max vector id=" << max_vid;
+  std::lock_guard<std::mutex> dump_lock(dump_mutex_);
+  long min_vid = dumped_max_vid_;
+  bool base = min_vid < 0 || delta_segments_ >= kMaxDeltaSegments;
+  long new_max_vid = std::max((long)max_vid, min_vid);
+
+  // the ids of the dumped entries in each bucket, and their positions in the
+  // codes array, are collected under the swap lock. The arrays are pinned
+  // until they are written, so buckets are extended and compacted meanwhile
+  std::vector<std::vector<long>> ids(buckets_num_);
+  std::vector<std::vector<int>> positions(buckets_num_);
+  std::vector<const uint8_t *> codes(buckets_num_);
+  std::vector<int> updated;
+  {
+    std::lock_guard<std::mutex> lock(swap_mutex_);
+    // raised first, so vids updated from now on are recorded for the next
+    // dump
+    dumped_max_vid_ = new_max_vid;
+    {
+      std::lock_guard<std::mutex> updated_lock(updated_mutex_);
+      updated.swap(updated_vids_);
+    }
+    if (max_vid <= min_vid && updated.empty()) {
+      LOG(INFO) << "no realtime index entries to dump, dumped max vid="
+                << min_vid;
+      return 0;
+    }
 
-  int ids_count = 0;
-  int real_dump_min_vid = INT_MAX, real_dump_max_vid = -1;
-  for (size_t i = 0; i < buckets_num_; i++) {
-    int start_pos = -1;
-    int size = 0;
-    if (cur_invert_ptr_->GetCurDumpPos(i, max_vid, start_pos, size) == 0) {
-      ids[i] = cur_invert_ptr_->idx_array_[i] + start_pos;
-      codes[i] =
-          cur_invert_ptr_->codes_array_[i] + (start_pos * code_bytes_per_vec_);
-      int bucket_min_vid = cur_invert_ptr_->idx_array_[i][start_pos];
-      int bucket_max_vid = cur_invert_ptr_->idx_array_[i][start_pos + size - 1];
-#ifdef DEBUG
-      LOG(INFO) << "dump bucket no=" << i << ", min vid=" << bucket_min_vid
-                << ", max vid=" << bucket_max_vid << ", size=" << size
-                << ", dir=" << dir
-                << ", dump_latest_pos_=" << cur_invert_ptr_->dump_latest_pos_[i]
-                << ", vids=" << utils::join(ids[i], size, ',');
-#endif
-      if (real_dump_min_vid > bucket_min_vid) {
-        real_dump_min_vid = bucket_min_vid;
+    RTInvertBucketData *invert = cur_invert_ptr_;
+    const utils::PagedArray<std::atomic<long>, long> &vid_bucket_no_pos =
+        *invert->vid_bucket_no_pos_;
+    auto deleted = [&](long vid) {
+      return bitmap::test(docids_bitmap_, vid_mgr_->VID2DocID(vid));
+    };
+    if (base) {
+      // merge all the dumps, deleted and superseded entries are dropped. An
+      // entry is live only where the vid is indexed, the old entry of an
+      // update moving it to another bucket may not be marked yet
+      for (size_t i = 0; i < buckets_num_; i++) {
+        const long *idx = invert->idx_array_[i];
+        for (int pos = 0; pos < invert->retrieve_idx_pos_[i]; pos++) {
+          long vid = idx[pos];
+          if ((vid & kDelIdxMask) || vid > new_max_vid ||
+              vid_bucket_no_pos[vid] != ((long)i << 32 | pos) ||
+              deleted(vid))
+            continue;
+          positions[i].push_back(pos);
+        }
       }
-      if (real_dump_max_vid < bucket_max_vid) {
-        real_dump_max_vid = bucket_max_vid;
+    } else {
+      auto add = [&](int vid) {
+        long bucket_no_pos = vid_bucket_no_pos[vid];
+        if (bucket_no_pos == -1 || deleted(vid)) return;
+        positions[bucket_no_pos >> 32].push_back(bucket_no_pos & 0xffffffff);
+      };
+      std::sort(updated.begin(), updated.end());
+      updated.erase(std::unique(updated.begin(), updated.end()),
+                    updated.end());
+      for (int vid : updated) {
+        if (vid <= min_vid) add(vid);
+      }
+      for (long vid = min_vid + 1; vid <= max_vid; vid++) add(vid);
+    }
+
+    for (size_t i = 0; i < buckets_num_; i++) {
+      std::sort(positions[i].begin(), positions[i].end());
+      ids[i].reserve(positions[i].size());
+      for (int pos : positions[i]) {
+        ids[i].push_back(invert->idx_array_[i][pos] & kRecoverIdxMask);
       }
+      codes[i] = invert->codes_array_[i];
     }
-    buckets[i] = size;
-    ids_count += size;
+    dumping_ = true;
   }
 
-  if (ids_count > 0) {
-    std::string dump_file = dir + "/" + vec_name + ".index";
-    FILE *fp = fopen(dump_file.c_str(), "wb");
+  std::vector<long> entries(buckets_num_);
+  long ids_count = 0;
+  for (size_t i = 0; i < buckets_num_; i++) {
+    entries[i] = ids[i].size();
+    ids_count += entries[i];
+  }
+
+  std::string dump_file = dir + "/" + vec_name + ".index.seg";
+  SegmentWriter writer;
+  int ret = writer.Open(dump_file, base ? kSegmentBase : kSegmentDelta,
+                        code_bytes_per_vec_, base ? -1 : min_vid, new_max_vid,
+                        entries);
+  for (size_t i = 0; i < buckets_num_ && ret == 0; i++) {
+    ret = writer.WriteIds(ids[i].data(), ids[i].size());
+  }
+  for (size_t i = 0; i < buckets_num_ && ret == 0; i++) {
+    // write runs of adjacent positions at once
+    const std::vector<int> &pos = positions[i];
+    for (size_t j = 0; j < pos.size() && ret == 0;) {
+      size_t end = j + 1;
+      while (end < pos.size() && pos[end] == pos[end - 1] + 1) end++;
+      ret = writer.WriteCodes(codes[i] + (long)pos[j] * code_bytes_per_vec_,
+                              end - j);
+      j = end;
+    }
+  }
+  if (ret == 0) ret = writer.Finish();
 
-    fwrite((void *)&ids_count, sizeof(int), 1, fp);
-    fwrite((void *)&real_dump_min_vid, sizeof(int), 1, fp);
-    fwrite((void *)&real_dump_max_vid, sizeof(int), 1, fp);
-    fwrite((void *)&buckets_num_, sizeof(int), 1, fp);
-    fwrite((void *)buckets, sizeof(int), buckets_num_, fp);
-    for (size_t i = 0; i < buckets_num_; i++) {
-      fwrite((void *)ids[i], sizeof(long), buckets[i], fp);
-      fwrite((void *)codes[i], sizeof(uint8_t),
-             buckets[i] * code_bytes_per_vec_, fp);
+  {
+    std::lock_guard<std::mutex> lock(swap_mutex_);
+    dumping_ = false;
+    for (const RetiredData &data : retired_data_) {
+      FreeOldDataLater(data);
+    }
+    retired_data_.clear();
+    if (ret != 0) {
+      // they are dumped by the next dump
+      dumped_max_vid_ = min_vid;
+      std::lock_guard<std::mutex> updated_lock(updated_mutex_);
+      updated_vids_.insert(updated_vids_.end(), updated.begin(),
+                           updated.end());
     }
-    fclose(fp);
-    LOG(INFO) << "ids_count=" << ids_count
-              << ", real_dump_min_vid=" << real_dump_min_vid
-              << ", real_dump_max_vid=" << real_dump_max_vid
-              << ", buckets_num_=" << buckets_num_
-              << ", buckets=" << utils::join<int>(buckets, buckets_num_, ',');
   }
+  if (ret != 0) {
+    LOG(ERROR) << "dump realtime index segment error, path=" << dump_file;
+    return -1;
+  }
+
+  delta_segments_ = base ? 0 : delta_segments_ + 1;
+  LOG(INFO) << "dump " << (base ? "base" : "delta")
+            << " segment=" << dump_file << ", ids_count=" << ids_count
+            << ", min vid=" << (base ? -1 : min_vid)
+            << ", max vid=" << new_max_vid
+            << ", delta segments=" << delta_segments_;
   return ids_count;
 }
 
 int RealTimeMemData::Load(const std::vector<std::string> &index_dirs,
                           const std::string &vec_name) {
-  size_t indexes_num = index_dirs.size();
-  int ids_count[indexes_num], min_vids[indexes_num], max_vids[indexes_num];
-  int bucket_ids[indexes_num][buckets_num_];
-  FILE *fp_array[indexes_num];
-
-  int total_bucket_ids[buckets_num_], total_ids = 0;
-  memset((void *)total_bucket_ids, 0, buckets_num_ * sizeof(int));
-  for (size_t i = 0; i < indexes_num; i++) {
-    std::string index_file = index_dirs[i] + "/" + vec_name + ".index";
-    if (access(index_file.c_str(), F_OK) != 0) {
-      fp_array[i] = nullptr;
-      continue;
-    }
-    fp_array[i] = fopen(index_file.c_str(), "rb");
-    fread((void *)(ids_count + i), sizeof(int), 1, fp_array[i]);
-    fread((void *)(min_vids + i), sizeof(int), 1, fp_array[i]);
-    fread((void *)(max_vids + i), sizeof(int), 1, fp_array[i]);
-    int buckets_num = 0;
-    fread((void *)&buckets_num, sizeof(int), 1, fp_array[i]);
-    if ((size_t)buckets_num != buckets_num_) {
-      LOG(ERROR) << "buckets_num must be " << buckets_num_;
-      continue;
-    }
-    if (ids_count[i] == 0 || min_vids[i] == INT_MAX || max_vids[i] == -1) {
-      LOG(INFO) << " no data in the bucket " << i
-                << " of real time index dumped";
-      continue;
-    }
-    if (i > 0 && max_vids[i - 1] != -1 && min_vids[i] != 0 &&
-        (min_vids[i] != (max_vids[i - 1] + 1))) {
-      std::string last_index_file =
-          index_dirs[i - 1] + "/" + vec_name + ".index";
-      LOG(ERROR) << "the file " << index_file
-                 << " missing some vectors after the file " << last_index_file;
+  // the last base segment and the deltas after it, in dump order
+  std::vector<std::string> segments;
+  bool has_base = false;
+  for (int i = (int)index_dirs.size() - 1; i >= 0 && !has_base; i--) {
+    std::string file = index_dirs[i] + "/" + vec_name + ".index.seg";
+    if (access(file.c_str(), F_OK) != 0) continue;
+    SegmentHeader header;
+    if (MappedSegment::ReadHeader(file, header)) return -1;
+    segments.push_back(file);
+    has_base = header.type == kSegmentBase;
+  }
+  if (!has_base) {
+    if (segments.size() > 0) {
+      LOG(ERROR) << "no base segment before " << segments.back();
+      return -1;
     }
+    LOG(INFO) << "no realtime index segment of " << vec_name;
+    return 0;
+  }
+  std::reverse(segments.begin(), segments.end());
 
-    fread((void *)bucket_ids[i], sizeof(int), buckets_num_, fp_array[i]);
-    for (size_t j = 0; j < buckets_num_; j++) {
-      total_bucket_ids[j] += bucket_ids[i][j];
-      total_ids += bucket_ids[i][j];
-    }
+  base_segment_.reset(new MappedSegment());
+  if (base_segment_->Open(segments[0], buckets_num_, code_bytes_per_vec_)) {
+    base_segment_.reset();
+    return -1;
   }
-  long *load_bucket_ids[buckets_num_];
-  uint8_t *load_bucket_codes[buckets_num_];
-  total_mem_bytes_ = buckets_num_ * sizeof(int) * 3;
+  // the docid bitmap is loaded before, the entries of docs deleted since
+  // the dump are counted for compaction
+  auto deleted = [&](long vid) {
+    return bitmap::test(docids_bitmap_, vid_mgr_->VID2DocID(vid));
+  };
+  RTInvertBucketData *invert = cur_invert_ptr_;
   for (size_t i = 0; i < buckets_num_; i++) {
-    size_t total_keys = total_bucket_ids[i] * 2;
-    // if (total_keys > bucket_keys_) {
-    //   total_keys = bucket_keys_;
-    // }
-    load_bucket_ids[i] = new long[total_keys];
-    total_mem_bytes_ += total_keys * sizeof(long);
-    load_bucket_codes[i] = new uint8_t[total_keys * code_bytes_per_vec_];
-    total_mem_bytes_ += total_keys * code_bytes_per_vec_ * sizeof(uint8_t);
-    cur_invert_ptr_->cur_bucket_keys_[i] = total_keys;
-    cur_invert_ptr_->retrieve_idx_pos_[i] = total_bucket_ids[i];
-  }
-
-  int ids_load_offset_list[buckets_num_], codes_load_offset_list[buckets_num_];
-  memset(ids_load_offset_list, 0, sizeof(ids_load_offset_list));
-  memset(codes_load_offset_list, 0, sizeof(codes_load_offset_list));
-  for (size_t i = 0; i < indexes_num; i++) {
-    if (!fp_array[i]) {
-      continue;
+    long size = base_segment_->BucketSize(i);
+    if (size == 0) continue;
+    long *ids = base_segment_->BucketIds(i);
+    for (long pos = 0; pos < size; pos++) {
+      if (ids[pos] >= max_vec_size_ || ids[pos] < 0) {
+        LOG(ERROR) << "invalid vid=" << ids[pos]
+                   << ", max vector size=" << max_vec_size_;
+        return -1;
+      }
+      if ((*invert->vid_bucket_no_pos_)[ids[pos]] != -1) {
+        LOG(ERROR) << "vid=" << ids[pos] << " is duplicated in base segment "
+                   << segments[0];
+        return -1;
+      }
+      (*invert->vid_bucket_no_pos_)[ids[pos]] = i << 32 | pos;
+      if (deleted(ids[pos])) invert->deleted_nums_[i]++;
     }
-    for (size_t j = 0; j < buckets_num_; j++) {
-      fread((void *)(load_bucket_ids[j] + ids_load_offset_list[j]),
-            sizeof(long), bucket_ids[i][j], fp_array[i]);
-#ifdef DEBUG
-      long min_vid = load_bucket_ids[j][ids_load_offset_list[j]];
-      long max_vid =
-          load_bucket_ids[j][ids_load_offset_list[j] + bucket_ids[i][j] - 1];
-      LOG(INFO) << "index id=" << i << ", bucket no=" << j
-                << ", min vid=" << min_vid << ", max vid=" << max_vid
-                << ", size=" << bucket_ids[i][j];
-#endif
-      ids_load_offset_list[j] += bucket_ids[i][j];
-      int codes_count = bucket_ids[i][j] * code_bytes_per_vec_;
-      fread((void *)(load_bucket_codes[j] + codes_load_offset_list[j]),
-            sizeof(uint8_t), codes_count, fp_array[i]);
-      codes_load_offset_list[j] += codes_count;
+    // the bucket is scanned in the mapped segment until it's extended
+    total_mem_bytes_ -= invert->cur_bucket_keys_[i] *
+                        (sizeof(long) + code_bytes_per_vec_ * sizeof(uint8_t));
+    delete[] invert->idx_array_[i];
+    delete[] invert->codes_array_[i];
+    invert->idx_array_[i] = ids;
+    invert->codes_array_[i] = base_segment_->BucketCodes(i);
+    invert->cur_bucket_keys_[i] = size;
+    invert->retrieve_idx_pos_[i] = size;
+  }
+  long max_vid = base_segment_->Header().max_vid;
+
+  for (size_t s = 1; s < segments.size(); s++) {
+    MappedSegment delta;
+    if (delta.Open(segments[s], buckets_num_, code_bytes_per_vec_)) return -1;
+    if (delta.Header().min_vid != max_vid) {
+      LOG(ERROR) << "segment " << segments[s] << " starts after vid "
+                 << delta.Header().min_vid << ", but vid " << max_vid
+                 << " is the last loaded";
+      return -1;
     }
-    fclose(fp_array[i]);
-  }
-
-  /* switch the ids and codes memory pointer */
-  for (size_t i = 0; i < buckets_num_; i++) {
-    delete[] cur_invert_ptr_->idx_array_[i];
-    cur_invert_ptr_->idx_array_[i] = load_bucket_ids[i];
-    delete[] cur_invert_ptr_->codes_array_[i];
-    cur_invert_ptr_->codes_array_[i] = load_bucket_codes[i];
-    cur_invert_ptr_->dump_latest_pos_[i] = total_bucket_ids[i];
-#ifdef DEBUG
-    LOG(INFO) << "bucket id=" << i
-              << ", dump_latest_pos_=" << cur_invert_ptr_->dump_latest_pos_[i];
-#endif
-  }
-
-  int bucket_size = 0;
-  long vid = -1;
-  for (size_t bucket_id = 0; bucket_id < buckets_num_; bucket_id++) {
-    bucket_size = cur_invert_ptr_->retrieve_idx_pos_[bucket_id];
-    for (int retrive_pos = 0; retrive_pos < bucket_size; retrive_pos++) {
-      vid = cur_invert_ptr_->idx_array_[bucket_id][retrive_pos];
-      if (vid >= max_vec_size_ || vid < 0) {
-        LOG(INFO) << "invalid vid=" << vid
-                  << ", max vector size=" << max_vec_size_;
+    for (size_t i = 0; i < buckets_num_; i++) {
+      long size = delta.BucketSize(i);
+      if (size == 0) continue;
+      std::vector<long> keys(delta.BucketIds(i), delta.BucketIds(i) + size);
+      const uint8_t *delta_codes = delta.BucketCodes(i);
+      std::vector<uint8_t> codes(delta_codes,
+                                 delta_codes + size * code_bytes_per_vec_);
+      for (long vid : keys) {
+        if (vid >= max_vec_size_ || vid < 0) {
+          LOG(ERROR) << "invalid vid=" << vid
+                     << ", max vector size=" << max_vec_size_;
+          return -1;
+        }
+        // supersede the entry of an earlier segment
+        long bucket_no_pos = (*cur_invert_ptr_->vid_bucket_no_pos_)[vid];
+        if (bucket_no_pos == -1) continue;
+        int old_bucket_no = bucket_no_pos >> 32;
+        int old_pos = bucket_no_pos & 0xffffffff;
+        cur_invert_ptr_->idx_array_[old_bucket_no][old_pos] |= kDelIdxMask;
+        // or it's counted already
+        if (!deleted(vid)) cur_invert_ptr_->deleted_nums_[old_bucket_no]++;
+      }
+      if (!AddKeys(i, size, keys, codes)) {
+        LOG(ERROR) << "add keys of segment " << segments[s] << " error";
         return -1;
       }
-      cur_invert_ptr_->vid_bucket_no_pos_[vid] = bucket_id << 32 | retrive_pos;
     }
+    max_vid = delta.Header().max_vid;
   }
-  return total_ids;
+
+  dumped_max_vid_ = max_vid;
+  delta_segments_ = segments.size() - 1;
+  LOG(INFO) << "load realtime index segments, base=" << segments[0]
+            << ", deltas=" << delta_segments_ << ", max vid=" << max_vid
+            << ", entries of base=" << base_segment_->Header().entries;
+  return max_vid + 1;
 }
 
 void RealTimeMemData::PrintBucketSize() {
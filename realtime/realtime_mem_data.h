@@ -11,9 +11,14 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
+#include "compaction_scheduler.h"
+#include "paged_array.h"
 #include "raw_vector_common.h"
+#include "realtime_segment.h"
 
 namespace tig_gamma {
 
@@ -35,9 +40,6 @@ struct RTInvertBucketData {
                        const size_t &code_bytes_per_vec,
                        std::atomic<long> &total_mem_bytes);
 
-  int GetCurDumpPos(const size_t &bucket_no, int max_vid, int &dump_start_pos,
-                    int &size);
-
   bool CompactBucket(const size_t &bucket_no, const size_t &code_bytes_per_vec);
 
   void Delete(int vid);
@@ -46,10 +48,10 @@ struct RTInvertBucketData {
   int *retrieve_idx_pos_;  // total nb of realtime added indexed vectors
   int *cur_bucket_keys_;
   uint8_t **codes_array_;
-  int *dump_latest_pos_;
   VIDMgr *vid_mgr_;
   const char *docids_bitmap_;
-  std::atomic<long> *vid_bucket_no_pos_;
+  // bucket_no << 32 | pos of each vid, -1 if not indexed
+  utils::PagedArray<std::atomic<long>, long> *vid_bucket_no_pos_;
   std::atomic<int> *deleted_nums_;
   long compacted_num_;
   size_t buckets_num_;
@@ -88,15 +90,35 @@ struct RealTimeMemData {
                     std::vector<std::vector<const uint8_t *>> &bucket_codes,
                     std::vector<std::vector<long>> &bucket_vids);
 
+  /** dump the vids up to max_vid to a segment in dir, a delta of the last
+   * dump or a base merging all of them once there are kMaxDeltaSegments
+   * deltas
+   *
+   * @return the number of dumped entries, < 0 if error
+   */
   int Dump(const std::string &dir, const std::string &vec_name, int max_vid);
+
+  /** map the last base segment of index_dirs into the lists and apply the
+   * deltas after it, earlier dumps aren't read. The docid bitmap should be
+   * loaded before
+   *
+   * @return the number of vids loaded, all of them are less than it. < 0 if
+   * error
+   */
   int Load(const std::vector<std::string> &index_dirs,
            const std::string &vec_name);
 
   void PrintBucketSize();
 
+  // a round of the compaction scheduler
   int CompactIfNeed();
-  bool Compactable(int bucket_no);
   bool CompactBucket(int bucket_no);
+  void SetCompactionOptions(const CompactionOptions &options) {
+    compaction_scheduler_->SetOptions(options);
+  }
+  void RecordScan(int bucket_no) {
+    compaction_scheduler_->RecordScan(bucket_no);
+  }
   int Delete(int *vids, int n);
 
   RTInvertBucketData *cur_invert_ptr_;
@@ -112,6 +134,41 @@ struct RealTimeMemData {
   long max_vec_size_;
   VIDMgr *vid_mgr_;
   const char *docids_bitmap_;
+  CompactionScheduler *compaction_scheduler_;
+
+ private:
+  static const int kMaxDeltaSegments = 8;
+
+  // arrays of the loaded base segment aren't freed
+  bool IsMapped(const void *p) const {
+    return base_segment_ && base_segment_->Contains(p);
+  }
+
+  std::unique_ptr<MappedSegment> base_segment_;
+  // arrays replaced by an extend or a compaction, and the lists they were in
+  struct RetiredData {
+    long *idx;
+    uint8_t *codes;
+    RTInvertBucketData *invert;
+    long size;
+  };
+
+  // freed after the searches reading them are done
+  void FreeOldDataLater(const RetiredData &data);
+
+  // held to swap cur_invert_ptr_, by deletes so their counts aren't lost in
+  // a compaction, and by a dump to collect what it writes
+  std::mutex swap_mutex_;
+  // dumps are serialized
+  std::mutex dump_mutex_;
+  // set with the swap lock, arrays retired while dumping are freed after it
+  bool dumping_;
+  std::vector<RetiredData> retired_data_;
+  std::atomic<long> dumped_max_vid_;
+  int delta_segments_;
+  // dumped vids updated since the last dump
+  std::vector<int> updated_vids_;
+  std::mutex updated_mutex_;
 };
 
 }  // namespace realtime
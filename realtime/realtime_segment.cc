@@ -0,0 +1,199 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "realtime_segment.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "utils.h"
+
+namespace tig_gamma {
+namespace realtime {
+
+SegmentWriter::SegmentWriter() : fp_(nullptr), written_(0) {
+  memset(&header_, 0, sizeof(header_));
+}
+
+SegmentWriter::~SegmentWriter() {
+  if (fp_) {
+    // not finished
+    fclose(fp_);
+    remove(tmp_file_.c_str());
+  }
+}
+
+int SegmentWriter::Open(const std::string &file, SegmentType type,
+                        int code_bytes, long min_vid, long max_vid,
+                        const std::vector<long> &entries) {
+  file_ = file;
+  tmp_file_ = file + ".tmp";
+  fp_ = fopen(tmp_file_.c_str(), "wb");
+  if (fp_ == nullptr) {
+    LOG(ERROR) << "open segment file error, path=" << tmp_file_
+               << ", error=" << strerror(errno);
+    return -1;
+  }
+
+  std::vector<int64_t> offsets(entries.size() + 1, 0);
+  for (size_t i = 0; i < entries.size(); i++) {
+    offsets[i + 1] = offsets[i] + entries[i];
+  }
+  long ids_end = sizeof(header_) + offsets.size() * sizeof(int64_t) +
+                 offsets.back() * sizeof(long);
+
+  memcpy(header_.magic, kSegmentMagic, sizeof(kSegmentMagic));
+  header_.version = kSegmentVersion;
+  header_.type = type;
+  header_.buckets_num = entries.size();
+  header_.code_bytes = code_bytes;
+  header_.min_vid = min_vid;
+  header_.max_vid = max_vid;
+  header_.entries = offsets.back();
+  header_.codes_offset =
+      (ids_end + kSegmentAlign - 1) / kSegmentAlign * kSegmentAlign;
+
+  if (Write(&header_, sizeof(header_)) ||
+      Write(offsets.data(), offsets.size() * sizeof(int64_t))) {
+    return -1;
+  }
+  return 0;
+}
+
+int SegmentWriter::WriteIds(const long *ids, long n) {
+  return Write(ids, n * sizeof(long));
+}
+
+int SegmentWriter::WriteCodes(const uint8_t *codes, long n) {
+  if (written_ < header_.codes_offset) {
+    char padding[kSegmentAlign] = {0};
+    if (Write(padding, header_.codes_offset - written_)) return -1;
+  }
+  return Write(codes, n * header_.code_bytes);
+}
+
+int SegmentWriter::Finish() {
+  if (header_.entries == 0 && written_ < header_.codes_offset) {
+    WriteCodes(nullptr, 0);
+  }
+  long expected = header_.codes_offset + header_.entries * header_.code_bytes;
+  if (written_ != expected) {
+    LOG(ERROR) << "segment " << file_ << " has " << written_
+               << " bytes, expected " << expected;
+    return -1;
+  }
+  if (fflush(fp_) || fsync(fileno(fp_))) {
+    LOG(ERROR) << "sync segment file error, path=" << tmp_file_;
+    return -1;
+  }
+  fclose(fp_);
+  fp_ = nullptr;
+  if (rename(tmp_file_.c_str(), file_.c_str())) {
+    LOG(ERROR) << "rename " << tmp_file_ << " to " << file_
+               << " error: " << strerror(errno);
+    remove(tmp_file_.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+int SegmentWriter::Write(const void *data, size_t size) {
+  if (size > 0 && fwrite(data, 1, size, fp_) != size) {
+    LOG(ERROR) << "write segment file error, path=" << tmp_file_;
+    return -1;
+  }
+  written_ += size;
+  return 0;
+}
+
+MappedSegment::MappedSegment()
+    : buf_(nullptr),
+      size_(0),
+      offsets_(nullptr),
+      ids_(nullptr),
+      codes_(nullptr) {
+  memset(&header_, 0, sizeof(header_));
+}
+
+MappedSegment::~MappedSegment() {
+  if (buf_ != nullptr && munmap(buf_, size_) != 0) {
+    LOG(ERROR) << "munmap segment error: " << strerror(errno);
+  }
+}
+
+int MappedSegment::ReadHeader(const std::string &file, SegmentHeader &header) {
+  int fd = open(file.c_str(), O_RDONLY, 0);
+  if (fd == -1) return -1;
+  ssize_t n = pread(fd, &header, sizeof(header), 0);
+  close(fd);
+  if (n != (ssize_t)sizeof(header) ||
+      memcmp(header.magic, kSegmentMagic, sizeof(kSegmentMagic)) ||
+      header.version != kSegmentVersion) {
+    LOG(ERROR) << "invalid segment header, path=" << file;
+    return -1;
+  }
+  return 0;
+}
+
+int MappedSegment::Open(const std::string &file, int buckets_num,
+                        int code_bytes) {
+  if (ReadHeader(file, header_)) return -1;
+  if (header_.buckets_num != buckets_num || header_.code_bytes != code_bytes) {
+    LOG(ERROR) << "segment " << file << " has " << header_.buckets_num
+               << " buckets of code bytes " << header_.code_bytes
+               << ", expected " << buckets_num << " and " << code_bytes;
+    return -1;
+  }
+  long file_size = utils::get_file_size(file.c_str());
+  long offsets_end = sizeof(header_) + (buckets_num + 1) * sizeof(int64_t);
+  if (header_.entries < 0 || header_.codes_offset < offsets_end ||
+      file_size != header_.codes_offset + header_.entries * code_bytes) {
+    LOG(ERROR) << "segment " << file << " is broken, size=" << file_size;
+    return -1;
+  }
+
+  int fd = open(file.c_str(), O_RDONLY, 0);
+  if (fd == -1) {
+    LOG(ERROR) << "open segment file error, path=" << file;
+    return -1;
+  }
+  // private and writable, so writes are copied on the touched pages only
+  buf_ = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (buf_ == MAP_FAILED) {
+    buf_ = nullptr;
+    LOG(ERROR) << "mmap segment error: " << strerror(errno);
+    return -1;
+  }
+  size_ = file_size;
+
+  char *base = static_cast<char *>(buf_);
+  offsets_ = reinterpret_cast<const int64_t *>(base + sizeof(header_));
+  ids_ = reinterpret_cast<long *>(base + offsets_end);
+  codes_ = reinterpret_cast<uint8_t *>(base + header_.codes_offset);
+  for (int i = 0; i < buckets_num; i++) {
+    if (offsets_[i] > offsets_[i + 1]) {
+      LOG(ERROR) << "segment " << file << " has invalid offsets";
+      return -1;
+    }
+  }
+  if (offsets_[0] != 0 || offsets_[buckets_num] != header_.entries ||
+      offsets_end + header_.entries * (long)sizeof(long) >
+          header_.codes_offset) {
+    LOG(ERROR) << "segment " << file << " has invalid offsets";
+    return -1;
+  }
+  return 0;
+}
+
+}  // namespace realtime
+}  // namespace tig_gamma
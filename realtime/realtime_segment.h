@@ -0,0 +1,134 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef REALTIME_SEGMENT_H_
+#define REALTIME_SEGMENT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+namespace tig_gamma {
+namespace realtime {
+
+/** a dumped segment of the realtime inverted lists, laid out to be scanned
+ * in place once it's mapped:
+ *
+ *   SegmentHeader
+ *   int64 offsets[buckets_num + 1]   entries of bucket i: [offsets[i],
+ *                                    offsets[i + 1])
+ *   int64 ids[entries]               grouped by bucket
+ *   padding to kSegmentAlign
+ *   uint8 codes[entries][code_bytes] grouped by bucket, at codes_offset
+ *
+ * A base segment holds all the live entries of the vids up to max_vid. A
+ * delta segment holds the vids in (min_vid, max_vid] and an overlay of the
+ * vids up to min_vid updated since the last dump, whose entries supersede
+ * the ones in earlier segments. Deleted docs are left to the dumped bitmap.
+ */
+const static char kSegmentMagic[8] = {'G', 'R', 'T', 'S', 'E', 'G', 0, 0};
+const static int kSegmentVersion = 1;
+const static long kSegmentAlign = 64;
+
+enum SegmentType { kSegmentBase = 0, kSegmentDelta = 1 };
+
+struct SegmentHeader {
+  char magic[8];
+  int32_t version;
+  int32_t type;
+  int32_t buckets_num;
+  int32_t code_bytes;
+  int64_t min_vid;
+  int64_t max_vid;
+  int64_t entries;
+  int64_t codes_offset;
+  char reserved[8];
+};
+
+static_assert(sizeof(SegmentHeader) == kSegmentAlign,
+              "segment header should be aligned");
+
+/** writes a segment from the buckets in memory, through a temporary file
+ * renamed at Finish(), so a segment is complete once it exists.
+ */
+class SegmentWriter {
+ public:
+  SegmentWriter();
+  ~SegmentWriter();
+
+  /** @param entries  the number of entries of each bucket
+   * @return 0 if successed
+   */
+  int Open(const std::string &file, SegmentType type, int code_bytes,
+           long min_vid, long max_vid, const std::vector<long> &entries);
+
+  // called in bucket order, for all the entries of a bucket
+  int WriteIds(const long *ids, long n);
+
+  // after all the ids, in the same order
+  int WriteCodes(const uint8_t *codes, long n);
+
+  int Finish();
+
+ private:
+  int Write(const void *data, size_t size);
+
+  std::string file_;
+  std::string tmp_file_;
+  FILE *fp_;
+  SegmentHeader header_;
+  long written_;
+};
+
+/** a segment mapped privately, entries can be marked deleted and codes
+ * rewritten in memory without changing the file
+ */
+class MappedSegment {
+ public:
+  MappedSegment();
+  ~MappedSegment();
+
+  // @return 0 if successed
+  static int ReadHeader(const std::string &file, SegmentHeader &header);
+
+  /** map and validate the layout against the lists
+   *
+   * @return 0 if successed
+   */
+  int Open(const std::string &file, int buckets_num, int code_bytes);
+
+  const SegmentHeader &Header() const { return header_; }
+
+  long BucketSize(int bucket_no) const {
+    return offsets_[bucket_no + 1] - offsets_[bucket_no];
+  }
+
+  long *BucketIds(int bucket_no) { return ids_ + offsets_[bucket_no]; }
+
+  uint8_t *BucketCodes(int bucket_no) {
+    return codes_ + offsets_[bucket_no] * header_.code_bytes;
+  }
+
+  bool Contains(const void *p) const {
+    return p >= buf_ && p < (const void *)((const char *)buf_ + size_);
+  }
+
+ private:
+  void *buf_;
+  size_t size_;
+  SegmentHeader header_;
+  const int64_t *offsets_;
+  long *ids_;
+  uint8_t *codes_;
+};
+
+}  // namespace realtime
+}  // namespace tig_gamma
+
+#endif  // REALTIME_SEGMENT_H_
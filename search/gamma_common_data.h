@@ -8,6 +8,7 @@
 #ifndef GAMMA_COMMON_DATA_H_
 #define GAMMA_COMMON_DATA_H_
 
+#include "arena.h"
 #include "field_range_index.h"
 #include "gamma_api.h"
 #include "log.h"
@@ -77,9 +78,12 @@ struct VectorDoc {
   int fields_len;
 };
 
+class VidFilter;
+
 struct GammaSearchCondition {
   GammaSearchCondition() {
     range_query_result = nullptr;
+    vid_filter = nullptr;
     topn = 0;
     has_rank = false;
     multi_vector_rank = false;
@@ -93,6 +97,8 @@ struct GammaSearchCondition {
     l2_sqrt = false;
     nprobe = 20;
     ivf_flat = false;
+    arena = nullptr;
+    trace = nullptr;
 
 #ifdef BUILD_GPU
     range_filters = nullptr;
@@ -110,6 +116,7 @@ struct GammaSearchCondition {
 
   GammaSearchCondition(GammaSearchCondition *condition) {
     range_query_result = condition->range_query_result;
+    vid_filter = condition->vid_filter;
     topn = condition->topn;
     has_rank = condition->has_rank;
     multi_vector_rank = condition->multi_vector_rank;
@@ -123,6 +130,8 @@ struct GammaSearchCondition {
     l2_sqrt = condition->l2_sqrt;
     nprobe = condition->nprobe;
     ivf_flat = condition->ivf_flat;
+    arena = condition->arena;
+    trace = condition->trace;
 
 #ifdef BUILD_GPU
     range_filters = condition->range_filters;
@@ -144,6 +153,9 @@ struct GammaSearchCondition {
   }
 
   MultiRangeQueryResults *range_query_result;
+  // the deleted docs and range_query_result in vid space, it's built by the
+  // index for the duration of its search, scanners build their own if null
+  const VidFilter *vid_filter;
 
 #ifdef BUILD_GPU
   RangeFilter **range_filters;
@@ -169,6 +181,11 @@ struct GammaSearchCondition {
   bool l2_sqrt;
   int nprobe;
   bool ivf_flat;
+  // memory of the request, temporaries may be allocated from it if not null,
+  // it's only used by the searching thread
+  utils::Arena *arena;
+  // trace of the request, null if it isn't traced
+  utils::QueryTrace *trace;
 
 #ifdef PERFORMANCE_TESTING
   double cur_time;
@@ -331,11 +348,24 @@ struct IVFPQRetrievalParams : RetrievalParams {
   int ncentroids;     // coarse cluster center number
   int nsubvector;     // number of sub cluster center
   int nbits_per_idx;  // bit number of sub cluster center
+  // copies of raw vectors in the inverted lists for ivf flat search: none,
+  // float or fp16
+  std::string ivf_flat_store;
+  // compaction of the realtime inverted lists, see CompactionOptions
+  double compact_deleted_ratio;
+  int compact_min_deleted;
+  int compact_mb_per_round;
+  int compact_ms_per_round;
 
   IVFPQRetrievalParams() : RetrievalParams() {
     ncentroids = 256;
     nsubvector = 64;
     nbits_per_idx = 8;
+    ivf_flat_store = "none";
+    compact_deleted_ratio = 0.3;
+    compact_min_deleted = 1;
+    compact_mb_per_round = 64;
+    compact_ms_per_round = 100;
   }
 
   int Parse(const char *str) {
@@ -396,6 +426,32 @@ struct IVFPQRetrievalParams : RetrievalParams {
       }
       if (nbits_per_idx > 0) this->nbits_per_idx = nbits_per_idx;
     }
+
+    if (jp.Contains("ivf_flat_store") &&
+        jp.GetString("ivf_flat_store", ivf_flat_store)) {
+      LOG(ERROR) << "invalid ivf_flat_store";
+      return -1;
+    }
+    if (jp.Contains("compact_deleted_ratio") &&
+        jp.GetDouble("compact_deleted_ratio", compact_deleted_ratio)) {
+      LOG(ERROR) << "invalid compact_deleted_ratio";
+      return -1;
+    }
+    if (jp.Contains("compact_min_deleted") &&
+        jp.GetInt("compact_min_deleted", compact_min_deleted)) {
+      LOG(ERROR) << "invalid compact_min_deleted";
+      return -1;
+    }
+    if (jp.Contains("compact_mb_per_round") &&
+        jp.GetInt("compact_mb_per_round", compact_mb_per_round)) {
+      LOG(ERROR) << "invalid compact_mb_per_round";
+      return -1;
+    }
+    if (jp.Contains("compact_ms_per_round") &&
+        jp.GetInt("compact_ms_per_round", compact_ms_per_round)) {
+      LOG(ERROR) << "invalid compact_ms_per_round";
+      return -1;
+    }
     if(!Validate())
       return -1;
     return 0;
@@ -413,6 +469,21 @@ struct IVFPQRetrievalParams : RetrievalParams {
       LOG(ERROR) << "only support 8 now, nbits_per_idx=" << nbits_per_idx;
       return false;
     }
+    if (ivf_flat_store != "none" && ivf_flat_store != "float" &&
+        ivf_flat_store != "fp16") {
+      LOG(ERROR) << "invalid ivf_flat_store=" << ivf_flat_store;
+      return false;
+    }
+    if (compact_deleted_ratio < 0 || compact_deleted_ratio > 1 ||
+        compact_min_deleted < 0 || compact_mb_per_round <= 0 ||
+        compact_ms_per_round <= 0) {
+      LOG(ERROR) << "invalid compaction parameters, compact_deleted_ratio="
+                 << compact_deleted_ratio
+                 << ", compact_min_deleted=" << compact_min_deleted
+                 << ", compact_mb_per_round=" << compact_mb_per_round
+                 << ", compact_ms_per_round=" << compact_ms_per_round;
+      return false;
+    }
     return true;
   }
 
@@ -421,7 +492,12 @@ struct IVFPQRetrievalParams : RetrievalParams {
     ss << "metric_type = " << metric_type << ", ";
     ss << "ncentroids =" << ncentroids << ", ";
     ss << "nsubvector =" << nsubvector << ", ";
-    ss << "nbits_per_idx =" << nbits_per_idx;
+    ss << "nbits_per_idx =" << nbits_per_idx << ", ";
+    ss << "ivf_flat_store =" << ivf_flat_store << ", ";
+    ss << "compact_deleted_ratio =" << compact_deleted_ratio << ", ";
+    ss << "compact_min_deleted =" << compact_min_deleted << ", ";
+    ss << "compact_mb_per_round =" << compact_mb_per_round << ", ";
+    ss << "compact_ms_per_round =" << compact_ms_per_round;
     return ss.str();
   }
 };
@@ -17,14 +17,15 @@
 #include <cstring>
 #include <fstream>
 #include <iomanip>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
 
 #include "bitmap.h"
-#include "cJSON.h"
 #include "gamma_common_data.h"
 #include "log.h"
+#include "metrics.h"
 #include "utils.h"
 
 using std::string;
@@ -238,6 +239,7 @@ GammaEngine::GammaEngine(const string &index_root_path)
   dump_docid_ = 0;
   bitmap_bytes_size_ = 0;
   field_range_index_ = nullptr;
+  filter_cache_bytes_ = 0;
   created_table_ = false;
   indexed_field_num_ = 0;
   b_loading_ = false;
@@ -245,6 +247,7 @@ GammaEngine::GammaEngine(const string &index_root_path)
   search_num_ = 0;
 #endif
   counters_ = nullptr;
+  write_epoch_ = 0;
 }
 
 GammaEngine::~GammaEngine() {
@@ -348,42 +351,28 @@ int GammaEngine::Setup(int max_doc_size) {
 }
 
 Response *GammaEngine::Search(const Request *request) {
+  ResponseSink sink;
+  Search(request, &sink);
+  return sink.Release();
+}
+
+int GammaEngine::Search(const Request *request, ResultSink *sink) {
 #ifdef DEBUG
   LOG(INFO) << "search request:" << RequestToString(request);
 #endif
 
   int ret = 0;
-  Response *response_results =
-      static_cast<Response *>(malloc(sizeof(Response)));
-  memset(response_results, 0, sizeof(Response));
-  response_results->req_num = request->req_num;
-
-  response_results->results = static_cast<SearchResult **>(
-      malloc(response_results->req_num * sizeof(SearchResult *)));
-  for (int i = 0; i < response_results->req_num; ++i) {
-    SearchResult *result =
-        static_cast<SearchResult *>(malloc(sizeof(SearchResult)));
-    result->total = 0;
-    result->result_num = 0;
-    result->result_items = nullptr;
-    result->msg = nullptr;
-    response_results->results[i] = result;
-  }
-
-  response_results->online_log_message = nullptr;
-
   if (request->req_num <= 0) {
     string msg = "req_num should not less than 0";
     LOG(ERROR) << msg;
-    for (int i = 0; i < response_results->req_num; ++i) {
-      response_results->results[i]->msg =
-          MakeByteArray(msg.c_str(), msg.length());
-      response_results->results[i]->result_code =
-          SearchResultCode::SEARCH_ERROR;
-    }
-    return response_results;
+    PackEmptyResults(request->req_num, SearchResultCode::SEARCH_ERROR, msg,
+                     nullptr, sink);
+    return -1;
   }
 
+  // strings of the profile are filtered and packed without copy
+  Profile::StringReadGuard string_guard(profile_);
+
   std::string online_log_level;
   if (request->online_log_level) {
     online_log_level.assign(request->online_log_level->value,
@@ -397,6 +386,9 @@ Response *GammaEngine::Search(const Request *request) {
 
   OLOG(&logger, INFO, "online log level: " << online_log_level);
 
+  utils::StageTimer total_timer(utils::kStageSearchTotal);
+  utils::Metrics::Instance().Add(utils::kCounterQueries, request->req_num);
+
   bool use_direct_search = ((request->direct_search_type == 1) ||
                             ((request->direct_search_type == 0) &&
                              (index_status_ != IndexStatus::INDEXED)));
@@ -404,13 +396,9 @@ Response *GammaEngine::Search(const Request *request) {
   if ((not use_direct_search) && (index_status_ != IndexStatus::INDEXED)) {
     string msg = "index not trained!";
     LOG(ERROR) << msg;
-    for (int i = 0; i < response_results->req_num; ++i) {
-      response_results->results[i]->msg =
-          MakeByteArray(msg.c_str(), msg.length());
-      response_results->results[i]->result_code =
-          SearchResultCode::INDEX_NOT_TRAINED;
-    }
-    return response_results;
+    PackEmptyResults(request->req_num, SearchResultCode::INDEX_NOT_TRAINED,
+                     msg, nullptr, sink);
+    return -1;
   }
 
   GammaQuery gamma_query;
@@ -429,6 +417,15 @@ Response *GammaEngine::Search(const Request *request) {
   condition.l2_sqrt = request->l2_sqrt;
   condition.nprobe = request->nprobe;
   condition.ivf_flat = request->ivf_flat;
+  condition.trace = logger.Trace();
+
+  // temporaries of the request are freed together with the arena
+  std::unique_ptr<utils::Arena> local_arena;
+  condition.arena = sink->GetArena();
+  if (condition.arena == nullptr) {
+    local_arena.reset(new utils::Arena());
+    condition.arena = local_arena.get();
+  }
 
 #ifdef BUILD_GPU
   condition.range_filters_num = request->range_filters_num;
@@ -438,13 +435,49 @@ Response *GammaEngine::Search(const Request *request) {
   condition.profile = profile_;
 #endif  // BUILD_GPU
 
+  // the cache is checked before filtering as filters are in the key
+  std::string cache_key;
+  uint64_t epoch = write_epoch_;
+  bool use_cache = search_cache_.Enabled() &&
+                   SearchCache::MakeKey(request, use_direct_search, cache_key);
+  if (use_cache) {
+    std::shared_ptr<const SearchCacheEntry> entry =
+        search_cache_.Get(cache_key, epoch);
+    if (entry != nullptr) {
+      OLOG(&logger, DEBUG, "hit search cache");
+      utils::Metrics::Instance().Add(utils::kCounterSearchCacheHits,
+                                     request->req_num);
+      std::vector<string> vec_names(request->vec_fields_num);
+      for (int i = 0; i < request->vec_fields_num; ++i) {
+        ByteArray *name = request->vec_fields[i]->name;
+        vec_names[i].assign(name->value, name->len);
+      }
+      GammaResult gamma_results[request->req_num];
+      SearchCache::ToResults(*entry, request->topn, vec_names.data(),
+                             request->vec_fields_num, docids_bitmap_,
+                             gamma_results);
+      sink->Begin(request->req_num);
+      PackResults(gamma_results, request->req_num, request, sink);
+      logger.FlushTrace();
+      sink->End(logger.Data(), logger.Length());
+      return 0;
+    }
+  }
+
 #ifndef BUILD_GPU
   MultiRangeQueryResults range_query_result;
   if (request->range_filters_num > 0 || request->term_filters_num > 0) {
-    int num = MultiRangeQuery(request, condition, response_results,
-                              &range_query_result, logger);
+    utils::StageTimer filter_timer(utils::kStageSearchFilter);
+    int num = MultiRangeQuery(request, condition, sink, &range_query_result,
+                              logger);
+    uint64_t filter_us = filter_timer.Stop();
+    if (condition.trace != nullptr) {
+      const RangeQueryResult *result = range_query_result.GetAllResult();
+      condition.trace->SetFilterDocs(result != nullptr ? result->Size() : -1);
+      condition.trace->AddStage("filter", filter_us);
+    }
     if (num == 0) {
-      return response_results;
+      return 0;
     }
   }
 #ifdef PERFORMANCE_TESTING
@@ -461,29 +494,33 @@ Response *GammaEngine::Search(const Request *request) {
       gamma_results[i].total = doc_num;
     }
 
+    utils::StageTimer vector_timer(utils::kStageSearchVector);
     ret = vec_manager_->Search(gamma_query, gamma_results);
+    uint64_t vector_us = vector_timer.Stop();
+    if (condition.trace != nullptr) {
+      condition.trace->AddStage("vector search", vector_us);
+    }
     if (ret != 0) {
       string msg = "search error [" + std::to_string(ret) + "]";
-      for (int i = 0; i < response_results->req_num; ++i) {
-        response_results->results[i]->msg =
-            MakeByteArray(msg.c_str(), msg.length());
-        response_results->results[i]->result_code =
-            SearchResultCode::SEARCH_ERROR;
-      }
-
-      const char *log_message = logger.Data();
-      if (log_message) {
-        response_results->online_log_message =
-            MakeByteArray(log_message, logger.Length());
-      }
-
-      return response_results;
+      PackEmptyResults(request->req_num, SearchResultCode::SEARCH_ERROR, msg,
+                       &logger, sink);
+      return ret;
     }
 
 #ifdef PERFORMANCE_TESTING
     condition.Perf("search total");
 #endif
-    PackResults(gamma_results, response_results, request);
+    if (use_cache) {
+      search_cache_.Put(cache_key, SearchCache::MakeEntry(
+                                       gamma_results, request->req_num, epoch));
+    }
+    utils::StageTimer pack_timer(utils::kStageSearchPack);
+    sink->Begin(request->req_num);
+    PackResults(gamma_results, request->req_num, request, sink);
+    uint64_t pack_us = pack_timer.Stop();
+    if (condition.trace != nullptr) {
+      condition.trace->AddStage("pack results", pack_us);
+    }
 #ifdef PERFORMANCE_TESTING
     condition.Perf("pack results");
 #endif
@@ -546,8 +583,8 @@ Response *GammaEngine::Search(const Request *request) {
         }
       }
     }
-    response_results->req_num = 1;  // only one result
-    PackResults(&gamma_result, response_results, request);
+    sink->Begin(1);  // only one result
+    PackResults(&gamma_result, 1, request, sink);
   }
 #endif
 
@@ -555,18 +592,17 @@ Response *GammaEngine::Search(const Request *request) {
   LOG(INFO) << condition.OutputPerf().str();
 #endif
 
-  const char *log_message = logger.Data();
-  if (log_message) {
-    response_results->online_log_message =
-        MakeByteArray(log_message, logger.Length());
+  if (condition.trace != nullptr) {
+    condition.trace->AddStage("total", total_timer.Stop());
   }
-
-  return response_results;
+  logger.FlushTrace();
+  sink->End(logger.Data(), logger.Length());
+  return 0;
 }
 
 int GammaEngine::MultiRangeQuery(const Request *request,
                                  GammaSearchCondition &condition,
-                                 Response *response_results,
+                                 ResultSink *sink,
                                  MultiRangeQueryResults *range_query_result,
                                  utils::OnlineLogger &logger) {
   std::vector<FilterInfo> filters;
@@ -604,17 +640,8 @@ int GammaEngine::MultiRangeQuery(const Request *request,
   if (retval == 0) {
     string msg = "No result: numeric filter return 0 result";
     LOG(INFO) << msg;
-    for (int i = 0; i < response_results->req_num; ++i) {
-      response_results->results[i]->msg =
-          MakeByteArray(msg.c_str(), msg.length());
-      response_results->results[i]->result_code = SearchResultCode::SUCCESS;
-    }
-
-    const char *log_message = logger.Data();
-    if (log_message) {
-      response_results->online_log_message =
-          MakeByteArray(log_message, logger.Length());
-    }
+    PackEmptyResults(request->req_num, SearchResultCode::SUCCESS, msg, &logger,
+                     sink);
   } else if (retval < 0) {
     condition.range_query_result = nullptr;
   } else {
@@ -649,6 +676,7 @@ int GammaEngine::CreateTable(const Table *table) {
     LOG(ERROR) << "add numeric index fields error!";
     return -3;
   }
+  field_range_index_->SetCacheCapacity(filter_cache_bytes_);
 
   auto func_build_field_index = std::bind(&GammaEngine::BuildFieldIndex, this);
   std::thread t(func_build_field_index);
@@ -671,6 +699,7 @@ int GammaEngine::Add(const Doc *doc) {
     LOG(ERROR) << "Doc size reached upper size [" << max_docid_ << "]";
     return -1;
   }
+  utils::StageTimer timer(utils::kStageAddDoc);
   std::vector<Field *> fields_profile;
   std::vector<Field *> fields_vec;
   for (int i = 0; i < doc->fields_num; ++i) {
@@ -680,8 +709,9 @@ int GammaEngine::Add(const Doc *doc) {
       fields_vec.push_back(doc->fields[i]);
     }
   }
-  // add fields into profile
-  if (profile_->Add(fields_profile, max_docid_, false) != 0) {
+  // add fields into profile, the key is indexed after the vectors are added
+  std::string key;
+  if (profile_->AddFields(fields_profile, max_docid_, key) != 0) {
     return -1;
   }
 
@@ -698,9 +728,12 @@ int GammaEngine::Add(const Doc *doc) {
   if (vec_manager_->AddToStore(max_docid_, fields_vec) != 0) {
     return -2;
   }
+  int ret = profile_->AddKey(key, max_docid_);
   ++max_docid_;
+  ++write_epoch_;
+  utils::Metrics::Instance().Add(utils::kCounterDocsWritten);
 
-  return 0;
+  return ret;
 }
 
 int GammaEngine::AddOrUpdate(const Doc *doc) {
@@ -708,6 +741,7 @@ int GammaEngine::AddOrUpdate(const Doc *doc) {
     LOG(ERROR) << "Doc size reached upper size [" << max_docid_ << "]";
     return -1;
   }
+  utils::StageTimer timer(utils::kStageAddDoc);
 #ifdef PERFORMANCE_TESTING
   double start = utils::getmillisecs();
 #endif
@@ -733,7 +767,8 @@ int GammaEngine::AddOrUpdate(const Doc *doc) {
   profile_->GetDocIDByKey(key, docid);
 
   if (docid == -1) {
-    int ret = profile_->Add(fields_profile, max_docid_, false);
+    // the key is indexed after the vectors are added
+    int ret = profile_->AddFields(fields_profile, max_docid_, key);
     if (ret != 0) return -1;
   } else {
     if (Update(docid, fields_profile, fields_vec)) {
@@ -758,7 +793,10 @@ int GammaEngine::AddOrUpdate(const Doc *doc) {
   if (vec_manager_->AddToStore(max_docid_, fields_vec) != 0) {
     return -2;
   }
+  int ret = profile_->AddKey(key, max_docid_);
   ++max_docid_;
+  ++write_epoch_;
+  utils::Metrics::Instance().Add(utils::kCounterDocsWritten);
 #ifdef PERFORMANCE_TESTING
   double end = utils::getmillisecs();
   if (max_docid_ % 10000 == 0) {
@@ -766,6 +804,130 @@ int GammaEngine::AddOrUpdate(const Doc *doc) {
               << "]ms, vec store cost [" << end - end_profile << "]ms";
   }
 #endif
+  return ret;
+}
+
+int GammaEngine::Add(Doc **docs, int num, int *codes) {
+  return AddDocs(docs, num, false, codes);
+}
+
+int GammaEngine::AddOrUpdate(Doc **docs, int num, int *codes) {
+  return AddDocs(docs, num, true, codes);
+}
+
+int GammaEngine::AddDocs(Doc **docs, int num, bool update_existed,
+                         int *codes) {
+  if (docs == nullptr || codes == nullptr || num <= 0) return -1;
+  utils::StageTimer timer(utils::kStageAddDocs);
+#ifdef PERFORMANCE_TESTING
+  double start = utils::getmillisecs();
+#endif
+  std::vector<std::vector<Field *>> fields_profile(num);
+  std::vector<std::vector<Field *>> fields_vec(num);
+  std::vector<string> keys(num);
+  for (int i = 0; i < num; i++) {
+    const Doc *doc = docs[i];
+    codes[i] = 0;
+    for (int j = 0; j < doc->fields_num; ++j) {
+      Field *field = doc->fields[j];
+      if (field->data_type == VECTOR) {
+        fields_vec[i].push_back(field);
+        continue;
+      }
+      fields_profile[i].push_back(field);
+      if (field->name->len == 3 && strncmp(field->name->value, "_id", 3) == 0) {
+        keys[i].assign(field->value->value, field->value->len);
+      }
+    }
+  }
+
+  std::vector<int> existed_docids;
+  if (update_existed) {
+    profile_->GetDocIDsByKeys(keys, existed_docids);
+  } else {
+    existed_docids.assign(num, -1);
+  }
+
+  // docs to add, and docs whose key is added before them in this batch. The
+  // keys of new docs are indexed after their vectors are added, so a failed
+  // batch leaves nothing found and its rows are overwritten by the next one
+  std::vector<int> docids;
+  std::vector<int> added_idxs;
+  std::vector<std::pair<int, int>> deferred_updates;
+  std::map<string, int> batch_keys;
+  for (int i = 0; i < num; i++) {
+    if (vec_manager_->CheckFields(fields_vec[i])) {
+      codes[i] = -1;
+      continue;
+    }
+    if (existed_docids[i] >= 0) {
+      if (Update(existed_docids[i], fields_profile[i], fields_vec[i])) {
+        LOG(ERROR) << "update error, key=" << keys[i]
+                   << ", docid=" << existed_docids[i];
+        codes[i] = -1;
+      }
+      continue;
+    }
+    if (update_existed) {
+      const auto &it = batch_keys.find(keys[i]);
+      if (it != batch_keys.end()) {
+        deferred_updates.emplace_back(i, it->second);
+        continue;
+      }
+    }
+    int docid = max_docid_ + docids.size();
+    if (docid >= max_doc_size_) {
+      LOG(ERROR) << "Doc size reached upper size [" << docid << "]";
+      codes[i] = -1;
+      continue;
+    }
+    if (profile_->AddFields(fields_profile[i], docid, keys[i]) != 0) {
+      codes[i] = -1;
+      continue;
+    }
+    if (update_existed) batch_keys[keys[i]] = docid;
+    docids.push_back(docid);
+    added_idxs.push_back(i);
+  }
+#ifdef PERFORMANCE_TESTING
+  double end_profile = utils::getmillisecs();
+#endif
+
+  std::vector<std::vector<Field *>> added_vecs;
+  added_vecs.reserve(added_idxs.size());
+  for (int i : added_idxs) added_vecs.push_back(fields_vec[i]);
+  if (vec_manager_->AddToStore(docids, added_vecs) != 0) {
+    LOG(ERROR) << "add vectors of " << docids.size() << " docs error";
+    for (int i : added_idxs) codes[i] = -2;
+    for (const auto &update : deferred_updates) codes[update.first] = -2;
+    return -2;
+  }
+  for (size_t j = 0; j < docids.size(); j++) {
+    int i = added_idxs[j];
+    if (profile_->AddKey(keys[i], docids[j]) != 0) codes[i] = -1;
+  }
+  max_docid_ += docids.size();
+  ++write_epoch_;
+  utils::Metrics::Instance().Add(utils::kCounterDocsWritten, docids.size());
+
+  for (const auto &update : deferred_updates) {
+    int i = update.first;
+    if (Update(update.second, fields_profile[i], fields_vec[i])) {
+      LOG(ERROR) << "update error, key=" << keys[i]
+                 << ", docid=" << update.second;
+      codes[i] = -1;
+    }
+  }
+#ifdef PERFORMANCE_TESTING
+  double end = utils::getmillisecs();
+  LOG(INFO) << "add " << num << " docs, new " << docids.size()
+            << ", profile cost [" << end_profile - start
+            << "]ms, vec store cost [" << end - end_profile << "]ms";
+#endif
+
+  for (int i = 0; i < num; i++) {
+    if (codes[i] != 0) return -1;
+  }
   return 0;
 }
 
@@ -773,6 +935,7 @@ int GammaEngine::Update(const Doc *doc) { return -1; }
 
 int GammaEngine::Update(int doc_id, std::vector<Field *> &fields_profile,
                         std::vector<Field *> &fields_vec) {
+  utils::StageTimer timer(utils::kStageUpdateDoc);
   int ret = vec_manager_->Update(doc_id, fields_vec);
   if (ret != 0) {
     return ret;
@@ -786,6 +949,8 @@ int GammaEngine::Update(int doc_id, std::vector<Field *> &fields_profile,
   }
 #endif  // BUILD_GPU
 
+  // the vectors may be updated even if profile fails
+  ++write_epoch_;
   if (profile_->Update(fields_profile, doc_id) != 0) {
     LOG(ERROR) << "profile update error";
     return -1;
@@ -799,6 +964,8 @@ int GammaEngine::Update(int doc_id, std::vector<Field *> &fields_profile,
   }
 #endif  // BUILD_GPU
 
+  ++write_epoch_;
+  utils::Metrics::Instance().Add(utils::kCounterDocsWritten);
 #ifdef DEBUG
   LOG(INFO) << "update success! key=" << key;
 #endif
@@ -806,6 +973,7 @@ int GammaEngine::Update(int doc_id, std::vector<Field *> &fields_profile,
 }
 
 int GammaEngine::Del(ByteArray *key) {
+  utils::StageTimer timer(utils::kStageDelDoc);
   int docid = -1, ret = 0;
   std::string key_str = std::string(key->value, key->len);
   ret = profile_->GetDocIDByKey(key_str, docid);
@@ -818,6 +986,7 @@ int GammaEngine::Del(ByteArray *key) {
   bitmap::set(docids_bitmap_, docid);
 
   vec_manager_->Delete(docid);
+  ++write_epoch_;
 
   return ret;
 }
@@ -864,7 +1033,10 @@ int GammaEngine::DelDocByQuery(Request *request) {
     }
     ++delete_num_;
     bitmap::set(docids_bitmap_, docid);
+    // counts the deleted codes of the lists, which drives compaction
+    vec_manager_->Delete(docid);
   }
+  ++write_epoch_;
 #endif  // BUILD_GPU
   return 0;
 }
@@ -937,17 +1109,28 @@ int GammaEngine::BuildIndex() {
 int GammaEngine::Indexing() {
   int ret = 0;
   bool has_error = false;
+  int indexed_docid = 0;
   while (b_running_) {
     if (has_error) {
       usleep(5000 * 1000);  // sleep 5000ms
       continue;
     }
+    int max_docid = max_docid_;
+    utils::StageTimer timer(utils::kStageIndexing);
     int add_ret = vec_manager_->AddRTVecsToIndex();
     if (add_ret != 0) {
       has_error = true;
       LOG(ERROR) << "Add real time vectors to index error!";
       continue;
     }
+    if (max_docid == indexed_docid) {
+      timer.Discard();  // nothing is indexed
+    } else {
+      timer.Stop();
+      // new docs are searchable now
+      indexed_docid = max_docid;
+      ++write_epoch_;
+    }
     index_status_ = IndexStatus::INDEXED;
     usleep(1000 * 1000);  // sleep 5000ms
   }
@@ -995,6 +1178,9 @@ long GammaEngine::GetMemoryBytes() {
   long dense_b = 0, sparse_b = 0, total_mem_b = 0;
 
   total_mem_b += field_range_index_->MemorySize(dense_b, sparse_b);
+  long cache_hits = 0, cache_misses = 0, cache_bytes = 0;
+  field_range_index_->GetCacheStats(cache_hits, cache_misses, cache_bytes);
+  total_mem_b += cache_bytes;
   // long total_mem_kb = total_mem_b / 1024;
   // long total_mem_mb = total_mem_kb / 1024;
   // LOG(INFO) << "Field range memory [" << total_mem_kb << "]kb, ["
@@ -1010,6 +1196,21 @@ long GammaEngine::GetMemoryBytes() {
   return total_mem_bytes;
 }
 
+void GammaEngine::SetFilterCache(long max_bytes) {
+  filter_cache_bytes_ = max_bytes;
+  if (field_range_index_ != nullptr) {
+    field_range_index_->SetCacheCapacity(max_bytes);
+  }
+}
+
+int GammaEngine::GetFilterCacheStats(long &hits, long &misses, long &bytes) {
+  if (field_range_index_ == nullptr) {
+    return -1;
+  }
+  field_range_index_->GetCacheStats(hits, misses, bytes);
+  return 0;
+}
+
 int GammaEngine::GetIndexStatus() { return index_status_; }
 
 int GammaEngine::Dump() {
@@ -1018,6 +1219,7 @@ int GammaEngine::Dump() {
     LOG(INFO) << "No fresh doc, cannot dump.";
     return 0;
   }
+  utils::StageTimer timer(utils::kStageDump);
 
   if (!utils::isFolderExist(dump_path_.c_str())) {
     mkdir(dump_path_.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
@@ -1077,6 +1279,7 @@ int GammaEngine::Dump() {
     return -1;
   }
 
+  utils::Metrics::Instance().Add(utils::kCounterFlushes);
   LOG(INFO) << "Dumped to [" << path << "], next dump docid [" << dump_docid_
             << "]";
   return ret;
@@ -1160,48 +1363,61 @@ int GammaEngine::Load() {
               << ", ret=" << ret;
   }
 
-  int ret = 0;
+  // profile and vectors are independent of each other once the dumped doc
+  // num is known, so they are loaded concurrently. The bitmap is read first,
+  // the vector indexes test it while loading
+  double load_start = utils::getmillisecs();
+  int doc_num = 0;
+  if (folders.size() > 0 && profile_->LoadDocNum(folders, doc_num)) {
+    LOG(ERROR) << "load dumped doc num error";
+    return -1;
+  }
+
+  double bitmap_cost = 0;
   if (folders.size() > 0) {
-    ret = profile_->Load(folders, max_docid_);
+    double start = utils::getmillisecs();
+    int ret = LoadBitmap(folders[folders.size() - 1]);
+    bitmap_cost = utils::getmillisecs() - start;
     if (ret != 0) {
-      LOG(ERROR) << "load profile error, ret=" << ret;
-      return -1;
-    }
-    // load bitmap
-    if (docids_bitmap_ == nullptr) {
-      LOG(ERROR) << "docid bitmap is not initilized";
-      return -1;
-    }
-    string bitmap_file_name = folders[folders.size() - 1] + "/bitmap";
-    FILE *fp_bm = fopen(bitmap_file_name.c_str(), "rb");
-    if (fp_bm == nullptr) {
-      LOG(ERROR) << "Cannot open file " << bitmap_file_name;
+      LOG(ERROR) << "load bitmap error, ret=" << ret;
       return -1;
     }
-    long bm_file_size = utils::get_file_size(bitmap_file_name.c_str());
-    if (bm_file_size > bitmap_bytes_size_) {
-      LOG(ERROR) << "bitmap file size=" << bm_file_size
-                 << " > allocated bitmap bytes size=" << bitmap_bytes_size_
-                 << ", max doc size=" << max_doc_size_;
-      fclose(fp_bm);
-      return -1;
-    }
-    fread((void *)(docids_bitmap_), sizeof(char), bm_file_size, fp_bm);
-    fclose(fp_bm);
+  }
 
-    delete_num_ = 0;
-    for (int i = 0; i < max_doc_size_; ++i) {
-      if (bitmap::test(docids_bitmap_, i)) {
-        ++delete_num_;
-      }
+  int profile_ret = 0;
+  double profile_cost = 0;
+  std::thread profile_loader([&]() {
+    if (folders.size() == 0) return;
+    double start = utils::getmillisecs();
+    int profile_doc_num = 0;
+    profile_ret = profile_->Load(folders, profile_doc_num);
+    if (profile_ret == 0 && profile_doc_num != doc_num) {
+      LOG(ERROR) << "profile doc num=" << profile_doc_num
+                 << " isn't equal to dumped doc num=" << doc_num;
+      profile_ret = -1;
     }
-  }
+    profile_cost = utils::getmillisecs() - start;
+  });
+
+  double vector_start = utils::getmillisecs();
+  int ret = vec_manager_->Load(folders, doc_num);
+  double vector_cost = utils::getmillisecs() - vector_start;
+
+  profile_loader.join();
 
-  ret = vec_manager_->Load(folders, max_docid_);
+  LOG(INFO) << "load stages cost: profile=" << profile_cost
+            << "ms, bitmap=" << bitmap_cost << "ms, vector=" << vector_cost
+            << "ms, total=" << utils::getmillisecs() - load_start << "ms";
+
+  if (profile_ret != 0) {
+    LOG(ERROR) << "load profile error, ret=" << profile_ret;
+    return -1;
+  }
   if (ret != 0) {
     LOG(ERROR) << "load vector error, ret=" << ret;
     return -1;
   }
+  max_docid_ = doc_num;
 
   dump_docid_ = max_docid_;
 
@@ -1212,6 +1428,32 @@ int GammaEngine::Load() {
   return 0;
 }
 
+int GammaEngine::LoadBitmap(const string &folder) {
+  if (docids_bitmap_ == nullptr) {
+    LOG(ERROR) << "docid bitmap is not initilized";
+    return -1;
+  }
+  string bitmap_file_name = folder + "/bitmap";
+  FILE *fp_bm = fopen(bitmap_file_name.c_str(), "rb");
+  if (fp_bm == nullptr) {
+    LOG(ERROR) << "Cannot open file " << bitmap_file_name;
+    return -1;
+  }
+  long bm_file_size = utils::get_file_size(bitmap_file_name.c_str());
+  if (bm_file_size > bitmap_bytes_size_) {
+    LOG(ERROR) << "bitmap file size=" << bm_file_size
+               << " > allocated bitmap bytes size=" << bitmap_bytes_size_
+               << ", max doc size=" << max_doc_size_;
+    fclose(fp_bm);
+    return -1;
+  }
+  fread((void *)(docids_bitmap_), sizeof(char), bm_file_size, fp_bm);
+  fclose(fp_bm);
+
+  delete_num_ = bitmap::count(docids_bitmap_, max_doc_size_);
+  return 0;
+}
+
 int GammaEngine::AddNumIndexFields() {
   int retvals = 0;
   std::map<std::string, enum DataType> attr_type;
@@ -1227,7 +1469,7 @@ int GammaEngine::AddNumIndexFields() {
       continue;
     }
     int is_index = attr_index_it->second;
-    if (is_index == 0) {
+    if (!(is_index & FIELD_INDEX_RANGE)) {
       continue;
     }
     int field_idx = profile_->GetAttrIdx(field_name);
@@ -1237,130 +1479,133 @@ int GammaEngine::AddNumIndexFields() {
   return retvals;
 }
 
-int GammaEngine::PackResults(const GammaResult *gamma_results,
-                             Response *response_results,
-                             const Request *request) {
-  for (int i = 0; i < response_results->req_num; ++i) {
-    SearchResult *result = response_results->results[i];
-    result->total = gamma_results[i].total;
-    result->result_num = gamma_results[i].results_count;
-    result->result_items = new ResultItem *[result->result_num];
-
-    for (int j = 0; j < result->result_num; ++j) {
-      VectorDoc *vec_doc = gamma_results[i].docs[j];
-      result->result_items[j] = PackResultItem(vec_doc, request);
+void GammaEngine::GetResultFields(const Request *request,
+                                  std::vector<ResultField> &profile_fields,
+                                  std::vector<std::string> &vec_fields) {
+  for (int i = 0; i < request->fields_num; ++i) {
+    ByteArray *field = request->fields[i];
+    string name = string(field->value, field->len);
+    if (vec_manager_->GetVectorIndex(name) != nullptr) {
+      vec_fields.emplace_back(std::move(name));
+      continue;
+    }
+    ResultField result_field;
+    result_field.id = profile_->GetAttrIdx(name);
+    if (result_field.id < 0 ||
+        profile_->GetFieldType(name, result_field.type) != 0) {
+      continue;
+    }
+    result_field.name = std::move(name);
+    profile_fields.emplace_back(std::move(result_field));
+  }
+
+  // all profile fields are returned if none is specified
+  if (profile_fields.size() == 0) {
+    std::map<std::string, enum DataType> attr_type_map;
+    profile_->GetAttrType(attr_type_map);
+    for (const auto &it : attr_type_map) {
+      ResultField result_field;
+      result_field.name = it.first;
+      result_field.id = profile_->GetAttrIdx(it.first);
+      result_field.type = it.second;
+      profile_fields.emplace_back(std::move(result_field));
     }
-
-    string msg = "Success";
-    result->msg = MakeByteArray(msg.c_str(), msg.length());
-    result->result_code = SearchResultCode::SUCCESS;
   }
-
-  return 0;
 }
 
-ResultItem *GammaEngine::PackResultItem(const VectorDoc *vec_doc,
-                                        const Request *request) {
-  ResultItem *result_item = new ResultItem;
-  result_item->score = vec_doc->score;
-
-  Doc *doc = nullptr;
-  int docid = vec_doc->docid;
+void GammaEngine::FetchHitFields(const std::vector<int> &docids,
+                                 HitFields &hit_fields) {
+  std::vector<int> field_ids;
+  for (const ResultField &field : hit_fields.profile_fields) {
+    field_ids.push_back(field.id);
+  }
+  profile_->GetFieldsRawValues(docids, field_ids, hit_fields.values,
+                               hit_fields.lens);
 
-  // add vector into result
-  if (request->fields_num != 0) {
-    std::vector<std::pair<string, int>> vec_fields_ids;
-    std::vector<string> profile_fields;
-
-    for (int i = 0; i < request->fields_num; ++i) {
-      ByteArray *field = request->fields[i];
-      string name = string(field->value, field->len);
-      const auto ret = vec_manager_->GetVectorIndex(name);
-      if (ret == nullptr) {
-        profile_fields.emplace_back(std::move(name));
-      } else {
-        vec_fields_ids.emplace_back(std::make_pair(name, docid));
-      }
+  hit_fields.vec_batches.resize(hit_fields.vec_fields.size());
+  for (size_t i = 0; i < hit_fields.vec_fields.size(); ++i) {
+    VectorBatch &batch = hit_fields.vec_batches[i];
+    if (vec_manager_->GetVectors(hit_fields.vec_fields[i], docids, batch)) {
+      batch.vecs.assign(docids.size(), nullptr);
     }
+  }
+}
 
-    std::vector<string> vec;
-    int ret = vec_manager_->GetVector(vec_fields_ids, vec, true);
-
-    int profile_fields_num = 0;
-    doc = static_cast<Doc *>(malloc(sizeof(Doc)));
+int GammaEngine::PackResults(const GammaResult *gamma_results, int req_num,
+                             const Request *request, ResultSink *sink) {
+  // fields to return are the same for all items
+  HitFields hit_fields;
+  GetResultFields(request, hit_fields.profile_fields, hit_fields.vec_fields);
+
+  // collect hits of all results, then only the returned fields are fetched
+  // in one pass
+  std::vector<int> docids;
+  for (int i = 0; i < req_num; ++i) {
+    for (int j = 0; j < gamma_results[i].results_count; ++j) {
+      docids.push_back(gamma_results[i].docs[j]->docid);
+    }
+  }
+  FetchHitFields(docids, hit_fields);
 
-    if (profile_fields.size() == 0) {
-      profile_fields_num = profile_->FieldsNum();
+  int hit = 0;
+  for (int i = 0; i < req_num; ++i) {
+    sink->BeginResult(gamma_results[i].total);
+    for (int j = 0; j < gamma_results[i].results_count; ++j) {
+      PackResultItem(gamma_results[i].docs[j], hit++, hit_fields, sink);
+    }
+    sink->EndResult(SearchResultCode::SUCCESS, "Success");
+  }
 
-      doc->fields_num = profile_fields_num + request->fields_num;
-      doc->fields =
-          static_cast<Field **>(malloc(doc->fields_num * sizeof(Field *)));
-      memset(doc->fields, 0, doc->fields_num * sizeof(Field *));
+  return 0;
+}
 
-      profile_->GetDocInfo(docid, doc);
-    } else {
-      profile_fields_num = profile_fields.size();
-      doc->fields_num = request->fields_num;
-      doc->fields =
-          static_cast<Field **>(malloc(doc->fields_num * sizeof(Field *)));
-      memset(doc->fields, 0, doc->fields_num * sizeof(Field *));
-
-      for (int i = 0; i < profile_fields_num; ++i) {
-        doc->fields[i] = profile_->GetFieldInfo(docid, profile_fields[i]);
-      }
-    }
+void GammaEngine::PackResultItem(const VectorDoc *vec_doc, int hit,
+                                 const HitFields &hit_fields,
+                                 ResultSink *sink) {
+  sink->BeginItem(vec_doc->score);
 
-    if (ret == 0 && vec.size() == vec_fields_ids.size()) {
-      int j = 0;
-      for (int i = profile_fields_num; i < doc->fields_num; ++i) {
-        const string &field_name = vec_fields_ids[j].first;
-        doc->fields[i] = static_cast<Field *>(malloc(sizeof(Field)));
-        memset(doc->fields[i], 0, sizeof(Field));
-        doc->fields[i]->name =
-            MakeByteArray(field_name.c_str(), field_name.length());
-        doc->fields[i]->value = MakeByteArray(vec[j].c_str(), vec[j].length());
-        doc->fields[i]->data_type = DataType::VECTOR;
-        ++j;
-      }
-    } else {
-      // get vector error
-      // TODO : release extra field
-      doc->fields_num = profile_fields_num;
-    }
-  } else {
-    profile_->GetDocInfo(docid, doc);
+  // profile values are passed without copy
+  size_t fields_num = hit_fields.profile_fields.size();
+  for (size_t i = 0; i < fields_num; ++i) {
+    size_t pos = hit * fields_num + i;
+    if (hit_fields.values[pos] == nullptr) continue;
+    const ResultField &field = hit_fields.profile_fields[i];
+    sink->AddField(field.name, hit_fields.values[pos], hit_fields.lens[pos],
+                   field.type);
   }
 
-  result_item->doc = doc;
+  // add vector into result
+  for (size_t i = 0; i < hit_fields.vec_fields.size(); ++i) {
+    const VectorBatch &batch = hit_fields.vec_batches[i];
+    if (batch.vecs[hit] == nullptr) continue;
+    sink->AddVectorField(hit_fields.vec_fields[i], batch.vecs[hit],
+                         batch.vec_bytes, batch.sources[hit],
+                         batch.source_lens[hit]);
+  }
 
-  cJSON *extra_json = cJSON_CreateObject();
-  cJSON *vec_result_json = cJSON_CreateArray();
-  cJSON_AddItemToObject(extra_json, EXTRA_VECTOR_RESULT.c_str(),
-                        vec_result_json);
   for (int i = 0; i < vec_doc->fields_len; ++i) {
     VectorDocField *vec_field = vec_doc->fields + i;
-    cJSON *vec_field_json = cJSON_CreateObject();
-
-    cJSON_AddStringToObject(vec_field_json, EXTRA_VECTOR_FIELD_NAME.c_str(),
-                            vec_field->name.c_str());
-    string source = string(vec_field->source, vec_field->source_len);
-    cJSON_AddStringToObject(vec_field_json, EXTRA_VECTOR_FIELD_SOURCE.c_str(),
-                            source.c_str());
-    cJSON_AddNumberToObject(vec_field_json, EXTRA_VECTOR_FIELD_SCORE.c_str(),
-                            vec_field->score);
-    cJSON_AddItemToArray(vec_result_json, vec_field_json);
-  }
-
-  char *extra_data = cJSON_PrintUnformatted(extra_json);
-  result_item->extra = static_cast<ByteArray *>(malloc(sizeof(ByteArray)));
-  result_item->extra->len = std::strlen(extra_data);
-  result_item->extra->value =
-      static_cast<char *>(malloc(result_item->extra->len));
-  memcpy(result_item->extra->value, extra_data, result_item->extra->len);
-  free(extra_data);
-  cJSON_Delete(extra_json);
-
-  return result_item;
+    sink->AddVectorResult(vec_field->name, vec_field->score, vec_field->source,
+                          vec_field->source_len);
+  }
+  sink->EndItem();
+}
+
+void GammaEngine::PackEmptyResults(int req_num, enum SearchResultCode code,
+                                   const std::string &msg,
+                                   utils::OnlineLogger *logger,
+                                   ResultSink *sink) {
+  sink->Begin(req_num);
+  for (int i = 0; i < req_num; ++i) {
+    sink->BeginResult(0);
+    sink->EndResult(code, msg);
+  }
+  if (logger != nullptr) {
+    logger->FlushTrace();
+    sink->End(logger->Data(), logger->Length());
+  } else {
+    sink->End(nullptr, 0);
+  }
 }
 
 }  // namespace tig_gamma
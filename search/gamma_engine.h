@@ -11,10 +11,13 @@
 #include "field_range_index.h"
 #include "gamma_api.h"
 #include "profile.h"
+#include "result_sink.h"
+#include "search_cache.h"
 #include "vector_manager.h"
 
 #include <condition_variable>
 #include <string>
+#include <vector>
 
 namespace tig_gamma {
 
@@ -29,11 +32,22 @@ class GammaEngine {
 
   Response *Search(const Request *request);
 
+  /** search and write results to sink, so they are packed to the output
+   * format without an intermediate Response
+   *
+   * @return 0 if successed
+   */
+  int Search(const Request *request, ResultSink *sink);
+
   int CreateTable(const Table *table);
 
   int Add(const Doc *doc);
   int AddOrUpdate(const Doc *doc);
 
+  /** add docs in batch, see AddDocs() */
+  int Add(Doc **docs, int num, int *codes);
+  int AddOrUpdate(Doc **docs, int num, int *codes);
+
   int Update(const Doc *doc);
   int Update(int doc_id, std::vector<Field *> &fields_profile,
              std::vector<Field *> &fields_vec);
@@ -71,12 +85,47 @@ class GammaEngine {
 
   long GetMemoryBytes();
 
+  /** set the search result cache, see SearchCache::SetOptions() */
+  void SetSearchCache(int capacity, int max_stale_ms) {
+    search_cache_.SetOptions(capacity, max_stale_ms);
+  }
+
+  void GetSearchCacheStats(long &hits, long &misses, int &size) {
+    hits = search_cache_.Hits();
+    misses = search_cache_.Misses();
+    size = search_cache_.Size();
+  }
+
+  /** set max memory of the filter result cache, 0 disables it */
+  void SetFilterCache(long max_bytes);
+
+  /** @return 0 if successed, -1 if the table isn't created */
+  int GetFilterCacheStats(long &hits, long &misses, long &bytes);
+
  private:
   GammaEngine(const std::string &index_root_path);
   int CreateTableFromLocal(std::string &table_name);
 
+  /** load the bitmap of deleted docs from dump folder and recount deleted
+   * docs
+   *
+   * @return 0 if successed
+   */
+  int LoadBitmap(const std::string &folder);
+
   int Indexing();
 
+  /** add docs in batch, keys are resolved together, profiles of new docs are
+   * added with sequential docids, then vectors are stored in one batch per
+   * vector field. A doc whose key exists is updated if update_existed is set,
+   * including the key added before it in the same batch.
+   *
+   * @param codes output, 0 if the doc is added or updated, otherwise the
+   * error code of the doc
+   * @return 0 if all docs are successed
+   */
+  int AddDocs(Doc **docs, int num, bool update_existed, int *codes);
+
  private:
   std::string index_root_path_;
   std::string dump_path_;
@@ -102,13 +151,42 @@ class GammaEngine {
   std::condition_variable running_cv_;
   std::condition_variable running_field_cv_;
 
-  int PackResults(const GammaResult *gamma_results, Response *response_results,
-                  const Request *request);
+  // a field to return, id is -1 for vector fields
+  struct ResultField {
+    std::string name;
+    int id;
+    enum DataType type;
+  };
+
+  // fields of all hits, they are fetched in batch before packing
+  struct HitFields {
+    std::vector<ResultField> profile_fields;
+    std::vector<std::string> vec_fields;
+    // value of hit i and profile field j is at i * profile_fields.size() + j
+    std::vector<const char *> values;
+    std::vector<int> lens;
+    std::vector<VectorBatch> vec_batches;  // of each vector field
+  };
+
+  void GetResultFields(const Request *request,
+                       std::vector<ResultField> &profile_fields,
+                       std::vector<std::string> &vec_fields);
 
-  ResultItem *PackResultItem(const VectorDoc *vec_doc, const Request *request);
+  void FetchHitFields(const std::vector<int> &docids, HitFields &hit_fields);
+
+  int PackResults(const GammaResult *gamma_results, int req_num,
+                  const Request *request, ResultSink *sink);
+
+  void PackResultItem(const VectorDoc *vec_doc, int hit,
+                      const HitFields &hit_fields, ResultSink *sink);
+
+  // every result of request is empty with code and msg
+  void PackEmptyResults(int req_num, enum SearchResultCode code,
+                        const std::string &msg, utils::OnlineLogger *logger,
+                        ResultSink *sink);
 
   int MultiRangeQuery(const Request *request, GammaSearchCondition &condition,
-                      Response *response_results,
+                      ResultSink *sink,
                       MultiRangeQueryResults *range_query_result,
                       utils::OnlineLogger &logger);
 
@@ -131,6 +209,11 @@ class GammaEngine {
 #endif
 
   GammaCounters *counters_;
+
+  SearchCache search_cache_;
+  long filter_cache_bytes_;
+  // bumped after docs are written, cached results of older epochs are stale
+  std::atomic<uint64_t> write_epoch_;
 };
 
 // specialization for string
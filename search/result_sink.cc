@@ -0,0 +1,175 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "result_sink.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gamma_common_data.h"
+#include "log.h"
+
+namespace tig_gamma {
+
+void ResultSink::AddVectorField(const std::string &name, const char *vec,
+                                int vec_bytes, const char *source,
+                                int source_len) {
+  std::string value;
+  value.reserve(sizeof(vec_bytes) + vec_bytes + source_len);
+  value.append((const char *)&vec_bytes, sizeof(vec_bytes));
+  value.append(vec, vec_bytes);
+  if (source_len > 0) value.append(source, source_len);
+  AddField(name, value.data(), value.size(), DataType::VECTOR);
+}
+
+ResponseSink::ResponseSink()
+    : arena_(new utils::Arena()),
+      response_(nullptr),
+      capacity_(0),
+      total_(0),
+      extra_json_(nullptr),
+      vector_results_(nullptr) {}
+
+ResponseSink::~ResponseSink() {
+  if (extra_json_ != nullptr) cJSON_Delete(extra_json_);
+  // the response isn't released, everything is in the arena
+  CHECK_DELETE(arena_);
+}
+
+ByteArray *ResponseSink::NewByteArray(const char *value, int len) {
+  ByteArray *byte_array = arena_->AllocateArray<ByteArray>(1);
+  byte_array->value = arena_->Copy(value, len);
+  byte_array->len = len;
+  return byte_array;
+}
+
+void ResponseSink::Begin(int req_num) {
+  ArenaResponse *arena_response = arena_->AllocateArray<ArenaResponse>(1);
+  memset(arena_response, 0, sizeof(ArenaResponse));
+  arena_response->arena = arena_;
+  response_ = &arena_response->response;
+  capacity_ = req_num > 0 ? req_num : 0;
+  response_->results = arena_->AllocateArray<SearchResult *>(capacity_);
+  // the number of results packed, it is updated by EndResult()
+  response_->req_num = 0;
+  response_->online_log_message = nullptr;
+}
+
+void ResponseSink::BeginResult(int total) {
+  total_ = total;
+  items_.clear();
+}
+
+void ResponseSink::BeginItem(double score) {
+  ResultItem *item = arena_->AllocateArray<ResultItem>(1);
+  memset(item, 0, sizeof(ResultItem));
+  item->score = score;
+  items_.push_back(item);
+  fields_.clear();
+  extra_json_ = cJSON_CreateObject();
+  vector_results_ = cJSON_CreateArray();
+  cJSON_AddItemToObject(extra_json_, EXTRA_VECTOR_RESULT.c_str(),
+                        vector_results_);
+}
+
+void ResponseSink::AddField(const std::string &name, const char *value,
+                            int len, enum DataType data_type) {
+  Field *field = arena_->AllocateArray<Field>(1);
+  memset(field, 0, sizeof(Field));
+  field->name = NewByteArray(name.c_str(), name.length());
+  field->value = NewByteArray(value, len);
+  field->data_type = data_type;
+  fields_.push_back(field);
+}
+
+void ResponseSink::AddVectorField(const std::string &name, const char *vec,
+                                  int vec_bytes, const char *source,
+                                  int source_len) {
+  // pack to the arena directly
+  int len = sizeof(vec_bytes) + vec_bytes + source_len;
+  ByteArray *value = arena_->AllocateArray<ByteArray>(1);
+  value->value = arena_->Allocate(len);
+  value->len = len;
+  memcpy(value->value, &vec_bytes, sizeof(vec_bytes));
+  memcpy(value->value + sizeof(vec_bytes), vec, vec_bytes);
+  if (source_len > 0) {
+    memcpy(value->value + sizeof(vec_bytes) + vec_bytes, source, source_len);
+  }
+
+  Field *field = arena_->AllocateArray<Field>(1);
+  memset(field, 0, sizeof(Field));
+  field->name = NewByteArray(name.c_str(), name.length());
+  field->value = value;
+  field->data_type = DataType::VECTOR;
+  fields_.push_back(field);
+}
+
+void ResponseSink::AddVectorResult(const std::string &name, double score,
+                                   const char *source, int source_len) {
+  cJSON *vec_field_json = cJSON_CreateObject();
+  cJSON_AddStringToObject(vec_field_json, EXTRA_VECTOR_FIELD_NAME.c_str(),
+                          name.c_str());
+  std::string source_str = std::string(source, source_len);
+  cJSON_AddStringToObject(vec_field_json, EXTRA_VECTOR_FIELD_SOURCE.c_str(),
+                          source_str.c_str());
+  cJSON_AddNumberToObject(vec_field_json, EXTRA_VECTOR_FIELD_SCORE.c_str(),
+                          score);
+  cJSON_AddItemToArray(vector_results_, vec_field_json);
+}
+
+void ResponseSink::EndItem() {
+  ResultItem *item = items_.back();
+  Doc *doc = arena_->AllocateArray<Doc>(1);
+  doc->fields_num = fields_.size();
+  doc->fields = arena_->AllocateArray<Field *>(fields_.size());
+  memcpy(doc->fields, fields_.data(), fields_.size() * sizeof(Field *));
+  fields_.clear();
+  item->doc = doc;
+
+  char *extra_data = cJSON_PrintUnformatted(extra_json_);
+  item->extra = NewByteArray(extra_data, strlen(extra_data));
+  free(extra_data);
+  cJSON_Delete(extra_json_);
+  extra_json_ = nullptr;
+  vector_results_ = nullptr;
+}
+
+void ResponseSink::EndResult(enum SearchResultCode code,
+                             const std::string &msg) {
+  if (response_->req_num >= capacity_) {
+    LOG(ERROR) << "too many results, capacity=" << capacity_;
+    return;
+  }
+  SearchResult *result = arena_->AllocateArray<SearchResult>(1);
+  result->total = total_;
+  result->result_num = items_.size();
+  result->result_items = arena_->AllocateArray<ResultItem *>(items_.size());
+  memcpy(result->result_items, items_.data(),
+         items_.size() * sizeof(ResultItem *));
+  items_.clear();
+  result->msg = NewByteArray(msg.c_str(), msg.length());
+  result->result_code = code;
+  response_->results[response_->req_num++] = result;
+}
+
+void ResponseSink::End(const char *log_message, int len) {
+  if (log_message != nullptr) {
+    response_->online_log_message = NewByteArray(log_message, len);
+  }
+}
+
+Response *ResponseSink::Release() {
+  Response *response = response_;
+  if (response != nullptr) {
+    // the arena is owned by the response now
+    arena_ = nullptr;
+    response_ = nullptr;
+  }
+  return response;
+}
+
+}  // namespace tig_gamma
@@ -0,0 +1,133 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef RESULT_SINK_H_
+#define RESULT_SINK_H_
+
+#include <string>
+#include <vector>
+#include "arena.h"
+#include "cJSON.h"
+#include "gamma_api.h"
+
+namespace tig_gamma {
+
+/** receiver of search results, the engine writes results to it directly, so
+ * every output format packs results without an intermediate Response.
+ *
+ * Calls are in order: Begin, then for each result BeginResult, its items
+ * (BeginItem, AddField and AddVectorResult, EndItem) and EndResult, at last
+ * End. Pointers passed in are valid only during the call.
+ */
+class ResultSink {
+ public:
+  virtual ~ResultSink() {}
+
+  virtual void Begin(int req_num) = 0;
+
+  virtual void BeginResult(int total) = 0;
+
+  virtual void BeginItem(double score) = 0;
+
+  // value is raw bytes of the field, a vector field is an array of DataType
+  virtual void AddField(const std::string &name, const char *value, int len,
+                        enum DataType data_type) = 0;
+
+  /** add a vector field, its value is packed as the length of vector in
+   * bytes (int), the vector and the source. vec and source are borrowed from
+   * the vector store, the default implementation packs them to AddField()
+   */
+  virtual void AddVectorField(const std::string &name, const char *vec,
+                              int vec_bytes, const char *source,
+                              int source_len);
+
+  // score and source of one vector field of the item
+  virtual void AddVectorResult(const std::string &name, double score,
+                               const char *source, int source_len) = 0;
+
+  virtual void EndItem() = 0;
+
+  virtual void EndResult(enum SearchResultCode code,
+                         const std::string &msg) = 0;
+
+  // log_message is null if there is no online log
+  virtual void End(const char *log_message, int len) = 0;
+
+  /** @return memory of the request, temporaries of searching are allocated
+   * from it, the engine uses its own arena if it's null
+   */
+  virtual utils::Arena *GetArena() { return nullptr; }
+};
+
+/** a Response of c_api and the arena it is allocated from. The arena isn't
+ * part of the public struct, the Response is the first member, so the one
+ * returned by Search() is cast back by DestroyResponse()
+ */
+struct ArenaResponse {
+  Response response;
+  utils::Arena *arena;
+
+  static ArenaResponse *Of(Response *response) {
+    return reinterpret_cast<ArenaResponse *>(response);
+  }
+};
+
+/** the sink packing results to Response of c_api, vector results of an item
+ * are packed to its extra as json. The response and temporaries of searching
+ * are allocated from one arena, which is freed by DestroyResponse(), so the
+ * temporaries live as long as the response
+ */
+class ResponseSink : public ResultSink {
+ public:
+  ResponseSink();
+
+  ~ResponseSink();
+
+  void Begin(int req_num) override;
+
+  void BeginResult(int total) override;
+
+  void BeginItem(double score) override;
+
+  void AddField(const std::string &name, const char *value, int len,
+                enum DataType data_type) override;
+
+  void AddVectorField(const std::string &name, const char *vec, int vec_bytes,
+                      const char *source, int source_len) override;
+
+  void AddVectorResult(const std::string &name, double score,
+                       const char *source, int source_len) override;
+
+  void EndItem() override;
+
+  void EndResult(enum SearchResultCode code, const std::string &msg) override;
+
+  void End(const char *log_message, int len) override;
+
+  utils::Arena *GetArena() override { return arena_; }
+
+  /** @return the packed response, it should be destroyed by
+   * DestroyResponse()
+   */
+  Response *Release();
+
+ private:
+  ByteArray *NewByteArray(const char *value, int len);
+
+  utils::Arena *arena_;
+  Response *response_;
+  int capacity_;  // SearchResult slots of response_
+  int total_;     // total of the current result
+  std::vector<ResultItem *> items_;
+  std::vector<Field *> fields_;
+  cJSON *extra_json_;      // extra of the current item
+  cJSON *vector_results_;  // vector results in extra_json_
+};
+
+}  // namespace tig_gamma
+
+#endif  // RESULT_SINK_H_
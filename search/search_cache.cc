@@ -0,0 +1,188 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "search_cache.h"
+
+#include "bitmap.h"
+#include "utils.h"
+
+namespace tig_gamma {
+
+namespace {
+
+template <typename T>
+void AppendValue(std::string &key, T value) {
+  key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// length prefixed, so adjacent values can't be confused
+void AppendBytes(std::string &key, const ByteArray *bytes) {
+  if (bytes == nullptr) {
+    AppendValue<int>(key, -1);
+    return;
+  }
+  AppendValue<int>(key, bytes->len);
+  key.append(bytes->value, bytes->len);
+}
+
+}  // namespace
+
+SearchCache::SearchCache()
+    : capacity_(0), max_stale_ms_(0), hits_(0), misses_(0) {}
+
+void SearchCache::SetOptions(int capacity, int max_stale_ms) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  capacity_ = capacity > 0 ? capacity : 0;
+  max_stale_ms_ = max_stale_ms > 0 ? max_stale_ms : 0;
+  while ((int)lru_.size() > capacity_) {
+    items_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+}
+
+bool SearchCache::MakeKey(const Request *request, bool use_direct_search,
+                          std::string &key) {
+  if (request->vec_fields_num <= 0) return false;
+  key.clear();
+  AppendValue(key, request->req_num);
+  AppendValue(key, request->topn);
+  AppendValue(key, use_direct_search);
+  AppendValue(key, request->has_rank);
+  AppendValue(key, request->multi_vector_rank);
+  AppendValue(key, request->l2_sqrt);
+  AppendValue(key, request->nprobe);
+  AppendValue(key, request->ivf_flat);
+
+  AppendValue(key, request->vec_fields_num);
+  for (int i = 0; i < request->vec_fields_num; ++i) {
+    const VectorQuery *query = request->vec_fields[i];
+    AppendBytes(key, query->name);
+    AppendBytes(key, query->value);
+    AppendValue(key, query->min_score);
+    AppendValue(key, query->max_score);
+    AppendValue(key, query->boost);
+    AppendValue(key, query->has_boost);
+  }
+
+  AppendValue(key, request->range_filters_num);
+  for (int i = 0; i < request->range_filters_num; ++i) {
+    const RangeFilter *filter = request->range_filters[i];
+    AppendBytes(key, filter->field);
+    AppendBytes(key, filter->lower_value);
+    AppendBytes(key, filter->upper_value);
+    AppendValue(key, filter->include_lower);
+    AppendValue(key, filter->include_upper);
+  }
+
+  AppendValue(key, request->term_filters_num);
+  for (int i = 0; i < request->term_filters_num; ++i) {
+    const TermFilter *filter = request->term_filters[i];
+    AppendBytes(key, filter->field);
+    AppendBytes(key, filter->value);
+    AppendValue(key, filter->is_union);
+  }
+  return true;
+}
+
+std::shared_ptr<const SearchCacheEntry> SearchCache::Get(
+    const std::string &key, uint64_t epoch) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto &it = items_.find(key);
+  if (it == items_.end()) {
+    ++misses_;
+    return nullptr;
+  }
+  std::shared_ptr<const SearchCacheEntry> entry = it->second->second;
+  if (entry->epoch != epoch &&
+      utils::getmillisecs() - entry->time > max_stale_ms_) {
+    lru_.erase(it->second);
+    items_.erase(it);
+    ++misses_;
+    return nullptr;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second);
+  ++hits_;
+  return entry;
+}
+
+void SearchCache::Put(const std::string &key,
+                      std::shared_ptr<const SearchCacheEntry> entry) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (capacity_ <= 0) return;
+  const auto &it = items_.find(key);
+  if (it != items_.end()) {
+    it->second->second = entry;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return;
+  }
+  lru_.emplace_front(key, entry);
+  items_[key] = lru_.begin();
+  if ((int)lru_.size() > capacity_) {
+    items_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+}
+
+int SearchCache::Size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lru_.size();
+}
+
+std::shared_ptr<SearchCacheEntry> SearchCache::MakeEntry(
+    const GammaResult *gamma_results, int req_num, uint64_t epoch) {
+  std::shared_ptr<SearchCacheEntry> entry(new SearchCacheEntry);
+  entry->epoch = epoch;
+  entry->time = utils::getmillisecs();
+  entry->results.resize(req_num);
+  for (int i = 0; i < req_num; ++i) {
+    SearchCacheEntry::Result &result = entry->results[i];
+    result.total = gamma_results[i].total;
+    result.hits.resize(gamma_results[i].results_count);
+    for (int j = 0; j < gamma_results[i].results_count; ++j) {
+      const VectorDoc *doc = gamma_results[i].docs[j];
+      SearchCacheEntry::Hit &hit = result.hits[j];
+      hit.docid = doc->docid;
+      hit.score = doc->score;
+      hit.fields.resize(doc->fields_len);
+      for (int k = 0; k < doc->fields_len; ++k) {
+        hit.fields[k].score = doc->fields[k].score;
+        if (doc->fields[k].source != nullptr) {
+          hit.fields[k].source.assign(doc->fields[k].source,
+                                      doc->fields[k].source_len);
+        }
+      }
+    }
+  }
+  return entry;
+}
+
+void SearchCache::ToResults(const SearchCacheEntry &entry, int topn,
+                            std::string *vec_names, int vec_num,
+                            const char *deleted, GammaResult *gamma_results) {
+  for (size_t i = 0; i < entry.results.size(); ++i) {
+    const SearchCacheEntry::Result &result = entry.results[i];
+    GammaResult &gamma_result = gamma_results[i];
+    gamma_result.init(topn, vec_names, vec_num);
+    gamma_result.total = result.total;
+    int count = 0;
+    for (const SearchCacheEntry::Hit &hit : result.hits) {
+      if (count >= topn) break;
+      if (bitmap::test(deleted, hit.docid)) continue;
+      VectorDoc *doc = gamma_result.docs[count++];
+      doc->docid = hit.docid;
+      doc->score = hit.score;
+      for (int k = 0; k < vec_num && k < (int)hit.fields.size(); ++k) {
+        doc->fields[k].score = hit.fields[k].score;
+        doc->fields[k].source = const_cast<char *>(hit.fields[k].source.data());
+        doc->fields[k].source_len = hit.fields[k].source.size();
+      }
+    }
+    gamma_result.results_count = count;
+  }
+}
+
+}  // namespace tig_gamma
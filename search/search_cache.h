@@ -0,0 +1,119 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef SEARCH_CACHE_H_
+#define SEARCH_CACHE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gamma_api.h"
+#include "gamma_common_data.h"
+
+namespace tig_gamma {
+
+/** hits of a request, fields are fetched from profile when it's packed, so
+ * the projection of request isn't a part of the key
+ */
+struct SearchCacheEntry {
+  struct VectorField {
+    double score;
+    std::string source;
+  };
+
+  struct Hit {
+    int docid;
+    double score;
+    std::vector<VectorField> fields;  // in the order of vector queries
+  };
+
+  struct Result {
+    int total;
+    std::vector<Hit> hits;
+  };
+
+  uint64_t epoch;  // write epoch of engine when it's searched
+  double time;     // ms
+  std::vector<Result> results;
+};
+
+/** LRU cache of search results. An entry is hit if no doc is written after
+ * it's searched, or if it's younger than max_stale_ms when bounded staleness
+ * is allowed. It's thread safe.
+ */
+class SearchCache {
+ public:
+  SearchCache();
+
+  /** @param capacity max number of entries, the cache is disabled if 0
+   * @param max_stale_ms an entry may be hit within this time after writes,
+   * 0 means writes invalidate entries at once
+   */
+  void SetOptions(int capacity, int max_stale_ms);
+
+  bool Enabled() const { return capacity_ > 0; }
+
+  /** make key of a request from vectors, filters and search parameters
+   *
+   * @param use_direct_search whether the request is searched directly
+   * @return false if the request can't be cached
+   */
+  static bool MakeKey(const Request *request, bool use_direct_search,
+                      std::string &key);
+
+  /** @param epoch current write epoch
+   * @return the entry, null if missed
+   */
+  std::shared_ptr<const SearchCacheEntry> Get(const std::string &key,
+                                              uint64_t epoch);
+
+  void Put(const std::string &key,
+           std::shared_ptr<const SearchCacheEntry> entry);
+
+  /** build an entry from results of vector search */
+  static std::shared_ptr<SearchCacheEntry> MakeEntry(
+      const GammaResult *gamma_results, int req_num, uint64_t epoch);
+
+  /** fill results with the entry for packing, sources of results point to
+   * the entry
+   *
+   * @param deleted bitmap of deleted docs, the deleted are skipped
+   */
+  static void ToResults(const SearchCacheEntry &entry, int topn,
+                        std::string *vec_names, int vec_num,
+                        const char *deleted, GammaResult *gamma_results);
+
+  long Hits() const { return hits_; }
+
+  long Misses() const { return misses_; }
+
+  int Size();
+
+ private:
+  typedef std::pair<std::string, std::shared_ptr<const SearchCacheEntry>>
+      Item;
+
+  std::mutex mutex_;
+  int capacity_;
+  int max_stale_ms_;
+  std::list<Item> lru_;  // the most recently used at front
+  std::unordered_map<std::string, std::list<Item>::iterator> items_;
+
+  std::atomic<long> hits_;
+  std::atomic<long> misses_;
+};
+
+}  // namespace tig_gamma
+
+#endif  // SEARCH_CACHE_H_
@@ -0,0 +1,220 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "gamma_api_generated.h"
+#include "test.h"
+
+namespace {
+
+const int kDim = 8;
+const int kMaxDocSize = 1000;
+
+// a doc of the test table, dim is the length of its vector
+struct TestDoc {
+  string key;
+  int count;
+  int dim;
+};
+
+class AddDocsV2Test : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/gamma_add_docs_v2_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    root_ = dir;
+
+    Config *config =
+        MakeConfig(StringToByteArray(root_ + "/engine"), kMaxDocSize);
+    engine_ = Init(config);
+    DestroyConfig(config);
+    ASSERT_NE(nullptr, engine_);
+
+    FieldInfo **field_infos = MakeFieldInfos(2);
+    SetFieldInfo(field_infos, 0,
+                 MakeFieldInfo(StringToByteArray("_id"), STRING, 0));
+    SetFieldInfo(field_infos, 1,
+                 MakeFieldInfo(StringToByteArray("count"), INT, 0));
+    VectorInfo **vectors_info = MakeVectorInfos(1);
+    SetVectorInfo(vectors_info, 0,
+                  MakeVectorInfo(StringToByteArray("vec"), FLOAT, TRUE, kDim,
+                                 StringToByteArray("model"),
+                                 StringToByteArray("Mmap"),
+                                 StringToByteArray("{\"cache_size\": 16}"),
+                                 FALSE));
+    string param =
+        "{\"metric_type\" : \"L2\", \"ncentroids\" : 16, \"nsubvector\" : 4}";
+    Table *table = MakeTable(StringToByteArray("test"), field_infos, 2,
+                             vectors_info, 1, StringToByteArray("IVFPQ"),
+                             StringToByteArray(param), 0);
+    ASSERT_EQ(SUCCESSED, CreateTable(engine_, table));
+    DestroyTable(table);
+  }
+
+  void TearDown() override {
+    if (engine_ != nullptr) Close(engine_);
+    utils::remove_dir(root_.c_str());
+  }
+
+  // a serialized DocBatch of docs
+  static ByteArray *NewBatch(const std::vector<TestDoc> &docs,
+                             bool add_or_update) {
+    flatbuffers::FlatBufferBuilder builder;
+    std::vector<flatbuffers::Offset<gamma_api::Doc>> fb_docs;
+    for (const TestDoc &doc : docs) {
+      std::vector<float> vec(doc.dim, doc.count);
+      std::vector<flatbuffers::Offset<gamma_api::Field>> fields = {
+          gamma_api::CreateField(
+              builder, builder.CreateString("_id"),
+              builder.CreateVector((const uint8_t *)doc.key.data(),
+                                   doc.key.size()),
+              0, gamma_api::FieldDataType_STRING),
+          gamma_api::CreateField(
+              builder, builder.CreateString("count"),
+              builder.CreateVector((const uint8_t *)&doc.count, sizeof(int)),
+              0, gamma_api::FieldDataType_INT),
+          gamma_api::CreateField(
+              builder, builder.CreateString("vec"),
+              builder.CreateVector((const uint8_t *)vec.data(),
+                                   vec.size() * sizeof(float)),
+              builder.CreateString("source-" + doc.key),
+              gamma_api::FieldDataType_VECTOR)};
+      fb_docs.push_back(
+          gamma_api::CreateDoc(builder, builder.CreateVector(fields)));
+    }
+    builder.Finish(gamma_api::CreateDocBatch(
+        builder, builder.CreateVector(fb_docs), add_or_update));
+    return MakeByteArray((const char *)builder.GetBufferPointer(),
+                         builder.GetSize());
+  }
+
+  enum ResponseCode AddBatch(const std::vector<TestDoc> &docs,
+                             bool add_or_update, std::vector<int> &results) {
+    ByteArray *batch = NewBatch(docs, add_or_update);
+    results.assign(docs.size(), 1);
+    enum ResponseCode ret = AddDocsV2(engine_, batch, results.data());
+    DestroyByteArray(batch);
+    return ret;
+  }
+
+  // count of the doc of key, -1 if it isn't found
+  int GetCount(const string &key) {
+    ByteArray *id = StringToByteArray(key);
+    Doc *doc = GetDocByID(engine_, id);
+    DestroyByteArray(id);
+    if (doc == nullptr) return -1;
+    int count = -1;
+    for (int i = 0; i < doc->fields_num; i++) {
+      Field *field = GetField(doc, i);
+      if (field != nullptr && ByteArrayToString(field->name) == "count") {
+        count = ByteArrayToInt(field->value);
+      }
+    }
+    DestroyDoc(doc);
+    return count;
+  }
+
+  string root_;
+  void *engine_;
+};
+
+TEST_F(AddDocsV2Test, AddAndAddOrUpdate) {
+  std::vector<int> results;
+  ASSERT_EQ(SUCCESSED,
+            AddBatch({{"a", 1, kDim}, {"b", 2, kDim}, {"c", 3, kDim}}, false,
+                     results));
+  EXPECT_EQ(std::vector<int>({0, 0, 0}), results);
+  EXPECT_EQ(3, GetDocsNum(engine_));
+  EXPECT_EQ(1, GetCount("a"));
+  EXPECT_EQ(2, GetCount("b"));
+  EXPECT_EQ(3, GetCount("c"));
+
+  // docs of existing keys are updated in place, keys repeated in the batch
+  // update the doc added by it
+  ASSERT_EQ(SUCCESSED,
+            AddBatch({{"a", 10, kDim}, {"d", 4, kDim}, {"d", 40, kDim}}, true,
+                     results));
+  EXPECT_EQ(std::vector<int>({0, 0, 0}), results);
+  EXPECT_EQ(4, GetDocsNum(engine_));
+  EXPECT_EQ(10, GetCount("a"));
+  EXPECT_EQ(40, GetCount("d"));
+
+  // without add_or_update a doc is added even if its key exists, the key
+  // still finds the first doc
+  ASSERT_EQ(SUCCESSED, AddBatch({{"b", 20, kDim}}, false, results));
+  EXPECT_EQ(std::vector<int>({0}), results);
+  EXPECT_EQ(5, GetDocsNum(engine_));
+  EXPECT_EQ(2, GetCount("b"));
+
+  // an empty batch
+  ASSERT_EQ(SUCCESSED, AddBatch({}, false, results));
+  EXPECT_EQ(5, GetDocsNum(engine_));
+}
+
+TEST_F(AddDocsV2Test, ResultsOfEachDoc) {
+  std::vector<int> results;
+  // the vector of the second doc is too short
+  EXPECT_EQ(FAILED,
+            AddBatch({{"a", 1, kDim}, {"b", 2, kDim - 1}, {"c", 3, kDim}},
+                     false, results));
+  ASSERT_EQ(3UL, results.size());
+  EXPECT_EQ(0, results[0]);
+  EXPECT_NE(0, results[1]);
+  EXPECT_EQ(0, results[2]);
+  EXPECT_EQ(2, GetDocsNum(engine_));
+  EXPECT_EQ(1, GetCount("a"));
+  EXPECT_EQ(-1, GetCount("b"));
+  EXPECT_EQ(3, GetCount("c"));
+
+  EXPECT_EQ(FAILED, AddBatch({{"a", 5, kDim + 1}, {"b", 2, kDim}}, true,
+                             results));
+  EXPECT_NE(0, results[0]);
+  EXPECT_EQ(0, results[1]);
+  EXPECT_EQ(1, GetCount("a"));
+  EXPECT_EQ(2, GetCount("b"));
+
+  // results may be null
+  ByteArray *batch = NewBatch({{"e", 5, kDim}}, false);
+  EXPECT_EQ(SUCCESSED, AddDocsV2(engine_, batch, nullptr));
+  DestroyByteArray(batch);
+  EXPECT_EQ(5, GetCount("e"));
+}
+
+TEST_F(AddDocsV2Test, InvalidBuffers) {
+  ByteArray *batch = NewBatch({{"a", 1, kDim}, {"b", 2, kDim}}, false);
+  std::vector<int> results(2, 1);
+
+  // truncated
+  ByteArray *truncated = MakeByteArray(batch->value, batch->len / 2);
+  EXPECT_EQ(FAILED, AddDocsV2(engine_, truncated, results.data()));
+  DestroyByteArray(truncated);
+
+  // an offset out of the buffer
+  string corrupted(batch->value, batch->len);
+  uint32_t root = 0;
+  memcpy(&root, corrupted.data(), sizeof(root));
+  root += batch->len;
+  memcpy(&corrupted[0], &root, sizeof(root));
+  ByteArray *bad = StringToByteArray(corrupted);
+  EXPECT_EQ(FAILED, AddDocsV2(engine_, bad, results.data()));
+  DestroyByteArray(bad);
+
+  ByteArray *garbage = StringToByteArray(string(64, '\xff'));
+  EXPECT_EQ(FAILED, AddDocsV2(engine_, garbage, results.data()));
+  DestroyByteArray(garbage);
+  EXPECT_EQ(FAILED, AddDocsV2(engine_, nullptr, results.data()));
+
+  // nothing is added and the results aren't written
+  EXPECT_EQ(std::vector<int>({1, 1}), results);
+  EXPECT_EQ(0, GetDocsNum(engine_));
+
+  EXPECT_EQ(SUCCESSED, AddDocsV2(engine_, batch, results.data()));
+  EXPECT_EQ(std::vector<int>({0, 0}), results);
+  EXPECT_EQ(2, GetDocsNum(engine_));
+  DestroyByteArray(batch);
+}
+
+}  // namespace
@@ -0,0 +1,218 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "util/fp16.h"
+
+namespace {
+
+float BitsToFloat(uint32_t x) {
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+bool IsHalfNaN(uint16_t h) { return (h & 0x7c00) == 0x7c00 && (h & 0x3ff); }
+
+// floats around the edges of half precision
+std::vector<float> EdgeValues() {
+  const float kInf = std::numeric_limits<float>::infinity();
+  std::vector<float> values = {
+      0.0f, 1.0f, 1.5f, 2.0f, 0.1f, 1.0f / 3, 1000.0f, kInf,
+      // subnormals, the smallest one and ties between two of them
+      std::ldexp(1.0f, -24), std::ldexp(1.0f, -25), std::ldexp(3.0f, -25),
+      std::ldexp(5.0f, -25), std::ldexp(1023.0f, -24),
+      std::ldexp(2047.0f, -25), std::ldexp(1.0f, -26), std::ldexp(1.0f, -40),
+      // the smallest normal and the largest subnormal rounded up to it
+      std::ldexp(1.0f, -14), std::ldexp(1.0f, -14) - std::ldexp(1.0f, -26),
+      // ties between normals, even and odd mantissas
+      1.0f + std::ldexp(1.0f, -11), 1.0f + std::ldexp(3.0f, -11),
+      1.0f + std::ldexp(1.0f, -11) + std::ldexp(1.0f, -20),
+      1024.0f + 0.5f, 1024.0f + 1.5f,
+      // the largest half, ties to it and to inf, and overflows
+      65504.0f, 65519.0f, 65519.996f, 65520.0f, 65536.0f, 1e10f,
+      std::numeric_limits<float>::max(),
+      std::numeric_limits<float>::denorm_min(),
+      std::numeric_limits<float>::quiet_NaN(), BitsToFloat(0x7f800001),
+      BitsToFloat(0x7fc00123), BitsToFloat(0x7fffffff)};
+  size_t n = values.size();
+  for (size_t i = 0; i < n; i++) values.push_back(-values[i]);
+  return values;
+}
+
+TEST(FP16Test, KnownValues) {
+  const float kInf = std::numeric_limits<float>::infinity();
+  struct {
+    float f;
+    uint16_t h;
+  } cases[] = {
+      {0.0f, 0x0000},
+      {-0.0f, 0x8000},
+      {1.0f, 0x3c00},
+      {-2.0f, 0xc000},
+      {65504.0f, 0x7bff},
+      {std::ldexp(1.0f, -14), 0x0400},
+      {std::ldexp(1.0f, -24), 0x0001},
+      {std::ldexp(1023.0f, -24), 0x03ff},
+      // ties to even
+      {std::ldexp(1.0f, -25), 0x0000},
+      {std::ldexp(3.0f, -25), 0x0002},
+      {std::ldexp(2047.0f, -25), 0x0400},
+      {1.0f + std::ldexp(1.0f, -11), 0x3c00},
+      {1.0f + std::ldexp(3.0f, -11), 0x3c02},
+      {65519.0f, 0x7bff},
+      // overflows
+      {65520.0f, 0x7c00},
+      {-1e10f, 0xfc00},
+      {kInf, 0x7c00},
+      {-kInf, 0xfc00},
+  };
+  for (const auto &c : cases) {
+    EXPECT_EQ(c.h, utils::FloatToHalf(c.f)) << "f=" << c.f;
+  }
+  EXPECT_TRUE(IsHalfNaN(utils::FloatToHalf(std::nanf(""))));
+  EXPECT_TRUE(std::isnan(utils::HalfToFloat(0x7e00)));
+  EXPECT_TRUE(std::isnan(utils::HalfToFloat(0xfc01)));
+  EXPECT_EQ(-kInf, utils::HalfToFloat(0xfc00));
+  EXPECT_EQ(std::ldexp(1.0f, -24), utils::HalfToFloat(0x0001));
+  EXPECT_EQ(-65504.0f, utils::HalfToFloat(0xfbff));
+}
+
+TEST(FP16Test, HalfRoundTrip) {
+  for (uint32_t h = 0; h <= 0xffff; h++) {
+    float f = utils::HalfToFloat(h);
+    if (IsHalfNaN(h)) {
+      EXPECT_TRUE(std::isnan(f)) << "h=" << h;
+      EXPECT_TRUE(IsHalfNaN(utils::FloatToHalf(f))) << "h=" << h;
+      continue;
+    }
+    EXPECT_EQ(h, utils::FloatToHalf(f)) << "h=" << h;
+  }
+}
+
+#if defined(__AVX2__) && defined(__F16C__)
+
+uint16_t HalfOfF16C(float f) {
+  __m128i h = _mm256_cvtps_ph(_mm256_set1_ps(f), _MM_FROUND_TO_NEAREST_INT);
+  return (uint16_t)_mm_extract_epi16(h, 0);
+}
+
+float FloatOfF16C(uint16_t h) {
+  return _mm_cvtss_f32(_mm256_castps256_ps128(
+      _mm256_cvtph_ps(_mm_set1_epi16((short)h))));
+}
+
+// the scalar conversion is the tail of the vectorized ones
+void ExpectSameAsF16C(float f) {
+  uint16_t h = utils::FloatToHalf(f);
+  uint16_t expected = HalfOfF16C(f);
+  if (std::isnan(f)) {
+    // payloads of nan may differ
+    EXPECT_TRUE(IsHalfNaN(h)) << "f=" << f;
+    EXPECT_TRUE(IsHalfNaN(expected)) << "f=" << f;
+    EXPECT_EQ(expected & 0x8000, h & 0x8000);
+    return;
+  }
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  EXPECT_EQ(expected, h) << "f=" << f << ", bits=" << std::hex << bits;
+}
+
+TEST(FP16Test, ScalarMatchesF16C) {
+  for (float f : EdgeValues()) ExpectSameAsF16C(f);
+
+  // all exponents, random mantissas
+  std::mt19937 rng(1);
+  for (int i = 0; i < 1000000; i++) {
+    ExpectSameAsF16C(BitsToFloat(rng()));
+  }
+  // the range of halves, with the bits rounded off
+  for (uint32_t x = 0x33000000; x < 0x47800000; x += 0x1000 - 1) {
+    ExpectSameAsF16C(BitsToFloat(x));
+    ExpectSameAsF16C(BitsToFloat(x | 0x80000000));
+  }
+  for (uint32_t x = 0x33000000; x < 0x47800000; x += 0x2000) {
+    // ties of the normal ones
+    ExpectSameAsF16C(BitsToFloat(x | 0x1000));
+  }
+
+  for (uint32_t h = 0; h <= 0xffff; h++) {
+    float f = utils::HalfToFloat(h);
+    float expected = FloatOfF16C(h);
+    if (IsHalfNaN(h)) {
+      EXPECT_TRUE(std::isnan(f));
+      EXPECT_TRUE(std::isnan(expected));
+      continue;
+    }
+    EXPECT_EQ(0, memcmp(&expected, &f, sizeof(f))) << "h=" << h;
+  }
+}
+
+#endif
+
+TEST(FP16Test, Encode) {
+  std::vector<float> values = EdgeValues();
+  std::vector<uint16_t> codes(values.size());
+  // 8 at a time with the tail
+  for (size_t d : {values.size(), (size_t)7, (size_t)9, (size_t)17}) {
+    utils::EncodeFP16(values.data(), codes.data(), d);
+    for (size_t i = 0; i < d; i++) {
+      uint16_t h = utils::FloatToHalf(values[i]);
+      if (std::isnan(values[i])) {
+        EXPECT_TRUE(IsHalfNaN(codes[i])) << "i=" << i;
+      } else {
+        EXPECT_EQ(h, codes[i]) << "i=" << i << ", value=" << values[i];
+      }
+    }
+  }
+}
+
+TEST(FP16Test, Distances) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> dist(-2.0f, 2.0f);
+  for (size_t d : {1, 3, 7, 8, 9, 15, 16, 17, 33, 100, 129}) {
+    for (int round = 0; round < 20; round++) {
+      std::vector<float> x(d), y(d);
+      for (size_t i = 0; i < d; i++) {
+        x[i] = dist(rng);
+        y[i] = dist(rng);
+      }
+      std::vector<uint16_t> codes(d);
+      utils::EncodeFP16(y.data(), codes.data(), d);
+
+      double l2 = 0, ip = 0, ip_abs = 0;
+      for (size_t i = 0; i < d; i++) {
+        double yi = utils::HalfToFloat(codes[i]);
+        l2 += (x[i] - yi) * (x[i] - yi);
+        ip += x[i] * yi;
+        ip_abs += std::fabs(x[i] * yi);
+      }
+      // float sums in another order
+      EXPECT_NEAR(l2, utils::L2SqrFP16(x.data(), codes.data(), d),
+                  1e-5 * l2 + 1e-6)
+          << "d=" << d;
+      EXPECT_NEAR(ip, utils::InnerProductFP16(x.data(), codes.data(), d),
+                  1e-5 * ip_abs + 1e-6)
+          << "d=" << d;
+
+      // to the float vector, within the error of half precision
+      double float_l2 = 0;
+      for (size_t i = 0; i < d; i++) float_l2 += (x[i] - y[i]) * (x[i] - y[i]);
+      EXPECT_NEAR(float_l2, l2, 2e-3 * std::sqrt(d * float_l2) + 1e-5 * d);
+    }
+  }
+}
+
+}  // namespace
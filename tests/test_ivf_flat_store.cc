@@ -0,0 +1,221 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <random>
+#include <tuple>
+
+#include "test.h"
+
+namespace {
+
+// not a multiple of 8, so the distance kernels have tails
+const int kDim = 20;
+// the ivfpq index is trained with 8192 vectors at least
+const int kDocNum = 10000;
+const int kRealtimeDocNum = 100;
+const int kNcentroids = 16;
+const int kTopN = 10;
+
+class IVFFlatStoreTest
+    : public ::testing::TestWithParam<std::tuple<string, string>> {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/gamma_ivf_flat_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    root_ = dir;
+    store_ = std::get<0>(GetParam());
+    metric_ = std::get<1>(GetParam());
+
+    Config *config = MakeConfig(StringToByteArray(root_ + "/engine"),
+                                kDocNum + kRealtimeDocNum);
+    engine_ = Init(config);
+    DestroyConfig(config);
+    ASSERT_NE(nullptr, engine_);
+
+    FieldInfo **field_infos = MakeFieldInfos(1);
+    SetFieldInfo(field_infos, 0,
+                 MakeFieldInfo(StringToByteArray("_id"), STRING, 0));
+    VectorInfo **vectors_info = MakeVectorInfos(1);
+    SetVectorInfo(vectors_info, 0,
+                  MakeVectorInfo(StringToByteArray("vec"), FLOAT, TRUE, kDim,
+                                 StringToByteArray("model"),
+                                 StringToByteArray("Mmap"),
+                                 StringToByteArray("{\"cache_size\": 16}"),
+                                 FALSE));
+    string param = "{\"metric_type\" : \"" + metric_ +
+                   "\", \"ncentroids\" : " + std::to_string(kNcentroids) +
+                   ", \"nsubvector\" : 4, \"ivf_flat_store\" : \"" + store_ +
+                   "\"}";
+    Table *table = MakeTable(StringToByteArray("test"), field_infos, 1,
+                             vectors_info, 1, StringToByteArray("IVFPQ"),
+                             StringToByteArray(param), 0);
+    ASSERT_EQ(SUCCESSED, CreateTable(engine_, table));
+    DestroyTable(table);
+  }
+
+  void TearDown() override {
+    if (engine_ != nullptr) Close(engine_);
+    utils::remove_dir(root_.c_str());
+  }
+
+  void AddDoc(const std::vector<float> &vector) {
+    int docid = vectors_.size() / kDim;
+    vectors_.insert(vectors_.end(), vector.begin(), vector.end());
+    Field **fields = MakeFields(2);
+    SetField(fields, 0,
+             MakeField(StringToByteArray("_id"),
+                       StringToByteArray(std::to_string(docid)), nullptr,
+                       STRING));
+    SetField(fields, 1,
+             MakeField(StringToByteArray("vec"),
+                       FloatToByteArray(vector.data(), kDim), nullptr,
+                       VECTOR));
+    Doc *doc = MakeDoc(fields, 2);
+    ASSERT_EQ(SUCCESSED, AddOrUpdateDoc(engine_, doc));
+    DestroyDoc(doc);
+  }
+
+  std::vector<float> RandomVector() {
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    std::vector<float> vector(kDim);
+    for (float &v : vector) v = dist(rng_);
+    return vector;
+  }
+
+  /** add num random docs, the last one is far from the others and is the
+   * nearest to itself by both metrics, so it tells when they are indexed
+   */
+  void AddDocs(int num) {
+    for (int i = 0; i < num - 1; i++) AddDoc(RandomVector());
+    AddDoc(std::vector<float>(kDim, 10.0f * ++batches_));
+  }
+
+  const float *Vector(int docid) const { return &vectors_[docid * kDim]; }
+
+  // distance of the metric in double
+  double Distance(const float *x, int docid) const {
+    const float *y = Vector(docid);
+    double dis = 0;
+    for (int j = 0; j < kDim; j++) {
+      dis += metric_ == "L2" ? (x[j] - y[j]) * (x[j] - y[j]) : x[j] * y[j];
+    }
+    return dis;
+  }
+
+  // nearer is less
+  double Order(double dis) const { return metric_ == "L2" ? dis : -dis; }
+
+  // ids and scores of the ivf flat search of x in all lists
+  std::vector<std::pair<int, double>> SearchVector(const float *x) {
+    VectorQuery **vector_querys = MakeVectorQuerys(1);
+    SetVectorQuery(vector_querys, 0,
+                   MakeVectorQuery(StringToByteArray("vec"),
+                                   FloatToByteArray(x, kDim), -10000, 10000,
+                                   0, 0));
+    ByteArray **fields = MakeByteArrays(1);
+    SetByteArray(fields, 0, StringToByteArray("_id"));
+    Request *request = MakeRequest(kTopN, vector_querys, 1, fields, 1, nullptr,
+                                   0, nullptr, 0, 1, 0, nullptr, FALSE, 0,
+                                   FALSE, FALSE, kNcentroids, TRUE);
+    Response *response = ::Search(engine_, request);
+
+    std::vector<std::pair<int, double>> items;
+    SearchResult *result = GetSearchResult(response, 0);
+    for (int i = 0; result != nullptr && i < result->result_num; i++) {
+      ResultItem *item = GetResultItem(result, i);
+      for (int j = 0; j < item->doc->fields_num; j++) {
+        Field *field = GetField(item->doc, j);
+        if (ByteArrayToString(field->name) != "_id") continue;
+        items.emplace_back(std::stoi(ByteArrayToString(field->value)),
+                           item->score);
+      }
+    }
+    DestroyResponse(response);
+    DestroyRequest(request);
+    return items;
+  }
+
+  // the docs are indexed by the indexing thread
+  bool WaitForDoc(int docid) {
+    for (int i = 0; i < 300; i++) {
+      auto items = SearchVector(Vector(docid));
+      if (!items.empty() && items[0].first == docid) return true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return false;
+  }
+
+  /** the results are the nearest docs by float distances, within the error
+   * of the stored vectors
+   */
+  void ExpectNearest(const float *x) {
+    auto items = SearchVector(x);
+    int doc_num = vectors_.size() / kDim;
+    ASSERT_EQ(std::min(kTopN, doc_num), (int)items.size());
+
+    std::vector<double> orders(doc_num);
+    for (int docid = 0; docid < doc_num; docid++) {
+      orders[docid] = Order(Distance(x, docid));
+    }
+    std::nth_element(orders.begin(), orders.begin() + kTopN - 1, orders.end());
+    double kth = orders[kTopN - 1];
+
+    // half precision has 11 bits of mantissa
+    double tolerance = store_ == "fp16" ? 2e-2 : 1e-4;
+    for (size_t i = 0; i < items.size(); i++) {
+      int docid = items[i].first;
+      double dis = Distance(x, docid);
+      EXPECT_NEAR(dis, items[i].second, tolerance) << "docid=" << docid;
+      EXPECT_LE(Order(dis), kth + tolerance) << "docid=" << docid;
+      if (i > 0) {
+        EXPECT_LE(Order(items[i - 1].second), Order(items[i].second));
+      }
+    }
+  }
+
+  string root_;
+  string store_;
+  string metric_;
+  void *engine_;
+  std::vector<float> vectors_;
+  std::mt19937 rng_;
+  int batches_ = 0;
+};
+
+TEST_P(IVFFlatStoreTest, SearchAllLists) {
+  AddDocs(kDocNum);
+  ASSERT_EQ(SUCCESSED, BuildIndex(engine_));
+  for (int i = 0; i < 600 && GetIndexStatus(engine_) != INDEXED; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  ASSERT_EQ(INDEXED, GetIndexStatus(engine_));
+  ASSERT_TRUE(WaitForDoc(kDocNum - 1));
+
+  // docs added after training are encoded by the realtime path
+  AddDocs(kRealtimeDocNum);
+  ASSERT_TRUE(WaitForDoc(kDocNum + kRealtimeDocNum - 1));
+
+  for (int q = 0; q < 20; q++) ExpectNearest(RandomVector().data());
+  for (int docid = 0; docid < kDocNum + kRealtimeDocNum; docid += 997) {
+    ExpectNearest(Vector(docid));
+    if (metric_ == "L2") {
+      // the stored vector of the query itself
+      auto items = SearchVector(Vector(docid));
+      ASSERT_FALSE(items.empty());
+      EXPECT_EQ(docid, items[0].first);
+      EXPECT_NEAR(0, items[0].second, 1e-4);
+    }
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(
+    Stores, IVFFlatStoreTest,
+    ::testing::Combine(::testing::Values("float", "fp16"),
+                       ::testing::Values("L2", "InnerProduct")));
+
+}  // namespace
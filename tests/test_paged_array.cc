@@ -0,0 +1,43 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+#include "util/paged_array.h"
+
+namespace {
+
+TEST(PagedArrayTest, PagesAreAllocatedByWrites) {
+  utils::PagedArray<int> array(1 << 20, -1, 10);
+  long table_bytes = array.MemBytes();
+  const utils::PagedArray<int> &const_array = array;
+  // const reads of untouched pages return the initial value
+  EXPECT_EQ(-1, const_array[0]);
+  EXPECT_EQ(-1, const_array[(1 << 20) - 1]);
+  EXPECT_EQ(table_bytes, array.MemBytes());
+
+  array[5] = 5;
+  EXPECT_EQ(table_bytes + (1 << 10) * (long)sizeof(int), array.MemBytes());
+  EXPECT_EQ(5, const_array[5]);
+  EXPECT_EQ(-1, const_array[6]);
+  EXPECT_EQ(-1, const_array[1 << 10]);
+  EXPECT_EQ(table_bytes + (1 << 10) * (long)sizeof(int), array.MemBytes());
+}
+
+TEST(PagedArrayTest, AtomicElements) {
+  utils::PagedArray<std::atomic<long>, long> array(1000, -1, 4);
+  const utils::PagedArray<std::atomic<long>, long> &const_array = array;
+  EXPECT_EQ(-1, const_array[999].load());
+  array[999] = 3;
+  EXPECT_EQ(3, const_array[999].load());
+  EXPECT_EQ(-1, const_array[998].load());
+  EXPECT_EQ(-1, const_array[0].load());
+}
+
+}  // namespace
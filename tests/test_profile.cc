@@ -0,0 +1,563 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "c_api/gamma_api.h"
+#include "index/field_range_index.h"
+#include "profile/profile.h"
+#include "profile/profile_column.h"
+#include "util/bitmap.h"
+#include "util/utils.h"
+
+using namespace tig_gamma;
+
+namespace {
+
+// strings of 128 bytes a doc
+const int kMaxDocSize = 100;
+
+ByteArray *StringToArray(const std::string &str) {
+  return MakeByteArray(str.data(), str.size());
+}
+
+class ProfileTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/gamma_profile_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    root_ = dir;
+    profile_ = nullptr;
+    NewProfile();
+  }
+
+  void TearDown() override {
+    delete profile_;
+    utils::remove_dir(root_.c_str());
+  }
+
+  // an empty profile of the table, as the engine restarts
+  void NewProfile() {
+    delete profile_;
+    profile_ = new Profile(kMaxDocSize, root_);
+
+    const char *names[] = {"_id", "name", "tag"};
+    int is_index[] = {0, 0, FIELD_INDEX_INTERN};
+    FieldInfo **fields = MakeFieldInfos(3);
+    for (int i = 0; i < 3; i++) {
+      SetFieldInfo(fields, i,
+                   MakeFieldInfo(StringToArray(names[i]), STRING, is_index[i]));
+    }
+    Table *table = MakeTable(StringToArray("test"), fields, 3, nullptr, 0,
+                             nullptr, nullptr, 0);
+    ASSERT_EQ(0, profile_->CreateTable(table));
+    DestroyTable(table);
+  }
+
+  Field *NewField(const std::string &name, const std::string &value) {
+    return MakeField(StringToArray(name), StringToArray(value), nullptr,
+                     STRING);
+  }
+
+  int AddDoc(int docid, const std::string &name) {
+    std::vector<Field *> fields = {NewField("_id", Key(docid)),
+                                   NewField("name", name),
+                                   NewField("tag", docid % 2 ? "odd" : "even")};
+    int ret = profile_->Add(fields, docid);
+    for (Field *field : fields) DestroyField(field);
+    return ret;
+  }
+
+  int UpdateName(int docid, const std::string &name) {
+    std::vector<Field *> fields = {NewField("name", name)};
+    int ret = profile_->Update(fields, docid);
+    DestroyField(fields[0]);
+    return ret;
+  }
+
+  std::string GetString(int docid, const std::string &field) {
+    Profile::StringReadGuard guard(profile_);
+    char *value = nullptr;
+    int len = profile_->GetFieldString(docid, field, &value);
+    return std::string(value, len);
+  }
+
+  static std::string Key(int docid) { return "key-" + std::to_string(docid); }
+
+  // name of docid, of len bytes
+  static std::string Name(int docid, int version, size_t len) {
+    std::string name =
+        "doc" + std::to_string(docid) + "-" + std::to_string(version) + "-";
+    name.resize(len, 'x');
+    return name;
+  }
+
+  void ExpectDocs(const std::vector<std::string> &names) {
+    for (size_t docid = 0; docid < names.size(); docid++) {
+      EXPECT_EQ(Key(docid), GetString(docid, "_id"));
+      EXPECT_EQ(names[docid], GetString(docid, "name"));
+      EXPECT_EQ(docid % 2 ? "odd" : "even", GetString(docid, "tag"));
+      std::string key = Key(docid);
+      int found = -1;
+      EXPECT_EQ(0, profile_->GetDocIDByKey(key, found));
+      EXPECT_EQ((int)docid, found);
+    }
+  }
+
+  // dump folder i of the test
+  std::string DumpFolder(int i) {
+    std::string folder = root_ + "/dump" + std::to_string(i);
+    utils::make_dir(folder.c_str());
+    return folder;
+  }
+
+  static bool HasSnapshot(const std::string &folder) {
+    return utils::get_file_size(folder + "/profile.str") > 0 ||
+           utils::get_file_size(folder + "/profile.rows") > 0 ||
+           utils::get_file_size(folder + "/profile.keys") > 0;
+  }
+
+  std::string root_;
+  Profile *profile_;
+};
+
+TEST_F(ProfileTest, KeyIsFoundAfterAddKey) {
+  std::vector<Field *> fields = {NewField("_id", Key(0)),
+                                 NewField("name", Name(0, 0, 40)),
+                                 NewField("tag", "even")};
+  std::string key;
+  ASSERT_EQ(0, profile_->AddFields(fields, 0, key));
+  for (Field *field : fields) DestroyField(field);
+  EXPECT_EQ(Key(0), key);
+  int docid = -1;
+  EXPECT_NE(0, profile_->GetDocIDByKey(key, docid));
+  EXPECT_EQ(0, profile_->DocNum());
+
+  // the given up doc is overwritten
+  ASSERT_EQ(0, AddDoc(0, Name(1, 0, 40)));
+  key = Key(0);
+  ASSERT_EQ(0, profile_->GetDocIDByKey(key, docid));
+  EXPECT_EQ(0, docid);
+  EXPECT_EQ(1, profile_->DocNum());
+  EXPECT_EQ(Name(1, 0, 40), GetString(0, "name"));
+}
+
+TEST_F(ProfileTest, CompactStrings) {
+  std::vector<std::string> names;
+  for (int docid = 0; docid < 50; docid++) {
+    names.push_back(Name(docid, 0, 40));
+    ASSERT_EQ(0, AddDoc(docid, names[docid]));
+  }
+  // longer strings are appended, shorter ones overwrite in place
+  for (int docid = 0; docid < 50; docid++) {
+    names[docid] = Name(docid, 1, docid % 2 ? 60 : 20);
+    ASSERT_EQ(0, UpdateName(docid, names[docid]));
+  }
+  ASSERT_EQ(0, profile_->CompactStrings());
+  ExpectDocs(names);
+  ASSERT_EQ(0, profile_->CompactStrings());
+  ExpectDocs(names);
+}
+
+TEST_F(ProfileTest, CompactFullStringArena) {
+  std::vector<std::string> names;
+  for (int docid = 0; docid < 50; docid++) {
+    names.push_back(Name(docid, 0, 200));
+    ASSERT_EQ(0, AddDoc(docid, names[docid]));
+  }
+  // the garbage stays under the ratio compacting in background, until the
+  // arena is full
+  int failed = -1;
+  for (int docid = 0; docid < 50 && failed < 0; docid++) {
+    std::string name = Name(docid, 1, 210);
+    if (UpdateName(docid, name) != 0) {
+      failed = docid;
+    } else {
+      names[docid] = name;
+    }
+  }
+  ASSERT_LE(0, failed);
+  ExpectDocs(names);
+
+  ASSERT_EQ(0, profile_->CompactStrings());
+  ExpectDocs(names);
+  names[failed] = Name(failed, 1, 210);
+  ASSERT_EQ(0, UpdateName(failed, names[failed]));
+  ASSERT_EQ(0, AddDoc(50, Name(50, 0, 200)));
+  names.push_back(Name(50, 0, 200));
+  ExpectDocs(names);
+}
+
+TEST_F(ProfileTest, AddToFullStringArenaFails) {
+  std::vector<std::string> names;
+  int failed = -1;
+  for (int docid = 0; docid < kMaxDocSize && failed < 0; docid++) {
+    std::string name = Name(docid, 0, 1000);
+    if (AddDoc(docid, name) != 0) {
+      failed = docid;
+    } else {
+      names.push_back(name);
+    }
+  }
+  ASSERT_LE(0, failed);
+  // the doc isn't published
+  EXPECT_EQ(failed, profile_->DocNum());
+  int docid = -1;
+  std::string key = Key(failed);
+  EXPECT_NE(0, profile_->GetDocIDByKey(key, docid));
+
+  ASSERT_EQ(0, profile_->CompactStrings());
+  ExpectDocs(names);
+}
+
+TEST_F(ProfileTest, CompactionWaitsForReaders) {
+  std::vector<std::string> names;
+  for (int docid = 0; docid < 10; docid++) {
+    names.push_back(Name(docid, 0, 40));
+    ASSERT_EQ(0, AddDoc(docid, names[docid]));
+    ASSERT_EQ(0, UpdateName(docid, Name(docid, 1, 60)));
+    names[docid] = Name(docid, 1, 60);
+  }
+
+  std::atomic<bool> done(false);
+  std::thread compactor;
+  {
+    Profile::StringReadGuard guard(profile_);
+    char *value = nullptr;
+    int len = profile_->GetFieldString(0, "name", &value);
+    compactor = std::thread([&]() {
+      EXPECT_EQ(0, profile_->CompactStrings());
+      done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    // the old arena isn't freed under the guard
+    EXPECT_FALSE(done);
+    EXPECT_EQ(names[0], std::string(value, len));
+  }
+  compactor.join();
+  EXPECT_TRUE(done);
+  ExpectDocs(names);
+}
+
+TEST_F(ProfileTest, WritesDuringCompaction) {
+  const int kDocNum = 50;
+  std::vector<std::string> names;
+  for (int docid = 0; docid < kDocNum; docid++) {
+    names.push_back(Name(docid, 0, 100));
+    ASSERT_EQ(0, AddDoc(docid, names[docid]));
+  }
+  std::atomic<bool> stop(false);
+  std::thread writer([&]() {
+    for (int version = 1; !stop; version++) {
+      for (int docid = 0; docid < kDocNum; docid++) {
+        // the arena may be full until a compaction frees it
+        std::string name = Name(docid, version, 100 + version % 20);
+        if (UpdateName(docid, name) == 0) names[docid] = name;
+      }
+    }
+  });
+  std::thread reader([&]() {
+    while (!stop) {
+      for (int docid = 0; docid < kDocNum; docid++) {
+        std::string prefix = "doc" + std::to_string(docid) + "-";
+        EXPECT_EQ(prefix, GetString(docid, "name").substr(0, prefix.size()));
+      }
+    }
+  });
+  auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+    EXPECT_EQ(0, profile_->CompactStrings());
+  }
+  stop = true;
+  writer.join();
+  reader.join();
+  ExpectDocs(names);
+}
+
+TEST_F(ProfileTest, ReloadSnapshot) {
+  std::vector<std::string> names;
+  for (int docid = 0; docid < 20; docid++) {
+    names.push_back(Name(docid, 0, 40));
+    ASSERT_EQ(0, AddDoc(docid, names[docid]));
+  }
+  // the garbage of updated strings isn't dumped
+  for (int docid = 0; docid < 20; docid += 3) {
+    names[docid] = Name(docid, 1, 60);
+    ASSERT_EQ(0, UpdateName(docid, names[docid]));
+  }
+  std::vector<std::string> folders = {DumpFolder(0)};
+  ASSERT_EQ(0, profile_->Dump(folders[0], 0, names.size() - 1));
+
+  NewProfile();
+  int doc_num = 0;
+  ASSERT_EQ(0, profile_->Load(folders, doc_num));
+  EXPECT_EQ(20, doc_num);
+  EXPECT_EQ(20, profile_->DocNum());
+  ExpectDocs(names);
+
+  // docs are added and updated after loading
+  names.push_back(Name(20, 0, 40));
+  ASSERT_EQ(0, AddDoc(20, names[20]));
+  names[1] = Name(1, 2, 30);
+  ASSERT_EQ(0, UpdateName(1, names[1]));
+  folders.push_back(DumpFolder(1));
+  ASSERT_EQ(0, profile_->Dump(folders[1], 20, names.size() - 1));
+  EXPECT_TRUE(HasSnapshot(folders[0]));
+
+  NewProfile();
+  ASSERT_EQ(0, profile_->LoadDocNum(folders, doc_num));
+  EXPECT_EQ(21, doc_num);
+  ASSERT_EQ(0, profile_->Load(folders, doc_num));
+  EXPECT_EQ(21, doc_num);
+  ExpectDocs(names);
+
+  // snapshots before the restart are removed as the later ones are dumped
+  folders.push_back(DumpFolder(2));
+  ASSERT_EQ(0, profile_->Dump(folders[2], 21, names.size() - 1));
+  EXPECT_FALSE(HasSnapshot(folders[0]));
+  EXPECT_TRUE(HasSnapshot(folders[1]));
+  folders.push_back(DumpFolder(3));
+  ASSERT_EQ(0, profile_->Dump(folders[3], 21, names.size() - 1));
+  EXPECT_FALSE(HasSnapshot(folders[1]));
+  EXPECT_TRUE(HasSnapshot(folders[2]));
+  EXPECT_TRUE(HasSnapshot(folders[3]));
+}
+
+TEST_F(ProfileTest, LoadRemovesOldSnapshots) {
+  std::vector<std::string> names;
+  std::vector<std::string> folders;
+  for (int i = 0; i < 3; i++) {
+    names.push_back(Name(i, 0, 40));
+    ASSERT_EQ(0, AddDoc(i, names[i]));
+    folders.push_back(DumpFolder(i));
+    ASSERT_EQ(0, profile_->Dump(folders[i], i, i));
+    // each process keeps its last two snapshots
+    NewProfile();
+    int doc_num = 0;
+    ASSERT_EQ(0, profile_->Load(folders, doc_num));
+    ASSERT_EQ(i + 1, doc_num);
+  }
+  // rows of an unfinished dump
+  folders.push_back(DumpFolder(3));
+  FILE *fp = fopen((folders[3] + "/profile.rows").c_str(), "wb");
+  ASSERT_NE(nullptr, fp);
+  fputs("partial", fp);
+  fclose(fp);
+
+  NewProfile();
+  int doc_num = 0;
+  ASSERT_EQ(0, profile_->Load(folders, doc_num));
+  EXPECT_EQ(3, doc_num);
+  ExpectDocs(names);
+  EXPECT_FALSE(HasSnapshot(folders[0]));
+  EXPECT_TRUE(HasSnapshot(folders[1]));
+  EXPECT_TRUE(HasSnapshot(folders[2]));
+  EXPECT_FALSE(HasSnapshot(folders[3]));
+}
+
+template <typename T>
+std::string RawValue(T value) {
+  return std::string(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// doc numbers of full bytes, tails and the parallel scan
+const int kScanDocNums[] = {0, 1, 7, 8, 9, 15, 17, 64, 1001, 100003};
+
+/** scan values with each bound pair and check the bitmap and the count
+ * against a scalar reference
+ */
+template <typename T>
+void ExpectRangeScan(enum DataType type, const std::vector<T> &values,
+                     const std::vector<std::pair<T, T>> &bounds) {
+  ProfileColumn column(type, values.size());
+  ASSERT_EQ(0, column.Init());
+  for (size_t docid = 0; docid < values.size(); docid++) {
+    column.Set(docid, reinterpret_cast<const char *>(&values[docid]));
+  }
+  for (int doc_num : kScanDocNums) {
+    for (const auto &bound : bounds) {
+      // the written bytes are overwritten, not or-ed
+      std::vector<char> bitmap(doc_num / 8 + 1, (char)0x5a);
+      int num = column.RangeScan(RawValue(bound.first), RawValue(bound.second),
+                                 doc_num, bitmap.data());
+      int expected_num = 0;
+      for (int docid = 0; docid < doc_num; docid++) {
+        T v = values[docid];
+        bool in = v >= bound.first && v <= bound.second;
+        expected_num += in;
+        ASSERT_EQ(in, bitmap::test(bitmap.data(), docid))
+            << "docid=" << docid << ", doc num=" << doc_num
+            << ", value=" << v << ", bound=[" << bound.first << ", "
+            << bound.second << "]";
+      }
+      ASSERT_EQ(expected_num, num) << "doc num=" << doc_num;
+      // bits of the tail after doc_num are cleared
+      for (int docid = doc_num; docid < (doc_num + 7) / 8 * 8; docid++) {
+        ASSERT_FALSE(bitmap::test(bitmap.data(), docid)) << "docid=" << docid;
+      }
+    }
+  }
+  std::vector<char> bitmap(2);
+  EXPECT_EQ(-1, column.RangeScan(RawValue<char>(0), RawValue<char>(1), 8,
+                                 bitmap.data()));
+  EXPECT_EQ(-1, column.RangeScan(RawValue(T()), RawValue(T()),
+                                 values.size() + 1, bitmap.data()));
+}
+
+// random values in [-1000, 1000] with the extremes of T among them
+template <typename T>
+std::vector<T> ScanValues(const std::vector<T> &specials) {
+  std::mt19937 rng(17);
+  std::uniform_int_distribution<int> dist(-1000, 1000);
+  std::vector<T> values(kScanDocNums[sizeof(kScanDocNums) /
+                                         sizeof(kScanDocNums[0]) -
+                                     1]);
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = (T)dist(rng);
+    if (std::is_floating_point<T>::value) values[i] += (T)0.5;
+    if (i % 13 == 0) values[i] = specials[(i / 13) % specials.size()];
+  }
+  return values;
+}
+
+template <typename T>
+void ExpectIntegerRangeScan(enum DataType type) {
+  T min = std::numeric_limits<T>::min();
+  T max = std::numeric_limits<T>::max();
+  std::vector<T> values = ScanValues<T>({min, max, -1, 0, 1, min + 1});
+  ExpectRangeScan<T>(type, values,
+                     {{-10, 10},
+                      {-500, -100},
+                      {-1000, -1000},
+                      {min, max},
+                      {min, min},
+                      {max, max},
+                      {min, -1},
+                      {1, max},
+                      {10, -10}});
+}
+
+template <typename T>
+void ExpectFloatRangeScan(enum DataType type) {
+  T inf = std::numeric_limits<T>::infinity();
+  T nan = std::numeric_limits<T>::quiet_NaN();
+  T lowest = std::numeric_limits<T>::lowest();
+  T max = std::numeric_limits<T>::max();
+  std::vector<T> values = ScanValues<T>({nan, inf, -inf, lowest, max, (T)-0.0});
+  ExpectRangeScan<T>(type, values,
+                     {{-10, 10},
+                      {(T)-500.5, (T)-100.5},
+                      {-inf, inf},
+                      {lowest, max},
+                      {inf, inf},
+                      {-inf, -inf},
+                      {0, 0},
+                      {nan, inf},
+                      {-inf, nan},
+                      {nan, nan},
+                      {10, -10}});
+}
+
+TEST(ProfileColumnTest, RangeScanInt) { ExpectIntegerRangeScan<int>(INT); }
+
+TEST(ProfileColumnTest, RangeScanLong) { ExpectIntegerRangeScan<long>(LONG); }
+
+TEST(ProfileColumnTest, RangeScanFloat) { ExpectFloatRangeScan<float>(FLOAT); }
+
+TEST(ProfileColumnTest, RangeScanDouble) {
+  ExpectFloatRangeScan<double>(DOUBLE);
+}
+
+// a column only field filtered with a field of the range index
+TEST(ProfileColumnTest, SearchColumnWithRangeIndex) {
+  const int kDocNum = 1003;
+  char dir[] = "/tmp/gamma_profile_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+  std::string root = dir;
+  Profile *profile = new Profile(kDocNum, root);
+  const char *names[] = {"_id", "price", "count"};
+  enum DataType types[] = {STRING, FLOAT, INT};
+  int is_index[] = {0, FIELD_INDEX_COLUMN, FIELD_INDEX_RANGE};
+  FieldInfo **fields = MakeFieldInfos(3);
+  for (int i = 0; i < 3; i++) {
+    SetFieldInfo(fields, i,
+                 MakeFieldInfo(StringToArray(names[i]), types[i], is_index[i]));
+  }
+  Table *table = MakeTable(StringToArray("test"), fields, 3, nullptr, 0,
+                           nullptr, nullptr, 0);
+  ASSERT_EQ(0, profile->CreateTable(table));
+  DestroyTable(table);
+  int price_field = profile->GetAttrIdx("price");
+  int count_field = profile->GetAttrIdx("count");
+  ASSERT_NE(nullptr, profile->GetColumn(price_field));
+  MultiFieldsRangeIndex *index = new MultiFieldsRangeIndex(root, profile);
+  ASSERT_EQ(0, index->AddField(count_field, INT));
+
+  for (int docid = 0; docid < kDocNum; docid++) {
+    std::string key = "key-" + std::to_string(docid);
+    float price = (docid % 100) - 50.5f;
+    int count = docid % 37;
+    std::vector<Field *> doc = {
+        MakeField(StringToArray("_id"), StringToArray(key), nullptr, STRING),
+        MakeField(StringToArray("price"), StringToArray(RawValue(price)),
+                  nullptr, FLOAT),
+        MakeField(StringToArray("count"), StringToArray(RawValue(count)),
+                  nullptr, INT)};
+    ASSERT_EQ(0, profile->Add(doc, docid));
+    for (Field *field : doc) DestroyField(field);
+    ASSERT_EQ(0, index->Add(docid, count_field));
+  }
+
+  std::vector<FilterInfo> filters(2);
+  filters[0].field = price_field;
+  filters[0].lower_value = RawValue(-20.0f);
+  filters[0].upper_value = RawValue(20.0f);
+  filters[0].is_union = 0;
+  filters[1].field = count_field;
+  filters[1].lower_value = RawValue(3);
+  filters[1].upper_value = RawValue(9);
+  filters[1].is_union = 0;
+  std::vector<int> expected;
+  for (int docid = 0; docid < kDocNum; docid++) {
+    float price = (docid % 100) - 50.5f;
+    int count = docid % 37;
+    if (price >= -20 && price <= 20 && count >= 3 && count <= 9) {
+      expected.push_back(docid);
+    }
+  }
+
+  // docs are indexed by the worker asynchronously
+  std::vector<int> docids;
+  for (int i = 0; i < 500 && docids != expected; i++) {
+    if (i > 0) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    MultiRangeQueryResults results;
+    docids.clear();
+    if (index->Search(filters, &results) <= 0) continue;
+    for (int docid = 0; docid < kDocNum; docid++) {
+      if (results.Has(docid)) docids.push_back(docid);
+    }
+  }
+  EXPECT_EQ(expected, docids);
+
+  delete index;
+  delete profile;
+  utils::remove_dir(root.c_str());
+}
+
+}  // namespace
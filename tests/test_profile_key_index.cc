@@ -0,0 +1,175 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "profile/profile_key_index.h"
+#include "util/utils.h"
+
+using namespace tig_gamma;
+
+namespace {
+
+// long keys of docs, key of docid is keys[docid]
+std::vector<long> Keys(int num) {
+  std::vector<long> keys(num);
+  for (int docid = 0; docid < num; docid++) keys[docid] = docid * 7919L + 1;
+  return keys;
+}
+
+int Find(const ProfileKeyIndex &index, long key) {
+  return index.Find(ProfileKeyIndex::Fingerprint(key),
+                    [](int) { return true; });
+}
+
+int Add(ProfileKeyIndex &index, long key, int docid) {
+  return index.Add(ProfileKeyIndex::Fingerprint(key), docid,
+                   [](int) { return true; });
+}
+
+class ProfileKeyIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/gamma_key_index_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    root_ = dir;
+    file_ = root_ + "/profile.keys";
+  }
+
+  void TearDown() override { utils::remove_dir(root_.c_str()); }
+
+  std::string root_;
+  std::string file_;
+};
+
+TEST_F(ProfileKeyIndexTest, GrowsWhenFull) {
+  const int kNum = 100000;
+  std::vector<long> keys = Keys(kNum);
+  ProfileKeyIndex index(100, true);
+  ASSERT_EQ(0, index.Init());
+  long init_bytes = index.GetMemoryBytes();
+
+  std::atomic<int> added(0);
+  std::atomic<bool> stop(false);
+  // readers probe the replaced tables while it grows
+  std::thread reader([&]() {
+    while (!stop) {
+      int num = added;
+      for (int docid = 0; docid < num; docid += 97) {
+        ASSERT_EQ(docid, Find(index, keys[docid]));
+      }
+    }
+  });
+  for (int docid = 0; docid < kNum; docid++) {
+    ASSERT_EQ(0, Add(index, keys[docid], docid));
+    added = docid + 1;
+  }
+  stop = true;
+  reader.join();
+
+  EXPECT_LT(init_bytes, index.GetMemoryBytes());
+  for (int docid = 0; docid < kNum; docid++) {
+    ASSERT_EQ(docid, Find(index, keys[docid]));
+  }
+  EXPECT_EQ(1, Add(index, keys[5], kNum));
+  EXPECT_EQ(-1, Find(index, -5));
+}
+
+TEST_F(ProfileKeyIndexTest, BuildKeepsFirstDoc) {
+  const int kNum = 50000;
+  std::vector<long> keys = Keys(kNum);
+  // the second half repeats the keys of the first
+  for (int docid = kNum / 2; docid < kNum; docid++) {
+    keys[docid] = keys[docid - kNum / 2];
+  }
+  ProfileKeyIndex index(100, true);
+  ASSERT_EQ(0, index.Init());
+  ASSERT_EQ(0, index.Build(
+                   kNum,
+                   [&](int docid) {
+                     return ProfileKeyIndex::Fingerprint(keys[docid]);
+                   },
+                   [&](int docid, int other) {
+                     return keys[docid] == keys[other];
+                   }));
+  for (int docid = 0; docid < kNum; docid++) {
+    ASSERT_EQ(docid % (kNum / 2), Find(index, keys[docid]));
+  }
+}
+
+TEST_F(ProfileKeyIndexTest, DumpAndLoad) {
+  const int kNum = 20000;
+  std::vector<long> keys = Keys(kNum);
+  // keys aren't added in docid order, the dump excludes docs >= kNum / 2
+  std::vector<int> docids(kNum);
+  for (int docid = 0; docid < kNum; docid++) docids[docid] = docid;
+  std::shuffle(docids.begin(), docids.end(), std::mt19937(7));
+  {
+    ProfileKeyIndex index(100, true);
+    ASSERT_EQ(0, index.Init());
+    for (int docid : docids) ASSERT_EQ(0, Add(index, keys[docid], docid));
+    ASSERT_EQ(0, index.Dump(file_, kNum / 2));
+  }
+
+  ProfileKeyIndex index(100, true);
+  ASSERT_EQ(0, index.Init());
+  EXPECT_NE(0, index.Load(file_, kNum / 2 + 1));
+  ProfileKeyIndex string_index(100, false);
+  ASSERT_EQ(0, string_index.Init());
+  EXPECT_NE(0, string_index.Load(file_, kNum / 2));
+
+  ASSERT_EQ(0, index.Load(file_, kNum / 2));
+  for (int docid = 0; docid < kNum / 2; docid++) {
+    ASSERT_EQ(docid, Find(index, keys[docid]));
+  }
+  for (int docid = kNum / 2; docid < kNum; docid++) {
+    ASSERT_EQ(-1, Find(index, keys[docid]));
+  }
+  // the mapped table is copied on write and grows
+  for (int docid = kNum / 2; docid < kNum * 4; docid++) {
+    ASSERT_EQ(0, Add(index, docid * 7919L + 1, docid));
+  }
+  for (int docid = 0; docid < kNum * 4; docid++) {
+    ASSERT_EQ(docid, Find(index, docid * 7919L + 1));
+  }
+}
+
+TEST_F(ProfileKeyIndexTest, StringKeysAreMatched) {
+  std::vector<std::string> keys;
+  for (int docid = 0; docid < 10000; docid++) {
+    keys.push_back("key-" + std::to_string(docid));
+  }
+  ProfileKeyIndex index(100, false);
+  ASSERT_EQ(0, index.Init());
+  auto fingerprint = [](const std::string &key) {
+    return ProfileKeyIndex::Fingerprint(key.data(), key.size());
+  };
+  for (int docid = 0; docid < (int)keys.size(); docid++) {
+    ASSERT_EQ(0, index.Add(fingerprint(keys[docid]), docid, [&](int other) {
+      return keys[other] == keys[docid];
+    }));
+  }
+  for (int docid = 0; docid < (int)keys.size(); docid++) {
+    ASSERT_EQ(docid, index.Find(fingerprint(keys[docid]), [&](int other) {
+      return keys[other] == keys[docid];
+    }));
+  }
+  std::string missing = "missing";
+  EXPECT_EQ(-1, index.Find(fingerprint(missing), [&](int other) {
+    return keys[other] == missing;
+  }));
+}
+
+}  // namespace
@@ -0,0 +1,286 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "c_api/gamma_api.h"
+#include "index/field_range_index.h"
+#include "index/range_query_cache.h"
+#include "profile/profile.h"
+#include "util/utils.h"
+
+using namespace tig_gamma;
+
+namespace {
+
+std::shared_ptr<const RangeQueryResult> NewResult(int min, int max) {
+  RangeQueryResult *result = new RangeQueryResult;
+  result->SetRange(min, max);
+  result->Resize();
+  return std::shared_ptr<const RangeQueryResult>(result);
+}
+
+std::string IntValue(int value) {
+  return std::string(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+TEST(RangeQueryCacheTest, InvalidateBumpsVersion) {
+  RangeQueryCache cache(2);
+  cache.SetCapacity(1 << 20);
+  std::string key;
+  RangeQueryCache::MakeKey(0, IntValue(1), IntValue(10), 0, nullptr, key);
+  auto result = NewResult(0, 100);
+  cache.Put(key, 0, cache.Version(0), 5, result);
+
+  int retval = -1;
+  std::shared_ptr<const RangeQueryResult> cached;
+  ASSERT_TRUE(cache.Get(key, 0, retval, cached));
+  EXPECT_EQ(5, retval);
+  EXPECT_EQ(result, cached);
+
+  // another field doesn't affect the entry
+  cache.Invalidate(1);
+  EXPECT_TRUE(cache.Get(key, 0, retval, cached));
+
+  uint64_t version = cache.Version(0);
+  cache.Invalidate(0);
+  EXPECT_EQ(version + 1, cache.Version(0));
+  EXPECT_FALSE(cache.Get(key, 0, retval, cached));
+  EXPECT_EQ(0, cache.MemoryBytes());
+
+  // searched before the field is changed
+  cache.Put(key, 0, version, 5, result);
+  EXPECT_FALSE(cache.Get(key, 0, retval, cached));
+  EXPECT_EQ(0, cache.MemoryBytes());
+  EXPECT_EQ(2, cache.Hits());
+  EXPECT_EQ(2, cache.Misses());
+}
+
+TEST(RangeQueryCacheTest, EvictsByBytes) {
+  RangeQueryCache cache(1);
+  std::vector<std::string> keys(3);
+  for (int i = 0; i < 3; i++) {
+    RangeQueryCache::MakeKey(0, IntValue(i), IntValue(i), 0, nullptr, keys[i]);
+  }
+  cache.Put(keys[0], 0, 0, 1, NewResult(0, 8000));
+  EXPECT_EQ(0, cache.MemoryBytes());
+
+  cache.SetCapacity(2500);
+  for (int i = 0; i < 3; i++) {
+    cache.Put(keys[i], 0, 0, 1, NewResult(0, 8000));
+  }
+  int retval = -1;
+  std::shared_ptr<const RangeQueryResult> cached;
+  EXPECT_FALSE(cache.Get(keys[0], 0, retval, cached));
+  EXPECT_TRUE(cache.Get(keys[1], 0, retval, cached));
+  EXPECT_TRUE(cache.Get(keys[2], 0, retval, cached));
+  EXPECT_GE(2500, cache.MemoryBytes());
+
+  // too large to be cached
+  cache.Put(keys[0], 0, 0, 1, NewResult(0, 80000));
+  EXPECT_FALSE(cache.Get(keys[0], 0, retval, cached));
+
+  cache.SetCapacity(0);
+  EXPECT_FALSE(cache.Enabled());
+  EXPECT_EQ(0, cache.MemoryBytes());
+}
+
+TEST(RangeQueryCacheTest, StringItemsOrderDoesNotMatter) {
+  std::string key1, key2, key3;
+  RangeQueryCache::MakeKey(0, "b\001a\001b", "", 1, "\001", key1);
+  RangeQueryCache::MakeKey(0, "a\001b", "", 1, "\001", key2);
+  RangeQueryCache::MakeKey(0, "a\001b", "", 0, "\001", key3);
+  EXPECT_EQ(key1, key2);
+  EXPECT_NE(key2, key3);
+}
+
+const int kMaxDocSize = 1000;
+
+ByteArray *StringToArray(const std::string &str) {
+  return MakeByteArray(str.data(), str.size());
+}
+
+class MultiFieldsRangeIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/gamma_range_index_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    root_ = dir;
+    profile_ = new Profile(kMaxDocSize, root_);
+
+    FieldInfo **fields = MakeFieldInfos(3);
+    SetFieldInfo(fields, 0, MakeFieldInfo(StringToArray("_id"), STRING, 0));
+    SetFieldInfo(fields, 1,
+                 MakeFieldInfo(StringToArray("price"), INT, FIELD_INDEX_RANGE));
+    SetFieldInfo(fields, 2, MakeFieldInfo(StringToArray("name"), STRING,
+                                          FIELD_INDEX_RANGE));
+    Table *table = MakeTable(StringToArray("test"), fields, 3, nullptr, 0,
+                             nullptr, nullptr, 0);
+    ASSERT_EQ(0, profile_->CreateTable(table));
+    DestroyTable(table);
+
+    field_ = profile_->GetAttrIdx("price");
+    name_field_ = profile_->GetAttrIdx("name");
+    index_ = new MultiFieldsRangeIndex(root_, profile_);
+    ASSERT_EQ(0, index_->AddField(field_, INT));
+    ASSERT_EQ(0, index_->AddField(name_field_, STRING));
+    index_->SetCacheCapacity(1 << 20);
+  }
+
+  void TearDown() override {
+    delete index_;
+    delete profile_;
+    utils::remove_dir(root_.c_str());
+  }
+
+  void AddDoc(int docid, int price, const std::string &name = "") {
+    std::string key = "key-" + std::to_string(docid);
+    std::vector<Field *> fields = {
+        MakeField(StringToArray("_id"), StringToArray(key), nullptr, STRING),
+        MakeField(StringToArray("price"), StringToArray(IntValue(price)),
+                  nullptr, INT),
+        MakeField(StringToArray("name"), StringToArray(name), nullptr,
+                  STRING)};
+    ASSERT_EQ(0, profile_->Add(fields, docid));
+    for (Field *field : fields) DestroyField(field);
+    ASSERT_EQ(0, index_->Add(docid, field_));
+    ASSERT_EQ(0, index_->Add(docid, name_field_));
+  }
+
+  // as the engine updates a doc
+  int UpdateName(int docid, const std::string &name) {
+    std::vector<Field *> fields = {MakeField(
+        StringToArray("name"), StringToArray(name), nullptr, STRING)};
+    index_->Delete(docid, name_field_);
+    int ret = profile_->Update(fields, docid);
+    index_->Add(docid, name_field_);
+    DestroyField(fields[0]);
+    return ret;
+  }
+
+  // docids of the filter, -1 if the field can't be filtered
+  std::vector<int> Search(const FilterInfo &filter) {
+    std::vector<FilterInfo> filters(1, filter);
+    MultiRangeQueryResults results;
+    std::vector<int> docids;
+    int retval = index_->Search(filters, &results);
+    if (retval < 0) return {-1};
+    for (int docid = 0; retval > 0 && docid < kMaxDocSize; docid++) {
+      if (results.Has(docid)) docids.push_back(docid);
+    }
+    return docids;
+  }
+
+  std::vector<int> Search(int lower, int upper) {
+    FilterInfo filter;
+    filter.field = field_;
+    filter.lower_value = IntValue(lower);
+    filter.upper_value = IntValue(upper);
+    filter.is_union = 0;
+    return Search(filter);
+  }
+
+  // docs are indexed by the worker asynchronously
+  std::vector<int> WaitForSearch(int lower, int upper,
+                                 const std::vector<int> &expected) {
+    std::vector<int> docids = Search(lower, upper);
+    for (int i = 0; i < 500 && docids != expected; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      docids = Search(lower, upper);
+    }
+    return docids;
+  }
+
+  // whether docid is found by its name once the worker indexes it
+  bool WaitForName(int docid, const std::string &name) {
+    FilterInfo filter;
+    filter.field = name_field_;
+    filter.lower_value = name;
+    filter.is_union = 1;
+    for (int i = 0; i < 500; i++) {
+      std::vector<int> docids = Search(filter);
+      if (std::find(docids.begin(), docids.end(), docid) != docids.end()) {
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+  }
+
+  static std::string Name(int docid, int version) {
+    std::string name =
+        "doc" + std::to_string(docid) + "-" + std::to_string(version) + "-";
+    name.resize(60 + version % 40, 'x');
+    return name;
+  }
+
+  std::string root_;
+  Profile *profile_;
+  MultiFieldsRangeIndex *index_;
+  int field_;
+  int name_field_;
+};
+
+TEST_F(MultiFieldsRangeIndexTest, WritesInvalidateCachedResults) {
+  for (int docid = 0; docid < 10; docid++) AddDoc(docid, docid * 10);
+  std::vector<int> expected = {0, 1, 2, 3, 4};
+  ASSERT_EQ(expected, WaitForSearch(0, 45, expected));
+
+  long hits = 0, misses = 0, bytes = 0;
+  index_->GetCacheStats(hits, misses, bytes);
+  EXPECT_LT(0, bytes);
+  EXPECT_EQ(expected, Search(0, 45));
+  long last_hits = hits;
+  index_->GetCacheStats(hits, misses, bytes);
+  EXPECT_EQ(last_hits + 1, hits);
+
+  // the cached result doesn't hide the new doc
+  AddDoc(10, 25);
+  expected.push_back(10);
+  EXPECT_EQ(expected, WaitForSearch(0, 45, expected));
+  EXPECT_EQ(expected, Search(0, 45));
+}
+
+TEST_F(MultiFieldsRangeIndexTest, CompactStringsWhileIndexing) {
+  const int kDocNum = 50;
+  std::vector<std::string> names;
+  for (int docid = 0; docid < kDocNum; docid++) {
+    names.push_back(Name(docid, 0));
+    AddDoc(docid, docid, names[docid]);
+  }
+  // the worker reads the strings of updated docs while they are compacted
+  std::atomic<bool> stop(false);
+  std::thread writer([&]() {
+    for (int version = 1; version < 200 && !stop; version++) {
+      for (int docid = 0; docid < kDocNum; docid++) {
+        // the arena may be full until a compaction frees it
+        std::string name = Name(docid, version);
+        if (UpdateName(docid, name) == 0) names[docid] = name;
+      }
+    }
+  });
+  auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+    EXPECT_EQ(0, profile_->CompactStrings());
+  }
+  stop = true;
+  writer.join();
+  for (int docid = 0; docid < kDocNum; docid++) {
+    EXPECT_TRUE(WaitForName(docid, names[docid])) << "docid=" << docid;
+  }
+}
+
+}  // namespace
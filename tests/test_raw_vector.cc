@@ -0,0 +1,140 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "c_api/gamma_api.h"
+#include "util/utils.h"
+#include "vector/mmap_raw_vector.h"
+
+using namespace tig_gamma;
+
+namespace {
+
+const int kDimension = 8;
+const int kMaxVectorSize = 10000;
+
+class MmapRawVectorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/gamma_raw_vector_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    root_ = dir;
+  }
+
+  void TearDown() override { utils::remove_dir(root_.c_str()); }
+
+  // all the vectors are kept in memory
+  MmapRawVector<float> *NewVector(bool async_load) {
+    StoreParams store_params;
+    store_params.cache_size_ =
+        (long)kMaxVectorSize * kDimension * sizeof(float);
+    store_params.async_load_ = async_load;
+    MmapRawVector<float> *raw_vector = new MmapRawVector<float>(
+        "vec", kDimension, kMaxVectorSize, root_, store_params);
+    EXPECT_EQ(0, raw_vector->Init(false, false));
+    return raw_vector;
+  }
+
+  static std::vector<float> Vector(int docid, int version) {
+    std::vector<float> vec(kDimension);
+    for (int i = 0; i < kDimension; i++) vec[i] = docid * 100 + version + i;
+    return vec;
+  }
+
+  static int Add(RawVector<float> *raw_vector, int docid) {
+    std::vector<float> vec = Vector(docid, 0);
+    Field *field = MakeField(nullptr,
+                             MakeByteArray((const char *)vec.data(),
+                                           vec.size() * sizeof(float)),
+                             nullptr, VECTOR);
+    int ret = raw_vector->Add(docid, field);
+    DestroyField(field);
+    return ret;
+  }
+
+  static int Update(RawVector<float> *raw_vector, int docid, int version) {
+    std::vector<float> vec = Vector(docid, version);
+    Field *field = MakeField(nullptr,
+                             MakeByteArray((const char *)vec.data(),
+                                           vec.size() * sizeof(float)),
+                             nullptr, VECTOR);
+    int ret = raw_vector->Update(docid, field);
+    DestroyField(field);
+    return ret;
+  }
+
+  static void ExpectVector(RawVector<float> *raw_vector, int vid,
+                           const std::vector<float> &expected) {
+    ScopeVector<float> vec;
+    ASSERT_EQ(0, raw_vector->GetVector(vid, vec));
+    ASSERT_NE(nullptr, vec.Get());
+    EXPECT_EQ(expected, std::vector<float>(vec.Get(), vec.Get() + kDimension))
+        << "vid=" << vid;
+  }
+
+  // vectors [start, end) of a header, vectors of docids divisible by 7 are
+  // updated twice
+  static void ExpectVectors(RawVector<float> *raw_vector, int start,
+                            int end) {
+    ScopeVector<float> vecs;
+    ASSERT_EQ(0, raw_vector->GetVectorHeader(start, end, vecs));
+    ASSERT_NE(nullptr, vecs.Get());
+    for (int vid = start; vid < end; vid++) {
+      const float *vec = vecs.Get() + (long)(vid - start) * kDimension;
+      EXPECT_EQ(Vector(vid, vid % 7 ? 0 : 2),
+                std::vector<float>(vec, vec + kDimension))
+          << "vid=" << vid;
+    }
+  }
+
+  std::string root_;
+};
+
+TEST_F(MmapRawVectorTest, AsyncLoadServesUpdatedVectors) {
+  const int kNum = 1000;
+  MmapRawVector<float> *raw_vector = NewVector(false);
+  StartFlushingIfNeed(raw_vector);
+  for (int docid = 0; docid < kNum; docid++) {
+    ASSERT_EQ(0, Add(raw_vector, docid));
+  }
+  // updated twice, the latest update is loaded
+  for (int docid = 0; docid < kNum; docid += 7) {
+    ASSERT_EQ(0, Update(raw_vector, docid, 1));
+    ASSERT_EQ(0, Update(raw_vector, docid, 2));
+  }
+  ASSERT_EQ(0, raw_vector->Dump(root_, 0, kNum - 1));
+  StopFlushingIfNeed(raw_vector);
+  delete raw_vector;
+
+  raw_vector = NewVector(true);
+  ASSERT_EQ(0, raw_vector->Load({root_}, kNum));
+  // read while the buffer may still be loading, a range without updates is
+  // served from the file, the whole vectors wait for the buffer
+  ExpectVectors(raw_vector, 1, 7);
+  ExpectVectors(raw_vector, 0, kNum);
+  for (int docid = 0; docid < kNum; docid++) {
+    ExpectVector(raw_vector, docid, Vector(docid, docid % 7 ? 0 : 2));
+  }
+  // writes wait for the loading
+  ASSERT_EQ(0, Add(raw_vector, kNum));
+  ASSERT_EQ(0, Update(raw_vector, 1, 3));
+  for (int docid = 0; docid < kNum; docid++) {
+    int version = docid % 7 ? 0 : 2;
+    if (docid == 1) version = 3;
+    ExpectVector(raw_vector, docid, Vector(docid, version));
+  }
+  ExpectVector(raw_vector, kNum, Vector(kNum, 0));
+  StopFlushingIfNeed(raw_vector);
+  delete raw_vector;
+}
+
+}  // namespace
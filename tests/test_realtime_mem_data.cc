@@ -0,0 +1,343 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "realtime/realtime_mem_data.h"
+#include "util/bitmap.h"
+#include "util/utils.h"
+
+using namespace tig_gamma;
+using namespace tig_gamma::realtime;
+
+namespace {
+
+const int kBucketsNum = 8;
+const int kBucketKeys = 1000;
+const int kCodeBytes = 16;
+const int kMaxVecSize = 100000;
+
+class RealTimeMemDataTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    long mem_bytes = 0;
+    vid_mgr_ = new VIDMgr(false);
+    ASSERT_EQ(0, vid_mgr_->Init(kMaxVecSize, mem_bytes));
+    int bytes = 0;
+    ASSERT_EQ(0, bitmap::create(bitmap_, bytes, kMaxVecSize));
+    data_ = NewData();
+  }
+
+  void TearDown() override {
+    // the arrays replaced by compactions are freed by a delayed task
+    sleep(2);
+    delete data_;
+    delete vid_mgr_;
+    free(bitmap_);
+  }
+
+  RealTimeMemData *NewData() {
+    RealTimeMemData *data =
+        new RealTimeMemData(kBucketsNum, kMaxVecSize, vid_mgr_, bitmap_,
+                            kBucketKeys, kBucketKeys * 64, kCodeBytes);
+    EXPECT_TRUE(data->Init());
+    return data;
+  }
+
+  // vids [from, to) to the bucket, the code of a vid is filled with its
+  // low byte
+  void AddToBucket(int bucket_no, long from, long to) {
+    std::vector<long> keys;
+    std::vector<uint8_t> codes;
+    for (long vid = from; vid < to; vid++) {
+      keys.push_back(vid);
+      codes.resize(codes.size() + kCodeBytes, (uint8_t)vid);
+    }
+    ASSERT_TRUE(data_->AddKeys(bucket_no, keys.size(), keys, codes));
+  }
+
+  void DeleteVids(long from, long to) {
+    std::vector<int> vids;
+    for (long vid = from; vid < to; vid++) {
+      bitmap::set(bitmap_, vid);
+      vids.push_back(vid);
+    }
+    data_->Delete(vids.data(), vids.size());
+  }
+
+  int BucketSize(int bucket_no) {
+    return data_->cur_invert_ptr_->retrieve_idx_pos_[bucket_no];
+  }
+
+  int DeletedNum(int bucket_no) {
+    return data_->cur_invert_ptr_->deleted_nums_[bucket_no];
+  }
+
+  VIDMgr *vid_mgr_;
+  char *bitmap_;
+  RealTimeMemData *data_;
+};
+
+TEST_F(RealTimeMemDataTest, CompactionOrderAndBudget) {
+  for (int i = 0; i < kBucketsNum; i++) {
+    AddToBucket(i, i * kBucketKeys, (i + 1) * kBucketKeys);
+  }
+  // half of bucket 1, 40% of bucket 2 and 10% of bucket 3
+  DeleteVids(1 * kBucketKeys, 1 * kBucketKeys + 500);
+  DeleteVids(2 * kBucketKeys, 2 * kBucketKeys + 400);
+  DeleteVids(3 * kBucketKeys, 3 * kBucketKeys + 100);
+  EXPECT_EQ(500, DeletedNum(1));
+  EXPECT_EQ(400, DeletedNum(2));
+  EXPECT_EQ(100, DeletedNum(3));
+
+  // bucket 2 is scanned more, so it saves more work than bucket 1
+  for (int i = 0; i < 100; i++) data_->RecordScan(2);
+  CompactionOptions options;
+  options.max_bytes_per_round = 1;  // one bucket a round
+  data_->SetCompactionOptions(options);
+
+  ASSERT_EQ(0, data_->CompactIfNeed());
+  EXPECT_EQ(600, BucketSize(2));
+  EXPECT_EQ(0, DeletedNum(2));
+  EXPECT_EQ(kBucketKeys, BucketSize(1));
+  EXPECT_EQ(1, data_->compaction_scheduler_->PendingBuckets());
+
+  ASSERT_EQ(0, data_->CompactIfNeed());
+  EXPECT_EQ(500, BucketSize(1));
+  EXPECT_EQ(0, data_->compaction_scheduler_->PendingBuckets());
+  // under the deleted ratio
+  EXPECT_EQ(kBucketKeys, BucketSize(3));
+
+  long *ids = nullptr;
+  uint8_t *codes = nullptr;
+  data_->GetIvtList(1, ids, codes);
+  for (int pos = 0; pos < BucketSize(1); pos++) {
+    EXPECT_EQ(1 * kBucketKeys + 500 + pos, ids[pos]);
+    EXPECT_EQ((uint8_t)ids[pos], codes[pos * kCodeBytes]);
+  }
+}
+
+TEST_F(RealTimeMemDataTest, CompactionWholeBudget) {
+  for (int i = 0; i < kBucketsNum; i++) {
+    AddToBucket(i, i * kBucketKeys, (i + 1) * kBucketKeys);
+    DeleteVids(i * kBucketKeys, i * kBucketKeys + 500);
+  }
+  ASSERT_EQ(0, data_->CompactIfNeed());
+  for (int i = 0; i < kBucketsNum; i++) EXPECT_EQ(500, BucketSize(i));
+  EXPECT_EQ(0, data_->compaction_scheduler_->PendingBuckets());
+}
+
+TEST_F(RealTimeMemDataTest, DeleteAfterCompactionIsNotCountedAgain) {
+  AddToBucket(0, 0, kBucketKeys);
+  // dropped by the compaction through the bitmap before they are counted
+  for (long vid = 0; vid < 500; vid++) bitmap::set(bitmap_, vid);
+  DeleteVids(500, 800);
+  ASSERT_EQ(0, data_->CompactIfNeed());
+  EXPECT_EQ(200, BucketSize(0));
+
+  std::vector<int> vids;
+  for (int vid = 0; vid < 500; vid++) vids.push_back(vid);
+  data_->Delete(vids.data(), vids.size());
+  EXPECT_EQ(0, DeletedNum(0));
+  EXPECT_EQ(-1, (*data_->cur_invert_ptr_->vid_bucket_no_pos_)[0]);
+
+  DeleteVids(800, 810);
+  EXPECT_EQ(10, DeletedNum(0));
+}
+
+TEST_F(RealTimeMemDataTest, UpdateToOtherBucketIsCompacted) {
+  AddToBucket(0, 0, 10);
+  std::vector<uint8_t> codes(kCodeBytes, 200);
+  for (int vid = 0; vid < 5; vid++) data_->Update(1, vid, codes);
+  EXPECT_EQ(5, DeletedNum(0));
+  EXPECT_EQ(5, BucketSize(1));
+
+  ASSERT_EQ(0, data_->CompactIfNeed());
+  EXPECT_EQ(5, BucketSize(0));
+  // the moved vids are still indexed in bucket 1
+  long bucket_no_pos = (*data_->cur_invert_ptr_->vid_bucket_no_pos_)[2];
+  EXPECT_EQ(1L << 32 | 2, bucket_no_pos);
+}
+
+// live entries of the lists, vid -> first byte of its code
+std::map<long, uint8_t> LiveEntries(RealTimeMemData *data,
+                                    const char *bitmap) {
+  std::map<long, uint8_t> entries;
+  for (int i = 0; i < kBucketsNum; i++) {
+    long *ids = nullptr;
+    uint8_t *codes = nullptr;
+    data->GetIvtList(i, ids, codes);
+    for (int pos = 0; pos < data->cur_invert_ptr_->retrieve_idx_pos_[i];
+         pos++) {
+      if ((ids[pos] & kDelIdxMask) || bitmap::test(bitmap, ids[pos])) continue;
+      EXPECT_EQ(0U, entries.count(ids[pos])) << "vid=" << ids[pos];
+      entries[ids[pos]] = codes[pos * kCodeBytes];
+    }
+  }
+  return entries;
+}
+
+class RealTimeSegmentTest : public RealTimeMemDataTest {
+ protected:
+  void SetUp() override {
+    RealTimeMemDataTest::SetUp();
+    char dir[] = "/tmp/gamma_rt_segment_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    root_ = dir;
+  }
+
+  void TearDown() override {
+    RealTimeMemDataTest::TearDown();
+    utils::remove_dir(root_.c_str());
+  }
+
+  // a dump folder of the engine
+  std::string NewDir() {
+    std::string dir = root_ + "/" + std::to_string(dirs_.size());
+    EXPECT_EQ(0, utils::make_dir(dir.c_str()));
+    dirs_.push_back(dir);
+    return dir;
+  }
+
+  // one vid a bucket in turn
+  void Add(long from, long to) {
+    for (long vid = from; vid < to; vid++) {
+      AddToBucket(vid % kBucketsNum, vid, vid + 1);
+    }
+  }
+
+  std::string root_;
+  std::vector<std::string> dirs_;
+};
+
+TEST_F(RealTimeSegmentTest, DumpLoadDeltaChain) {
+  long max_vid = 0;
+  // more deltas than kept, so the chain is merged into a new base
+  for (int round = 0; round < 12; round++) {
+    Add(max_vid, max_vid + 50);
+    max_vid += 50;
+    // updates in place and moving to another bucket
+    for (long vid = round; vid < max_vid; vid += 37) {
+      std::vector<uint8_t> codes(kCodeBytes, (uint8_t)(vid + round + 1));
+      data_->Update((vid + round) % kBucketsNum, vid, codes);
+    }
+    DeleteVids(round * 3, round * 3 + 1);
+    // the last vids are dumped by the next round sometimes
+    ASSERT_LE(0, data_->Dump(NewDir(), "v", max_vid - 1 - (round % 2) * 5));
+  }
+  ASSERT_LE(0, data_->Dump(NewDir(), "v", max_vid - 1));
+  std::map<long, uint8_t> expected = LiveEntries(data_, bitmap_);
+
+  RealTimeMemData *loaded = NewData();
+  ASSERT_EQ(max_vid, loaded->Load(dirs_, "v"));
+  EXPECT_EQ(expected, LiveEntries(loaded, bitmap_));
+
+  // the mapped buckets are extended by adds and updates after loading
+  std::swap(loaded, data_);
+  Add(max_vid, max_vid + 100);
+  std::vector<uint8_t> codes(kCodeBytes, 7);
+  data_->Update(1, 4, codes);
+  ASSERT_EQ(0, data_->CompactIfNeed());
+  for (long vid = 0; vid < max_vid + 100; vid++) {
+    if (bitmap::test(bitmap_, vid)) continue;
+    long bucket_no_pos = (*data_->cur_invert_ptr_->vid_bucket_no_pos_)[vid];
+    ASSERT_NE(-1, bucket_no_pos);
+    long *ids = nullptr;
+    uint8_t *bucket_codes = nullptr;
+    data_->GetIvtList(bucket_no_pos >> 32, ids, bucket_codes);
+    EXPECT_EQ(vid, ids[bucket_no_pos & 0xffffffff]);
+  }
+  EXPECT_EQ(7, LiveEntries(data_, bitmap_)[4]);
+  delete loaded;
+}
+
+TEST_F(RealTimeSegmentTest, LoadCountsDeletedSinceDump) {
+  AddToBucket(0, 0, 100);
+  ASSERT_EQ(100, data_->Dump(NewDir(), "v", 99));
+
+  // deleted after the dump, before the bitmap is dumped
+  for (long vid = 0; vid < 50; vid++) bitmap::set(bitmap_, vid);
+  RealTimeMemData *loaded = NewData();
+  ASSERT_EQ(100, loaded->Load(dirs_, "v"));
+  EXPECT_EQ(50, loaded->cur_invert_ptr_->deleted_nums_[0]);
+
+  // the mapped bucket is compacted
+  std::swap(loaded, data_);
+  ASSERT_EQ(0, data_->CompactIfNeed());
+  EXPECT_EQ(50, BucketSize(0));
+  delete loaded;
+}
+
+TEST_F(RealTimeSegmentTest, BaseDumpsMovedVidOnce) {
+  AddToBucket(0, 0, 10);
+  // moved to bucket 1, the old entry isn't marked deleted yet
+  std::vector<long> keys = {3};
+  std::vector<uint8_t> codes(kCodeBytes, 33);
+  ASSERT_TRUE(data_->AddKeys(1, 1, keys, codes));
+
+  ASSERT_EQ(10, data_->Dump(NewDir(), "v", 9));
+  RealTimeMemData *loaded = NewData();
+  ASSERT_EQ(10, loaded->Load(dirs_, "v"));
+  std::map<long, uint8_t> entries = LiveEntries(loaded, bitmap_);
+  EXPECT_EQ(10U, entries.size());
+  EXPECT_EQ(33, entries[3]);
+  delete loaded;
+}
+
+TEST_F(RealTimeSegmentTest, LoadRejectsDuplicatedBase) {
+  std::string file = NewDir() + "/v.index.seg";
+  std::vector<long> entries(kBucketsNum, 0);
+  entries[0] = 1;
+  entries[1] = 1;
+  SegmentWriter writer;
+  ASSERT_EQ(0, writer.Open(file, kSegmentBase, kCodeBytes, -1, 0, entries));
+  long vid = 0;
+  ASSERT_EQ(0, writer.WriteIds(&vid, 1));
+  ASSERT_EQ(0, writer.WriteIds(&vid, 1));
+  std::vector<uint8_t> codes(2 * kCodeBytes, 0);
+  ASSERT_EQ(0, writer.WriteCodes(codes.data(), 2));
+  ASSERT_EQ(0, writer.Finish());
+
+  EXPECT_GT(0, data_->Load(dirs_, "v"));
+}
+
+TEST_F(RealTimeSegmentTest, DumpWhileCompacting) {
+  AddToBucket(0, 0, kBucketKeys);
+  DeleteVids(0, 500);
+  std::string dir = NewDir();
+  // compactions run on the indexing thread while the dump writes
+  std::thread compactor([&]() {
+    for (int i = 0; i < 10; i++) {
+      AddToBucket(1, kBucketKeys + i * 100, kBucketKeys + (i + 1) * 100);
+      DeleteVids(kBucketKeys + i * 100, kBucketKeys + i * 100 + 60);
+      data_->CompactIfNeed();
+    }
+  });
+  int dumped = data_->Dump(dir, "v", kBucketKeys - 1);
+  compactor.join();
+  ASSERT_EQ(500, dumped);
+
+  RealTimeMemData *loaded = NewData();
+  ASSERT_EQ(kBucketKeys, loaded->Load(dirs_, "v"));
+  std::map<long, uint8_t> entries = LiveEntries(loaded, bitmap_);
+  EXPECT_EQ(500U, entries.size());
+  for (const auto &entry : entries) {
+    EXPECT_EQ((uint8_t)entry.first, entry.second);
+  }
+  delete loaded;
+}
+
+}  // namespace
@@ -0,0 +1,114 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "search/search_cache.h"
+#include "util/bitmap.h"
+
+using namespace tig_gamma;
+
+namespace {
+
+// an entry of one request whose hits are docids
+std::shared_ptr<SearchCacheEntry> NewEntry(uint64_t epoch,
+                                           const std::vector<int> &docids) {
+  std::string vec_name = "vec";
+  GammaResult result;
+  result.init(docids.size(), &vec_name, 1);
+  result.total = docids.size();
+  result.results_count = docids.size();
+  for (size_t i = 0; i < docids.size(); i++) {
+    result.docs[i]->docid = docids[i];
+    result.docs[i]->score = docids[i] * 0.5;
+    result.docs[i]->fields[0].score = docids[i] * 0.5;
+    result.docs[i]->fields[0].source = nullptr;
+    result.docs[i]->fields[0].source_len = 0;
+  }
+  return SearchCache::MakeEntry(&result, 1, epoch);
+}
+
+TEST(SearchCacheTest, WritesInvalidateEntries) {
+  SearchCache cache;
+  EXPECT_FALSE(cache.Enabled());
+  cache.Put("q", NewEntry(1, {1, 2}));
+  EXPECT_EQ(0, cache.Size());
+
+  cache.SetOptions(10, 0);
+  ASSERT_TRUE(cache.Enabled());
+  EXPECT_EQ(nullptr, cache.Get("q", 1));
+  cache.Put("q", NewEntry(1, {1, 2}));
+  auto entry = cache.Get("q", 1);
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(1UL, entry->epoch);
+  ASSERT_EQ(1UL, entry->results.size());
+  EXPECT_EQ(2UL, entry->results[0].hits.size());
+
+  // a doc is written after the entry is searched
+  EXPECT_EQ(nullptr, cache.Get("q", 2));
+  EXPECT_EQ(0, cache.Size());
+  EXPECT_EQ(nullptr, cache.Get("q", 1));
+  EXPECT_EQ(1, cache.Hits());
+  EXPECT_EQ(3, cache.Misses());
+}
+
+TEST(SearchCacheTest, StaleEntriesWithinBound) {
+  SearchCache cache;
+  cache.SetOptions(10, 200);
+  cache.Put("q", NewEntry(1, {1}));
+  EXPECT_NE(nullptr, cache.Get("q", 5));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  EXPECT_NE(nullptr, cache.Get("q", 1));
+  EXPECT_EQ(nullptr, cache.Get("q", 5));
+}
+
+TEST(SearchCacheTest, EvictsLeastRecentlyUsed) {
+  SearchCache cache;
+  cache.SetOptions(2, 0);
+  cache.Put("a", NewEntry(1, {1}));
+  cache.Put("b", NewEntry(1, {2}));
+  ASSERT_NE(nullptr, cache.Get("a", 1));
+  cache.Put("c", NewEntry(1, {3}));
+  EXPECT_EQ(2, cache.Size());
+  EXPECT_EQ(nullptr, cache.Get("b", 1));
+  EXPECT_NE(nullptr, cache.Get("a", 1));
+  EXPECT_NE(nullptr, cache.Get("c", 1));
+
+  cache.SetOptions(1, 0);
+  EXPECT_EQ(1, cache.Size());
+  EXPECT_NE(nullptr, cache.Get("c", 1));
+  cache.SetOptions(0, 0);
+  EXPECT_EQ(0, cache.Size());
+  EXPECT_EQ(nullptr, cache.Get("c", 1));
+}
+
+TEST(SearchCacheTest, DeletedDocsAreSkipped) {
+  auto entry = NewEntry(1, {1, 2, 3, 4});
+  char *deleted = nullptr;
+  int bytes = 0;
+  ASSERT_EQ(0, bitmap::create(deleted, bytes, 8));
+  bitmap::set(deleted, 2);
+
+  std::string vec_name = "vec";
+  GammaResult result;
+  SearchCache::ToResults(*entry, 2, &vec_name, 1, deleted, &result);
+  EXPECT_EQ(4, result.total);
+  ASSERT_EQ(2, result.results_count);
+  EXPECT_EQ(1, result.docs[0]->docid);
+  EXPECT_EQ(3, result.docs[1]->docid);
+  EXPECT_DOUBLE_EQ(1.5, result.docs[1]->fields[0].score);
+  free(deleted);
+}
+
+}  // namespace
@@ -0,0 +1,149 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <vector>
+
+#include "index/vid_filter.h"
+#include "util/bitmap.h"
+
+using namespace tig_gamma;
+
+namespace {
+
+const int kMaxDocNum = 256;
+
+// a range filter passing docids
+MultiRangeQueryResults *NewRange(const std::vector<int> &docids) {
+  MultiRangeQueryResults *range = new MultiRangeQueryResults;
+  RangeQueryResult *result = new RangeQueryResult;
+  for (int docid : docids) result->SetRange(docid, docid);
+  result->Resize();
+  for (int docid : docids) result->Set(docid - result->MinAligned());
+  result->SetDocNum(docids.size());
+  range->Add(result);
+  return range;
+}
+
+// the positions passing the filter, through the bulk and the single paths
+std::vector<int> Filter(const VidFilter &filter,
+                        const std::vector<int64_t> &ids, size_t &n_deleted) {
+  std::vector<int> pos;
+  size_t npass = filter.Filter(ids.size(), ids.data(), pos, n_deleted);
+  EXPECT_LE(ids.size(), pos.size());
+  pos.resize(npass);
+
+  std::vector<int> expected;
+  for (size_t j = 0; j < ids.size(); j++) {
+    if (ids[j] >= 0 && filter.Pass(ids[j])) expected.push_back(j);
+  }
+  EXPECT_EQ(expected, pos);
+  return pos;
+}
+
+class VidFilterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    int bytes = 0;
+    ASSERT_EQ(0, bitmap::create(deleted_, bytes, kMaxDocNum));
+  }
+
+  void TearDown() override { free(deleted_); }
+
+  char *deleted_;
+};
+
+TEST_F(VidFilterTest, DeletedAndMarkedIds) {
+  VIDMgr vid_mgr(false);
+  long mem_bytes = 0;
+  ASSERT_EQ(0, vid_mgr.Init(kMaxDocNum, mem_bytes));
+  bitmap::set(deleted_, 3);
+  bitmap::set(deleted_, 100);
+
+  VidFilter filter;
+  ASSERT_EQ(0, filter.Init(deleted_, &vid_mgr, nullptr));
+  std::vector<int64_t> ids = {0, 3, 5, 100, 7 | INT64_MIN, 101, 2 | INT64_MIN};
+  size_t n_deleted = 1;
+  std::vector<int> expected = {0, 2, 5};
+  EXPECT_EQ(expected, Filter(filter, ids, n_deleted));
+  EXPECT_EQ(3UL, n_deleted);
+
+  // all positions pass without ids
+  std::vector<int> pos;
+  n_deleted = 0;
+  ASSERT_EQ(4UL, filter.Filter(4, nullptr, pos, n_deleted));
+  expected = {0, 1, 2, 3};
+  EXPECT_EQ(expected, pos);
+  EXPECT_EQ(0UL, n_deleted);
+
+  VidFilter uninit;
+  EXPECT_NE(0, uninit.Init(nullptr, &vid_mgr, nullptr));
+  EXPECT_FALSE(uninit.Pass(0));
+}
+
+TEST_F(VidFilterTest, RangeWindow) {
+  VIDMgr vid_mgr(false);
+  long mem_bytes = 0;
+  ASSERT_EQ(0, vid_mgr.Init(kMaxDocNum, mem_bytes));
+  bitmap::set(deleted_, 12);
+  std::unique_ptr<MultiRangeQueryResults> range(NewRange({10, 12, 13, 70}));
+
+  VidFilter filter;
+  ASSERT_EQ(0, filter.Init(deleted_, &vid_mgr, range.get()));
+  for (int vid = 0; vid < kMaxDocNum; vid++) {
+    EXPECT_EQ(vid == 10 || vid == 13 || vid == 70, filter.Pass(vid))
+        << "vid=" << vid;
+  }
+  // out of the window on both sides
+  std::vector<int64_t> ids = {70, 0, 13, 200, 10 | INT64_MIN, 12, 10, 71};
+  size_t n_deleted = 0;
+  std::vector<int> expected = {0, 2, 6};
+  EXPECT_EQ(expected, Filter(filter, ids, n_deleted));
+  EXPECT_EQ(1UL, n_deleted);
+
+  // an empty result passes nothing
+  MultiRangeQueryResults empty;
+  ASSERT_EQ(0, filter.Init(deleted_, &vid_mgr, &empty));
+  EXPECT_EQ(std::vector<int>(), Filter(filter, ids, n_deleted));
+}
+
+TEST_F(VidFilterTest, MultiVids) {
+  VIDMgr vid_mgr(true);
+  long mem_bytes = 0;
+  ASSERT_EQ(0, vid_mgr.Init(kMaxDocNum, mem_bytes));
+  // vids 2 * docid and 2 * docid + 1 of 20 docs, and vid 40 of doc 5
+  for (int docid = 0; docid < 20; docid++) {
+    ASSERT_EQ(0, vid_mgr.Add(2 * docid, docid));
+    ASSERT_EQ(0, vid_mgr.Add(2 * docid + 1, docid));
+  }
+  ASSERT_EQ(0, vid_mgr.Add(40, 5));
+  bitmap::set(deleted_, 7);
+
+  VidFilter filter;
+  ASSERT_EQ(0, filter.Init(deleted_, &vid_mgr, nullptr));
+  std::vector<int64_t> ids = {14, 15, 16, 40, 41, 6 | INT64_MIN};
+  size_t n_deleted = 0;
+  std::vector<int> expected = {2, 3};
+  EXPECT_EQ(expected, Filter(filter, ids, n_deleted));
+  EXPECT_EQ(1UL, n_deleted);
+
+  std::unique_ptr<MultiRangeQueryResults> range(NewRange({5, 7, 9}));
+  ASSERT_EQ(0, filter.Init(deleted_, &vid_mgr, range.get()));
+  for (int vid = 0; vid < 50; vid++) {
+    bool pass = vid == 10 || vid == 11 || vid == 40 || vid == 18 || vid == 19;
+    EXPECT_EQ(pass, filter.Pass(vid)) << "vid=" << vid;
+  }
+  ids = {40, 10, 14, 19, 18 | INT64_MIN, 0};
+  expected = {0, 1, 3};
+  EXPECT_EQ(expected, Filter(filter, ids, n_deleted));
+}
+
+}  // namespace
@@ -0,0 +1,115 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "vector/raw_vector_common.h"
+
+namespace {
+
+const int kMaxVectorSize = 200000;
+
+std::vector<int> DocVIDs(const VIDMgr &vid_mgr, int docid) {
+  int num = 0;
+  const int *vids = vid_mgr.DocVIDs(docid, num);
+  if (num == 0) {
+    EXPECT_EQ(nullptr, vids);
+    return {};
+  }
+  return std::vector<int>(vids, vids + num);
+}
+
+void ExpectDocs(const VIDMgr &vid_mgr,
+                const std::vector<std::vector<int>> &doc_vids) {
+  for (size_t docid = 0; docid < doc_vids.size(); docid++) {
+    const std::vector<int> &vids = doc_vids[docid];
+    ASSERT_EQ(vids, DocVIDs(vid_mgr, docid)) << "docid=" << docid;
+    for (int vid : vids) ASSERT_EQ((int)docid, vid_mgr.VID2DocID(vid));
+    if (vids.empty()) {
+      EXPECT_EQ(-1, vid_mgr.GetFirstVID(docid));
+      continue;
+    }
+    EXPECT_EQ(vids.front(), vid_mgr.GetFirstVID(docid));
+    EXPECT_EQ(vids.back(), vid_mgr.GetLastVID(docid));
+  }
+}
+
+TEST(VIDMgrTest, ListsAcrossArenaPages) {
+  VIDMgr vid_mgr(true);
+  long mem_bytes = 0;
+  ASSERT_EQ(0, vid_mgr.Init(kMaxVectorSize, mem_bytes));
+  long init_bytes = vid_mgr.GetMemBytes();
+
+  // 3 vids a doc, so some list reaches the end of an arena page and is
+  // moved to the next one
+  std::vector<std::vector<int>> doc_vids(50000);
+  int vid = 0;
+  for (size_t docid = 0; docid < doc_vids.size(); docid++) {
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ(0, vid_mgr.Add(vid, docid));
+      doc_vids[docid].push_back(vid++);
+    }
+  }
+  ExpectDocs(vid_mgr, doc_vids);
+  EXPECT_LT(init_bytes, vid_mgr.GetMemBytes());
+
+  std::vector<int> vids;
+  vid_mgr.DocID2VID(21845, vids);
+  EXPECT_EQ(doc_vids[21845], vids);
+  EXPECT_EQ(std::vector<int>(), DocVIDs(vid_mgr, doc_vids.size()));
+}
+
+TEST(VIDMgrTest, RelocatesOutOfOrderVids) {
+  VIDMgr vid_mgr(true);
+  long mem_bytes = 0;
+  ASSERT_EQ(0, vid_mgr.Init(kMaxVectorSize, mem_bytes));
+  std::vector<std::vector<int>> doc_vids(100);
+  int vid = 0;
+  for (size_t docid = 0; docid < doc_vids.size(); docid += 2) {
+    ASSERT_EQ(0, vid_mgr.Add(vid, docid));
+    doc_vids[docid].push_back(vid++);
+  }
+
+  int num = 0;
+  const int *old_vids = vid_mgr.DocVIDs(10, num);
+  ASSERT_EQ(1, num);
+  // vids are added to earlier docs, interleaved
+  for (int round = 0; round < 20; round++) {
+    for (size_t docid = 0; docid < doc_vids.size(); docid += 5) {
+      ASSERT_EQ(0, vid_mgr.Add(vid, docid));
+      doc_vids[docid].push_back(vid++);
+    }
+  }
+  ExpectDocs(vid_mgr, doc_vids);
+  // readers of the relocated list still see its old vids
+  EXPECT_EQ(doc_vids[10][0], old_vids[0]);
+}
+
+TEST(VIDMgrTest, OutOfBounds) {
+  VIDMgr vid_mgr(true);
+  long mem_bytes = 0;
+  ASSERT_EQ(0, vid_mgr.Init(100, mem_bytes));
+  EXPECT_NE(0, vid_mgr.Add(100, 0));
+  EXPECT_NE(0, vid_mgr.Add(0, 100));
+  EXPECT_NE(0, vid_mgr.Add(-1, 0));
+  EXPECT_EQ(0, vid_mgr.Add(99, 99));
+  ExpectDocs(vid_mgr, {{}, {}});
+  EXPECT_EQ(std::vector<int>({99}), DocVIDs(vid_mgr, 99));
+  EXPECT_EQ(std::vector<int>(), DocVIDs(vid_mgr, 100));
+
+  // a doc of a single vector is its vid
+  VIDMgr single(false);
+  ASSERT_EQ(0, single.Init(100, mem_bytes));
+  EXPECT_EQ(0, single.Add(5, 5));
+  EXPECT_EQ(5, single.VID2DocID(5));
+  EXPECT_EQ(5, single.GetFirstVID(5));
+  EXPECT_EQ(0, single.GetMemBytes());
+}
+
+}  // namespace
@@ -9,12 +9,19 @@
 #include <sys/mman.h>
 #include <sys/sysinfo.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <fstream>
 #include <functional>
 #include <future>
 #include <iostream>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 #include "gamma_api.h"
 #include "log.h"
@@ -26,6 +33,9 @@
  *   ftp://ftp.irisa.fr/local/texmex/corpus/siftsmall.tar.gz
  *
  * and unzip it.
+ *
+ * Or without any dataset, set "synthetic" to generate the docs and queries,
+ * and set "workload" to "mixed" to run writers alongside searchers.
  **/
 
 using namespace std;
@@ -46,6 +56,11 @@ inline ByteArray *FloatToByteArray(const float *feature, int dimension) {
   memcpy((void *)ba->value, (void *)feature, ba->len);
   return ba;
 }
+
+template <typename T>
+inline ByteArray *NumberToByteArray(T v) {
+  return MakeByteArray(reinterpret_cast<const char *>(&v), sizeof(v));
+}
 }  // namespace
 
 namespace test {
@@ -80,6 +95,16 @@ namespace test {
     }                                                 \
   }
 
+#define JPGETDOUBLE(name, value)                      \
+  {                                                   \
+    if (jp.Contains(name)) {                          \
+      if (jp.GetDouble(name, value)) {                \
+        LOG(ERROR) << "json get error name=" << name; \
+        return -1;                                    \
+      }                                               \
+    }                                                 \
+  }
+
 struct GammaPerfConf {
   GammaPerfConf() {
     nprobe = 20;
@@ -99,14 +124,37 @@ struct GammaPerfConf {
     store_param = "";
     has_rank = 1;
     fixed_search_threads = -1;
+    fields_index = {0, 0, 1, 1, 0};
+    metric_type = "InnerProduct";
+    topn = 10;
+
+    synthetic = 0;
+    nclusters = 100;
+    cluster_std = 0.1;
+    skew = 0;
+    ntags = 1000;
+    seed = 1;
+
+    workload = "search";
+    duration = 60;
+    report_interval = 5;
+    search_threads = 8;
+    write_threads = 2;
+    search_qps = 0;
+    add_qps = 0;
+    update_qps = 0;
+    delete_qps = 0;
+    filter_ratio = 0;
+    range_selectivity = 0.1;
   }
 
   int Parse(string &conf_path) {
     long file_size = utils::get_file_size(conf_path.c_str());
-    std::unique_ptr<char[]> data(new char[file_size]);
+    std::unique_ptr<char[]> data(new char[file_size + 1]);
     utils::FileIO conf_file(conf_path);
     conf_file.Open("r");
     conf_file.Read(data.get(), 1, file_size);
+    data[file_size] = '\0';
 
     utils::JsonParser jp;
     if (jp.Parse(data.get())) {
@@ -115,11 +163,17 @@ struct GammaPerfConf {
       return -1;
     }
 
-    JPMUSTGETSTRING("add_profile_file", add_profile_file);
-    JPMUSTGETSTRING("add_feature_file", add_feature_file);
-    JPMUSTGETSTRING("search_feature_file", search_feature_file);
+    JPGETINT("synthetic", synthetic);
+    if (not synthetic) {
+      JPMUSTGETSTRING("add_profile_file", add_profile_file);
+      JPMUSTGETSTRING("add_feature_file", add_feature_file);
+      JPMUSTGETSTRING("search_feature_file", search_feature_file);
+    }
     JPGETSTRING("store_type", store_type);
     JPGETSTRING("store_param", store_param);
+    JPGETSTRING("retrieval_type", retrieval_type);
+    JPGETSTRING("metric_type", metric_type);
+    JPGETSTRING("workload", workload);
 
     JPGETINT("nprobe", nprobe);
     JPGETINT("ncentroids", ncentroids);
@@ -130,12 +184,40 @@ struct GammaPerfConf {
     JPGETINT("nsearch", nsearch);
     JPGETINT("has_rank", has_rank);
     JPGETINT("fixed_search_threads", fixed_search_threads);
-
-    if (add_profile_file == "" || add_feature_file == "" ||
-        search_feature_file == "") {
+    JPGETINT("topn", topn);
+
+    JPGETINT("nclusters", nclusters);
+    JPGETDOUBLE("cluster_std", cluster_std);
+    JPGETDOUBLE("skew", skew);
+    JPGETINT("ntags", ntags);
+    JPGETINT("seed", seed);
+
+    JPGETINT("duration", duration);
+    JPGETINT("report_interval", report_interval);
+    JPGETINT("search_threads", search_threads);
+    JPGETINT("write_threads", write_threads);
+    JPGETDOUBLE("search_qps", search_qps);
+    JPGETDOUBLE("add_qps", add_qps);
+    JPGETDOUBLE("update_qps", update_qps);
+    JPGETDOUBLE("delete_qps", delete_qps);
+    JPGETDOUBLE("filter_ratio", filter_ratio);
+    JPGETDOUBLE("range_selectivity", range_selectivity);
+
+    if (not synthetic && (add_profile_file == "" || add_feature_file == "" ||
+                          search_feature_file == "")) {
       LOG(ERROR) << "add or search file empty";
       return -1;
     }
+    if (workload != "search" && workload != "mixed") {
+      LOG(ERROR) << "unknown workload " << workload;
+      return -1;
+    }
+    if (workload == "mixed" &&
+        nadd + add_qps * duration > (double)max_doc_size) {
+      LOG(ERROR) << "max_doc_size=" << max_doc_size
+                 << " is too small for the adds of the workload";
+      return -1;
+    }
     LOG(INFO) << "add_profile_file=" << add_profile_file
               << ", add_feature_file=" << add_feature_file
               << ", search_feature_file=" << search_feature_file
@@ -143,7 +225,13 @@ struct GammaPerfConf {
               << ", max_doc_size=" << max_doc_size << ", nadd=" << nadd
               << ", nsearch=" << nsearch << ", store_type=" << store_type
               << ", store_param=" << store_param << ", has_rank=" << has_rank
-              << ", fixed_search_threads=" << fixed_search_threads;
+              << ", fixed_search_threads=" << fixed_search_threads
+              << ", synthetic=" << synthetic << ", nclusters=" << nclusters
+              << ", skew=" << skew << ", workload=" << workload
+              << ", duration=" << duration << "s, search_qps=" << search_qps
+              << ", add_qps=" << add_qps << ", update_qps=" << update_qps
+              << ", delete_qps=" << delete_qps
+              << ", filter_ratio=" << filter_ratio;
     return 0;
   }
 
@@ -164,6 +252,31 @@ struct GammaPerfConf {
   string store_param;
   int has_rank;
   int fixed_search_threads;
+  std::vector<char> fields_index;
+  string metric_type;
+  int topn;
+
+  // synthetic docs, see SyntheticData
+  int synthetic;
+  int nclusters;
+  double cluster_std;
+  double skew;
+  int ntags;
+  int seed;
+
+  // mixed workload, a rate of 0 is closed loop for searches and disables
+  // the writes
+  string workload;
+  int duration;         // seconds
+  int report_interval;  // seconds
+  int search_threads;
+  int write_threads;  // of each write operation
+  double search_qps;
+  double add_qps;
+  double update_qps;
+  double delete_qps;
+  double filter_ratio;       // the proportion of searches with filters
+  double range_selectivity;  // of the range filter on field2
 
   string add_profile_file;
   string add_feature_file;
@@ -180,8 +293,10 @@ struct Stat {
   double end;
 
   // compute results
+  float tp50;
   float tp90;
   float tp99;
+  float tp999;
   float avg_latency;
   float qps;
 
@@ -190,8 +305,10 @@ struct Stat {
     nsucc = 0;
     start = std::numeric_limits<float>::max();
     end = 0.0f;
+    tp50 = 0.0f;
     tp90 = 0.0f;
     tp99 = 0.0f;
+    tp999 = 0.0f;
     avg_latency = 0.0f;
     qps = 0.0f;
   }
@@ -212,11 +329,12 @@ struct Stat {
   }
 
   void Analyze() {
+    if (costs.empty()) return;
     std::sort(costs.begin(), costs.end());
-    int i90 = (int)(costs.size() * 0.9);
-    int i99 = (int)(costs.size() * 0.99);
-    tp90 = costs[i90];
-    tp99 = costs[i99];
+    tp50 = costs[(int)(costs.size() * 0.5)];
+    tp90 = costs[(int)(costs.size() * 0.9)];
+    tp99 = costs[(int)(costs.size() * 0.99)];
+    tp999 = costs[(int)(costs.size() * 0.999)];
 
     float total = std::accumulate(costs.begin(), costs.end(), 0.0f);
     avg_latency = total / costs.size();
@@ -226,6 +344,14 @@ struct Stat {
     qps = costs.size() / secs;
   }
 
+  string PercentileString() {
+    stringstream ss;
+    ss << "qps=" << qps << ", tp50=" << tp50 << "ms, tp90=" << tp90
+       << "ms, tp99=" << tp99 << "ms, tp999=" << tp999
+       << "ms, success number=" << nsucc << ", fail number=" << nfail;
+    return ss.str();
+  }
+
   string ToString() {
     stringstream ss;
     ss << "qps=" << qps << ", average latency=" << avg_latency
@@ -237,6 +363,138 @@ struct Stat {
   }
 };
 
+/** synthetic docs and queries. Vectors are drawn from gaussian clusters of
+ * uniform centers, the clusters are chosen by a zipf distribution of exponent
+ * skew (0 is uniform), so do the tags of field1. field2 is uniform in
+ * [0, kField2Range) for the range filters, and field3 is the cluster.
+ */
+class SyntheticData {
+ public:
+  static const int kField2Range = 10000;
+
+  explicit SyntheticData(GammaPerfConf *conf) : conf_(conf) {
+    std::mt19937 rng(conf->seed);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    centers_.resize((long)conf->nclusters * conf->dimension);
+    for (float &c : centers_) c = uniform(rng);
+    ZipfCDF(conf->nclusters, conf->skew, cluster_cdf_);
+    ZipfCDF(conf->ntags, conf->skew, tag_cdf_);
+  }
+
+  int Cluster(std::mt19937 &rng) { return Zipf(cluster_cdf_, rng); }
+
+  int Tag(std::mt19937 &rng) { return Zipf(tag_cdf_, rng); }
+
+  void Vector(int cluster, std::mt19937 &rng, float *vec) {
+    std::normal_distribution<float> noise(0, conf_->cluster_std);
+    const float *center = centers_.data() + (long)cluster * conf_->dimension;
+    for (size_t i = 0; i < conf_->dimension; i++) {
+      vec[i] = center[i] + noise(rng);
+    }
+  }
+
+  /** make a doc of the perf fields, key is also the _id
+   *
+   * @param vec  vector of the doc, a synthetic one is drawn if it's nullptr
+   */
+  Doc *MakeSyntheticDoc(long key, std::mt19937 &rng, const float *vec) {
+    int cluster = Cluster(rng);
+    std::vector<float> buf;
+    if (vec == nullptr) {
+      buf.resize(conf_->dimension);
+      Vector(cluster, rng, buf.data());
+      vec = buf.data();
+    }
+    string id = std::to_string(key);
+    std::uniform_int_distribution<int> field2(0, kField2Range - 1);
+    Field **fields = MakeFields(conf_->fields_vec.size() + 1);
+    ByteArray *values[] = {
+        NumberToByteArray(key), StringToByteArray(id),
+        StringToByteArray("t" + std::to_string(Tag(rng))),
+        NumberToByteArray(field2(rng)), NumberToByteArray(cluster)};
+    for (size_t i = 0; i < conf_->fields_vec.size(); i++) {
+      Field *field = MakeField(StringToByteArray(conf_->fields_vec[i]),
+                               values[i], StringToByteArray(id),
+                               conf_->fields_type[i]);
+      SetField(fields, i, field);
+    }
+    Field *field = MakeField(StringToByteArray(conf_->vector_name),
+                             FloatToByteArray(vec, conf_->dimension),
+                             StringToByteArray(id), VECTOR);
+    SetField(fields, conf_->fields_vec.size(), field);
+    return MakeDoc(fields, conf_->fields_vec.size() + 1);
+  }
+
+ private:
+  static void ZipfCDF(int n, double s, std::vector<double> &cdf) {
+    cdf.resize(n);
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+      sum += 1.0 / std::pow(i + 1, s);
+      cdf[i] = sum;
+    }
+    for (double &c : cdf) c /= sum;
+  }
+
+  static int Zipf(const std::vector<double> &cdf, std::mt19937 &rng) {
+    std::uniform_real_distribution<double> uniform(0, 1);
+    int i = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) -
+            cdf.begin();
+    return std::min(i, (int)cdf.size() - 1);
+  }
+
+  GammaPerfConf *conf_;
+  std::vector<float> centers_;
+  std::vector<double> cluster_cdf_;
+  std::vector<double> tag_cdf_;
+};
+
+enum OpType { OP_SEARCH = 0, OP_ADD, OP_UPDATE, OP_DELETE, OP_NUM };
+
+static const char *kOpNames[] = {"search", "add", "update", "delete"};
+
+/** arrivals of an operation type. If rate > 0 it's an open loop, operations
+ * are scheduled by a poisson process regardless of the workers, and the
+ * latency counts from the scheduled time, so it includes the queueing once
+ * the workers fall behind. Otherwise each worker issues the next operation as
+ * soon as the previous one returns.
+ */
+class Arrivals {
+ public:
+  Arrivals(double rate, double start, double end, int seed)
+      : rate_(rate), next_(start), end_(end), rng_(seed) {}
+
+  /** the scheduled time of the next operation
+   *
+   * @return false if the workload is over
+   */
+  bool Next(double &scheduled) {
+    if (rate_ <= 0) {
+      scheduled = utils::getmillisecs();
+      return scheduled < end_;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::exponential_distribution<double> gap(rate_ / 1000);
+    next_ += gap(rng_);
+    scheduled = next_;
+    return scheduled < end_;
+  }
+
+ private:
+  double rate_;  // per second
+  double next_;  // ms
+  double end_;
+  std::mt19937 rng_;
+  std::mutex mutex_;
+};
+
+// an operation finished at end
+struct OpSample {
+  double end;
+  float latency;
+  bool succ;
+};
+
 static int nums[] = {1, 5, 10, 20, 30, 50, 70, 100};
 
 class GammaPerfTest {
@@ -248,19 +506,26 @@ class GammaPerfTest {
   int max_steps_;
   Stat *stats_;
   int run_steps_;
+  SyntheticData *synthetic_;
+  std::atomic<long> next_key_;  // of the docs added
+  string mixed_result_;
 
  public:
-  GammaPerfTest(GammaPerfConf *conf) {
+  GammaPerfTest(GammaPerfConf *conf) : next_key_(0) {
     conf_ = conf;
+    engine_ = nullptr;
+    search_vectors_ = nullptr;
     thread_nums_ = nums;
     max_steps_ = sizeof(nums) / sizeof(nums[0]);
     stats_ = new Stat[max_steps_];
     run_steps_ = 0;
+    synthetic_ = new SyntheticData(conf);
   }
   ~GammaPerfTest() {
     if (engine_) Close(engine_);
     if (search_vectors_) delete[] search_vectors_;
     if (stats_) delete[] stats_;
+    if (synthetic_) delete synthetic_;
   }
   int Init() {
     utils::remove_dir(conf_->root_path.c_str());
@@ -279,6 +544,14 @@ class GammaPerfTest {
     BuildIndex();
 
     search_vectors_ = new float[(long)conf_->nsearch * conf_->dimension];
+    if (conf_->synthetic) {
+      std::mt19937 rng(conf_->seed + 1);
+      for (int i = 0; i < conf_->nsearch; i++) {
+        synthetic_->Vector(synthetic_->Cluster(rng), rng,
+                           search_vectors_ + (long)i * conf_->dimension);
+      }
+      return 0;
+    }
     utils::FileIO fet_file(conf_->search_feature_file);
     if (fet_file.Open("rb")) {
       LOG(ERROR) << "open error:" << conf_->search_feature_file;
@@ -294,6 +567,8 @@ class GammaPerfTest {
   }
 
   int Run() {
+    if (conf_->workload == "mixed") return RunMixed();
+
     if (conf_->fixed_search_threads > 0) {
       thread_nums_[0] = conf_->fixed_search_threads;
       max_steps_ = 1;
@@ -320,6 +595,10 @@ class GammaPerfTest {
   }
 
   void GetResult(string &result) {
+    if (conf_->workload == "mixed") {
+      result = mixed_result_;
+      return;
+    }
     stringstream ss;
     ss << "------------------Performance----------------\n";
     for (int i = 0; i < run_steps_; i++) {
@@ -358,15 +637,7 @@ class GammaPerfTest {
     stat->Start();
     for (int id = 0; id < conf->nsearch; id++) {
       float *vector = t->search_vectors_ + (long)id * dimension;
-      VectorQuery **vector_querys = MakeVectorQuerys(1);
-      ByteArray *value = FloatToByteArray(vector, dimension);
-      VectorQuery *vector_query = MakeVectorQuery(
-          StringToByteArray(conf->vector_name), value, 0, 10000, 0.1, 0);
-      SetVectorQuery(vector_querys, 0, vector_query);
-
-      Request *request =
-          MakeRequest(10, vector_querys, 1, nullptr, 0, nullptr, 0, nullptr, 0,
-                      1, 0, nullptr, conf->has_rank, 0, FALSE, FALSE);
+      Request *request = t->MakeSearchRequest(vector, nullptr);
 
       double start = utils::getmillisecs();
       Response *response = Search(t->engine_, request);
@@ -385,13 +656,197 @@ class GammaPerfTest {
     //           << ", end=" << (long)stat->end;
   };
 
+  /** make a request of a query vector, with the filters of a random range of
+   * field2 and a random tag of field1 by filter_ratio if rng isn't nullptr
+   */
+  Request *MakeSearchRequest(const float *vector, std::mt19937 *rng) {
+    VectorQuery **vector_querys = MakeVectorQuerys(1);
+    ByteArray *value = FloatToByteArray(vector, conf_->dimension);
+    VectorQuery *vector_query = MakeVectorQuery(
+        StringToByteArray(conf_->vector_name), value, 0, 10000, 0.1, 0);
+    SetVectorQuery(vector_querys, 0, vector_query);
+
+    std::uniform_real_distribution<double> uniform(0, 1);
+    if (rng == nullptr || uniform(*rng) >= conf_->filter_ratio) {
+      return MakeRequest(conf_->topn, vector_querys, 1, nullptr, 0, nullptr, 0,
+                         nullptr, 0, 1, 0, nullptr, conf_->has_rank, 0, FALSE,
+                         FALSE, conf_->nprobe, FALSE);
+    }
+
+    int width = SyntheticData::kField2Range * conf_->range_selectivity;
+    int lower = (SyntheticData::kField2Range - width) * uniform(*rng);
+    int upper = lower + width;
+    RangeFilter **range_filters = MakeRangeFilters(1);
+    SetRangeFilter(range_filters, 0,
+                   MakeRangeFilter(StringToByteArray("field2"),
+                                   NumberToByteArray(lower),
+                                   NumberToByteArray(upper), TRUE, FALSE));
+    TermFilter **term_filters = MakeTermFilters(1);
+    string tag = "t" + std::to_string(synthetic_->Tag(*rng));
+    SetTermFilter(term_filters, 0,
+                  MakeTermFilter(StringToByteArray("field1"),
+                                 StringToByteArray(tag), TRUE));
+    return MakeRequest(conf_->topn, vector_querys, 1, nullptr, 0,
+                       range_filters, 1, term_filters, 1, 1, 0, nullptr,
+                       conf_->has_rank, 0, FALSE, FALSE, conf_->nprobe, FALSE);
+  }
+
+  /** run searchers and writers concurrently for duration seconds, then
+   * report the latency percentiles of each operation type by report_interval
+   */
+  int RunMixed() {
+    const double rates[OP_NUM] = {conf_->search_qps, conf_->add_qps,
+                                  conf_->update_qps, conf_->delete_qps};
+    const int nthreads[OP_NUM] = {
+        conf_->search_threads, conf_->add_qps > 0 ? conf_->write_threads : 0,
+        conf_->update_qps > 0 ? conf_->write_threads : 0,
+        conf_->delete_qps > 0 ? conf_->write_threads : 0};
+
+    double start = utils::getmillisecs();
+    double end = start + conf_->duration * 1000.0;
+    std::vector<std::unique_ptr<Arrivals>> arrivals;
+    for (int op = 0; op < OP_NUM; op++) {
+      arrivals.emplace_back(
+          new Arrivals(rates[op], start, end, conf_->seed + op));
+    }
+
+    std::vector<OpType> types;
+    for (int op = 0; op < OP_NUM; op++) {
+      types.insert(types.end(), nthreads[op], (OpType)op);
+    }
+    std::vector<std::vector<OpSample>> samples(types.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < types.size(); i++) {
+      threads.emplace_back(&GammaPerfTest::OpRunner, this, types[i],
+                           arrivals[types[i]].get(), conf_->seed + i + 2,
+                           &samples[i]);
+    }
+    for (std::thread &t : threads) t.join();
+
+    std::vector<OpSample> op_samples[OP_NUM];
+    for (size_t i = 0; i < types.size(); i++) {
+      op_samples[types[i]].insert(op_samples[types[i]].end(),
+                                  samples[i].begin(), samples[i].end());
+    }
+    stringstream ss;
+    ss << "------------------Mixed workload-------------\n";
+    for (int op = 0; op < OP_NUM; op++) {
+      if (op_samples[op].empty()) continue;
+      ss << kOpNames[op] << ", rate=" << rates[op]
+         << (rates[op] > 0 ? "/s open loop" : " closed loop")
+         << ", threads=" << nthreads[op] << "\n";
+      ss << Report(op_samples[op], start, end);
+    }
+    ss << "--------------------------------------------\n";
+    mixed_result_ = ss.str();
+    return 0;
+  }
+
+  static void OpRunner(GammaPerfTest *t, OpType type, Arrivals *arrivals,
+                       int seed, std::vector<OpSample> *samples) {
+    std::mt19937 rng(seed);
+    double scheduled = 0;
+    while (arrivals->Next(scheduled)) {
+      double now = utils::getmillisecs();
+      if (scheduled > now) {
+        std::this_thread::sleep_for(
+            std::chrono::microseconds((long)((scheduled - now) * 1000)));
+      }
+      bool succ = t->Execute(type, rng);
+      double end = utils::getmillisecs();
+      samples->push_back({end, (float)(end - scheduled), succ});
+    }
+  }
+
+  // updates and deletes pick a random key of the docs added
+  bool Execute(OpType type, std::mt19937 &rng) {
+    if (type == OP_SEARCH) {
+      std::uniform_int_distribution<int> query(0, conf_->nsearch - 1);
+      Request *request = MakeSearchRequest(
+          search_vectors_ + (long)query(rng) * conf_->dimension, &rng);
+      Response *response = Search(engine_, request);
+      bool succ = GetSearchResult(response, 0)->result_num > 0;
+      DestroyRequest(request);
+      DestroyResponse(response);
+      return succ;
+    }
+
+    long key = 0;
+    if (type == OP_ADD) {
+      key = next_key_++;
+    } else {
+      if (next_key_ == 0) return false;
+      std::uniform_int_distribution<long> keys(0, next_key_ - 1);
+      key = keys(rng);
+    }
+    enum ResponseCode ret;
+    if (type == OP_DELETE) {
+      ByteArray *id = StringToByteArray(std::to_string(key));
+      ret = DelDoc(engine_, id);
+      DestroyByteArray(id);
+    } else {
+      Doc *doc = synthetic_->MakeSyntheticDoc(key, rng, WriteVector(key));
+      ret = AddOrUpdateDoc(engine_, doc);
+      DestroyDoc(doc);
+    }
+    return ret == SUCCESSED;
+  }
+
+  // written docs reuse the search vectors without synthetic data
+  const float *WriteVector(long key) {
+    if (conf_->synthetic) return nullptr;
+    return search_vectors_ + (key % conf_->nsearch) * conf_->dimension;
+  }
+
+  // latency percentiles of each interval and of the whole workload
+  string Report(std::vector<OpSample> &samples, double start, double end) {
+    double interval = conf_->report_interval * 1000.0;
+    int nwindows = std::ceil((end - start) / interval);
+    std::vector<Stat> windows(nwindows + 1);
+    Stat total;
+    total.start = start;
+    total.end = end;
+    for (int w = 0; w <= nwindows; w++) {
+      windows[w].start = start + w * interval;
+      windows[w].end = std::min(start + (w + 1) * interval, end);
+    }
+    for (OpSample &sample : samples) {
+      // operations finished after the end are in the last window
+      int w = std::min((int)((sample.end - start) / interval), nwindows);
+      for (Stat *stat : {&windows[w], &total}) {
+        stat->costs.push_back(sample.latency);
+        if (sample.succ) {
+          stat->nsucc++;
+        } else {
+          stat->nfail++;
+        }
+      }
+    }
+
+    stringstream ss;
+    for (int w = 0; w <= nwindows; w++) {
+      if (windows[w].costs.empty()) continue;
+      windows[w].Analyze();
+      ss << "  [" << (long)(windows[w].start - start) / 1000 << "s, ";
+      if (w == nwindows) {
+        ss << "drain] ";
+      } else {
+        ss << (long)(windows[w].end - start) / 1000 << "s) ";
+      }
+      ss << windows[w].PercentileString() << "\n";
+    }
+    total.Analyze();
+    ss << "  total " << total.PercentileString() << "\n";
+    return ss.str();
+  }
+
  private:
   int CreateTable() {
     ByteArray *table_name = MakeByteArray("test_table", 4);
     FieldInfo **field_infos = MakeFieldInfos(conf_->fields_vec.size());
 
     for (size_t i = 0; i < conf_->fields_vec.size(); ++i) {
-      char is_index = 0;
+      char is_index = conf_->fields_index[i];
       FieldInfo *field_info =
           MakeFieldInfo(StringToByteArray(conf_->fields_vec[i]),
                         conf_->fields_type[i], is_index);
@@ -402,22 +857,36 @@ class GammaPerfTest {
     VectorInfo *vector_info =
         MakeVectorInfo(StringToByteArray(conf_->vector_name), FLOAT, TRUE,
                        conf_->dimension, StringToByteArray(conf_->model_id),
-                       StringToByteArray(conf_->retrieval_type),
                        StringToByteArray(conf_->store_type),
                        StringToByteArray(conf_->store_param), FALSE);
     SetVectorInfo(vectors_info, 0, vector_info);
 
-    string param;
-    ByteArray *retrieve_param = MakeByteArray(param.c_str(), param.size());
-    
+    stringstream param;
+    param << "{\"nprobe\" : " << conf_->nprobe << ", \"metric_type\" : \""
+          << conf_->metric_type << "\", \"ncentroids\" : " << conf_->ncentroids
+          << ", \"nsubvector\" : " << conf_->nsubvector << "}";
+    ByteArray *retrieve_param = StringToByteArray(param.str());
+
     Table *table = MakeTable(table_name, field_infos, conf_->fields_vec.size(),
-                             vectors_info, 1, retrieve_param);
+                             vectors_info, 1,
+                             StringToByteArray(conf_->retrieval_type),
+                             retrieve_param, 0);
     enum ResponseCode ret = ::CreateTable(engine_, table);
     DestroyTable(table);
     return ret;
   }
 
   int AddDoc() {
+    if (conf_->synthetic) {
+      std::mt19937 rng(conf_->seed);
+      for (int i = 0; i < conf_->nadd; ++i) {
+        Doc *doc = synthetic_->MakeSyntheticDoc(next_key_++, rng, nullptr);
+        AddOrUpdateDoc(engine_, doc);
+        DestroyDoc(doc);
+      }
+      return 0;
+    }
+
     std::ifstream fin;
     fin.open(conf_->add_profile_file.c_str());
     std::string str;
@@ -473,6 +942,7 @@ class GammaPerfTest {
       AddOrUpdateDoc(engine_, doc);
       DestroyDoc(doc);
     }
+    next_key_ = conf_->nadd;
     delete[] vector;
     fclose(fet_fp);
     fin.close();
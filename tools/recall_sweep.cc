@@ -0,0 +1,659 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <sys/sysinfo.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gamma_api.h"
+#include "gamma_index_flat.h"
+#include "gamma_index_hnsw.h"
+#include "faiss/IndexFlat.h"
+#include "gamma_index_ivfpq.h"
+#include "log.h"
+#include "raw_vector_factory.h"
+#include "utils.h"
+
+/**
+ * Sweep the search parameters of each retrieval model, and report the recalls
+ * at 1, 10 and 100 against qps and tp99. The ground truth is computed by the
+ * flat index exactly.
+ *
+ * The dataset is loaded from fvecs or bvecs files, for example SIFT1M of
+ *
+ *   http://corpus-texmex.irisa.fr/
+ *
+ * or generated as gaussian clusters if there isn't a base file.
+ **/
+
+using namespace std;
+using namespace tig_gamma;
+
+namespace test {
+
+// get an int array of conf, a single int is also accepted
+int GetIntList(utils::JsonParser &jp, const string &name, vector<int> &values) {
+  cJSON *item = cJSON_GetObjectItem(jp.content_, name.c_str());
+  if (item == nullptr) return 0;
+  if (cJSON_IsNumber(item)) {
+    values.assign(1, item->valueint);
+    return 0;
+  }
+  if (not cJSON_IsArray(item)) {
+    LOG(ERROR) << name << " should be an int array";
+    return -1;
+  }
+  values.clear();
+  for (int i = 0; i < cJSON_GetArraySize(item); i++) {
+    cJSON *value = cJSON_GetArrayItem(item, i);
+    if (not cJSON_IsNumber(value)) {
+      LOG(ERROR) << name << " should be an int array";
+      return -1;
+    }
+    values.push_back(value->valueint);
+  }
+  return 0;
+}
+
+#define JPGETSTRING(name, value)                      \
+  {                                                   \
+    if (jp.Contains(name)) {                          \
+      if (jp.GetString(name, value)) {                \
+        LOG(ERROR) << "json get error name=" << name; \
+        return -1;                                    \
+      }                                               \
+    }                                                 \
+  }
+
+#define JPGETINT(name, value)                         \
+  {                                                   \
+    if (jp.Contains(name)) {                          \
+      double v = 0.0f;                                \
+      if (jp.GetDouble(name, v)) {                    \
+        LOG(ERROR) << "json get error name=" << name; \
+        return -1;                                    \
+      }                                               \
+      value = v;                                      \
+    }                                                 \
+  }
+
+#define JPGETINTLIST(name, value)                     \
+  {                                                   \
+    if (GetIntList(jp, name, value)) {                \
+      LOG(ERROR) << "json get error name=" << name; \
+      return -1;                                      \
+    }                                                 \
+  }
+
+struct SweepConf {
+  SweepConf() {
+    dimension = 128;
+    nb = 100000;
+    nq = 1000;
+    nclusters = 100;
+    cluster_std = 0.1;
+    topn = 100;
+    search_threads = 1;
+    batch_size = 16;
+    ncentroids = 256;
+    nsubvector = 32;
+    nlinks = 32;
+    ef_construction = 40;
+    models = {"IVFPQ", "HNSW", "FLAT"};
+    nprobe = {1, 5, 10, 20, 40, 80};
+    recall_num = {100, 200, 400};
+    has_rank = {0, 1};
+    ef_search = {16, 32, 64, 128, 256};
+    parallel_based_on_query = {0};
+    root_path = "sweep_files";
+  }
+
+  int Parse(string &conf_path) {
+    long file_size = utils::get_file_size(conf_path.c_str());
+    if (file_size <= 0) {
+      LOG(ERROR) << "conf file error: " << conf_path;
+      return -1;
+    }
+    std::unique_ptr<char[]> data(new char[file_size + 1]);
+    utils::FileIO conf_file(conf_path);
+    conf_file.Open("r");
+    conf_file.Read(data.get(), 1, file_size);
+    data[file_size] = '\0';
+
+    utils::JsonParser jp;
+    if (jp.Parse(data.get())) {
+      LOG(ERROR) << "json parse error: " << conf_path << ", len=" << file_size
+                 << ", content=" << data.get();
+      return -1;
+    }
+
+    JPGETSTRING("base_file", base_file);
+    JPGETSTRING("query_file", query_file);
+    JPGETSTRING("output_file", output_file);
+    JPGETSTRING("root_path", root_path);
+    JPGETINT("dimension", dimension);
+    JPGETINT("nb", nb);
+    JPGETINT("nq", nq);
+    JPGETINT("nclusters", nclusters);
+    JPGETINT("cluster_std", cluster_std);
+    JPGETINT("topn", topn);
+    JPGETINT("search_threads", search_threads);
+    JPGETINT("batch_size", batch_size);
+    JPGETINT("ncentroids", ncentroids);
+    JPGETINT("nsubvector", nsubvector);
+    JPGETINT("nlinks", nlinks);
+    JPGETINT("ef_construction", ef_construction);
+    JPGETINTLIST("nprobe", nprobe);
+    JPGETINTLIST("recall_num", recall_num);
+    JPGETINTLIST("has_rank", has_rank);
+    JPGETINTLIST("ef_search", ef_search);
+    JPGETINTLIST("parallel_based_on_query", parallel_based_on_query);
+
+    cJSON *models_json = cJSON_GetObjectItem(jp.content_, "models");
+    if (models_json != nullptr) {
+      models.clear();
+      for (int i = 0; i < cJSON_GetArraySize(models_json); i++) {
+        cJSON *model = cJSON_GetArrayItem(models_json, i);
+        if (not cJSON_IsString(model)) {
+          LOG(ERROR) << "models should be a string array";
+          return -1;
+        }
+        models.push_back(model->valuestring);
+      }
+    }
+
+    if (base_file != "" && query_file == "") {
+      LOG(ERROR) << "query_file is needed with base_file";
+      return -1;
+    }
+    if (topn < 100) {
+      LOG(ERROR) << "topn should be at least 100 for recall@100";
+      return -1;
+    }
+    LOG(INFO) << "base_file=" << base_file << ", query_file=" << query_file
+              << ", dimension=" << dimension << ", nb=" << nb
+              << ", nq=" << nq << ", nclusters=" << nclusters
+              << ", cluster_std=" << cluster_std << ", topn=" << topn
+              << ", search_threads=" << search_threads
+              << ", models=" << utils::join(models, ',');
+    return 0;
+  }
+
+  string base_file;
+  string query_file;
+  string output_file;
+  string root_path;
+  int dimension;
+  int nb;
+  int nq;
+  int nclusters;
+  double cluster_std;
+  int topn;
+  int search_threads;
+  int batch_size;
+  int ncentroids;
+  int nsubvector;
+  int nlinks;
+  int ef_construction;
+  vector<string> models;
+  vector<int> nprobe;
+  vector<int> recall_num;
+  vector<int> has_rank;
+  vector<int> ef_search;
+  vector<int> parallel_based_on_query;
+};
+
+/** read at most n vectors of fvecs or bvecs file, each vector is stored as
+ * its dimension(int) and its values(float or uint8)
+ *
+ * @return the number of vectors read, -1 if failed
+ */
+int ReadVecs(const string &path, int n, int &d, vector<float> &vecs) {
+  bool is_bvecs = path.size() > 6 && path.substr(path.size() - 6) == ".bvecs";
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (fp == nullptr) {
+    LOG(ERROR) << "open error: " << path;
+    return -1;
+  }
+  int num = 0;
+  vector<uint8_t> bytes;
+  int dim = 0;
+  while (num < n && fread(&dim, sizeof(dim), 1, fp) == 1) {
+    if (num == 0) {
+      d = dim;
+      vecs.reserve((long)n * d);
+      bytes.resize(d);
+    } else if (dim != d) {
+      LOG(ERROR) << "dimension of vector " << num << " is " << dim
+                 << ", expected " << d;
+      fclose(fp);
+      return -1;
+    }
+    size_t size = vecs.size();
+    vecs.resize(size + d);
+    size_t nread = is_bvecs ? fread(bytes.data(), 1, d, fp)
+                            : fread(vecs.data() + size, sizeof(float), d, fp);
+    if (nread != (size_t)d) {
+      LOG(ERROR) << "read vector " << num << " error";
+      fclose(fp);
+      return -1;
+    }
+    if (is_bvecs) {
+      for (int i = 0; i < d; i++) vecs[size + i] = bytes[i];
+    }
+    num++;
+  }
+  fclose(fp);
+  return num;
+}
+
+/** n vectors of gaussian clusters, centers are uniform in [0, 1)^d, base and
+ * queries are drawn from the same clusters with different seeds
+ */
+void GaussianClusters(int n, int d, int nclusters, double stddev,
+                      uint32_t seed, vector<float> &vecs) {
+  std::mt19937 center_gen(1234);
+  std::uniform_real_distribution<float> uniform(0, 1);
+  vector<float> centers((long)nclusters * d);
+  for (float &c : centers) c = uniform(center_gen);
+
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> cluster(0, nclusters - 1);
+  std::normal_distribution<float> noise(0, stddev);
+  vecs.resize((long)n * d);
+  for (int i = 0; i < n; i++) {
+    const float *center = centers.data() + (long)cluster(gen) * d;
+    for (int j = 0; j < d; j++) {
+      vecs[(long)i * d + j] = center[j] + noise(gen);
+    }
+  }
+}
+
+// one point of the sweep
+struct SweepResult {
+  string model;
+  string params;
+  double recalls[3];  // at 1, 10 and 100
+  double qps;
+  double avg_latency;
+  double tp99;
+
+  string ToJson() {
+    stringstream ss;
+    ss << "{\"model\":\"" << model << "\",\"params\":{" << params
+       << "},\"recall@1\":" << recalls[0] << ",\"recall@10\":" << recalls[1]
+       << ",\"recall@100\":" << recalls[2] << ",\"qps\":" << qps
+       << ",\"avg_latency_ms\":" << avg_latency << ",\"tp99_ms\":" << tp99
+       << "}";
+    return ss.str();
+  }
+
+  string ToString() {
+    stringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(4);
+    ss << model << " " << params << ": R@1=" << recalls[0]
+       << ", R@10=" << recalls[1] << ", R@100=" << recalls[2];
+    ss.precision(2);
+    ss << ", qps=" << qps << ", average latency=" << avg_latency
+       << "ms, tp99=" << tp99 << "ms";
+    return ss.str();
+  }
+};
+
+/** searches n queries of x, results are written to distances and labels of
+ * n * topn
+ */
+typedef std::function<void(int n, const float *x,
+                           GammaSearchCondition *condition, float *distances,
+                           idx_t *labels, int *total)>
+    SearchFunc;
+
+class RecallSweep {
+ public:
+  explicit RecallSweep(SweepConf *conf)
+      : conf_(conf), docids_bitmap_(nullptr) {}
+
+  ~RecallSweep() {
+    indexes_.clear();
+    raw_vec_.reset();
+    if (docids_bitmap_) free(docids_bitmap_);
+  }
+
+  int Init() {
+    if (LoadData()) return -1;
+
+    utils::remove_dir(conf_->root_path.c_str());
+    utils::make_dir(conf_->root_path.c_str());
+    int bytes_count = 0;
+    if (bitmap::create(docids_bitmap_, bytes_count, conf_->nb)) {
+      LOG(ERROR) << "create bitmap error";
+      return -1;
+    }
+
+    raw_vec_.reset(RawVectorFactory::Create(
+        Mmap, "sweep", conf_->dimension, conf_->nb, conf_->root_path, ""));
+    if (raw_vec_ == nullptr || raw_vec_->Init(false, false)) {
+      LOG(ERROR) << "init raw vector error";
+      return -1;
+    }
+    vector<int> docids(conf_->nb);
+    vector<Field> fields(conf_->nb);
+    vector<Field *> pfields(conf_->nb);
+    for (int i = 0; i < conf_->nb; i++) {
+      docids[i] = i;
+      fields[i].name = nullptr;
+      fields[i].value = MakeByteArray(
+          reinterpret_cast<const char *>(base_.data() + (long)i * d()),
+          d() * sizeof(float));
+      fields[i].source = nullptr;
+      fields[i].data_type = VECTOR;
+      pfields[i] = &fields[i];
+    }
+    int ret = raw_vec_->Add(docids, pfields);
+    for (Field &field : fields) DestroyByteArray(field.value);
+    if (ret) {
+      LOG(ERROR) << "add vectors error, ret=" << ret;
+      return -1;
+    }
+    vector<float>().swap(base_);
+
+    return GroundTruth();
+  }
+
+  int Run() {
+    for (const string &model : conf_->models) {
+      if (model == "IVFPQ") {
+        SweepIVFPQ();
+      } else if (model == "HNSW") {
+        SweepHNSW();
+      } else if (model == "FLAT") {
+        SweepFLAT();
+      } else {
+        LOG(ERROR) << "unsupported model " << model;
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  void GetResult(string &result) {
+    stringstream ss;
+    ss << "------------------Recall sweep----------------\n";
+    for (SweepResult &r : results_) ss << r.ToString() << "\n";
+    ss << "----------------------------------------------\n";
+    result = ss.str();
+  }
+
+  int Output() {
+    if (conf_->output_file == "") return 0;
+    std::ofstream out(conf_->output_file);
+    if (not out.is_open()) {
+      LOG(ERROR) << "open output file error: " << conf_->output_file;
+      return -1;
+    }
+    for (SweepResult &r : results_) out << r.ToJson() << "\n";
+    return 0;
+  }
+
+ private:
+  int d() { return conf_->dimension; }
+
+  int LoadData() {
+    if (conf_->base_file == "") {
+      GaussianClusters(conf_->nb, d(), conf_->nclusters, conf_->cluster_std,
+                       1, base_);
+      GaussianClusters(conf_->nq, d(), conf_->nclusters, conf_->cluster_std,
+                       2, queries_);
+      return 0;
+    }
+    int nb = ReadVecs(conf_->base_file, conf_->nb, conf_->dimension, base_);
+    int qd = 0;
+    int nq = ReadVecs(conf_->query_file, conf_->nq, qd, queries_);
+    if (nb <= 0 || nq <= 0 || qd != d()) {
+      LOG(ERROR) << "load dataset error, nb=" << nb << ", nq=" << nq
+                 << ", dimension=" << d() << ", query dimension=" << qd;
+      return -1;
+    }
+    conf_->nb = nb;
+    conf_->nq = nq;
+    return 0;
+  }
+
+  // exact topn of each query
+  int GroundTruth() {
+    double start = utils::getmillisecs();
+    GammaFLATIndex flat(d(), docids_bitmap_, raw_vec_.get());
+    GammaSearchCondition condition;
+    condition.topn = conf_->topn;
+    condition.metric_type = L2;
+    vector<float> distances((long)conf_->nq * conf_->topn);
+    gt_.resize((long)conf_->nq * conf_->topn);
+    vector<int> total(conf_->nq, 0);
+    flat.SearchDirectly(conf_->nq, queries_.data(), &condition,
+                        distances.data(), gt_.data(), total.data());
+    LOG(INFO) << "ground truth is computed, cost "
+              << utils::getmillisecs() - start << "ms";
+    return 0;
+  }
+
+  void SweepIVFPQ() {
+    faiss::IndexFlatL2 *quantizer = new faiss::IndexFlatL2(d());
+    GammaIVFPQIndex *index = new GammaIVFPQIndex(
+        quantizer, d(), conf_->ncentroids, conf_->nsubvector, 8,
+        docids_bitmap_, raw_vec_.get(), nullptr);
+    indexes_.emplace_back(index);
+    if (Build(index)) return;
+
+    SearchFunc search = [index](int n, const float *x,
+                                GammaSearchCondition *condition,
+                                float *distances, idx_t *labels, int *total) {
+      index->SearchIVFPQ(n, x, condition, distances, labels, total);
+    };
+    for (int nprobe : conf_->nprobe) {
+      for (int has_rank : conf_->has_rank) {
+        // recall_num is topn without rank
+        vector<int> recall_nums =
+            has_rank ? conf_->recall_num : vector<int>(1, conf_->topn);
+        for (int recall_num : recall_nums) {
+          if (recall_num < conf_->topn) continue;
+          for (int by_query : conf_->parallel_based_on_query) {
+            GammaSearchCondition condition;
+            condition.nprobe = nprobe;
+            condition.has_rank = has_rank;
+            condition.recall_num = recall_num;
+            condition.parallel_based_on_query = by_query;
+            stringstream params;
+            params << "\"nprobe\":" << nprobe << ",\"has_rank\":" << has_rank
+                   << ",\"recall_num\":" << recall_num
+                   << ",\"parallel_based_on_query\":" << by_query;
+            Measure("IVFPQ", params.str(), search, condition);
+          }
+        }
+      }
+    }
+  }
+
+  void SweepHNSW() {
+    GammaHNSWFlatIndex *index = new GammaHNSWFlatIndex(
+        d(), L2, conf_->nlinks, conf_->ef_search[0], conf_->ef_construction,
+        docids_bitmap_, raw_vec_.get());
+    indexes_.emplace_back(index);
+    if (Build(index)) return;
+
+    SearchFunc search = [index](int n, const float *x,
+                                GammaSearchCondition *condition,
+                                float *distances, idx_t *labels, int *total) {
+      index->SearchHNSW(n, x, condition, distances, labels, total);
+    };
+    for (int ef_search : conf_->ef_search) {
+      index->gamma_hnsw_.efSearch = ef_search;
+      for (int by_query : conf_->parallel_based_on_query) {
+        GammaSearchCondition condition;
+        condition.parallel_based_on_query = by_query;
+        stringstream params;
+        params << "\"ef_search\":" << ef_search
+               << ",\"parallel_based_on_query\":" << by_query;
+        Measure("HNSW", params.str(), search, condition);
+      }
+    }
+  }
+
+  void SweepFLAT() {
+    GammaFLATIndex *index =
+        new GammaFLATIndex(d(), docids_bitmap_, raw_vec_.get());
+    indexes_.emplace_back(index);
+
+    SearchFunc search = [index](int n, const float *x,
+                                GammaSearchCondition *condition,
+                                float *distances, idx_t *labels, int *total) {
+      index->SearchDirectly(n, x, condition, distances, labels, total);
+    };
+    for (int by_query : conf_->parallel_based_on_query) {
+      GammaSearchCondition condition;
+      condition.parallel_based_on_query = by_query;
+      condition.parallel_mode = by_query ? 0 : 1;
+      stringstream params;
+      params << "\"parallel_based_on_query\":" << by_query;
+      Measure("FLAT", params.str(), search, condition);
+    }
+  }
+
+  int Build(GammaIndex *index) {
+    double start = utils::getmillisecs();
+    if (index->Indexing() || index->AddRTVecsToIndex()) {
+      LOG(ERROR) << "build index error";
+      return -1;
+    }
+    LOG(INFO) << "index is built, cost " << utils::getmillisecs() - start
+              << "ms";
+    return 0;
+  }
+
+  /** search all queries by search_threads threads, a thread searches
+   * batch_size queries at a time if parallel_based_on_query, otherwise one
+   * query at a time
+   */
+  void Measure(const string &model, const string &params,
+               const SearchFunc &search,
+               const GammaSearchCondition &base_condition) {
+    const int nq = conf_->nq;
+    const int topn = conf_->topn;
+    const int batch =
+        base_condition.parallel_based_on_query ? conf_->batch_size : 1;
+    vector<float> distances((long)nq * topn);
+    vector<idx_t> labels((long)nq * topn);
+    vector<double> latencies(nq);
+    std::atomic<int> next(0);
+
+    auto runner = [&]() {
+      GammaSearchCondition condition(
+          const_cast<GammaSearchCondition *>(&base_condition));
+      // it isn't copied by the constructor
+      condition.parallel_based_on_query =
+          base_condition.parallel_based_on_query;
+      condition.topn = topn;
+      condition.metric_type = L2;
+      if (condition.recall_num < topn) condition.recall_num = topn;
+      vector<int> total(batch);
+      int begin = 0;
+      while ((begin = next.fetch_add(batch)) < nq) {
+        int n = std::min(batch, nq - begin);
+        std::fill(total.begin(), total.end(), 0);
+        double start = utils::getmillisecs();
+        search(n, queries_.data() + (long)begin * d(), &condition,
+               distances.data() + (long)begin * topn,
+               labels.data() + (long)begin * topn, total.data());
+        double cost = utils::getmillisecs() - start;
+        for (int i = begin; i < begin + n; i++) latencies[i] = cost;
+      }
+    };
+
+    double start = utils::getmillisecs();
+    vector<std::thread> threads;
+    for (int i = 0; i < conf_->search_threads; i++) threads.emplace_back(runner);
+    for (std::thread &t : threads) t.join();
+    double secs = (utils::getmillisecs() - start) / 1000;
+
+    SweepResult result;
+    result.model = model;
+    result.params = params;
+    Recalls(labels, result.recalls);
+    result.qps = secs > 0 ? nq / secs : 0;
+    result.avg_latency =
+        std::accumulate(latencies.begin(), latencies.end(), 0.0) / nq;
+    std::sort(latencies.begin(), latencies.end());
+    result.tp99 = latencies[(int)(nq * 0.99)];
+    LOG(INFO) << result.ToString();
+    results_.push_back(result);
+  }
+
+  /** recall at k is the proportion of queries of which the nearest neighbor
+   * is in the first k results
+   */
+  void Recalls(const vector<idx_t> &labels, double *recalls) {
+    const int ks[3] = {1, 10, 100};
+    const int topn = conf_->topn;
+    for (int r = 0; r < 3; r++) {
+      int hits = 0;
+      for (int i = 0; i < conf_->nq; i++) {
+        idx_t nn = gt_[(long)i * topn];
+        const idx_t *result = labels.data() + (long)i * topn;
+        if (std::find(result, result + ks[r], nn) != result + ks[r]) hits++;
+      }
+      recalls[r] = (double)hits / conf_->nq;
+    }
+  }
+
+  SweepConf *conf_;
+  char *docids_bitmap_;
+  vector<float> base_;
+  vector<float> queries_;
+  vector<idx_t> gt_;
+  std::unique_ptr<RawVector<float>> raw_vec_;
+  vector<std::unique_ptr<GammaIndex>> indexes_;
+  vector<SweepResult> results_;
+};
+
+}  // namespace test
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    cerr << "Usage: " << argv[0] << " conf_path" << endl;
+    return -1;
+  }
+
+  string conf_path = argv[1];
+  LOG(INFO) << "recall sweep conf path=" << conf_path
+            << ", processors=" << get_nprocs();
+  test::SweepConf conf;
+  if (conf.Parse(conf_path)) {
+    LOG(ERROR) << "parse conf error";
+    return -1;
+  }
+  test::RecallSweep sweep(&conf);
+  if (sweep.Init()) {
+    LOG(ERROR) << "init error";
+    return -1;
+  }
+  sweep.Run();
+  string result;
+  sweep.GetResult(result);
+  LOG(INFO) << result;
+  return sweep.Output();
+}
@@ -0,0 +1,319 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include <sys/sysinfo.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gamma_api.h"
+#include "log.h"
+#include "request_recorder.h"
+#include "utils.h"
+
+/**
+ * Replay a request log recorded by StartRecording() against an engine
+ * snapshot, at the original speed or scaled, and compare the latencies with
+ * the recorded ones.
+ *
+ * The writes of the log change the snapshot, so replay a copy of it.
+ **/
+
+using namespace std;
+using tig_gamma::RecordType;
+using tig_gamma::RecordedRequest;
+
+namespace test {
+
+#define JPGETSTRING(name, value)                      \
+  {                                                   \
+    if (jp.Contains(name)) {                          \
+      if (jp.GetString(name, value)) {                \
+        LOG(ERROR) << "json get error name=" << name; \
+        return -1;                                    \
+      }                                               \
+    }                                                 \
+  }
+
+#define JPGETDOUBLE(name, value)                      \
+  {                                                   \
+    if (jp.Contains(name)) {                          \
+      if (jp.GetDouble(name, value)) {                \
+        LOG(ERROR) << "json get error name=" << name; \
+        return -1;                                    \
+      }                                               \
+    }                                                 \
+  }
+
+#define JPGETINT(name, value)                         \
+  {                                                   \
+    if (jp.Contains(name)) {                          \
+      double v = 0.0f;                                \
+      if (jp.GetDouble(name, v)) {                    \
+        LOG(ERROR) << "json get error name=" << name; \
+        return -1;                                    \
+      }                                               \
+      value = (int)v;                                 \
+    }                                                 \
+  }
+
+struct ReplayConf {
+  ReplayConf() {
+    max_doc_size = 10000 * 200;
+    speed = 1;
+    threads = 16;
+    writes = 1;
+  }
+
+  int Parse(string &conf_path) {
+    long file_size = utils::get_file_size(conf_path.c_str());
+    if (file_size <= 0) {
+      LOG(ERROR) << "conf file error: " << conf_path;
+      return -1;
+    }
+    std::unique_ptr<char[]> data(new char[file_size + 1]);
+    utils::FileIO conf_file(conf_path);
+    conf_file.Open("r");
+    conf_file.Read(data.get(), 1, file_size);
+    data[file_size] = '\0';
+
+    utils::JsonParser jp;
+    if (jp.Parse(data.get())) {
+      LOG(ERROR) << "json parse error: " << conf_path << ", len=" << file_size
+                 << ", content=" << data.get();
+      return -1;
+    }
+
+    JPGETSTRING("root_path", root_path);
+    JPGETSTRING("log_file", log_file);
+    JPGETINT("max_doc_size", max_doc_size);
+    JPGETDOUBLE("speed", speed);
+    JPGETINT("threads", threads);
+    JPGETINT("writes", writes);
+
+    if (root_path == "" || log_file == "") {
+      LOG(ERROR) << "root_path and log_file are needed";
+      return -1;
+    }
+    LOG(INFO) << "root_path=" << root_path << ", log_file=" << log_file
+              << ", max_doc_size=" << max_doc_size << ", speed=" << speed
+              << ", threads=" << threads << ", writes=" << writes;
+    return 0;
+  }
+
+  string root_path;
+  string log_file;
+  int max_doc_size;
+  double speed;  // 2 replays twice as fast, 0 as fast as possible
+  int threads;
+  int writes;  // whether to replay AddOrUpdateDoc and DelDoc
+};
+
+// latencies of a request type in milliseconds
+struct Latencies {
+  vector<float> costs;
+  int nfail = 0;
+
+  void Merge(Latencies &other) {
+    costs.insert(costs.end(), other.costs.begin(), other.costs.end());
+    nfail += other.nfail;
+  }
+
+  string ToString() {
+    if (costs.empty()) return "none";
+    std::sort(costs.begin(), costs.end());
+    float avg =
+        std::accumulate(costs.begin(), costs.end(), 0.0f) / costs.size();
+    stringstream ss;
+    ss << "num=" << costs.size() << ", average latency=" << avg
+       << "ms, tp50=" << costs[(int)(costs.size() * 0.5)]
+       << "ms, tp99=" << costs[(int)(costs.size() * 0.99)]
+       << "ms, tp999=" << costs[(int)(costs.size() * 0.999)]
+       << "ms, max=" << costs.back() << "ms, fail number=" << nfail;
+    return ss.str();
+  }
+};
+
+static const int kTypes = 3;
+static const char *kTypeNames[] = {"search", "add_or_update", "del"};
+
+class Replay {
+ public:
+  explicit Replay(ReplayConf *conf) : conf_(conf), engine_(nullptr), next_(0) {}
+
+  ~Replay() {
+    if (engine_) Close(engine_);
+  }
+
+  int Init() {
+    tig_gamma::RequestLogReader reader;
+    if (reader.Open(conf_->log_file)) return -1;
+    while (true) {
+      RecordedRequest *record = new RecordedRequest;
+      int ret = reader.Next(*record);
+      if (ret <= 0) {
+        delete record;
+        if (ret < 0) return -1;
+        break;
+      }
+      if (not conf_->writes && record->type != RecordType::SEARCH) {
+        delete record;
+        continue;
+      }
+      records_.emplace_back(record);
+    }
+    // records are written when the calls return
+    std::stable_sort(records_.begin(), records_.end(),
+                     [](const std::unique_ptr<RecordedRequest> &a,
+                        const std::unique_ptr<RecordedRequest> &b) {
+                       return a->timestamp < b->timestamp;
+                     });
+    LOG(INFO) << "read " << records_.size() << " requests";
+    if (records_.empty()) return -1;
+
+    Config *config = MakeConfig(MakeByteArray(conf_->root_path.c_str(),
+                                              conf_->root_path.size()),
+                                conf_->max_doc_size);
+    engine_ = ::Init(config);
+    DestroyConfig(config);
+    if (engine_ == nullptr || ::Load(engine_) != SUCCESSED) {
+      LOG(ERROR) << "load engine error, root_path=" << conf_->root_path;
+      return -1;
+    }
+    LOG(INFO) << "engine is loaded, docs num=" << GetDocsNum(engine_);
+    return 0;
+  }
+
+  /** requests are issued by their recorded timestamps scaled by speed
+   * regardless of the previous ones (open loop), and the latency counts from
+   * the scheduled time
+   */
+  int Run() {
+    vector<vector<Latencies>> latencies(conf_->threads,
+                                        vector<Latencies>(kTypes));
+    start_ = utils::getmillisecs();
+    vector<std::thread> threads;
+    for (int i = 0; i < conf_->threads; i++) {
+      threads.emplace_back(&Replay::Runner, this, &latencies[i]);
+    }
+    for (std::thread &t : threads) t.join();
+    double cost = utils::getmillisecs() - start_;
+
+    replayed_.assign(kTypes, Latencies());
+    recorded_.assign(kTypes, Latencies());
+    for (int i = 0; i < conf_->threads; i++) {
+      for (int type = 0; type < kTypes; type++) {
+        replayed_[type].Merge(latencies[i][type]);
+      }
+    }
+    for (std::unique_ptr<RecordedRequest> &record : records_) {
+      recorded_[(int)record->type - 1].costs.push_back(record->cost / 1000.0);
+    }
+    double span = records_.back()->timestamp / 1000.0;
+    stringstream ss;
+    ss << "replayed " << records_.size() << " requests in " << cost
+       << "ms, recorded in " << span << "ms";
+    summary_ = ss.str();
+    return 0;
+  }
+
+  void GetResult(string &result) {
+    stringstream ss;
+    ss << "------------------Replay---------------------\n";
+    ss << summary_ << "\n";
+    for (int type = 0; type < kTypes; type++) {
+      if (recorded_[type].costs.empty()) continue;
+      ss << kTypeNames[type] << "\n";
+      ss << "  recorded: " << recorded_[type].ToString() << "\n";
+      ss << "  replayed: " << replayed_[type].ToString() << "\n";
+    }
+    ss << "--------------------------------------------\n";
+    result = ss.str();
+  }
+
+ private:
+  static void Runner(Replay *t, vector<Latencies> *latencies) {
+    size_t i = 0;
+    while ((i = t->next_++) < t->records_.size()) {
+      RecordedRequest *record = t->records_[i].get();
+      double scheduled = utils::getmillisecs();
+      if (t->conf_->speed > 0) {
+        scheduled = t->start_ + record->timestamp / 1000.0 / t->conf_->speed;
+        double now = utils::getmillisecs();
+        if (scheduled > now) {
+          std::this_thread::sleep_for(
+              std::chrono::microseconds((long)((scheduled - now) * 1000)));
+        }
+      }
+      bool succ = t->Execute(record);
+      Latencies &l = (*latencies)[(int)record->type - 1];
+      l.costs.push_back(utils::getmillisecs() - scheduled);
+      if (not succ) l.nfail++;
+    }
+  }
+
+  bool Execute(RecordedRequest *record) {
+    switch (record->type) {
+      case RecordType::SEARCH: {
+        Response *response = Search(engine_, record->request);
+        bool succ = response != nullptr;
+        DestroyResponse(response);
+        return succ;
+      }
+      case RecordType::ADD_OR_UPDATE:
+        return AddOrUpdateDoc(engine_, record->doc) == SUCCESSED;
+      case RecordType::DEL:
+        return record->doc_id && DelDoc(engine_, record->doc_id) == SUCCESSED;
+    }
+    return false;
+  }
+
+  ReplayConf *conf_;
+  void *engine_;
+  vector<std::unique_ptr<RecordedRequest>> records_;
+  std::atomic<size_t> next_;
+  double start_;
+  vector<Latencies> recorded_;
+  vector<Latencies> replayed_;
+  string summary_;
+};
+
+}  // namespace test
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    cerr << "Usage: " << argv[0] << " conf_path" << endl;
+    return -1;
+  }
+
+  string conf_path = argv[1];
+  LOG(INFO) << "replay conf path=" << conf_path
+            << ", processors=" << get_nprocs();
+  test::ReplayConf conf;
+  if (conf.Parse(conf_path)) {
+    LOG(ERROR) << "parse conf error";
+    return -1;
+  }
+  test::Replay replay(&conf);
+  if (replay.Init()) {
+    LOG(ERROR) << "init error";
+    return -1;
+  }
+  replay.Run();
+  string result;
+  replay.GetResult(result);
+  LOG(INFO) << result;
+  return 0;
+}
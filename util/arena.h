@@ -0,0 +1,125 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef UTIL_ARENA_H_
+#define UTIL_ARENA_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace utils {
+
+/** bump allocator of one request, memory is allocated from large blocks and
+ * freed all together when the arena is destroyed. It isn't thread safe.
+ */
+class Arena {
+ public:
+  explicit Arena(size_t block_size = 8192)
+      : block_size_(block_size), ptr_(nullptr), remain_(0), bytes_(0) {}
+
+  ~Arena() {
+    for (char *block : blocks_) free(block);
+  }
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  /** @return memory aligned to 16 bytes, it is never null, even for 0
+   * bytes
+   */
+  char *Allocate(size_t bytes) {
+    bytes = bytes == 0 ? kAlign : (bytes + kAlign - 1) & ~(kAlign - 1);
+    if (bytes > remain_) {
+      // a large allocation has its own block, so the current one is kept
+      if (bytes > block_size_ / 4) return NewBlock(bytes);
+      ptr_ = NewBlock(block_size_);
+      remain_ = block_size_;
+    }
+    char *result = ptr_;
+    ptr_ += bytes;
+    remain_ -= bytes;
+    return result;
+  }
+
+  template <typename T>
+  T *AllocateArray(size_t n) {
+    return reinterpret_cast<T *>(Allocate(n * sizeof(T)));
+  }
+
+  char *Copy(const char *data, size_t len) {
+    char *result = Allocate(len);
+    if (len > 0) memcpy(result, data, len);
+    return result;
+  }
+
+  size_t MemoryBytes() const { return bytes_; }
+
+ private:
+  char *NewBlock(size_t bytes) {
+    char *block = static_cast<char *>(malloc(bytes));
+    if (block == nullptr) throw std::bad_alloc();
+    blocks_.push_back(block);
+    bytes_ += bytes;
+    return block;
+  }
+
+  static const size_t kAlign = 16;
+
+  size_t block_size_;
+  char *ptr_;
+  size_t remain_;
+  size_t bytes_;
+  std::vector<char *> blocks_;
+};
+
+/** STL allocator on an arena, deallocate is a no-op. It falls back to the
+ * heap if arena is null.
+ */
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+
+  explicit ArenaAllocator(Arena *arena) : arena_(arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) {}
+
+  T *allocate(size_t n) {
+    if (arena_ == nullptr) {
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+    return arena_->AllocateArray<T>(n);
+  }
+
+  void deallocate(T *p, size_t) {
+    if (arena_ == nullptr) ::operator delete(p);
+  }
+
+  Arena *arena() const { return arena_; }
+
+ private:
+  Arena *arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena() != b.arena();
+}
+
+}  // namespace utils
+
+#endif  // UTIL_ARENA_H_
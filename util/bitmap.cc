@@ -6,6 +6,7 @@
  */
 
 #include "bitmap.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -13,20 +14,29 @@ namespace bitmap {
 
 int create(char *&bitmap, int &bytes_count, int size) {
   bytes_count = (size >> 3) + 1;
-  bitmap = (char *)malloc(bytes_count);
+  // zeroed pages are mapped lazily, so a large bitmap costs its memory as
+  // the docs are added
+  bitmap = (char *)calloc(bytes_count, 1);
   if (!bitmap) {
     return -1;
   }
-  memset(bitmap, 0, bytes_count);
   return 0;
 }
 
-bool test(const char *bitmap, int id) {
-  return (bitmap[id >> 3] & (0x1 << (id & 0x7)));
+long count(const char *bitmap, int size) {
+  if (size <= 0) return 0;
+  long words = (long)size >> 6;
+  long num = 0;
+#pragma omp parallel for reduction(+ : num)
+  for (long i = 0; i < words; i++) {
+    uint64_t word;
+    memcpy(&word, bitmap + (i << 3), sizeof(word));
+    num += __builtin_popcountll(word);
+  }
+  for (int id = (int)(words << 6); id < size; id++) {
+    if (test(bitmap, id)) ++num;
+  }
+  return num;
 }
 
-void set(char *bitmap, int id) { bitmap[id >> 3] |= (0x1 << (id & 0x7)); }
-
-void unset(char *bitmap, int id) { bitmap[id >> 3] -= (0x1 << (id & 0x7)); }
-
 } // namespace bitmap
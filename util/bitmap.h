@@ -13,14 +13,24 @@ namespace bitmap {
 /* init a bitmap of which the total length is size */
 int create(char *&bitmap, int &bytes_count, int size);
 
-/* assume id not exceed the total size of bitmap */
-bool test(const char *bitmap, int id);
+/* assume id not exceed the total size of bitmap, inlined as it's called for
+ * every candidate of a search */
+inline bool test(const char *bitmap, int id) {
+  return (bitmap[id >> 3] & (0x1 << (id & 0x7)));
+}
 
 /* assume id not exceed the total size of bitmap */
-void set(char *bitmap, int id);
+inline void set(char *bitmap, int id) {
+  bitmap[id >> 3] |= (0x1 << (id & 0x7));
+}
 
 /* assume id not exceed the total size of bitmap */
-void unset(char *bitmap, int id);
+inline void unset(char *bitmap, int id) {
+  bitmap[id >> 3] -= (0x1 << (id & 0x7));
+}
+
+/* count the set bits in [0, size) by popcount */
+long count(const char *bitmap, int size);
 
 } // namespace bitmap
 
@@ -0,0 +1,118 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef UTIL_FP16_H_
+#define UTIL_FP16_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <cmath>
+
+#if defined(__AVX2__) && defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace utils {
+
+// IEEE half precision, rounded to nearest even
+inline uint16_t FloatToHalf(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000;
+  uint32_t abs = x & 0x7fffffff;
+  if (abs >= 0x7f800000) {  // inf or nan
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  }
+  if (abs >= 0x477ff000) return sign | 0x7c00;  // overflow
+  if (abs < 0x38800000) {                       // subnormal or zero
+    float v;
+    memcpy(&v, &abs, sizeof(v));
+    return sign | (uint16_t)std::nearbyint(v * 16777216.0f);  // v / 2^-24
+  }
+  uint32_t mant_odd = (abs >> 13) & 1;
+  abs += 0xc8000fff + mant_odd;  // rebias exponent and round
+  return sign | (abs >> 13);
+}
+
+inline float HalfToFloat(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t x;
+  if (exp == 0x1f) {
+    x = sign | 0x7f800000 | (mant << 13);
+  } else if (exp == 0) {
+    float v = mant / 16777216.0f;
+    memcpy(&x, &v, sizeof(x));
+    x |= sign;
+  } else {
+    x = sign | ((exp + 112) << 23) | (mant << 13);
+  }
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+inline void EncodeFP16(const float *x, uint16_t *y, size_t d) {
+  size_t i = 0;
+#if defined(__AVX2__) && defined(__F16C__)
+  for (; i + 8 <= d; i += 8) {
+    __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i *)(y + i), h);
+  }
+#endif
+  for (; i < d; i++) y[i] = FloatToHalf(x[i]);
+}
+
+#if defined(__AVX2__) && defined(__F16C__)
+inline float HorizontalSum(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_hadd_ps(s, s);
+  s = _mm_hadd_ps(s, s);
+  return _mm_cvtss_f32(s);
+}
+#endif
+
+// squared L2 distance between a float query and a half vector
+inline float L2SqrFP16(const float *x, const uint16_t *y, size_t d) {
+  float res = 0;
+  size_t i = 0;
+#if defined(__AVX2__) && defined(__F16C__)
+  __m256 sum = _mm256_setzero_ps();
+  for (; i + 8 <= d; i += 8) {
+    __m256 yv = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(y + i)));
+    __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(x + i), yv);
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
+  }
+  res = HorizontalSum(sum);
+#endif
+  for (; i < d; i++) {
+    float diff = x[i] - HalfToFloat(y[i]);
+    res += diff * diff;
+  }
+  return res;
+}
+
+inline float InnerProductFP16(const float *x, const uint16_t *y, size_t d) {
+  float res = 0;
+  size_t i = 0;
+#if defined(__AVX2__) && defined(__F16C__)
+  __m256 sum = _mm256_setzero_ps();
+  for (; i + 8 <= d; i += 8) {
+    __m256 yv = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(y + i)));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(x + i), yv));
+  }
+  res = HorizontalSum(sum);
+#endif
+  for (; i < d; i++) res += x[i] * HalfToFloat(y[i]);
+  return res;
+}
+
+}  // namespace utils
+
+#endif  // UTIL_FP16_H_
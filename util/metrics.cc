@@ -0,0 +1,139 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "metrics.h"
+
+#include "cJSON.h"
+
+namespace utils {
+
+namespace {
+
+const char *kStageNames[kStageNum] = {
+    "search_total", "search_filter", "search_vector", "search_pack",
+    "add_doc",      "add_docs",      "update_doc",    "del_doc",
+    "indexing",     "dump",          "compaction"};
+
+const char *kCounterNames[kCounterNum] = {
+    "queries",           "search_cache_hits", "codes_scanned",
+    "reranked_vectors",  "docs_written",      "compactions",
+    "flushes",           "compacted_codes",   "compacted_bytes"};
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : sum_(0), max_(0) {
+  for (int i = 0; i < kBuckets; i++) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+uint64_t LatencyHistogram::BucketLower(int bucket) {
+  const int kSub = 1 << kSubBits;
+  if (bucket < kSub) return bucket;
+  int msb = bucket / kSub + kSubBits - 1;
+  return (uint64_t)(kSub + bucket % kSub) << (msb - kSubBits);
+}
+
+uint64_t HistogramSnapshot::Percentile(double p) const {
+  if (count == 0) return 0;
+  uint64_t rank = (uint64_t)(p / 100 * count + 0.5);
+  if (rank < 1) rank = 1;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); i++) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      uint64_t lower = LatencyHistogram::BucketLower(i);
+      uint64_t upper = i + 1 < buckets.size()
+                           ? LatencyHistogram::BucketLower(i + 1)
+                           : lower + 1;
+      uint64_t value = (lower + upper) / 2;
+      return value < max ? value : max;
+    }
+  }
+  return max;
+}
+
+std::string MetricsSnapshot::ToJson() const {
+  cJSON *root = cJSON_CreateObject();
+  cJSON *stages_json = cJSON_AddObjectToObject(root, "stages");
+  for (int i = 0; i < kStageNum; i++) {
+    const HistogramSnapshot &h = stages[i];
+    cJSON *stage = cJSON_AddObjectToObject(
+        stages_json, Metrics::StageName(static_cast<MetricStage>(i)));
+    cJSON_AddNumberToObject(stage, "count", h.count);
+    cJSON_AddNumberToObject(stage, "mean_us",
+                            h.count > 0 ? (double)h.sum / h.count : 0);
+    cJSON_AddNumberToObject(stage, "p50_us", h.Percentile(50));
+    cJSON_AddNumberToObject(stage, "p90_us", h.Percentile(90));
+    cJSON_AddNumberToObject(stage, "p99_us", h.Percentile(99));
+    cJSON_AddNumberToObject(stage, "p999_us", h.Percentile(99.9));
+    cJSON_AddNumberToObject(stage, "max_us", h.max);
+  }
+  cJSON *counters_json = cJSON_AddObjectToObject(root, "counters");
+  for (int i = 0; i < kCounterNum; i++) {
+    cJSON_AddNumberToObject(
+        counters_json, Metrics::CounterName(static_cast<MetricCounter>(i)),
+        counters[i]);
+  }
+  char *str = cJSON_PrintUnformatted(root);
+  std::string json(str);
+  free(str);
+  cJSON_Delete(root);
+  return json;
+}
+
+Metrics::Shard::Shard() {
+  for (int i = 0; i < kCounterNum; i++) {
+    counters[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+Metrics::Metrics() {}
+
+Metrics &Metrics::Instance() {
+  static Metrics metrics;
+  return metrics;
+}
+
+int Metrics::ShardOf() {
+  static std::atomic<int> next_shard(0);
+  static thread_local int shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed) % kShards;
+  return shard;
+}
+
+void Metrics::Snapshot(MetricsSnapshot &snapshot) const {
+  for (int i = 0; i < kStageNum; i++) {
+    HistogramSnapshot &h = snapshot.stages[i];
+    h.count = h.sum = h.max = 0;
+    h.buckets.assign(LatencyHistogram::kBuckets, 0);
+    for (const Shard &shard : shards_) {
+      const LatencyHistogram &hist = shard.stages[i];
+      for (int b = 0; b < LatencyHistogram::kBuckets; b++) {
+        h.buckets[b] += hist.Bucket(b);
+      }
+      h.sum += hist.Sum();
+      if (hist.Max() > h.max) h.max = hist.Max();
+    }
+    // counted by buckets, so percentiles are consistent while recording
+    for (uint64_t n : h.buckets) h.count += n;
+  }
+  for (int i = 0; i < kCounterNum; i++) {
+    snapshot.counters[i] = 0;
+    for (const Shard &shard : shards_) {
+      snapshot.counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+const char *Metrics::StageName(MetricStage stage) { return kStageNames[stage]; }
+
+const char *Metrics::CounterName(MetricCounter counter) {
+  return kCounterNames[counter];
+}
+
+}  // namespace utils
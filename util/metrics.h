@@ -0,0 +1,189 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef UTIL_METRICS_H_
+#define UTIL_METRICS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace utils {
+
+// stages whose latency is recorded
+enum MetricStage {
+  kStageSearchTotal = 0,
+  kStageSearchFilter,
+  kStageSearchVector,
+  kStageSearchPack,
+  kStageAddDoc,
+  kStageAddDocs,
+  kStageUpdateDoc,
+  kStageDelDoc,
+  kStageIndexing,
+  kStageDump,
+  kStageCompaction,
+  kStageNum
+};
+
+enum MetricCounter {
+  kCounterQueries = 0,
+  kCounterSearchCacheHits,
+  kCounterCodesScanned,
+  kCounterReranked,
+  kCounterDocsWritten,
+  kCounterCompactions,
+  kCounterFlushes,
+  kCounterCompactedCodes,
+  kCounterCompactedBytes,
+  kCounterNum
+};
+
+/** log-linear histogram of microseconds like HDR histogram, a power of 2 is
+ * split into 8 buckets, so the relative error is at most 12.5%. Recording is
+ * lock free.
+ */
+class LatencyHistogram {
+ public:
+  static const int kSubBits = 3;
+  static const int kBuckets = 256;
+
+  LatencyHistogram();
+
+  void Record(uint64_t us) {
+    buckets_[BucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(us, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (us > max && not max_.compare_exchange_weak(
+                           max, us, std::memory_order_relaxed)) {
+    }
+  }
+
+  static int BucketOf(uint64_t us) {
+    const uint64_t kSub = 1 << kSubBits;
+    if (us < kSub) return us;
+    int msb = 63 - __builtin_clzl(us);
+    int bucket = (msb - kSubBits + 1) * kSub +
+                 ((us >> (msb - kSubBits)) & (kSub - 1));
+    return bucket < kBuckets ? bucket : kBuckets - 1;
+  }
+
+  // the least value of a bucket
+  static uint64_t BucketLower(int bucket);
+
+  uint64_t Sum() const { return sum_.load(std::memory_order_relaxed); }
+
+  uint64_t Max() const { return max_.load(std::memory_order_relaxed); }
+
+  uint64_t Bucket(int i) const {
+    return buckets_[i].load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> buckets_[kBuckets];
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+};
+
+// histogram merged from all threads
+struct HistogramSnapshot {
+  HistogramSnapshot() : count(0), sum(0), max(0) {}
+
+  /** @param p in (0, 100]
+   * @return the value at percentile p in microseconds, it's the middle of
+   * its bucket
+   */
+  uint64_t Percentile(double p) const;
+
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  std::vector<uint64_t> buckets;
+};
+
+struct MetricsSnapshot {
+  HistogramSnapshot stages[kStageNum];
+  uint64_t counters[kCounterNum];
+
+  // as json
+  std::string ToJson() const;
+};
+
+/** always on metrics of the process, it's cheap enough for production.
+ * Threads write to their own shards without locking, shards are merged when
+ * a snapshot is taken.
+ */
+class Metrics {
+ public:
+  static Metrics &Instance();
+
+  void Record(MetricStage stage, uint64_t us) {
+    shards_[ShardOf()].stages[stage].Record(us);
+  }
+
+  void Add(MetricCounter counter, uint64_t n = 1) {
+    shards_[ShardOf()].counters[counter].fetch_add(n,
+                                                   std::memory_order_relaxed);
+  }
+
+  void Snapshot(MetricsSnapshot &snapshot) const;
+
+  static const char *StageName(MetricStage stage);
+
+  static const char *CounterName(MetricCounter counter);
+
+ private:
+  Metrics();
+
+  static const int kShards = 16;
+
+  // aligned, so threads don't share cache lines
+  struct alignas(64) Shard {
+    Shard();
+
+    LatencyHistogram stages[kStageNum];
+    std::atomic<uint64_t> counters[kCounterNum];
+  };
+
+  static int ShardOf();
+
+  Shard shards_[kShards];
+};
+
+/** records the time from construction to Stop() or destruction */
+class StageTimer {
+ public:
+  explicit StageTimer(MetricStage stage)
+      : stage_(stage), start_(std::chrono::steady_clock::now()) {}
+
+  ~StageTimer() { Stop(); }
+
+  // @return elapsed microseconds, 0 if it's stopped
+  uint64_t Stop() {
+    if (stage_ == kStageNum) return 0;
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start_)
+                      .count();
+    Metrics::Instance().Record(stage_, us);
+    stage_ = kStageNum;
+    return us;
+  }
+
+  // stop without recording
+  void Discard() { stage_ = kStageNum; }
+
+ private:
+  MetricStage stage_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace utils
+
+#endif  // UTIL_METRICS_H_
@@ -9,6 +9,7 @@
 #define SRC_SEARCHER_UTIL_ONLINE_LOGGER_H_
 
 #include "log_stream.h"
+#include "query_trace.h"
 
 using framework::LogStream;
 
@@ -27,14 +28,24 @@ namespace utils {
  */
 class OnlineLogger {
 public:
-  OnlineLogger() : log_stream_(nullptr) {}
+  OnlineLogger() : log_stream_(nullptr), trace_(nullptr) {}
 
   ~OnlineLogger() {
     delete log_stream_;
     log_stream_ = nullptr;
+    delete trace_;
+    trace_ = nullptr;
   }
 
+  // level "trace" logs as "debug" and records a QueryTrace
   int Init(const std::string &log_level_str) {
+    if (strcasecmp(log_level_str.c_str(), "trace") == 0) {
+      trace_ = new (std::nothrow) QueryTrace();
+      if (trace_ == nullptr) {
+        return -1;
+      }
+      return Init("debug");
+    }
     auto log_level = LogStream::GetLevel(log_level_str.c_str());
     if (log_level != LogStream::LOG_NONE) {
       log_stream_ = new (std::nothrow) LogStream();
@@ -64,8 +75,22 @@ public:
     return log_stream_ ? log_stream_->Length() : -1; // -1 instead of 0
   }
 
+  // null if the request isn't traced
+  QueryTrace *Trace() { return trace_; }
+
+  // log the trace as one json line, it should be called before Data()
+  void FlushTrace() {
+    if (trace_ == nullptr) {
+      return;
+    }
+    OLOG(this, DEBUG, "trace: " << trace_->ToJson());
+    delete trace_;
+    trace_ = nullptr;
+  }
+
 private:
   framework::LogStream *log_stream_;
+  QueryTrace *trace_;
 };
 
 } // namespace utils
@@ -0,0 +1,103 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef UTIL_PAGED_ARRAY_H_
+#define UTIL_PAGED_ARRAY_H_
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace utils {
+
+/** a growable array of stable addresses. Elements live in pages of
+ * 2^page_bits, which are allocated and filled with the initial value when
+ * they are first touched, so the memory follows the elements in use rather
+ * than the capacity. Only the page table is sized by the capacity.
+ *
+ * Pages are published by CAS, so elements may be read and written by
+ * different threads without locking, like a plain array. Reads through a
+ * const reference don't allocate. V is the type of the initial value, for T
+ * like std::atomic<long>.
+ */
+template <typename T, typename V = T>
+class PagedArray {
+ public:
+  PagedArray(long capacity, V init_value, int page_bits = 16)
+      : page_bits_(page_bits),
+        page_mask_((1L << page_bits) - 1),
+        npages_((capacity + page_mask_) >> page_bits),
+        init_value_(init_value),
+        init_element_(init_value),
+        pages_(new std::atomic<T *>[npages_]),
+        nallocated_(0) {
+    for (long i = 0; i < npages_; i++) pages_[i] = nullptr;
+  }
+
+  ~PagedArray() {
+    for (long i = 0; i < npages_; i++) delete[] pages_[i].load();
+  }
+
+  PagedArray(const PagedArray &) = delete;
+  PagedArray &operator=(const PagedArray &) = delete;
+
+  // i should be less than Capacity()
+  T &operator[](long i) {
+    T *page = pages_[i >> page_bits_].load(std::memory_order_acquire);
+    if (page == nullptr) page = NewPage(i >> page_bits_);
+    return page[i & page_mask_];
+  }
+
+  // an untouched page is read as the initial value, it isn't allocated
+  const T &operator[](long i) const {
+    const T *page = pages_[i >> page_bits_].load(std::memory_order_acquire);
+    if (page == nullptr) return init_element_;
+    return page[i & page_mask_];
+  }
+
+  /** the contiguous elements from i in its page
+   *
+   * @param len  set to the number of them, at most n
+   */
+  T *Range(long i, long n, long &len) {
+    len = std::min(n, (page_mask_ + 1) - (i & page_mask_));
+    return &(*this)[i];
+  }
+
+  long Capacity() const { return npages_ << page_bits_; }
+
+  long MemBytes() const {
+    return npages_ * sizeof(T *) + (nallocated_ << page_bits_) * sizeof(T);
+  }
+
+ private:
+  T *NewPage(long page_no) {
+    long page_size = page_mask_ + 1;
+    T *page = new T[page_size];
+    for (long j = 0; j < page_size; j++) page[j] = init_value_;
+    T *expected = nullptr;
+    if (not pages_[page_no].compare_exchange_strong(
+            expected, page, std::memory_order_acq_rel)) {
+      delete[] page;  // published by another thread
+      return expected;
+    }
+    ++nallocated_;
+    return page;
+  }
+
+  int page_bits_;
+  long page_mask_;
+  long npages_;
+  V init_value_;
+  const T init_element_;
+  std::unique_ptr<std::atomic<T *>[]> pages_;
+  std::atomic<long> nallocated_;
+};
+
+}  // namespace utils
+
+#endif  // UTIL_PAGED_ARRAY_H_
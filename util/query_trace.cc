@@ -0,0 +1,45 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#include "query_trace.h"
+
+#include "cJSON.h"
+
+namespace utils {
+
+std::string QueryTrace::ToJson() {
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddNumberToObject(root, "nprobe", nprobe_);
+  cJSON_AddNumberToObject(root, "threads", threads_);
+  cJSON_AddNumberToObject(root, "filter_docs", filter_docs_);
+  cJSON_AddNumberToObject(root, "lists_probed", lists_probed_);
+  cJSON_AddNumberToObject(root, "codes_scanned", codes_scanned_);
+  cJSON_AddNumberToObject(root, "codes_filtered", codes_filtered_);
+  cJSON_AddNumberToObject(root, "codes_deleted", codes_deleted_);
+  cJSON_AddNumberToObject(root, "reranked", reranked_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON *lists = cJSON_AddArrayToObject(root, "lists");
+    for (const auto &list : lists_) {
+      cJSON *item = cJSON_CreateArray();
+      cJSON_AddItemToArray(item, cJSON_CreateNumber(list.first));
+      cJSON_AddItemToArray(item, cJSON_CreateNumber(list.second));
+      cJSON_AddItemToArray(lists, item);
+    }
+    cJSON *stages = cJSON_AddObjectToObject(root, "stages_us");
+    for (const auto &stage : stages_) {
+      cJSON_AddNumberToObject(stages, stage.first, stage.second);
+    }
+  }
+  char *str = cJSON_PrintUnformatted(root);
+  std::string json(str);
+  free(str);
+  cJSON_Delete(root);
+  return json;
+}
+
+}  // namespace utils
@@ -0,0 +1,96 @@
+/**
+ * Copyright 2019 The Gamma Authors.
+ *
+ * This source code is licensed under the Apache License, Version 2.0 license
+ * found in the LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef UTIL_QUERY_TRACE_H_
+#define UTIL_QUERY_TRACE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace utils {
+
+/** structured execution trace of one request, it's only created when the
+ * online log level of the request is "trace". Searching threads may record
+ * to it concurrently.
+ */
+class QueryTrace {
+ public:
+  // lists of a vector field are kept at most, the rest are only counted
+  static const size_t kMaxLists = 1024;
+
+  QueryTrace()
+      : nprobe_(-1),
+        threads_(0),
+        filter_docs_(-1),
+        lists_probed_(0),
+        codes_scanned_(0),
+        codes_filtered_(0),
+        codes_deleted_(0),
+        reranked_(0) {}
+
+  void SetNprobe(int nprobe) { nprobe_ = nprobe; }
+
+  void SetThreads(int threads) { threads_ = threads; }
+
+  // docs passing the filters, -1 if there isn't a filter
+  void SetFilterDocs(int docs) { filter_docs_ = docs; }
+
+  void AddList(long list_no, long size) {
+    lists_probed_.fetch_add(1, std::memory_order_relaxed);
+    codes_scanned_.fetch_add(size, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (lists_.size() < kMaxLists) lists_.emplace_back(list_no, size);
+  }
+
+  // codes skipped in scanning as their docs are filtered out or deleted
+  void AddSkipped(long filtered, long deleted) {
+    codes_filtered_.fetch_add(filtered, std::memory_order_relaxed);
+    codes_deleted_.fetch_add(deleted, std::memory_order_relaxed);
+  }
+
+  // codes scanned without probing lists, e.g. by flat and hnsw
+  void AddScanned(long codes) {
+    codes_scanned_.fetch_add(codes, std::memory_order_relaxed);
+  }
+
+  void AddReranked(long n) {
+    reranked_.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  void AddStage(const char *name, uint64_t us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stages_.emplace_back(name, us);
+  }
+
+  /** @return the trace as compact json, lists are [list_no, size] pairs and
+   * stage times are in microseconds
+   */
+  std::string ToJson();
+
+ private:
+  std::atomic<int> nprobe_;
+  std::atomic<int> threads_;
+  std::atomic<int> filter_docs_;
+  std::atomic<long> lists_probed_;
+  std::atomic<long> codes_scanned_;
+  std::atomic<long> codes_filtered_;
+  std::atomic<long> codes_deleted_;
+  std::atomic<long> reranked_;
+
+  std::mutex mutex_;
+  std::vector<std::pair<long, long>> lists_;
+  std::vector<std::pair<const char *, uint64_t>> stages_;
+};
+
+}  // namespace utils
+
+#endif  // UTIL_QUERY_TRACE_H_
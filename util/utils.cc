@@ -8,6 +8,7 @@
 #include "utils.h"
 
 #include <dirent.h>
+#include <errno.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -259,6 +260,21 @@ ssize_t write_n(int fd, const char *buf, ssize_t n_bytes, int retry) {
   return write_bytes;
 }
 
+ssize_t pread_n(int fd, char *buf, ssize_t n_bytes, off_t offset) {
+  ssize_t read_bytes = 0;
+  while (read_bytes < n_bytes) {
+    ssize_t ret = pread(fd, (void *)(buf + read_bytes), n_bytes - read_bytes,
+                        offset + read_bytes);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (ret == 0) break;  // end of file
+    read_bytes += ret;
+  }
+  return read_bytes;
+}
+
 std::string join(const std::vector<std::string> &strs, char separator) {
   std::stringstream ss;
   ss << "[";
@@ -8,6 +8,7 @@
 #ifndef UTILS_H_
 #define UTILS_H_
 
+#include <sys/types.h>
 #include <cassert>
 #include <functional>
 #include <sstream>
@@ -77,6 +78,12 @@ std::vector<std::string> ls_folder(const std::string &dir_name,
 
 ssize_t write_n(int fd, const char *buf, ssize_t nbyte, int retry);
 
+/** read nbyte bytes at offset, retrying on short reads
+ *
+ * @return bytes read, -1 on error
+ */
+ssize_t pread_n(int fd, char *buf, ssize_t nbyte, off_t offset);
+
 template <class T>
 inline T *NewArray(int len, const char *msg) {
   assert(len > 0);
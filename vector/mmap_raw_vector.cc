@@ -8,10 +8,12 @@
 #include "mmap_raw_vector.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <exception>
+#include "bitmap.h"
 #include "log.h"
 #include "utils.h"
 
@@ -38,10 +40,21 @@ MmapRawVector<DataType>::MmapRawVector(const string &name, int dimension,
   store_params_ = new StoreParams(store_params);
   stored_num_ = 0;
   memory_only_ = false;
+  loading_ = false;
+  load_status_ = 0;
+  load_runner_ = nullptr;
+  updated_data_ = nullptr;
+  updated_data_size_ = 0;
 }
 
 template <typename DataType>
 MmapRawVector<DataType>::~MmapRawVector() {
+  if (load_runner_ != nullptr) {
+    load_runner_->join();
+    delete load_runner_;
+    load_runner_ = nullptr;
+  }
+  if (updated_data_ != nullptr) munmap(updated_data_, updated_data_size_);
   if (vector_buffer_queue_ != nullptr) {
     delete vector_buffer_queue_;
   }
@@ -192,91 +205,190 @@ int MmapRawVector<DataType>::LoadVectors(int vec_num) {
     disk_vector_num = vec_num;
   }
 
-  // read vectors from fet file to vector buffer queue
-  if (vec_num > 0) {
-    long offset =
-        vec_num > max_buffer_size_
-            ? (long)(vec_num - max_buffer_size_) * this->vector_byte_size_
-            : 0;
-    FILE *fet_fp = fopen(fet_file_path_.c_str(), "rb");
-    if (fet_fp == NULL) {
-      LOG(ERROR) << "open feature file error, file path=" << fet_file_path_;
-      return 1;
-    }
-    if (0 != fseek(fet_fp, offset, SEEK_SET)) {
-      LOG(ERROR) << "fseek feature file error, file path=" << fet_file_path_
-                 << ", offset=" << offset;
-      fclose(fet_fp);
-      return 2;
-    }
-    int load_num = vec_num > max_buffer_size_ ? max_buffer_size_ : vec_num;
-    stored_num_ = vec_num > max_buffer_size_ ? vec_num - max_buffer_size_ : 0;
-    int batch = 1000;
-    DataType *buffer = new DataType[batch * this->dimension_];
-    int times = load_num / batch;
-    for (int i = 0; i < times; i++) {
-      fread(buffer, this->vector_byte_size_, batch, fet_fp);
-      vector_buffer_queue_->Push(buffer, this->dimension_, batch, -1);
-    }
-    int remainder = load_num % batch;
-    if (remainder > 0) {
-      fread(buffer, this->vector_byte_size_, remainder, fet_fp);
-      vector_buffer_queue_->Push(buffer, this->dimension_, remainder, -1);
-    }
-    delete[] buffer;
-    fclose(fet_fp);
+  int load_num = vec_num > max_buffer_size_ ? max_buffer_size_ : vec_num;
+  stored_num_ = vec_num - load_num;
+  nflushed_ = disk_vector_num;
+  last_nflushed_ = nflushed_;
 
-    vector_buffer_queue_->Erase();
+  if (MapUpdatedVectors()) {
+    LOG(ERROR) << "map update file error, path=" << updated_fet_file_path_;
+    return -1;
   }
 
-  nflushed_ = disk_vector_num;
-  last_nflushed_ = nflushed_;
+  if (store_params_->async_load_ && load_num > 0) {
+    // searches fall back to the mapped file until the buffer is filled
+    loading_ = true;
+    load_runner_ = new std::thread(&MmapRawVector<DataType>::LoadBuffer, this,
+                                   load_num);
+    LOG(INFO) << "start loading vectors in background, load num="
+              << load_num << ", nflushed=" << nflushed_;
+    return 0;
+  }
+  return LoadBuffer(load_num);
+}
 
-  LoadUpdatedVectors();
+template <typename DataType>
+int MmapRawVector<DataType>::LoadBuffer(int load_num) {
+  int ret = 0;
+  double start = utils::getmillisecs();
+  if (load_num > 0) {
+    int fd = open(fet_file_path_.c_str(), O_RDONLY);
+    if (fd == -1) {
+      LOG(ERROR) << "open feature file error, file path=" << fet_file_path_
+                 << ", error:" << strerror(errno);
+      ret = 1;
+    } else {
+      // the buffer keeps the latest load_num vectors
+      long offset = (long)stored_num_ * this->vector_byte_size_;
+      posix_fadvise(fd, offset, (off_t)load_num * this->vector_byte_size_,
+                    POSIX_FADV_SEQUENTIAL);
+      ret = vector_buffer_queue_->Load(fd, offset, load_num);
+      close(fd);
+      if (ret != 0) {
+        LOG(ERROR) << "load feature file to buffer error, ret=" << ret
+                   << ", file path=" << fet_file_path_;
+        ret = 2;
+      } else {
+        vector_buffer_queue_->Erase();
+      }
+    }
+  }
+  double load_end = utils::getmillisecs();
 
-  LOG(INFO) << "load vectors success, nflushed=" << nflushed_;
+  if (ret == 0 && ApplyUpdatedVectors()) ret = 3;
+
+  LOG(INFO) << "load vectors " << (ret == 0 ? "success" : "failed")
+            << ", load num=" << load_num << ", nflushed=" << nflushed_
+            << ", load cost=" << load_end - start
+            << "ms, update cost=" << utils::getmillisecs() - load_end << "ms";
 
   StartFlushingIfNeed(this);
-  return 0;
+  {
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    load_status_ = ret;
+    loading_ = false;
+  }
+  load_cv_.notify_all();
+  return ret;
+}
+
+template <typename DataType>
+int MmapRawVector<DataType>::WaitForLoading() const {
+  std::unique_lock<std::mutex> lock(load_mutex_);
+  load_cv_.wait(lock, [this]() { return !loading_; });
+  return load_status_;
 }
 
 template <typename DataType>
-int MmapRawVector<DataType>::LoadUpdatedVectors() {
-  if (!memory_only_) return -1;
-  FILE *fp = fopen(updated_fet_file_path_.c_str(), "rb");
-  int vid = -1;
-  DataType *vec = new DataType[this->dimension_];
-  // TODO: check file length
+int MmapRawVector<DataType>::CheckLoaded() const {
+  if (!loading_ && load_status_ == 0) return 0;
+  int ret = WaitForLoading();
+  if (ret != 0) {
+    LOG(ERROR) << "vectors aren't loaded, ret=" << ret;
+  }
+  return ret;
+}
+
+template <typename DataType>
+int MmapRawVector<DataType>::MapUpdatedVectors() {
+  if (!memory_only_) return 0;
+  long file_size = utils::get_file_size(updated_fet_file_path_.c_str());
+  if (file_size <= 0) return 0;
+
+  int fd = open(updated_fet_file_path_.c_str(), O_RDONLY);
+  if (fd == -1) {
+    LOG(ERROR) << "open update file error:" << strerror(errno);
+    return -1;
+  }
+  char *data =
+      (char *)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "mmap update file error:" << strerror(errno);
+    return -1;
+  }
+  madvise(data, file_size, MADV_SEQUENTIAL);
+  updated_data_ = data;
+  updated_data_size_ = file_size;
+
+  // each record is (int vid, vector), records after the first invalid vid or
+  // an incomplete tail are dropped
+  size_t record_size = sizeof(int) + this->vector_byte_size_;
+  size_t record_num = file_size / record_size;
   size_t update_num = 0;
-  while (!feof(fp)) {
-    fread((void *)&vid, sizeof(int), 1, fp);
-    fread((void *)vec, sizeof(DataType), this->dimension_, fp);
-    if (vid >= nflushed_) {
-      delete[] vec;
-      fclose(fp);
-      size_t truncate_len = update_num * (this->vector_byte_size_ + sizeof(int));
-      if (truncate(updated_fet_file_path_.c_str(), truncate_len)) {
-        LOG(ERROR) << "truncate update file error:" << strerror(errno)
-                   << ", truncate length=" << truncate_len;
-        return -1;
-      }
-      return 0;
+  for (; update_num < record_num; update_num++) {
+    int vid = -1;
+    memcpy((void *)&vid, data + update_num * record_size, sizeof(int));
+    if (vid < 0 || vid >= nflushed_) break;
+  }
+
+  // only the latest update of each vid is kept, so the records can be
+  // applied in parallel without overlapping
+  for (size_t i = 0; i < update_num; i++) {
+    int vid = -1;
+    memcpy((void *)&vid, data + i * record_size, sizeof(int));
+    updated_records_[vid] = data + i * record_size;
+  }
+  LOG(INFO) << "map updated vectors, record num=" << update_num
+            << ", vid num=" << updated_records_.size();
+
+  if (update_num != record_num || (long)(record_num * record_size) != file_size) {
+    // the kept records are before the truncated length, so they stay mapped
+    size_t truncate_len = update_num * record_size;
+    if (truncate(updated_fet_file_path_.c_str(), truncate_len)) {
+      LOG(ERROR) << "truncate update file error:" << strerror(errno)
+                 << ", truncate length=" << truncate_len;
+      return -1;
     }
-    vector_buffer_queue_->Update(vid, vec, this->dimension_);
-    ++update_num;
   }
-  delete[] vec;
-  fclose(fp);
+  return 0;
+}
+
+template <typename DataType>
+int MmapRawVector<DataType>::ApplyUpdatedVectors() {
+  std::vector<const char *> records;
+  records.reserve(updated_records_.size());
+  for (const auto &record : updated_records_) records.push_back(record.second);
+
+  int failed = 0;
+#pragma omp parallel for reduction(+ : failed)
+  for (size_t i = 0; i < records.size(); i++) {
+    int vid = -1;
+    memcpy((void *)&vid, records[i], sizeof(int));
+    DataType *vec = new DataType[this->dimension_];
+    memcpy((void *)vec, records[i] + sizeof(int), this->vector_byte_size_);
+    if (vector_buffer_queue_->Update(vid - stored_num_, vec,
+                                     this->dimension_))
+      failed++;
+    delete[] vec;
+  }
+  if (failed > 0) {
+    LOG(ERROR) << "apply updated vectors error, failed num=" << failed
+               << ", applied num=" << records.size();
+    return -1;
+  }
+  LOG(INFO) << "apply updated vectors, applied num=" << records.size();
   return 0;
 }
 
 template <typename DataType>
 int MmapRawVector<DataType>::AddToStore(DataType *v, int len) {
+  int ret = CheckLoaded();
+  if (ret != 0) return ret;
   return vector_buffer_queue_->Push(v, len, -1);
 }
 
+template <typename DataType>
+int MmapRawVector<DataType>::AddToStore(DataType *v, int dim, int num) {
+  int ret = CheckLoaded();
+  if (ret != 0) return ret;
+  return vector_buffer_queue_->Push(v, dim, num, -1);
+}
+
 template <typename DataType>
 int MmapRawVector<DataType>::UpdateToStore(int vid, DataType *v, int len) {
+  int ret = CheckLoaded();
+  if (ret != 0) return ret;
   if (memory_only_) {
     vector_buffer_queue_->Update(vid, v, len);
     fwrite((void *)&vid, sizeof(int), 1, updated_fet_fp_);
@@ -291,8 +403,8 @@ int MmapRawVector<DataType>::GetVectorHeader(int start, int end,
                                              ScopeVector<DataType> &vec) {
   if (end > this->ntotal_ || start > end) return 1;
 
-  // memory only mode
-  if (memory_only_) {
+  // memory only mode, the buffer is valid after loading
+  if (memory_only_ && !loading_ && load_status_ == 0) {
     DataType *vec_head = nullptr;
     if (vector_buffer_queue_->GetVectorHead(start, &vec_head, this->dimension_))
       return 1;
@@ -302,9 +414,30 @@ int MmapRawVector<DataType>::GetVectorHeader(int start, int end,
 
   // disk mode
   Until(end);
-  vec.Set(
-      vector_file_mapper_->GetVectors() + (uint64_t)start * this->dimension_,
-      false);
+  const DataType *file_head =
+      vector_file_mapper_->GetVectors() + (uint64_t)start * this->dimension_;
+  if (!memory_only_ || updated_records_.empty()) {
+    vec.Set(file_head, false);
+    return 0;
+  }
+  // the file is served until the buffer is loaded if the range has no update,
+  // a range with updates, such as the whole vectors of a flat search, waits
+  // for the buffer instead of patching a copy of the file per call
+  auto it = updated_records_.lower_bound(start);
+  if (it == updated_records_.end() || it->first >= end) {
+    vec.Set(file_head, false);
+    return 0;
+  }
+  int ret = WaitForLoading();
+  if (ret != 0) {
+    LOG(ERROR) << "vectors aren't loaded, ret=" << ret << ", start=" << start
+               << ", end=" << end;
+    return 1;
+  }
+  DataType *vec_head = nullptr;
+  if (vector_buffer_queue_->GetVectorHead(start, &vec_head, this->dimension_))
+    return 1;
+  vec.Set(vec_head, false);
   return 0;
 }
 
@@ -315,6 +448,16 @@ int MmapRawVector<DataType>::GetVector(long vid, const DataType *&vec,
     return 1;
   };
 
+  // the buffer doesn't have the updates of the update file until it is loaded
+  if ((loading_ || load_status_ != 0) && !updated_records_.empty()) {
+    auto it = updated_records_.find(vid);
+    if (it != updated_records_.end()) {
+      vec = (const DataType *)(it->second + sizeof(int));
+      deletable = false;
+      return 0;
+    }
+  }
+
   // int stored_num = ntotal_ - vector_buffer_queue_->size();
   if (vid >= stored_num_) {
     DataType *vector = new DataType[this->dimension_];
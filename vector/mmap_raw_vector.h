@@ -8,6 +8,10 @@
 #ifndef MMAP_RAW_VECTOR_H_
 #define MMAP_RAW_VECTOR_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <string>
 #include <thread>
 #include "raw_vector.h"
@@ -26,8 +30,11 @@ class MmapRawVector : public RawVector<DataType>, public AsyncFlusher {
   ~MmapRawVector();
   int InitStore() override;
   int AddToStore(DataType *v, int len) override;
+
+  int AddToStore(DataType *v, int dim, int num) override;
   int GetVectorHeader(int start, int end, ScopeVector<DataType> &vec) override;
   int UpdateToStore(int vid, DataType *v, int len);
+  int PrepareStore(int num) override { return CheckLoaded(); }
   int GetMemoryMode() { return memory_only_; }
 
  protected:
@@ -35,7 +42,26 @@ class MmapRawVector : public RawVector<DataType>, public AsyncFlusher {
   int GetVector(long vid, const DataType *&vec, bool &deletable) const override;
   int DumpVectors(int dump_vid, int max_vid);
   int LoadVectors(int vec_num) override;
-  int LoadUpdatedVectors();
+  /** fill the buffer with the latest load_num vectors of fet file by parallel
+   * preads, then apply the update file and start flushing
+   *
+   * @return 0 if successed
+   */
+  int LoadBuffer(int load_num);
+  /** map the update file and index the latest record of each vid, they are
+   * served instead of the buffer until it is loaded
+   *
+   * @return 0 if successed
+   */
+  int MapUpdatedVectors();
+  int ApplyUpdatedVectors();
+  /** wait for the background loading
+   *
+   * @return 0 if the buffer is loaded, the error of LoadBuffer() if not
+   */
+  int WaitForLoading() const;
+  // @return 0 if the buffer is loaded, waiting for the background loading
+  int CheckLoaded() const;
 
  private:
   VectorBufferQueue<DataType> *vector_buffer_queue_;
@@ -53,6 +79,17 @@ class MmapRawVector : public RawVector<DataType>, public AsyncFlusher {
   StoreParams *store_params_;
   int stored_num_;
   bool memory_only_;
+  std::atomic<bool> loading_;  // buffer is being filled in background
+  std::atomic<int> load_status_;  // set by LoadBuffer(), writes fail if != 0
+  mutable std::mutex load_mutex_;
+  mutable std::condition_variable load_cv_;
+  std::thread *load_runner_;
+  // the mapped update file and the latest record of each vid in it, kept
+  // until destruction as searches may read them. Ordered by vid, so the
+  // updates in a range of vids are found without scanning all of them
+  char *updated_data_;
+  long updated_data_size_;
+  std::map<int, const char *> updated_records_;
 };
 
 }  // namespace tig_gamma
@@ -18,6 +18,33 @@ using namespace std;
 
 namespace tig_gamma {
 
+namespace {
+
+// write elements [start, start + n) of a paged array page by page
+template <typename T>
+void WritePages(int fd, utils::PagedArray<T> &array, long start, long n) {
+  while (n > 0) {
+    long len = 0;
+    T *data = array.Range(start, n, len);
+    write(fd, (void *)data, len * sizeof(T));
+    start += len;
+    n -= len;
+  }
+}
+
+template <typename T>
+void ReadPages(int fd, utils::PagedArray<T> &array, long start, long n) {
+  while (n > 0) {
+    long len = 0;
+    T *data = array.Range(start, n, len);
+    read(fd, (void *)data, len * sizeof(T));
+    start += len;
+    n -= len;
+  }
+}
+
+}  // namespace
+
 template <typename DataType>
 RawVectorIO<DataType>::RawVectorIO(RawVector<DataType> *raw_vector) {
   raw_vector_ = raw_vector;
@@ -55,7 +82,7 @@ template <typename DataType>
 int RawVectorIO<DataType>::Dump(int start, int n) {
   if (raw_vector_->has_source_) {
     char *str_mem_ptr = raw_vector_->str_mem_ptr_;
-    long *source_mem_pos = raw_vector_->source_mem_pos_.data();
+    utils::PagedArray<long> &source_mem_pos = *raw_vector_->source_mem_pos_;
 
     // dump source
     if (str_mem_ptr) {
@@ -65,17 +92,14 @@ int RawVectorIO<DataType>::Dump(int start, int n) {
 
     // dump source position
     if (start == 0) {
-      write(src_pos_fd_, (void *)(source_mem_pos + start),
-            (n + 1) * sizeof(long));
+      WritePages(src_pos_fd_, source_mem_pos, start, n + 1);
     } else {
-      write(src_pos_fd_, (void *)(source_mem_pos + start + 1),
-            n * sizeof(long));
+      WritePages(src_pos_fd_, source_mem_pos, start + 1, n);
     }
   }
 
   if (raw_vector_->vid_mgr_->multi_vids_) {
-    int *vid2docid = raw_vector_->vid_mgr_->vid2docid_.data();
-    write(docid_fd_, (void *)(vid2docid + start), n * sizeof(int));
+    WritePages(docid_fd_, *raw_vector_->vid_mgr_->vid2docid_, start, n);
   }
 
 #ifdef DEBUG
@@ -112,12 +136,17 @@ int RawVectorIO<DataType>::Load(int doc_num) {
       return -1;
     }
     int num = docid_file_size / sizeof(int);
-    read(docid_fd_, (void *)raw_vector_->vid_mgr_->vid2docid_.data(),
-         num * sizeof(int));
-    // create docid2vid_ from vid2docid_
+    utils::PagedArray<int> &vid2docid = *raw_vector_->vid_mgr_->vid2docid_;
+    if (num > vid2docid.Capacity()) {
+      LOG(ERROR) << "docid file has " << num << " vectors, more than "
+                 << vid2docid.Capacity();
+      return -1;
+    }
+    ReadPages(docid_fd_, vid2docid, 0, num);
+    // rebuild the vid lists of docs from vid2docid_, compactly
     int vid = 0;
     for (; vid < num; vid++) {
-      int docid = raw_vector_->vid_mgr_->vid2docid_[vid];
+      int docid = vid2docid[vid];
       if (docid == -1) {
         continue;
       }
@@ -129,7 +158,7 @@ int RawVectorIO<DataType>::Load(int doc_num) {
     n = vid;
     // set [n, num) to be -1
     for (int i = n; i < num; i++) {
-      raw_vector_->vid_mgr_->vid2docid_[i] = -1;
+      vid2docid[i] = -1;
     }
 
     // truncate docid file to vid_num length
@@ -140,11 +169,10 @@ int RawVectorIO<DataType>::Load(int doc_num) {
   }
 
   if (raw_vector_->has_source_) {
-    read(src_pos_fd_, (void *)raw_vector_->source_mem_pos_.data(),
-         (n + 1) * sizeof(long));
-    if (raw_vector_->source_mem_pos_[n] > 0) {
-      read(src_fd_, (void *)raw_vector_->str_mem_ptr_,
-           raw_vector_->source_mem_pos_[n]);
+    utils::PagedArray<long> &source_mem_pos = *raw_vector_->source_mem_pos_;
+    ReadPages(src_pos_fd_, source_mem_pos, 0, n + 1);
+    if (source_mem_pos[n] > 0) {
+      read(src_fd_, (void *)raw_vector_->str_mem_ptr_, source_mem_pos[n]);
     }
 
     // truncate str file to vid_num length
@@ -152,7 +180,7 @@ int RawVectorIO<DataType>::Load(int doc_num) {
       LOG(ERROR) << "truncate source position file error:" << strerror(errno);
       return -1;
     }
-    if (ftruncate(src_fd_, raw_vector_->source_mem_pos_[n])) {
+    if (ftruncate(src_fd_, source_mem_pos[n])) {
       LOG(ERROR) << "truncate source file error:" << strerror(errno);
       return -1;
     }
@@ -188,8 +216,8 @@ int RawVector<DataType>::Init(bool has_source, bool multi_vids) {
     uint64_t len = (uint64_t)max_vector_size_ * 100;
     str_mem_ptr_ = new (std::nothrow) char[len];
     total_mem_bytes_ += len;
-    source_mem_pos_.resize(max_vector_size_ + 1, 0);
-    total_mem_bytes_ += max_vector_size_ * sizeof(long);
+    source_mem_pos_.reset(
+        new utils::PagedArray<long>((long)max_vector_size_ + 1, 0));
   }
   has_source_ = has_source;
 
@@ -262,8 +290,9 @@ int RawVector<DataType>::GetSource(int vid, char *&str, int &len) {
     len = 0;
     return 0;
   }
-  len = source_mem_pos_[vid + 1] - source_mem_pos_[vid];
-  str = str_mem_ptr_ + source_mem_pos_[vid];
+  const utils::PagedArray<long> &source_mem_pos = *source_mem_pos_;
+  len = source_mem_pos[vid + 1] - source_mem_pos[vid];
+  str = str_mem_ptr_ + source_mem_pos[vid];
   return 0;
 }
 
@@ -276,24 +305,78 @@ int RawVector<DataType>::Add(int docid, Field *&field) {
     LOG(ERROR) << "Doc [" << docid << "] len " << field->value->len << "]";
     return -1;
   }
-  AddToStore((DataType *)field->value->value,
-             field->value->len / sizeof(DataType));
+  int ret = AddToStore((DataType *)field->value->value,
+                       field->value->len / sizeof(DataType));
+  if (ret != 0) {
+    LOG(ERROR) << "add to store error, docid=" << docid << ", ret=" << ret;
+    return ret;
+  }
 
   // add to source
   if (has_source_) {
     int len = field->source ? field->source->len : 0;
     if (len > 0) {
-      memcpy(str_mem_ptr_ + source_mem_pos_[ntotal_], field->source->value,
+      memcpy(str_mem_ptr_ + (*source_mem_pos_)[ntotal_], field->source->value,
              len * sizeof(char));
-      source_mem_pos_[ntotal_ + 1] = source_mem_pos_[ntotal_] + len;
+      (*source_mem_pos_)[ntotal_ + 1] = (*source_mem_pos_)[ntotal_] + len;
     } else {
-      source_mem_pos_[ntotal_ + 1] = source_mem_pos_[ntotal_];
+      (*source_mem_pos_)[ntotal_ + 1] = (*source_mem_pos_)[ntotal_];
     }
   }
 
   return vid_mgr_->Add(ntotal_++, docid);
 }
 
+template <typename DataType>
+int RawVector<DataType>::Add(const std::vector<int> &docids,
+                             const std::vector<Field *> &fields) {
+  int num = docids.size();
+  if (num == 0) return 0;
+  if (ntotal_ + num > max_vector_size_ || (int)fields.size() != num) {
+    return -1;
+  }
+  std::vector<DataType> vecs((long)num * dimension_);
+  for (int i = 0; i < num; i++) {
+    if (fields[i]->value->len != vector_byte_size_) {
+      LOG(ERROR) << "Doc [" << docids[i] << "] len " << fields[i]->value->len
+                 << ", vector byte size " << vector_byte_size_;
+      return -1;
+    }
+    memcpy((void *)(vecs.data() + (long)i * dimension_),
+           fields[i]->value->value, vector_byte_size_);
+  }
+  int ret = AddToStore(vecs.data(), dimension_, num);
+  if (ret != 0) {
+    LOG(ERROR) << "add " << num << " vectors to store error, ret=" << ret;
+    return ret;
+  }
+
+  for (int i = 0; i < num; i++) {
+    if (has_source_) {
+      Field *field = fields[i];
+      int len = field->source ? field->source->len : 0;
+      if (len > 0) {
+        memcpy(str_mem_ptr_ + (*source_mem_pos_)[ntotal_], field->source->value,
+               len * sizeof(char));
+      }
+      (*source_mem_pos_)[ntotal_ + 1] = (*source_mem_pos_)[ntotal_] + len;
+    }
+    ret = vid_mgr_->Add(ntotal_++, docids[i]);
+    if (ret != 0) return ret;
+  }
+  return 0;
+}
+
+template <typename DataType>
+int RawVector<DataType>::PrepareAdd(int num) {
+  if (ntotal_ + num > max_vector_size_) {
+    LOG(ERROR) << "vector num reached upper size, name=" << vector_name_
+               << ", ntotal=" << ntotal_ << ", num=" << num;
+    return -1;
+  }
+  return PrepareStore(num);
+}
+
 template <typename DataType>
 int RawVector<DataType>::Update(int docid, Field *&field) {
   if (vid_mgr_->multi_vids_ || docid >= ntotal_) return -1;
@@ -394,6 +477,11 @@ int StoreParams::Parse(const char *str) {
     cache_size_ = (long)cache_size * 1024 * 1024;
   }
 
+  int async_load = 0;
+  if (!jp.GetInt("async_load", async_load)) {
+    async_load_ = async_load != 0;
+  }
+
   return 0;
 }
 
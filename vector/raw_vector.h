@@ -96,13 +96,31 @@ class RawVector {
    */
   int Add(int docid, Field *&field);
 
+  /** add one vector field of each doc, vectors are stored in one batch
+   *
+   * @param docids doc ids
+   * @param fields vector fields of docs, the value of each field must be a
+   * vector of dimension
+   * @return 0 if successed
+   */
+  int Add(const std::vector<int> &docids, const std::vector<Field *> &fields);
+
+  /** check that num vectors can be added, so the fields of a doc are added
+   * to all of their raw vectors or none of them
+   *
+   * @return 0 if successed
+   */
+  int PrepareAdd(int num);
+
   int Update(int docid, Field *&field);
 
   virtual size_t GetStoreMemUsage() { return 0; }
 
   long GetTotalMemBytes() {
     GetStoreMemUsage();
-    return total_mem_bytes_;
+    long bytes = total_mem_bytes_ + vid_mgr_->GetMemBytes();
+    if (source_mem_pos_) bytes += source_mem_pos_->MemBytes();
+    return bytes;
   };
   int GetVectorNum() const { return ntotal_; };
   int GetMaxVectorSize() const { return max_vector_size_; }
@@ -113,8 +131,25 @@ class RawVector {
    */
   virtual int AddToStore(DataType *v, int len) = 0;
 
+  /** add num sequential vectors of dimension to store, it adds them one by
+   * one if the store can't add them in batch
+   */
+  virtual int AddToStore(DataType *v, int dim, int num) {
+    for (int i = 0; i < num; i++) {
+      int ret = AddToStore(v + (long)i * dim, dim);
+      if (ret != 0) return ret;
+    }
+    return 0;
+  }
+
   virtual int UpdateToStore(int vid, DataType *v, int len) = 0;
 
+  /** check that the store can add num vectors now
+   *
+   * @return 0 if successed
+   */
+  virtual int PrepareStore(int num) { return 0; }
+
   int GetDimension() { return dimension_; };
 
   VIDMgr *vid_mgr_;
@@ -142,7 +177,8 @@ class RawVector {
   int ntotal_;                        // vector num
   long total_mem_bytes_;              // total used memory bytes
   char *str_mem_ptr_;                 // source memory
-  std::vector<long> source_mem_pos_;  // position of each source
+  // position of each source, paged by the number of vectors
+  std::unique_ptr<utils::PagedArray<long>> source_mem_pos_;
   bool has_source_;
 };
 
@@ -205,15 +241,23 @@ void StopFlushingIfNeed(RawVector<DataType> *vec) {
 
 struct StoreParams {
   long cache_size_;  // bytes
+  // copy vectors into memory in background when loading, searches are
+  // served from the mapped vector file until it completes
+  bool async_load_;
 
-  StoreParams() { cache_size_ = -1; }
+  StoreParams() {
+    cache_size_ = -1;
+    async_load_ = false;
+  }
   StoreParams(const StoreParams &other) {
     this->cache_size_ = other.cache_size_;
+    this->async_load_ = other.async_load_;
   }
   int Parse(const char *str);
   std::string ToString() {
     std::stringstream ss;
-    ss << "{cache size=" << cache_size_ << "}";
+    ss << "{cache size=" << cache_size_ << ", async load=" << async_load_
+       << "}";
     return ss.str();
   }
 };
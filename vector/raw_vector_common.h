@@ -1,10 +1,18 @@
 #ifndef RAW_VECTOR_COMMON_H_
 #define RAW_VECTOR_COMMON_H_
 
+#include <stdint.h>
 #include <string.h>
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "log.h"
+#include "paged_array.h"
 #include "utils.h"
 
-const static int MAX_VECTOR_NUM_PER_DOC = 10;
 const static int MAX_CACHE_SIZE = 1024 * 1024;  // M bytes, it is equal to 1T
 
 template <typename DataType>
@@ -48,90 +56,156 @@ struct ScopeVectors {
   }
 };
 
+/** maps vector ids to doc ids and back. With multiple vectors per doc, the
+ * vids of the docs are packed in an append-only arena (CSR like), the list of
+ * a doc is doc_vids_num_[docid] vids from doc_vids_start_[docid]. All arrays
+ * are paged, so their memory follows the number of vectors.
+ *
+ * Vectors come in docid order, so a vid is appended to the list of the last
+ * doc in place. Adding to an earlier doc, or crossing a page, relocates its
+ * list to the end of the arena as an overflow page, whose old place isn't
+ * reused until the arena is rebuilt compactly from vid2docid_ by loading. A
+ * list is written before its start and number are published, so readers
+ * don't lock.
+ */
 struct VIDMgr {
-  std::vector<int> vid2docid_;    // vector id to doc id
-  std::vector<int *> docid2vid_;  // doc id to vector id list
+  std::unique_ptr<utils::PagedArray<int>> vid2docid_;  // vector id to doc id
   bool multi_vids_;
 
-  VIDMgr(bool multi_vids) : multi_vids_(multi_vids) {}
+  VIDMgr(bool multi_vids)
+      : multi_vids_(multi_vids), max_vector_size_(0), arena_size_(0) {}
 
-  ~VIDMgr() {
-    if (multi_vids_) {
-      for (size_t i = 0; i < docid2vid_.size(); i++) {
-        if (docid2vid_[i] != nullptr) {
-          delete[] docid2vid_[i];
-          docid2vid_[i] = nullptr;
-        }
-      }
-    }
-  }
+  ~VIDMgr() {}
 
+  /** max_vector_size bounds the vids and the docids, but the memory is
+   * allocated by pages as they are used
+   */
   int Init(int max_vector_size, long &total_mem_bytes) {
+    max_vector_size_ = max_vector_size;
     if (multi_vids_) {
-      vid2docid_.resize(max_vector_size, -1);
-      total_mem_bytes += max_vector_size * sizeof(int);
-      docid2vid_.resize(max_vector_size, nullptr);
-      total_mem_bytes += max_vector_size * sizeof(docid2vid_[0]);
+      vid2docid_.reset(new utils::PagedArray<int>(max_vector_size, -1));
+      doc_vids_start_.reset(new utils::PagedArray<int>(max_vector_size, 0));
+      doc_vids_num_.reset(
+          new utils::PagedArray<uint16_t>(max_vector_size, 0));
+      // lists are relocated at most once per page
+      vids_arena_.reset(new utils::PagedArray<int>(
+          (long)max_vector_size * 2 + kArenaPageSize, -1, kArenaPageBits));
     }
     return 0;
   }
 
+  long GetMemBytes() const {
+    if (!multi_vids_) return 0;
+    return vid2docid_->MemBytes() + doc_vids_start_->MemBytes() +
+           doc_vids_num_->MemBytes() + vids_arena_->MemBytes();
+  }
+
   int Add(int vid, int docid) {
-    // add to vid2docid_ and docid2vid_
-    if (multi_vids_) {
-      vid2docid_[vid] = docid;
-      if (docid2vid_[docid] == nullptr) {
-        docid2vid_[docid] =
-            utils::NewArray<int>(MAX_VECTOR_NUM_PER_DOC + 1, "init_vid_list");
-        // total_mem_bytes += (MAX_VECTOR_NUM_PER_DOC + 1) * sizeof(int);
-        docid2vid_[docid][0] = 1;
-        docid2vid_[docid][1] = vid;
-      } else {
-        int *vid_list = docid2vid_[docid];
-        if (vid_list[0] + 1 > MAX_VECTOR_NUM_PER_DOC) {
-          return -1;
-        }
-        vid_list[vid_list[0]] = vid;
-        vid_list[0]++;
+    if (!multi_vids_) return 0;
+    if (docid < 0 || docid >= max_vector_size_ || vid < 0 ||
+        vid >= max_vector_size_) {
+      LOG(ERROR) << "vid [" << vid << "] or docid [" << docid
+                 << "] exceeds vid manager";
+      return -1;
+    }
+    int num = (*doc_vids_num_)[docid];
+    if (num >= std::numeric_limits<uint16_t>::max()) {
+      LOG(ERROR) << "too many vectors of doc [" << docid << "]";
+      return -1;
+    }
+    long start = (*doc_vids_start_)[docid];
+    bool in_place = num > 0 && start + num == arena_size_ &&
+                    (arena_size_ & (kArenaPageSize - 1)) != 0;
+    if (!in_place) {
+      // a list never crosses pages, so DocVIDs() returns it contiguously
+      long offset = arena_size_ & (kArenaPageSize - 1);
+      if (offset + num + 1 > kArenaPageSize) {
+        arena_size_ += kArenaPageSize - offset;
+      }
+      if (arena_size_ + num + 1 > vids_arena_->Capacity()) {
+        LOG(ERROR) << "vid arena is full, size=" << arena_size_;
+        return -1;
+      }
+      // relocate the list to the end, readers still see its old vids
+      for (int i = 0; i < num; i++) {
+        (*vids_arena_)[arena_size_ + i] = (*vids_arena_)[start + i];
       }
+      start = arena_size_;
+      arena_size_ += num;
+      (*doc_vids_start_)[docid] = start;
     }
+    (*vids_arena_)[arena_size_++] = vid;
+    (*vid2docid_)[vid] = docid;
+    std::atomic_thread_fence(std::memory_order_release);
+    (*doc_vids_num_)[docid] = num + 1;
     return 0;
   }
 
-  inline int VID2DocID(int vid) {
+  inline int VID2DocID(int vid) const {
     if (!multi_vids_) return vid;
-    return vid2docid_[vid];
+    const utils::PagedArray<int> &vid2docid = *vid2docid_;
+    return vid2docid[vid];
   }
 
-  inline void DocID2VID(int docid, std::vector<int> &vids) {
+  /** the vids of docid without copying, for multi_vids_ only. The number is
+   * read before the start, as the start is published before the number.
+   *
+   * @return nullptr if the doc has no vector
+   */
+  inline const int *DocVIDs(int docid, int &num) const {
+    num = 0;
+    if (docid < 0 || docid >= max_vector_size_) return nullptr;
+    // read through const references, so docs without vectors don't allocate
+    const utils::PagedArray<uint16_t> &doc_vids_num = *doc_vids_num_;
+    const utils::PagedArray<int> &doc_vids_start = *doc_vids_start_;
+    const utils::PagedArray<int> &vids_arena = *vids_arena_;
+    num = doc_vids_num[docid];
+    if (num == 0) return nullptr;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return &vids_arena[doc_vids_start[docid]];
+  }
+
+  inline void DocID2VID(int docid, std::vector<int> &vids) const {
     if (!multi_vids_) {
       vids.resize(1);
       vids[0] = docid;
       return;
     }
-    int *vid_list = docid2vid_[docid];
-    vids.resize(vid_list[0]);
-    memcpy((void *)vids.data(), (void *)(vid_list + 1), vid_list[0] * sizeof(int));
-    return;
+    int num = 0;
+    const int *vid_list = DocVIDs(docid, num);
+    vids.assign(vid_list, vid_list + num);
   }
 
-  inline int GetFirstVID(int docid) {
+  inline int GetFirstVID(int docid) const {
     if (!multi_vids_) {
       return docid;
     }
-    int *vid_list = docid2vid_[docid];
-    if (vid_list[0] <= 0) return -1;
-    return vid_list[1];
+    int num = 0;
+    const int *vid_list = DocVIDs(docid, num);
+    if (num <= 0) return -1;
+    return vid_list[0];
   }
 
-  inline int GetLastVID(int docid) {
+  inline int GetLastVID(int docid) const {
     if (!multi_vids_) {
       return docid;
     }
-    int *vid_list = docid2vid_[docid];
-    if (vid_list[0] <= 0) return -1;
-    return vid_list[vid_list[0]];
+    int num = 0;
+    const int *vid_list = DocVIDs(docid, num);
+    if (num <= 0) return -1;
+    return vid_list[num - 1];
   }
+
+ private:
+  static const int kArenaPageBits = 16;
+  static const long kArenaPageSize = 1L << kArenaPageBits;
+
+  std::unique_ptr<utils::PagedArray<int>> doc_vids_start_;
+  std::unique_ptr<utils::PagedArray<uint16_t>> doc_vids_num_;
+  std::unique_ptr<utils::PagedArray<int>> vids_arena_;
+  // the capacities of the paged arrays are rounded up to pages
+  int max_vector_size_;
+  long arena_size_;
 };
 
 #endif  // RAW_VECTOR_COMMON_H_
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include "log.h"
 #include "rocksdb/table.h"
+#include "rocksdb/write_batch.h"
 #include "utils.h"
 
 using namespace std;
@@ -95,6 +96,25 @@ int RocksDBRawVector<DataType>::AddToStore(DataType *v, int len) {
   return UpdateToStore(this->ntotal_, v, len);
 }
 
+template <typename DataType>
+int RocksDBRawVector<DataType>::AddToStore(DataType *v, int dim, int num) {
+  if (v == nullptr || dim != this->dimension_) return -1;
+  rocksdb::WriteBatch batch;
+  string key;
+  for (int i = 0; i < num; i++) {
+    ToRowKey(this->ntotal_ + i, key);
+    batch.Put(Slice(key), Slice((char *)(v + (long)i * dim),
+                                this->vector_byte_size_));
+  }
+  Status s = db_->Write(WriteOptions(), &batch);
+  if (!s.ok()) {
+    LOG(ERROR) << "rocksdb write batch error:" << s.ToString()
+               << ", num=" << num;
+    return -2;
+  }
+  return 0;
+}
+
 template <typename DataType>
 size_t RocksDBRawVector<DataType>::GetStoreMemUsage() {
   size_t cache_mem = table_options_.block_cache->GetUsage();
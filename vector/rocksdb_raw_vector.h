@@ -29,6 +29,7 @@ class RocksDBRawVector : public RawVector<DataType> {
   /* RawVector */
   int InitStore() override;
   int AddToStore(DataType *v, int len) override;
+  int AddToStore(DataType *v, int dim, int num) override;
   int GetVectorHeader(int start, int end, ScopeVector<DataType> &vec) override;
   int UpdateToStore(int vid, DataType *v, int len);
 
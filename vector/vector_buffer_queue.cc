@@ -61,6 +61,7 @@ int VectorBufferQueue<DataType>::Init() {
   chunk_size_ = max_vector_size_ / chunk_num_;
 
   vector_byte_size_ = sizeof(DataType) * dimension_;
+  // pages are committed as vectors are pushed, not by the reservation
   buffer_ = (DataType *)malloc((size_t)max_vector_size_ * vector_byte_size_);
   if (buffer_ == NULL) {
     cerr << "malloc buffer failed" << endl;
@@ -164,6 +165,39 @@ int VectorBufferQueue<DataType>::Pop(DataType *v, int dim, int num,
   return 0;
 }
 
+template <typename DataType>
+int VectorBufferQueue<DataType>::Load(int fd, long offset, int num) {
+  if (fd < 0 || num < 0 || num > max_vector_size_ || push_index_ != 0)
+    return 1;
+  if (num == 0) return 0;
+
+  // each pread covers about 64M bytes
+  int batch = (64 << 20) / vector_byte_size_;
+  if (batch <= 0) batch = 1;
+  int batch_num = (num + batch - 1) / batch;
+  int failed = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+ : failed)
+  for (int i = 0; i < batch_num; i++) {
+    long start = (long)i * batch;
+    long n = start + batch > num ? num - start : batch;
+    ssize_t nbytes = n * vector_byte_size_;
+    ssize_t ret =
+        utils::pread_n(fd, (char *)(buffer_ + start * dimension_), nbytes,
+                       offset + start * vector_byte_size_);
+    if (ret != nbytes) failed++;
+  }
+  if (failed > 0) {
+    LOG(ERROR) << "load vectors error, failed batch=" << failed
+               << ", total batch=" << batch_num << ", num=" << num;
+    return 5;
+  }
+  // publish the loaded vectors
+  __sync_synchronize();
+  push_index_ = num;
+  return 0;
+}
+
 template <typename DataType>
 int VectorBufferQueue<DataType>::GetVector(int id, DataType *v, int dim) {
   if (v == nullptr || dim != dimension_) return 1;
@@ -80,6 +80,19 @@ class VectorBufferQueue {
    */
   int Pop(DataType *v, int dim, int num, int timeout);  // batch pop
 
+  /**
+   * fill an empty queue with sequential vectors from file, the file is read
+   * with large parallel preads directly into the buffer and the vectors are
+   * published only when all of them are loaded
+   * warning: it bypasses the chunk locks, so it must be finished before any
+   * Push or Pop
+   * @param fd the file descriptor of vector file
+   * @param offset the byte offset of the first vector in file
+   * @param num the number of vectors to load
+   * @return 0 success; 1 parameter error; 5 read error
+   */
+  int Load(int fd, long offset, int num);
+
   int GetVector(int id, DataType *v, int dim);
   /**
    * get the head address of sequential vectors begin with id
@@ -179,24 +179,106 @@ int VectorManager::CreateVectorTable(VectorInfo **vectors_info, int vectors_num,
 }
 
 int VectorManager::AddToStore(int docid, std::vector<Field *> &fields) {
-  for (unsigned int i = 0; i < fields.size(); i++) {
-    std::string name =
-        std::string(fields[i]->name->value, fields[i]->name->len);
-    if (raw_vectors_.find(name) == raw_vectors_.end()) {
-      // LOG(ERROR) << "Cannot find raw vector [" << name << "]";
-      continue;
+  return AddToStore(std::vector<int>(1, docid),
+                    std::vector<std::vector<Field *>>(1, fields));
+}
+
+namespace {
+
+// the vectors of one raw vector in a batch of docs
+struct FieldBatch {
+  std::vector<int> docids;
+  std::vector<Field *> fields;
+};
+
+// group the fields by raw vector, every doc must have each vector, and check
+// they can be added
+template <typename DataType>
+int PrepareFieldBatches(
+    const std::map<std::string, RawVector<DataType> *> &raw_vectors,
+    const std::vector<int> &docids,
+    const std::vector<std::vector<Field *>> &fields,
+    std::vector<FieldBatch> &batches) {
+  for (const auto &it : raw_vectors) {
+    FieldBatch batch;
+    for (size_t i = 0; i < docids.size(); i++) {
+      size_t num = batch.fields.size();
+      for (Field *field : fields[i]) {
+        if (field->name->len == (int)it.first.size() &&
+            memcmp(field->name->value, it.first.data(), field->name->len) ==
+                0) {
+          batch.docids.push_back(docids[i]);
+          batch.fields.push_back(field);
+        }
+      }
+      if (batch.fields.size() == num) {
+        LOG(ERROR) << "doc " << docids[i] << " has no vector " << it.first;
+        return -1;
+      }
+    }
+    int ret = it.second->PrepareAdd(batch.fields.size());
+    if (ret != 0) {
+      LOG(ERROR) << "can't add vectors of " << it.first << ", ret=" << ret;
+      return ret;
     }
-    raw_vectors_[name]->Add(docid, fields[i]);
+    batches.push_back(std::move(batch));
   }
+  return 0;
+}
 
-  for (unsigned int i = 0; i < fields.size(); i++) {
-    std::string name =
-        std::string(fields[i]->name->value, fields[i]->name->len);
-    if (raw_binary_vectors_.find(name) == raw_binary_vectors_.end()) {
-      // LOG(ERROR) << "Cannot find raw vector [" << name << "]";
-      continue;
+template <typename DataType>
+int AddFieldBatches(
+    const std::map<std::string, RawVector<DataType> *> &raw_vectors,
+    const std::vector<FieldBatch> &batches) {
+  size_t i = 0;
+  for (const auto &it : raw_vectors) {
+    int ret = it.second->Add(batches[i].docids, batches[i].fields);
+    if (ret != 0) {
+      LOG(ERROR) << "add vectors of " << it.first << " error, ret=" << ret;
+      return ret;
+    }
+    i++;
+  }
+  return 0;
+}
+
+}  // namespace
+
+int VectorManager::AddToStore(const std::vector<int> &docids,
+                              const std::vector<std::vector<Field *>> &fields) {
+  if (docids.size() != fields.size()) return -1;
+  // all the fields are checked before any of them is added, so the raw
+  // vectors keep the same vids
+  std::vector<FieldBatch> batches;
+  std::vector<FieldBatch> binary_batches;
+  int ret = PrepareFieldBatches<float>(raw_vectors_, docids, fields, batches);
+  if (ret != 0) return ret;
+  ret = PrepareFieldBatches<uint8_t>(raw_binary_vectors_, docids, fields,
+                                     binary_batches);
+  if (ret != 0) return ret;
+  ret = AddFieldBatches<float>(raw_vectors_, batches);
+  if (ret != 0) return ret;
+  return AddFieldBatches<uint8_t>(raw_binary_vectors_, binary_batches);
+}
+
+int VectorManager::CheckFields(const std::vector<Field *> &fields) const {
+  for (const Field *field : fields) {
+    std::string name(field->name->value, field->name->len);
+    int byte_size = 0;
+    const auto &it = raw_vectors_.find(name);
+    if (it != raw_vectors_.end()) {
+      byte_size = it->second->GetDimension() * sizeof(float);
+    } else {
+      const auto &bit = raw_binary_vectors_.find(name);
+      if (bit == raw_binary_vectors_.end()) continue;
+      byte_size = bit->second->GetDimension() * sizeof(uint8_t);
+    }
+    if (field->value == nullptr || field->value->len != byte_size) {
+      LOG(ERROR) << "invalid length of vector " << name << ", len="
+                 << (field->value ? field->value->len : 0)
+                 << ", expected=" << byte_size;
+      return -1;
     }
-    raw_binary_vectors_[name]->Add(docid, fields[i]);
   }
   return 0;
 }
@@ -307,7 +389,8 @@ int VectorManager::Search(const GammaQuery &query, GammaResult *results) {
       return -1;
     }
 
-    if (!all_vector_results[i].init(n, query.condition->topn)) {
+    if (!all_vector_results[i].init(n, query.condition->topn,
+                                    query.condition->arena)) {
       LOG(ERROR) << "Query name " << name << "init vector result error";
       return -1;
     }
@@ -433,6 +516,70 @@ int VectorManager::Search(const GammaQuery &query, GammaResult *results) {
   return ret;
 }
 
+namespace {
+
+template <typename DataType>
+void GetRawVectors(RawVector<DataType> *raw_vec, const std::vector<int> &docids,
+                   VectorBatch &batch,
+                   std::unique_ptr<ScopeVectors<DataType>> &holder) {
+  size_t n = docids.size();
+  batch.vec_bytes = raw_vec->GetDimension() * sizeof(DataType);
+  batch.vecs.assign(n, nullptr);
+  batch.sources.assign(n, nullptr);
+  batch.source_lens.assign(n, 0);
+
+  // read in vector id order, so the store is scanned forward
+  std::vector<std::pair<long, int>> vid_pos;
+  vid_pos.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    if (docids[i] < 0) continue;
+    int vid = raw_vec->vid_mgr_->GetFirstVID(docids[i]);
+    if (vid < 0 || vid >= raw_vec->GetVectorNum()) continue;
+    vid_pos.emplace_back(vid, i);
+  }
+  std::sort(vid_pos.begin(), vid_pos.end());
+
+  std::vector<long> vids(vid_pos.size());
+  for (size_t i = 0; i < vid_pos.size(); i++) vids[i] = vid_pos[i].first;
+  holder.reset(new ScopeVectors<DataType>(vids.size()));
+  raw_vec->Gets(vids.size(), vids.data(), *holder);
+
+  for (size_t i = 0; i < vid_pos.size(); i++) {
+    int pos = vid_pos[i].second;
+    batch.vecs[pos] = reinterpret_cast<const char *>(holder->Get(i));
+    char *source = nullptr;
+    int len = 0;
+    if (raw_vec->GetSource(vid_pos[i].first, source, len) == 0) {
+      batch.sources[pos] = source;
+      batch.source_lens[pos] = len;
+    }
+  }
+}
+
+}  // namespace
+
+int VectorManager::GetVectors(const std::string &name,
+                              const std::vector<int> &docids,
+                              VectorBatch &batch) {
+  const auto &iter = vector_indexes_.find(name);
+  if (iter == vector_indexes_.end()) {
+    LOG(ERROR) << "cannot find vector field [" << name << "]";
+    return -1;
+  }
+  GammaIndex *gamma_index = iter->second;
+  if (gamma_index->raw_vec_ != nullptr) {
+    GetRawVectors<float>(gamma_index->raw_vec_, docids, batch,
+                         batch.float_vecs);
+  } else if (gamma_index->raw_vec_binary_ != nullptr) {
+    GetRawVectors<uint8_t>(gamma_index->raw_vec_binary_, docids, batch,
+                           batch.binary_vecs);
+  } else {
+    LOG(ERROR) << "raw_vec is null!";
+    return -1;
+  }
+  return 0;
+}
+
 int VectorManager::GetVector(
     const std::vector<std::pair<string, int>> &fields_ids,
     std::vector<string> &vec, bool is_bytearray) {
@@ -590,33 +737,54 @@ int VectorManager::Dump(const string &path, int dump_docid, int max_docid) {
 
 int VectorManager::Load(const std::vector<std::string> &index_dirs,
                         int doc_num) {
-  for (const auto &iter : raw_vectors_) {
-    if (0 != iter.second->Load(index_dirs, doc_num)) {
-      LOG(ERROR) << "vector [" << iter.first << "] load failed!";
-      return -1;
-    }
-    LOG(INFO) << "vector [" << iter.first << "] load success!";
-  }
-
-  for (const auto &iter : raw_binary_vectors_) {
-    if (0 != iter.second->Load(index_dirs, doc_num)) {
-      LOG(ERROR) << "vector [" << iter.first << "] load failed!";
-      return -1;
+  // each vector field is loaded by its own thread, the gamma index of a field
+  // depends only on its raw vector
+  std::vector<std::string> names;
+  for (const auto &iter : raw_vectors_) names.push_back(iter.first);
+  for (const auto &iter : raw_binary_vectors_) names.push_back(iter.first);
+
+  std::vector<int> rets(names.size(), 0);
+  auto load_field = [&](size_t i) {
+    const std::string &name = names[i];
+    double start = utils::getmillisecs();
+    int ret = 0;
+    const auto &float_iter = raw_vectors_.find(name);
+    if (float_iter != raw_vectors_.end()) {
+      ret = float_iter->second->Load(index_dirs, doc_num);
+    } else {
+      ret = raw_binary_vectors_.find(name)->second->Load(index_dirs, doc_num);
     }
-    LOG(INFO) << "vector [" << iter.first << "] load success!";
-  }
-
-  if (index_dirs.size() > 0) {
-    for (const auto &iter : vector_indexes_) {
-      if (iter.second->Load(index_dirs) < 0) {
-        LOG(ERROR) << "vector [" << iter.first << "] load gamma index failed!";
-        return -1;
-      } else {
-        LOG(INFO) << "vector [" << iter.first << "] load gamma index success!";
+    if (ret != 0) {
+      LOG(ERROR) << "vector [" << name << "] load failed!";
+      rets[i] = -1;
+      return;
+    }
+    double raw_end = utils::getmillisecs();
+    LOG(INFO) << "vector [" << name << "] load success! cost "
+              << raw_end - start << "ms";
+
+    const auto &index_iter = vector_indexes_.find(name);
+    if (index_dirs.size() > 0 && index_iter != vector_indexes_.end()) {
+      if (index_iter->second->Load(index_dirs) < 0) {
+        LOG(ERROR) << "vector [" << name << "] load gamma index failed!";
+        rets[i] = -1;
+        return;
       }
+      LOG(INFO) << "vector [" << name << "] load gamma index success! cost "
+                << utils::getmillisecs() - raw_end << "ms";
     }
+  };
+
+  std::vector<std::thread> loaders;
+  for (size_t i = 1; i < names.size(); i++) {
+    loaders.emplace_back(load_field, i);
   }
+  if (names.size() > 0) load_field(0);
+  for (auto &loader : loaders) loader.join();
 
+  for (size_t i = 0; i < names.size(); i++) {
+    if (rets[i] != 0) return -1;
+  }
   return 0;
 }
 
@@ -10,6 +10,7 @@
 #define VECTOR_MANAGER_H_
 
 #include <map>
+#include <memory>
 #include <string>
 #include "log.h"
 
@@ -20,6 +21,21 @@
 
 namespace tig_gamma {
 
+/** vectors of one field for a batch of docs, they are borrowed from the raw
+ * vector store if possible, and copies are freed with the batch
+ */
+struct VectorBatch {
+  VectorBatch() : vec_bytes(0) {}
+
+  int vec_bytes;                   // bytes of one vector
+  std::vector<const char *> vecs;  // null if the doc has no vector
+  std::vector<const char *> sources;
+  std::vector<int> source_lens;
+
+  std::unique_ptr<ScopeVectors<float>> float_vecs;
+  std::unique_ptr<ScopeVectors<uint8_t>> binary_vecs;
+};
+
 class VectorManager {
  public:
   VectorManager(const RetrievalModel &model,
@@ -31,6 +47,23 @@ class VectorManager {
                         std::string &retrieval_type, std::string &retrieval_param);
 
   int AddToStore(int docid, std::vector<Field *> &fields);
+
+  /** add vectors of docs, vectors of a field are added in one batch. Every
+   * doc must have each vector field, they are added to all the raw vectors
+   * or none of them
+   *
+   * @param docids doc ids
+   * @param fields vector fields of each doc
+   * @return 0 if successed
+   */
+  int AddToStore(const std::vector<int> &docids,
+                 const std::vector<std::vector<Field *>> &fields);
+
+  /** check the lengths of vector fields match their dimensions
+   *
+   * @return 0 if all are valid
+   */
+  int CheckFields(const std::vector<Field *> &fields) const;
   int Update(int docid, std::vector<Field *> &fields);
 
   int Indexing();
@@ -43,6 +76,14 @@ class VectorManager {
   int GetVector(const std::vector<std::pair<std::string, int>> &fields_ids,
                 std::vector<std::string> &vec, bool is_bytearray = false);
 
+  /** get vectors of a field for docs, vectors are read in vector id order
+   *
+   * @param batch(output) vectors and sources of docids
+   * @return 0 if successed
+   */
+  int GetVectors(const std::string &name, const std::vector<int> &docids,
+                 VectorBatch &batch);
+
   long GetTotalMemBytes() {
     long index_total_mem_bytes = 0;
     for (auto iter = vector_indexes_.begin(); iter != vector_indexes_.end();